@@ -37,6 +37,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
 #include <pwr_mon.h>
 #include <signal.h>
 #include <string.h>
@@ -48,6 +50,7 @@
 #define DEFAULT_REFRESH_RATE        500000 /* 500ms */
 #define DEFAULT_LOOPCOUNT           1
 #define DEFAULT_CONTINUOUS          0
+#define DEFAULT_WINDOW              16 /* sweeps per min/max/avg window */
 
 #define LINE_PER_DEVICE             5
 #define HDR_LINE_COUNT              2
@@ -76,6 +79,11 @@ static uint32_t timestamp = 0;
 static char separator[512];
 static char header[512];
 static size_t pwrmon_num_devs;
+static bool pwrmon_initialized;
+#ifdef CONFIG_SVC_PWRMON_STREAM
+static bool stream;
+static uint32_t window = DEFAULT_WINDOW;
+#endif
 
 static const char ct_strings[ina230_ct_count + 1][8] = {
     "140us",
@@ -93,7 +101,7 @@ static const char ct_strings[ina230_ct_count + 1][8] = {
  */
 static void usage(void)
 {
-            printf("Usage: arapm [-d device] [-r rail] [-i current_lsb] [-t conversion_time] [-g avg_count] [-u refresh_rate] [-l loop] [-c] [-h]\n");
+            printf("Usage: arapm [-d device] [-r rail] [-i current_lsb] [-t conversion_time] [-g avg_count] [-u refresh_rate] [-l loop] [-c] [-s [-w window]] [-h]\n");
             printf("         -d: select device (SW, APB[1-3], GPB[1-2])"
                    " (default: all).\n");
             printf("         -r: select rail (default: all):\n");
@@ -110,6 +118,12 @@ static void usage(void)
             printf("         -l: select number of power measurements (default: 1).\n");
             printf("         -c: select continuous power measurements mode (default: disabled).\n");
             printf("         -x: export power measurements as .csv trace instead of table.\n");
+#ifdef CONFIG_SVC_PWRMON_STREAM
+            printf("         -s: sample all rails in the background and stream every sample (.csv),\n");
+            printf("             draining the stream every refresh period.\n");
+            printf("         -w: select min/max/avg window in sweeps for -s (default: %u).\n",
+                   DEFAULT_WINDOW);
+#endif
             printf("         -h: print help.\n\n");
 }
 
@@ -269,10 +283,14 @@ static int arapm_main_get_user_options(int argc, char **argv)
     conversion_time = DEFAULT_CONVERSION_TIME;
     avg_count = DEFAULT_AVG_SAMPLE_COUNT;
     csv_export = false;
+#ifdef CONFIG_SVC_PWRMON_STREAM
+    stream = false;
+    window = DEFAULT_WINDOW;
+#endif
 
     dbg_verbose("%s(): retrieving user options...\n", __func__);
     optind = -1;
-    while ((c = getopt(argc, argv, "xhcd:r:l:u:i:t:n:")) != 255) {
+    while ((c = getopt(argc, argv, "xhcsd:r:l:u:i:t:n:w:")) != 255) {
         switch (c) {
         case 'd':
             ret = pwrmon_device_id(optarg, &user_dev_id);
@@ -370,6 +388,25 @@ static int arapm_main_get_user_options(int argc, char **argv)
             printf("Using .csv format to display power measurements.\n");
             break;
 
+#ifdef CONFIG_SVC_PWRMON_STREAM
+        case 's':
+            stream = true;
+            printf("Streaming power measurements.\n");
+            break;
+
+        case 'w':
+            ret = sscanf(optarg, "%u", &window);
+            if (ret != 1 || !window) {
+                window = DEFAULT_WINDOW;
+                fprintf(stderr,
+                        "Invalid window (%s)! Using default %u.\n",
+                        optarg, window);
+            } else {
+                printf("Using %u sweeps window.\n", window);
+            }
+            break;
+#endif
+
         case 'h':
         default:
             return -EINVAL;
@@ -574,8 +611,12 @@ static int arapm_main_init(void)
                       &pwrmon_num_devs);
     if (ret) {
         fprintf(stderr, "%s(): Init failed!!! (%d)\n", __func__, ret);
+        if (ret == -EBUSY) {
+            fprintf(stderr, "Power measurement HW in use (background sampling running?)\n");
+        }
         return ret;
     }
+    pwrmon_initialized = true;
 
     /* Alloc data structs */
     arapm_rails = zalloc(sizeof(pwrmon_rail **) * pwrmon_num_devs);
@@ -663,6 +704,10 @@ static void arapm_main_deinit(void)
     uint8_t d_start, d_end;
     uint8_t r_start, r_end;
 
+    if (!pwrmon_initialized) {
+        return;
+    }
+
     arapm_main_get_device_list(&d_start, &d_end);
     for (d = d_start; d < d_end; d++) {
         arapm_main_get_rail_list(d, &r_start, &r_end);
@@ -673,6 +718,7 @@ static void arapm_main_deinit(void)
         }
     }
     pwrmon_deinit();
+    pwrmon_initialized = false;
 
     free_rails();
     free_measurements();
@@ -680,6 +726,114 @@ static void arapm_main_deinit(void)
     printf("Power measurement HW and library deinitialized.\n\n");
 }
 
+#ifdef CONFIG_SVC_PWRMON_STREAM
+/**
+ * @brief           Check whether a rail was selected by the user.
+ * @return          true if selected, false otherwise
+ * @param[in]       dev: device ID
+ * @param[in]       rail: power rail ID
+ */
+static bool arapm_main_rail_selected(uint8_t dev, uint8_t rail)
+{
+    uint8_t d_start, d_end;
+    uint8_t r_start, r_end;
+
+    arapm_main_get_device_list(&d_start, &d_end);
+    if (dev < d_start || dev >= d_end) {
+        return false;
+    }
+    arapm_main_get_rail_list(dev, &r_start, &r_end);
+
+    return rail >= r_start && rail < r_end;
+}
+
+/**
+ * @brief           Stream power measurements from the background sampler.
+ * @return          0 on success, standard error codes otherwise
+ */
+static int arapm_main_stream(void)
+{
+    struct pwrmon_stream_cfg cfg;
+    struct pwrmon_stream_sample samples[16];
+    struct pwrmon_stream_window w;
+    struct pwrmon_stream_stats stats;
+    uint8_t d_start, d_end;
+    uint8_t r_start, r_end;
+    uint8_t d, r;
+    ssize_t len;
+    int fd, ret, i;
+
+    pwrmon_num_devs = pwrmon_dev_count();
+
+    fd = open(PWRMON_STREAM_DEVPATH, O_RDONLY | O_NONBLOCK);
+    if (fd < 0) {
+        fprintf(stderr, "Failed to open %s! (%d)\n",
+                PWRMON_STREAM_DEVPATH, errno);
+        return -errno;
+    }
+
+    cfg.current_lsb_uA = current_lsb;
+    cfg.ct = conversion_time;
+    cfg.avg_count = avg_count;
+    cfg.period_us = 0;
+    cfg.window = window;
+    ret = ioctl(fd, PWRMONIOC_START, (unsigned long)&cfg);
+    if (ret) {
+        ret = -errno;
+        fprintf(stderr, "Failed to start power sampling! (%d)\n", ret);
+        close(fd);
+        return ret;
+    }
+
+    printf("%-14s, %-20s, %10s, %10s, %10s\n", "Timestamp (us)", "Rail",
+           "V (uV)", "I (uA)", "P (uW)");
+    do {
+        usleep(refresh_rate);
+        while ((len = read(fd, samples, sizeof(samples))) > 0) {
+            for (i = 0; i < len / sizeof(samples[0]); i++) {
+                if (!arapm_main_rail_selected(samples[i].dev,
+                                              samples[i].rail)) {
+                    continue;
+                }
+                printf("%14u, %-20s, %10d, %10d, %10d\n", samples[i].usec,
+                       pwrmon_rail_name(samples[i].dev, samples[i].rail),
+                       samples[i].m.uV, samples[i].m.uA, samples[i].m.uW);
+            }
+        }
+        if (!continuous) {
+            loopcount -= 1;
+        }
+    } while (loopcount != 0);
+
+    printf("\n%-20s, %10s, %10s, %10s (last %u sweeps window)\n", "Rail",
+           "Pmin (uW)", "Pavg (uW)", "Pmax (uW)", window);
+    arapm_main_get_device_list(&d_start, &d_end);
+    for (d = d_start; d < d_end; d++) {
+        arapm_main_get_rail_list(d, &r_start, &r_end);
+        for (r = r_start; r < r_end; r++) {
+            w.dev = d;
+            w.rail = r;
+            if (ioctl(fd, PWRMONIOC_GETWINDOW, (unsigned long)&w) ||
+                !w.count) {
+                continue;
+            }
+            printf("%-20s, %10d, %10d, %10d\n", pwrmon_rail_name(d, r),
+                   w.min.uW, w.avg.uW, w.max.uW);
+        }
+    }
+
+    if (!ioctl(fd, PWRMONIOC_GETSTATS, (unsigned long)&stats)) {
+        printf("\n%u sweeps every %uus, %u samples, %u dropped, "
+               "%u errors, %u overruns\n", stats.sweeps, stats.period_us,
+               stats.samples, stats.dropped, stats.errors, stats.overruns);
+    }
+
+    ioctl(fd, PWRMONIOC_STOP, 0);
+    close(fd);
+
+    return 0;
+}
+#endif
 
 /**
  * @brief           Application main entry point.
@@ -703,6 +857,12 @@ int arapm_main(int argc, char *argv[])
         exit(-EINVAL);
     }
 
+#ifdef CONFIG_SVC_PWRMON_STREAM
+    if (stream) {
+        return arapm_main_stream();
+    }
+#endif
+
     ret = arapm_main_init();
     if (ret) {
         arapm_main_deinit();
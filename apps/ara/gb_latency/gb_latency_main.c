@@ -0,0 +1,72 @@
+/**
+ * Copyright (c) 2016 Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include <nuttx/greybus/latency.h>
+
+#define GB_LATENCY_DUMP_SIZE    4096
+
+int gb_latency_main(int argc, char **argv)
+{
+    char *buf;
+    int opt;
+
+    optind = -1;
+    while ((opt = getopt(argc, argv, "rh")) != -1) {
+        switch (opt) {
+        case 'r':
+            gb_latency_reset();
+            return EXIT_SUCCESS;
+        default:
+            goto help;
+        }
+    }
+
+    buf = malloc(GB_LATENCY_DUMP_SIZE);
+    if (!buf) {
+        fprintf(stderr, "out of memory\n");
+        return EXIT_FAILURE;
+    }
+
+    gb_latency_dump(buf, GB_LATENCY_DUMP_SIZE);
+    printf("%s", buf);
+    free(buf);
+
+    return EXIT_SUCCESS;
+
+help:
+    printf("Display the Greybus latency histograms\n\n"
+           "\tusage: gb_latency [OPTS]\n"
+           "\tOPTS:\n"
+           "\t\t-r - reset the histograms\n\n");
+
+    return EXIT_FAILURE;
+}
@@ -30,6 +30,7 @@
 #include <ara_debug.h>
 
 #include <nuttx/config.h>
+#include <nuttx/clock.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -61,6 +62,9 @@ enum {
     QOS,
     RELEASE,
     IDMOD,
+    CONNSTATS,
+    BOOTTIME,
+    ATTRCACHE,
     MAX_CMD,
 };
 
@@ -83,6 +87,12 @@ static const struct command commands[] = {
     [IDMOD] = {'m', "idmod", "Identify module and boot status"},
     [QOS] = {'q', "qos", "Quality of Service control"},
     [RELEASE] = {'x', "release", "Pulse module release signals"},
+    [CONNSTATS] = {'c', "connstats",
+                   "print (or \"reset\") connection setup statistics"},
+    [BOOTTIME] = {'b', "boottime", "print svcd bring-up timeline"},
+    [ATTRCACHE] = {'a', "attrcache",
+                   "print (or \"reset\"/\"flush\") switch attribute cache "
+                   "statistics"},
 };
 
 static char *seltostr(uint16_t sel, char *buf) {
@@ -543,6 +553,100 @@ static int dump_routing_table(int argc, char *argv[])
     return rc;
 }
 
+static int conn_stats(int argc, char *argv[])
+{
+    struct tsb_switch *sw = svc->sw;
+    struct switch_connection_stats stats;
+
+    if (!sw) {
+        return -ENODEV;
+    }
+
+    if (argc > 2 && !strcmp(argv[2], "reset")) {
+        switch_connection_stats_reset(sw);
+        return 0;
+    }
+
+    switch_connection_stats_get(sw, &stats);
+
+    printf("Connections created: %u, failed: %u\n",
+           stats.count, stats.failures);
+    if (stats.count) {
+        printf("Setup time (us): last %u, avg %u, max %u "
+               "(resolution %u)\n",
+               stats.last_usec, (uint32_t)(stats.total_usec / stats.count),
+               stats.max_usec, USEC_PER_TICK);
+    }
+    printf("NCP commands: %u in %u SPI bursts\n",
+           stats.ncp_cmds, stats.ncp_bursts);
+
+    return 0;
+}
+
+static int boot_time(int argc, char *argv[])
+{
+    uint32_t prev = 0;
+    int i;
+
+    if (argc != 2) {
+        printf("Ignoring unexpected arguments.\n");
+    }
+
+    printf("%-20s %10s %10s\n", "Stage", "At (ms)", "Took (ms)");
+    for (i = 0; i < SVC_BOOT_NR_STAGES; i++) {
+        uint32_t ticks = svc->boot_ticks[i];
+
+        if (!ticks) {
+            printf("%-20s %10s %10s\n", svc_boot_stage_name(i), "-", "-");
+            continue;
+        }
+
+        printf("%-20s %10u %10u\n", svc_boot_stage_name(i),
+               (unsigned int)TICK2MSEC(ticks),
+               (unsigned int)TICK2MSEC(ticks - prev));
+        prev = ticks;
+    }
+
+    return 0;
+}
+
+static int attr_cache(int argc, char *argv[])
+{
+    struct tsb_switch *sw = svc->sw;
+    struct switch_cache_stats stats;
+    uint32_t lookups;
+
+    if (!sw) {
+        return -ENODEV;
+    }
+
+    if (argc > 2) {
+        if (!strcmp(argv[2], "reset")) {
+            switch_cache_stats_reset(sw);
+            return 0;
+        }
+        if (!strcmp(argv[2], "flush")) {
+            switch_cache_invalidate_all(sw);
+            return 0;
+        }
+        printf("Ignoring unexpected arguments.\n");
+    }
+
+    switch_cache_stats_get(sw, &stats);
+
+    lookups = stats.hits + stats.misses;
+    printf("Lookups: %u, hits: %u, misses: %u", lookups, stats.hits,
+           stats.misses);
+    if (lookups) {
+        printf(" (hit rate %u%%)", stats.hits * 100 / lookups);
+    }
+    printf("\nUncached accesses: %u\n", stats.uncached);
+    printf("Writes: %u, skipped: %u\n", stats.writes, stats.writes_skipped);
+    printf("Invalidations: %u\n", stats.invalidations);
+
+    return 0;
+}
+
 static void dme_io_usage(void) {
     printf("svc %s <r|w> [options]: usage:\n", commands[DME_IO].longc);
     printf("    Common options:\n");
@@ -2093,6 +2197,15 @@ int svc_main(int argc, char *argv[])
     case IDMOD:
         rc = idmod(argc, argv);
         break;
+    case CONNSTATS:
+        rc = conn_stats(argc, argv);
+        break;
+    case BOOTTIME:
+        rc = boot_time(argc, argv);
+        break;
+    case ATTRCACHE:
+        rc = attr_cache(argc, argv);
+        break;
     default:
         usage(EXIT_FAILURE);
     }
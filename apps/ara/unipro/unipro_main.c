@@ -143,6 +143,15 @@ int unipro_main(int argc, char **argv) {
             exit(1);
         }
         return 0;
+    } else if (!strcmp(op, "prio") && argc == 5) {
+        rc = unipro_set_cport_priority(strtoul(argv[2], NULL, 10),
+                                       strtoul(argv[3], NULL, 10),
+                                       strtoul(argv[4], NULL, 10));
+        if (rc) {
+            printf("Failed to set cport priority. rc: %d\n", rc);
+            exit(1);
+        }
+        return 0;
     } else if (!strcmp(op, "info")) {
         unipro_info();
         return 0;
@@ -0,0 +1,340 @@
+/*
+ * Copyright (c) 2016 Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Host stress test and benchmark of the bufram allocator
+ *
+ * The allocator is built on top of a static arena registered as on the
+ * bridges, as a 64KiB and a 128KiB region. The stress test allocates and
+ * frees random sizes with both the byte and the page interfaces, checks that
+ * live buffers never overlap and that everything merges back once freed.
+ * The benchmark then measures alloc/free pairs per second with a varying
+ * number of free blocks in the allocator, next to the host malloc() for
+ * reference.
+ */
+
+#include <nuttx/config.h>
+
+#include <errno.h>
+#include <getopt.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <nuttx/util.h>
+#include <nuttx/bufram.h>
+#include <arch/chip/chip.h>
+
+#define DEFAULT_ITERATIONS  1000000
+#define DEFAULT_MAX_SIZE    2048
+#define DEFAULT_BENCH_SIZE  64
+#define STRESS_SLOTS        256
+#define BENCH_ACTIVE        16
+#define MAX_HOLES           512
+
+struct slot {
+    void *ptr;
+    size_t size;
+    size_t page_count;
+    uint8_t tag;
+};
+
+char bufram_arena[BUFRAM_SIZE] __attribute__((aligned(1 << 17)));
+
+/* only available since the allocator keeps statistics */
+size_t bufram_dump(char *buf, size_t size) __attribute__((weak));
+
+static struct slot slots[2 * MAX_HOLES + BENCH_ACTIVE];
+static uint32_t rng_state = 1;
+
+int lowsyslog(const char *fmt, ...)
+{
+    va_list ap;
+    int retval;
+
+    va_start(ap, fmt);
+    retval = vfprintf(stderr, fmt, ap);
+    va_end(ap);
+
+    return retval;
+}
+
+static uint32_t rng(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void arena_init(void)
+{
+    bufram_init();
+    bufram_register_region(BUFRAM_BASE, 16);
+    bufram_register_region(BUFRAM_BASE + (1 << 16), 17);
+}
+
+/*
+ * Stress test
+ */
+
+static int slot_alloc(struct slot *slot, size_t max_size)
+{
+    slot->size = rng() % max_size + 1;
+    slot->tag = rng();
+
+    /* a quarter of the buffers go through the page interface */
+    if (!(rng() % 4)) {
+        slot->page_count = bufram_size_to_page_count(slot->size);
+        slot->size = slot->page_count * BUFRAM_PAGE_SIZE;
+        slot->ptr = bufram_page_alloc(slot->page_count);
+    } else {
+        slot->page_count = 0;
+        slot->ptr = bufram_alloc(slot->size);
+    }
+
+    if (!slot->ptr)
+        return -ENOMEM;
+
+    if ((uintptr_t) slot->ptr < BUFRAM_BASE ||
+        (uintptr_t) slot->ptr + slot->size > BUFRAM_BASE + BUFRAM_SIZE) {
+        fprintf(stderr, "buffer %p out of the arena\n", slot->ptr);
+        return -EFAULT;
+    }
+
+    memset(slot->ptr, slot->tag, slot->size);
+    return 0;
+}
+
+static int slot_free(struct slot *slot)
+{
+    uint8_t *data = slot->ptr;
+    size_t i;
+
+    for (i = 0; i < slot->size; i++) {
+        if (data[i] != slot->tag) {
+            fprintf(stderr, "buffer %p of %zu bytes overwritten at %zu\n",
+                    slot->ptr, slot->size, i);
+            return -EFAULT;
+        }
+    }
+
+    if (slot->page_count)
+        bufram_page_free(slot->ptr, slot->page_count);
+    else
+        bufram_free(slot->ptr);
+
+    slot->ptr = NULL;
+    return 0;
+}
+
+static int stress(unsigned long iterations, size_t max_size)
+{
+    unsigned long failures = 0;
+    unsigned long i;
+    struct slot *slot;
+    void *whole;
+    int retval;
+
+    arena_init();
+
+    for (i = 0; i < iterations; i++) {
+        slot = &slots[rng() % STRESS_SLOTS];
+
+        retval = slot->ptr ? slot_free(slot) : slot_alloc(slot, max_size);
+        if (retval == -ENOMEM)
+            failures++;
+        else if (retval)
+            return retval;
+    }
+
+    for (i = 0; i < STRESS_SLOTS; i++) {
+        if (slots[i].ptr) {
+            retval = slot_free(&slots[i]);
+            if (retval)
+                return retval;
+        }
+    }
+
+    /* everything must have merged back into the two regions */
+    whole = bufram_page_alloc((1 << 17) / BUFRAM_PAGE_SIZE);
+    if (!whole || (uintptr_t) whole != BUFRAM_BASE + (1 << 16)) {
+        fprintf(stderr, "the 128KiB region did not merge back\n");
+        return -EFAULT;
+    }
+    bufram_page_free(whole, (1 << 17) / BUFRAM_PAGE_SIZE);
+
+    whole = bufram_page_alloc((1 << 16) / BUFRAM_PAGE_SIZE);
+    if (!whole || (uintptr_t) whole != BUFRAM_BASE) {
+        fprintf(stderr, "the 64KiB region did not merge back\n");
+        return -EFAULT;
+    }
+    bufram_page_free(whole, (1 << 16) / BUFRAM_PAGE_SIZE);
+
+    printf("stress: %lu operations, %lu allocation failures: OK\n",
+           iterations, failures);
+    return 0;
+}
+
+/*
+ * Benchmark
+ */
+
+/*
+ * Measure alloc/free pairs on BENCH_ACTIVE buffers while "holes" free blocks
+ * of the same size sit in the allocator, left by freeing every other buffer
+ * of a contiguous run. The holes cannot merge since their buddies stay
+ * allocated: this is what makes a free list walk expensive.
+ */
+static double bench(void *(*alloc)(size_t), void (*release)(void *),
+                    unsigned int holes, size_t size,
+                    unsigned long iterations)
+{
+    unsigned int count = 2 * holes + BENCH_ACTIVE;
+    unsigned long i;
+    unsigned int n;
+    double start;
+
+    for (n = 0; n < count; n++) {
+        slots[n].ptr = alloc(size);
+        if (!slots[n].ptr)
+            break;
+    }
+
+    if (n < count) {
+        while (n--)
+            release(slots[n].ptr);
+        return 0;
+    }
+
+    for (n = 0; n < 2 * holes; n += 2) {
+        release(slots[n].ptr);
+        slots[n].ptr = NULL;
+    }
+
+    start = now();
+    for (i = 0; i < iterations; i++) {
+        n = 2 * holes + rng() % BENCH_ACTIVE;
+        release(slots[n].ptr);
+        slots[n].ptr = alloc(size);
+    }
+    start = now() - start;
+
+    for (n = 0; n < count; n++) {
+        if (slots[n].ptr)
+            release(slots[n].ptr);
+    }
+
+    return iterations / start;
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr,
+            "usage: %s [-n iterations] [-m max size] [-s size] [-r seed]\n"
+            "\n"
+            "  -n  number of operations of each run (default: %d)\n"
+            "  -m  largest allocation of the stress test (default: %d)\n"
+            "  -s  allocation size of the benchmark (default: %d)\n"
+            "  -r  seed of the random generator (default: 1)\n",
+            name, DEFAULT_ITERATIONS, DEFAULT_MAX_SIZE, DEFAULT_BENCH_SIZE);
+}
+
+int main(int argc, char **argv)
+{
+    static const unsigned int levels[] = { 0, 16, 64, 256, MAX_HOLES };
+    unsigned long iterations = DEFAULT_ITERATIONS;
+    size_t max_size = DEFAULT_MAX_SIZE;
+    size_t size = DEFAULT_BENCH_SIZE;
+    double bufram_rate, malloc_rate;
+    char dump[1024];
+    int retval;
+    int opt;
+    int i;
+
+    while ((opt = getopt(argc, argv, "n:m:s:r:h")) != -1) {
+        switch (opt) {
+        case 'n':
+            iterations = strtoul(optarg, NULL, 0);
+            break;
+        case 'm':
+            max_size = strtoul(optarg, NULL, 0);
+            break;
+        case 's':
+            size = strtoul(optarg, NULL, 0);
+            break;
+        case 'r':
+            rng_state = strtoul(optarg, NULL, 0) ?: 1;
+            break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+
+    if (!iterations || !max_size || !size) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    /* keep going on errors, to benchmark allocators with known bugs */
+    retval = stress(iterations, max_size);
+
+    if (bufram_dump) {
+        bufram_dump(dump, sizeof(dump));
+        printf("%s", dump);
+    }
+
+    printf("\n%11s %14s %14s\n", "free blocks", "bufram op/s", "malloc op/s");
+
+    for (i = 0; i < ARRAY_SIZE(levels); i++) {
+        arena_init();
+        bufram_rate = bench(bufram_alloc, bufram_free, levels[i], size,
+                            iterations);
+        malloc_rate = bench(malloc, free, levels[i], size, iterations);
+
+        if (bufram_rate)
+            printf("%11u %14.0f %14.0f\n", levels[i], bufram_rate,
+                   malloc_rate);
+        else
+            printf("%11u %14s %14.0f\n", levels[i], "out of memory",
+                   malloc_rate);
+    }
+
+    return retval ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,413 @@
+/*
+ * Copyright (c) 2016 Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Mock devices behind the Greybus protocol drivers. They complete every
+ * request immediately so that the harness measures the Greybus dispatch
+ * path and the protocol drivers, not the peripherals.
+ */
+
+#include <nuttx/config.h>
+
+#include <errno.h>
+#include <semaphore.h>
+#include <string.h>
+
+#include <nuttx/device.h>
+#include <nuttx/device_i2c.h>
+#include <nuttx/device_spi.h>
+#include <nuttx/device_uart.h>
+#include <nuttx/gpio.h>
+#include <nuttx/util.h>
+
+#include "gb_bench.h"
+
+#define GPIO_LINE_COUNT     16
+
+/*
+ * GPIO
+ */
+
+static struct {
+    uint8_t value;
+    uint8_t direction;
+    bool active;
+    bool masked;
+    int trigger;
+    uint16_t debounce;
+    xcpt_t isr;
+} gpio_lines[GPIO_LINE_COUNT];
+
+/* set by mock_gpio_stall() to hold the next gpio_get_value() */
+static sem_t *gpio_stalled;
+static sem_t *gpio_release;
+
+void mock_gpio_stall(sem_t *stalled, sem_t *release)
+{
+    gpio_stalled = stalled;
+    gpio_release = release;
+}
+
+uint8_t gpio_line_count(void)
+{
+    return GPIO_LINE_COUNT;
+}
+
+int gpio_activate(uint8_t which)
+{
+    gpio_lines[which].active = true;
+    return 0;
+}
+
+int gpio_deactivate(uint8_t which)
+{
+    gpio_lines[which].active = false;
+    return 0;
+}
+
+int gpio_get_direction(uint8_t which)
+{
+    return gpio_lines[which].direction;
+}
+
+void gpio_direction_in(uint8_t which)
+{
+    gpio_lines[which].direction = 1;
+}
+
+void gpio_direction_out(uint8_t which, uint8_t value)
+{
+    gpio_lines[which].direction = 0;
+    gpio_lines[which].value = value;
+}
+
+uint8_t gpio_get_value(uint8_t which)
+{
+    sem_t *release = gpio_release;
+
+    if (release) {
+        gpio_release = NULL;
+        sem_post(gpio_stalled);
+        while (sem_wait(release))
+            ;
+    }
+
+    return gpio_lines[which].value;
+}
+
+void gpio_set_value(uint8_t which, uint8_t value)
+{
+    gpio_lines[which].value = value;
+}
+
+int gpio_set_debounce(uint8_t which, uint16_t delay)
+{
+    gpio_lines[which].debounce = delay;
+    return 0;
+}
+
+int gpio_irq_attach(uint8_t which, xcpt_t isr)
+{
+    gpio_lines[which].isr = isr;
+    return 0;
+}
+
+int gpio_irq_settriggering(uint8_t which, int trigger)
+{
+    gpio_lines[which].trigger = trigger;
+    return 0;
+}
+
+int gpio_irq_mask(uint8_t which)
+{
+    gpio_lines[which].masked = true;
+    return 0;
+}
+
+int gpio_irq_unmask(uint8_t which)
+{
+    gpio_lines[which].masked = false;
+    return 0;
+}
+
+/*
+ * I2C: reads return a byte pattern, writes are dropped
+ */
+
+static int mock_i2c_transfer(struct device *dev,
+                             struct device_i2c_request *requests,
+                             uint32_t count)
+{
+    uint32_t i;
+
+    for (i = 0; i < count; i++) {
+        if (requests[i].flags & I2C_FLAG_READ)
+            memset(requests[i].buffer, requests[i].addr, requests[i].length);
+    }
+
+    return 0;
+}
+
+static struct device_i2c_type_ops mock_i2c_type_ops = {
+    .transfer = mock_i2c_transfer,
+};
+
+/*
+ * SPI: each byte read is the byte written mixed with the settings in use, so
+ * that spi_test can check the settings every byte was exchanged with. The
+ * setting changes, chip select assertions and exchanges are counted.
+ */
+
+static struct {
+    uint16_t mode;
+    int nbits;
+    uint32_t frequency;
+    bool selected;
+    struct mock_spi_stats stats;
+} mock_spi;
+
+uint8_t mock_spi_answer(uint8_t byte, uint16_t mode, int nbits,
+                        uint32_t frequency)
+{
+    return byte ^ (mode << 4) ^ nbits ^ (frequency / 1000);
+}
+
+void mock_spi_get_stats(struct mock_spi_stats *stats)
+{
+    *stats = mock_spi.stats;
+}
+
+void mock_spi_reset_stats(void)
+{
+    memset(&mock_spi.stats, 0, sizeof(mock_spi.stats));
+}
+
+static int mock_spi_nop(struct device *dev)
+{
+    return 0;
+}
+
+static int mock_spi_select(struct device *dev, int devid)
+{
+    mock_spi.selected = true;
+    mock_spi.stats.selects++;
+    return 0;
+}
+
+static int mock_spi_deselect(struct device *dev, int devid)
+{
+    mock_spi.selected = false;
+    return 0;
+}
+
+static int mock_spi_setfrequency(struct device *dev, uint32_t *frequency)
+{
+    mock_spi.frequency = *frequency;
+    mock_spi.stats.setfrequency++;
+    return 0;
+}
+
+static int mock_spi_setmode(struct device *dev, uint16_t mode)
+{
+    mock_spi.mode = mode;
+    mock_spi.stats.setmode++;
+    return 0;
+}
+
+static int mock_spi_setbits(struct device *dev, int nbits)
+{
+    mock_spi.nbits = nbits;
+    mock_spi.stats.setbits++;
+    return 0;
+}
+
+static int mock_spi_exchange(struct device *dev,
+                             struct device_spi_transfer *transfer)
+{
+    const uint8_t *tx = transfer->txbuffer;
+    uint8_t *rx = transfer->rxbuffer;
+    size_t i;
+
+    mock_spi.stats.exchanges++;
+    if (!mock_spi.selected)
+        mock_spi.stats.unselected++;
+
+    if (!rx)
+        return 0;
+
+    for (i = 0; i < transfer->nwords; i++)
+        rx[i] = mock_spi_answer(tx ? tx[i] : 0xff, mock_spi.mode,
+                                mock_spi.nbits, mock_spi.frequency);
+
+    return 0;
+}
+
+static int mock_spi_getcaps(struct device *dev, struct device_spi_caps *caps)
+{
+    caps->modes = SPI_MODE_CPHA | SPI_MODE_CPOL | SPI_MODE_LOOP;
+    caps->flags = 0;
+    caps->bpw = BIT(8 - 1);
+    caps->csnum = 1;
+    return 0;
+}
+
+static struct device_spi_type_ops mock_spi_type_ops = {
+    .lock = mock_spi_nop,
+    .unlock = mock_spi_nop,
+    .select = mock_spi_select,
+    .deselect = mock_spi_deselect,
+    .setfrequency = mock_spi_setfrequency,
+    .setmode = mock_spi_setmode,
+    .setbits = mock_spi_setbits,
+    .exchange = mock_spi_exchange,
+    .getcaps = mock_spi_getcaps,
+};
+
+/*
+ * UART: transmitted bytes are dropped and the receiver stays idle
+ */
+
+static int mock_uart_set_configuration(struct device *dev, int baud,
+                                       int parity, int databits, int stopbit,
+                                       int flow)
+{
+    return 0;
+}
+
+static int mock_uart_modem_ctrl(struct device *dev, uint8_t *modem_ctrl)
+{
+    return 0;
+}
+
+static int mock_uart_status(struct device *dev, uint8_t *status)
+{
+    *status = 0;
+    return 0;
+}
+
+static int mock_uart_set_break(struct device *dev, uint8_t break_on)
+{
+    return 0;
+}
+
+static int mock_uart_attach_callback(struct device *dev,
+                                     void (*callback)(uint8_t status))
+{
+    return 0;
+}
+
+static int mock_uart_start_transmitter(struct device *dev, uint8_t *buffer,
+                                       int length, void *dma, int *sent,
+                                       void (*callback)(uint8_t *buffer,
+                                                        int length, int error))
+{
+    if (sent)
+        *sent = length;
+    if (callback)
+        callback(buffer, length, 0);
+    return 0;
+}
+
+static int mock_uart_start_receiver(struct device *dev, uint8_t *buffer,
+                                    int length, void *dma, int *got,
+                                    void (*callback)(uint8_t *buffer,
+                                                     int length, int error))
+{
+    return 0;
+}
+
+static int mock_uart_stop(struct device *dev)
+{
+    return 0;
+}
+
+static struct device_uart_type_ops mock_uart_type_ops = {
+    .set_configuration = mock_uart_set_configuration,
+    .get_modem_ctrl = mock_uart_modem_ctrl,
+    .set_modem_ctrl = mock_uart_modem_ctrl,
+    .get_modem_status = mock_uart_status,
+    .get_line_status = mock_uart_status,
+    .set_break = mock_uart_set_break,
+    .attach_ms_callback = mock_uart_attach_callback,
+    .attach_ls_callback = mock_uart_attach_callback,
+    .start_transmitter = mock_uart_start_transmitter,
+    .stop_transmitter = mock_uart_stop,
+    .start_receiver = mock_uart_start_receiver,
+    .stop_receiver = mock_uart_stop,
+};
+
+/*
+ * Device table
+ */
+
+static struct device_driver_ops mock_driver_ops[] = {
+    { .type_ops = &mock_i2c_type_ops, },
+    { .type_ops = &mock_spi_type_ops, },
+    { .type_ops = &mock_uart_type_ops, },
+};
+
+static struct device_driver mock_drivers[] = {
+    { .type = DEVICE_TYPE_I2C_HW, .name = "mock_i2c",
+      .ops = &mock_driver_ops[0], },
+    { .type = DEVICE_TYPE_SPI_HW, .name = "mock_spi",
+      .ops = &mock_driver_ops[1], },
+    { .type = DEVICE_TYPE_UART_HW, .name = "mock_uart",
+      .ops = &mock_driver_ops[2], },
+};
+
+static struct device mock_devices[] = {
+    { .type = DEVICE_TYPE_I2C_HW, .name = "mock_i2c", .id = 0,
+      .driver = &mock_drivers[0], },
+    { .type = DEVICE_TYPE_SPI_HW, .name = "mock_spi", .id = 0,
+      .driver = &mock_drivers[1], },
+    { .type = DEVICE_TYPE_UART_HW, .name = "mock_uart", .id = 0,
+      .driver = &mock_drivers[2], },
+};
+
+struct device *device_open(char *type, unsigned int id)
+{
+    int i;
+
+    for (i = 0; i < ARRAY_SIZE(mock_devices); i++) {
+        if (strcmp(mock_devices[i].type, type) || mock_devices[i].id != id)
+            continue;
+
+        if (device_is_open(&mock_devices[i]))
+            return NULL;
+
+        mock_devices[i].state = DEVICE_STATE_OPEN;
+        return &mock_devices[i];
+    }
+
+    return NULL;
+}
+
+void device_close(struct device *dev)
+{
+    dev->state = DEVICE_STATE_PROBED;
+}
@@ -0,0 +1,339 @@
+/*
+ * Copyright (c) 2016 Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Greybus event channel test
+ *
+ * Holds the worker of the GPIO cport in a GET_VALUE request, raises GPIO
+ * interrupts meanwhile and checks that:
+ * - the interrupt handler queues the events without allocating memory;
+ * - repeated interrupts on a line waiting to be reported are merged;
+ * - the events are sent in order once the worker is released;
+ * - a channel without coalescing drops the events it has no room for.
+ */
+
+#include <nuttx/config.h>
+
+#include <errno.h>
+#include <semaphore.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <arch/byteorder.h>
+#include <nuttx/util.h>
+#include <nuttx/greybus/greybus.h>
+
+#include "gpio-gb.h"
+
+#include "gb_bench.h"
+
+#define TEST_CPORT          0
+#define TEST_EVENT_TYPE     0x7f
+#define TEST_EVENT_COUNT    2
+#define MAX_MESSAGES        16
+#define SEND_TIMEOUT_SEC    2
+
+struct test_message {
+    uint8_t type;
+    uint16_t id;
+    size_t size;
+    uint8_t payload;
+};
+
+static struct test_message messages[MAX_MESSAGES];
+static unsigned int message_count;
+static sem_t message_sem;
+static sem_t stalled_sem;
+static sem_t release_sem;
+
+static int test_send(unsigned int cport, const void *buf, size_t len)
+{
+    const struct gb_operation_hdr *hdr = buf;
+
+    if (message_count < MAX_MESSAGES) {
+        messages[message_count].type = hdr->type;
+        messages[message_count].id = le16_to_cpu(hdr->id);
+        messages[message_count].size = len;
+        messages[message_count].payload =
+            len > sizeof(*hdr) ? ((const uint8_t *) buf)[sizeof(*hdr)] : 0;
+        message_count++;
+    }
+    sem_post(&message_sem);
+    return 0;
+}
+
+static void test_noop(void)
+{
+}
+
+static int test_listen(unsigned int cport)
+{
+    return 0;
+}
+
+static void *test_alloc_buf(size_t size)
+{
+    return malloc(size);
+}
+
+static void test_free_buf(void *ptr)
+{
+    free(ptr);
+}
+
+static struct gb_transport_backend test_transport = {
+    .init = test_noop,
+    .exit = test_noop,
+    .listen = test_listen,
+    .stop_listening = test_listen,
+    .send = test_send,
+    .alloc_buf = test_alloc_buf,
+    .free_buf = test_free_buf,
+};
+
+static int timed_wait(sem_t *sem)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += SEND_TIMEOUT_SEC;
+
+    while (sem_timedwait(sem, &ts)) {
+        if (errno != EINTR)
+            return -errno;
+    }
+
+    return 0;
+}
+
+/* Hold the worker of the cport in a GET_VALUE request */
+static int stall_worker(uint16_t id)
+{
+    struct {
+        struct gb_operation_hdr hdr;
+        struct gb_gpio_get_value_request req;
+    } __packed request = {
+        .hdr = {
+            .size = cpu_to_le16(sizeof(request)),
+            .id = cpu_to_le16(id),
+            .type = GB_GPIO_TYPE_GET_VALUE,
+        },
+    };
+
+    mock_gpio_stall(&stalled_sem, &release_sem);
+
+    if (greybus_rx_handler(TEST_CPORT, &request, sizeof(request)))
+        return -1;
+
+    return timed_wait(&stalled_sem);
+}
+
+/* Release the worker and wait for the response and count events */
+static int release_worker(unsigned int count)
+{
+    unsigned int i;
+
+    message_count = 0;
+    sem_post(&release_sem);
+
+    for (i = 0; i < count + 1; i++) {
+        if (timed_wait(&message_sem))
+            return -1;
+    }
+
+    /* nothing else must be sent */
+    usleep(10000);
+    return message_count == count + 1 ? 0 : -1;
+}
+
+static int check_events(const char *name, uint8_t type,
+                        const uint8_t *expected, unsigned int count,
+                        size_t size)
+{
+    unsigned int i;
+
+    /* messages[0] is the response to the stalled request */
+    for (i = 0; i < count; i++) {
+        const struct test_message *msg = &messages[i + 1];
+
+        if (msg->type != type || msg->id || msg->size != size ||
+            msg->payload != expected[i]) {
+            fprintf(stderr, "%s: event %u: type 0x%02x id %u size %zu "
+                    "payload %u, expected 0x%02x 0 %zu %u\n", name, i,
+                    msg->type, msg->id, msg->size, msg->payload, type, size,
+                    expected[i]);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+static int test_gpio_coalescing(void)
+{
+    static const int irqs[] = { 3, 3, 3, 5, 3, 5, 7 };
+    static const uint8_t expected[] = { 3, 5, 7 };
+    unsigned long allocs, frees, allocs_after, frees_after;
+    unsigned int i;
+
+    if (stall_worker(1)) {
+        fprintf(stderr, "gpio coalescing: worker not stalled\n");
+        return -1;
+    }
+
+    host_heap_stats(&allocs, &frees);
+    for (i = 0; i < ARRAY_SIZE(irqs); i++)
+        gb_gpio_irq_event(irqs[i], NULL);
+    host_heap_stats(&allocs_after, &frees_after);
+
+    if (allocs_after != allocs || frees_after != frees) {
+        fprintf(stderr, "gpio coalescing: %lu allocations in the handler\n",
+                allocs_after - allocs);
+        return -1;
+    }
+
+    if (release_worker(ARRAY_SIZE(expected))) {
+        fprintf(stderr, "gpio coalescing: %u messages, expected %zu\n",
+                message_count, ARRAY_SIZE(expected) + 1);
+        return -1;
+    }
+
+    return check_events("gpio coalescing", GB_GPIO_TYPE_IRQ_EVENT, expected,
+                        ARRAY_SIZE(expected),
+                        sizeof(struct gb_operation_hdr) +
+                        sizeof(struct gb_gpio_irq_event_request));
+}
+
+static int test_channel_full(void)
+{
+    static const uint8_t expected[TEST_EVENT_COUNT] = { 1, 1 };
+    struct gb_event_channel channel;
+    uint8_t payload = 1;
+    int retval;
+    int i;
+
+    retval = gb_event_channel_init(&channel, TEST_CPORT, TEST_EVENT_TYPE,
+                                   sizeof(payload), TEST_EVENT_COUNT, false);
+    if (retval) {
+        fprintf(stderr, "channel full: init failed (%d)\n", retval);
+        return -1;
+    }
+
+    if (stall_worker(2)) {
+        fprintf(stderr, "channel full: worker not stalled\n");
+        goto error;
+    }
+
+    for (i = 0; i < TEST_EVENT_COUNT; i++) {
+        retval = gb_event_channel_send(&channel, &payload);
+        if (retval) {
+            fprintf(stderr, "channel full: event %d not queued (%d)\n", i,
+                    retval);
+            goto error;
+        }
+    }
+
+    retval = gb_event_channel_send(&channel, &payload);
+    if (retval != -ENOMEM || channel.dropped != 1) {
+        fprintf(stderr, "channel full: extra event not dropped (%d)\n",
+                retval);
+        goto error;
+    }
+
+    if (release_worker(TEST_EVENT_COUNT)) {
+        fprintf(stderr, "channel full: %u messages, expected %d\n",
+                message_count, TEST_EVENT_COUNT + 1);
+        goto error;
+    }
+
+    if (check_events("channel full", TEST_EVENT_TYPE, expected,
+                     TEST_EVENT_COUNT,
+                     sizeof(struct gb_operation_hdr) + sizeof(payload)))
+        goto error;
+
+    if (channel.sent != TEST_EVENT_COUNT) {
+        fprintf(stderr, "channel full: %u events sent\n", channel.sent);
+        goto error;
+    }
+
+    gb_event_channel_deinit(&channel);
+    return 0;
+
+error:
+    /* let the worker go before releasing the channel */
+    sem_post(&release_sem);
+    usleep(10000);
+    gb_event_channel_deinit(&channel);
+    return -1;
+}
+
+static const struct {
+    const char *name;
+    int (*run)(void);
+} tests[] = {
+    { "gpio coalescing", test_gpio_coalescing },
+    { "channel full", test_channel_full },
+};
+
+int main(int argc, char **argv)
+{
+    int failed = 0;
+    int retval;
+    int i;
+
+    sem_init(&message_sem, 0, 0);
+    sem_init(&stalled_sem, 0, 0);
+    sem_init(&release_sem, 0, 0);
+
+    retval = host_init();
+    if (retval) {
+        fprintf(stderr, "cannot start the watchdog thread\n");
+        return EXIT_FAILURE;
+    }
+
+    gb_init(&test_transport);
+    gb_gpio_register(TEST_CPORT);
+
+    for (i = 0; i < ARRAY_SIZE(tests); i++) {
+        retval = tests[i].run();
+        printf("%s: %s\n", tests[i].name, retval ? "FAIL" : "ok");
+        failed += !!retval;
+    }
+
+    gb_deinit();
+    host_exit();
+    sem_destroy(&release_sem);
+    sem_destroy(&stalled_sem);
+    sem_destroy(&message_sem);
+
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
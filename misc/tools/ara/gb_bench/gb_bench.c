@@ -0,0 +1,882 @@
+/*
+ * Copyright (c) 2016 Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Greybus core benchmark
+ *
+ * Runs greybus-core.c and the protocol drivers on the host, on top of a
+ * transport backend that loops the responses back to the harness and of
+ * mock devices. Requests are either generated or replayed from a gb_tape
+ * capture, and the harness reports the message rate, the request to response
+ * latency percentiles of each operation type and the heap allocations done
+ * per message.
+ */
+
+#include <nuttx/config.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <semaphore.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <arch/byteorder.h>
+#include <nuttx/clock.h>
+#include <nuttx/gpio.h>
+#include <nuttx/util.h>
+#include <nuttx/hires_tmr.h>
+#include <nuttx/greybus/greybus.h>
+#include <nuttx/greybus/latency.h>
+#include <nuttx/greybus/loopback.h>
+#include <nuttx/greybus/tape.h>
+
+#include "gpio-gb.h"
+#include "i2c-gb.h"
+#include "spi-gb.h"
+#include "uart-gb.h"
+
+#include "gb_bench.h"
+
+#define DEFAULT_COUNT       10000
+#define DEFAULT_SIZE        64
+#define DEFAULT_WINDOW      1
+#define MAX_WINDOW          256
+#define DRAIN_TIMEOUT_SEC   2
+#define OP_ID_COUNT         65536
+
+struct bench_op {
+    const char *name;
+    uint8_t type;
+    size_t (*build)(void *payload, size_t size, unsigned int seq);
+};
+
+struct bench_protocol {
+    const char *name;
+    unsigned int cport;
+    void (*init)(int cport);
+    const struct bench_op *ops;
+    size_t op_count;
+    bool enabled;
+};
+
+struct op_stats {
+    const char *name;
+    uint32_t *samples;
+    unsigned int capacity;
+    unsigned int count;
+    unsigned int errors;
+};
+
+struct pending_op {
+    uint32_t start;
+    bool active;
+};
+
+static struct op_stats stats[GB_BENCH_CPORT_COUNT][GB_TYPE_RESPONSE_FLAG];
+static struct pending_op pending[GB_BENCH_CPORT_COUNT][OP_ID_COUNT];
+static sem_t credits;
+
+static unsigned int responses;
+static unsigned int unmatched;
+static unsigned int unsolicited;
+static uint32_t last_response;
+
+/*
+ * Request builders
+ */
+
+static size_t clamp_size(size_t size, size_t overhead)
+{
+    return MIN(size, GB_MAX_PAYLOAD_SIZE - overhead);
+}
+
+static size_t build_empty(void *payload, size_t size, unsigned int seq)
+{
+    return 0;
+}
+
+static size_t build_loopback_transfer(void *payload, size_t size,
+                                      unsigned int seq)
+{
+    struct gb_loopback_transfer_request *req = payload;
+
+    /* the response carries the data back with a larger header */
+    size = clamp_size(size, sizeof(struct gb_loopback_transfer_response));
+    req->len = cpu_to_le32(size);
+    memset(req->data, seq, size);
+
+    return sizeof(*req) + size;
+}
+
+static size_t build_gpio_set_value(void *payload, size_t size,
+                                   unsigned int seq)
+{
+    struct gb_gpio_set_value_request *req = payload;
+
+    req->which = seq % gpio_line_count();
+    req->value = seq & 1;
+
+    return sizeof(*req);
+}
+
+static size_t build_gpio_get_value(void *payload, size_t size,
+                                   unsigned int seq)
+{
+    struct gb_gpio_get_value_request *req = payload;
+
+    req->which = seq % gpio_line_count();
+
+    return sizeof(*req);
+}
+
+/* register address write followed by a read, as an EEPROM read does */
+static size_t build_i2c_transfer(void *payload, size_t size, unsigned int seq)
+{
+    struct gb_i2c_transfer_req *req = payload;
+    uint8_t *write_data = (uint8_t *) &req->desc[2];
+
+    size = clamp_size(size, 0);
+    req->op_count = cpu_to_le16(2);
+    req->desc[0].addr = cpu_to_le16(0x50);
+    req->desc[0].flags = 0;
+    req->desc[0].size = cpu_to_le16(1);
+    req->desc[1].addr = cpu_to_le16(0x50);
+    req->desc[1].flags = cpu_to_le16(GB_I2C_M_RD);
+    req->desc[1].size = cpu_to_le16(size);
+    write_data[0] = seq;
+
+    return sizeof(*req) + 2 * sizeof(req->desc[0]) + 1;
+}
+
+static size_t build_spi_transfer(void *payload, size_t size, unsigned int seq)
+{
+    struct gb_spi_transfer_request *req = payload;
+    uint8_t *write_data = (uint8_t *) &req->transfers[1];
+
+    size = clamp_size(size, 0);
+    size = MIN(size, GB_MAX_PAYLOAD_SIZE - sizeof(*req) -
+                     sizeof(req->transfers[0]));
+    req->chip_select = 0;
+    req->mode = 0;
+    req->count = cpu_to_le16(1);
+    req->transfers[0].speed_hz = cpu_to_le32(1000000);
+    req->transfers[0].len = cpu_to_le32(size);
+    req->transfers[0].delay_usecs = 0;
+    req->transfers[0].cs_change = 0;
+    req->transfers[0].bits_per_word = 8;
+    memset(write_data, seq, size);
+
+    return sizeof(*req) + sizeof(req->transfers[0]) + size;
+}
+
+static size_t build_uart_send_data(void *payload, size_t size,
+                                   unsigned int seq)
+{
+    struct gb_uart_send_data_request *req = payload;
+
+    size = clamp_size(size, sizeof(*req));
+    req->size = cpu_to_le16(size);
+    memset(req->data, seq, size);
+
+    return sizeof(*req) + size;
+}
+
+static const struct bench_op loopback_ops[] = {
+    { "ping", GB_LOOPBACK_TYPE_PING, build_empty },
+    { "transfer", GB_LOOPBACK_TYPE_TRANSFER, build_loopback_transfer },
+};
+
+static const struct bench_op gpio_ops[] = {
+    { "set_value", GB_GPIO_TYPE_SET_VALUE, build_gpio_set_value },
+    { "get_value", GB_GPIO_TYPE_GET_VALUE, build_gpio_get_value },
+};
+
+static const struct bench_op i2c_ops[] = {
+    { "transfer", GB_I2C_PROTOCOL_TRANSFER, build_i2c_transfer },
+};
+
+static const struct bench_op spi_ops[] = {
+    { "transfer", GB_SPI_PROTOCOL_TRANSFER, build_spi_transfer },
+};
+
+static const struct bench_op uart_ops[] = {
+    { "send_data", GB_UART_PROTOCOL_SEND_DATA, build_uart_send_data },
+};
+
+static struct bench_protocol protocols[] = {
+    { "loopback", GB_BENCH_CPORT_LOOPBACK, gb_loopback_register,
+      loopback_ops, ARRAY_SIZE(loopback_ops) },
+    { "gpio", GB_BENCH_CPORT_GPIO, gb_gpio_register,
+      gpio_ops, ARRAY_SIZE(gpio_ops) },
+    { "i2c", GB_BENCH_CPORT_I2C, gb_i2c_register,
+      i2c_ops, ARRAY_SIZE(i2c_ops) },
+    { "spi", GB_BENCH_CPORT_SPI, gb_spi_register,
+      spi_ops, ARRAY_SIZE(spi_ops) },
+    { "uart", GB_BENCH_CPORT_UART, gb_uart_register,
+      uart_ops, ARRAY_SIZE(uart_ops) },
+};
+
+static struct bench_protocol *find_protocol(const char *name, size_t len)
+{
+    int i;
+
+    for (i = 0; i < ARRAY_SIZE(protocols); i++) {
+        if (strlen(protocols[i].name) == len &&
+            !strncmp(protocols[i].name, name, len))
+            return &protocols[i];
+    }
+
+    return NULL;
+}
+
+static const char *find_op_name(unsigned int cport, uint8_t type)
+{
+    int i, j;
+
+    for (i = 0; i < ARRAY_SIZE(protocols); i++) {
+        if (protocols[i].cport != cport)
+            continue;
+
+        for (j = 0; j < protocols[i].op_count; j++) {
+            if (protocols[i].ops[j].type == type)
+                return protocols[i].ops[j].name;
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * Statistics
+ */
+
+static int stats_alloc(unsigned int cport, uint8_t type, const char *name,
+                       unsigned int capacity)
+{
+    struct op_stats *op = &stats[cport][type];
+    uint32_t *samples;
+
+    samples = realloc(op->samples,
+                      (op->capacity + capacity) * sizeof(*samples));
+    if (!samples)
+        return -ENOMEM;
+
+    op->samples = samples;
+    op->capacity += capacity;
+    if (name)
+        op->name = name;
+
+    return 0;
+}
+
+static void stats_free(void)
+{
+    int i, j;
+
+    for (i = 0; i < GB_BENCH_CPORT_COUNT; i++) {
+        for (j = 0; j < GB_TYPE_RESPONSE_FLAG; j++)
+            free(stats[i][j].samples);
+    }
+}
+
+static void stats_record(unsigned int cport, uint8_t type, uint32_t usec,
+                         uint8_t result)
+{
+    struct op_stats *op = &stats[cport][type];
+    unsigned int i;
+
+    if (result != GB_OP_SUCCESS)
+        __atomic_add_fetch(&op->errors, 1, __ATOMIC_RELAXED);
+
+    i = __atomic_fetch_add(&op->count, 1, __ATOMIC_RELAXED);
+    if (i < op->capacity)
+        op->samples[i] = usec;
+}
+
+static int compare_u32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *) a;
+    uint32_t y = *(const uint32_t *) b;
+
+    return x < y ? -1 : x > y;
+}
+
+static uint32_t percentile(const uint32_t *samples, unsigned int count,
+                           unsigned int pct)
+{
+    return samples[(count - 1) * pct / 100];
+}
+
+static const char *cport_protocol_name(unsigned int cport)
+{
+    int i;
+
+    for (i = 0; i < ARRAY_SIZE(protocols); i++) {
+        if (protocols[i].cport == cport)
+            return protocols[i].name;
+    }
+
+    return "?";
+}
+
+static void stats_report(uint32_t elapsed, unsigned long allocs,
+                         unsigned long frees)
+{
+    struct op_stats *op;
+    unsigned int count;
+    char name[32];
+    int i, j;
+
+    printf("%u responses in %u.%06u s: %.0f msg/s\n", responses,
+           elapsed / USEC_PER_SEC, elapsed % USEC_PER_SEC,
+           elapsed ? (double) responses * USEC_PER_SEC / elapsed : 0.0);
+    if (responses)
+        printf("heap: %.2f allocations/msg, %.2f frees/msg\n",
+               (double) allocs / responses, (double) frees / responses);
+    else
+        printf("heap: %lu allocations, %lu frees\n", allocs, frees);
+    if (unmatched || unsolicited)
+        printf("%u unmatched responses, %u requests from the drivers\n",
+               unmatched, unsolicited);
+
+    printf("\n%-4s %-20s %8s %6s %8s %8s %8s %8s\n", "CP", "operation",
+           "count", "errors", "p50 us", "p90 us", "p99 us", "max us");
+
+    for (i = 0; i < GB_BENCH_CPORT_COUNT; i++) {
+        for (j = 0; j < GB_TYPE_RESPONSE_FLAG; j++) {
+            op = &stats[i][j];
+            count = MIN(op->count, op->capacity);
+            if (!count)
+                continue;
+
+            qsort(op->samples, count, sizeof(*op->samples), compare_u32);
+
+            if (op->name)
+                snprintf(name, sizeof(name), "%s/%s", cport_protocol_name(i),
+                         op->name);
+            else
+                snprintf(name, sizeof(name), "%s/0x%02x",
+                         cport_protocol_name(i), j);
+
+            printf("%-4d %-20s %8u %6u %8u %8u %8u %8u\n", i, name,
+                   op->count, op->errors,
+                   percentile(op->samples, count, 50),
+                   percentile(op->samples, count, 90),
+                   percentile(op->samples, count, 99),
+                   op->samples[count - 1]);
+        }
+    }
+}
+
+/*
+ * Loopback transport: the responses of the Greybus core come back here
+ */
+
+static void mark_pending(unsigned int cport, uint16_t id)
+{
+    pending[cport][id].start = hrt_getusec();
+    __atomic_store_n(&pending[cport][id].active, true, __ATOMIC_RELEASE);
+}
+
+static void bench_receive(unsigned int cport, const void *buf, size_t len)
+{
+    const struct gb_operation_hdr *hdr = buf;
+    struct pending_op *op;
+    uint32_t now = hrt_getusec();
+
+    if (len < sizeof(*hdr) || !(hdr->type & GB_TYPE_RESPONSE_FLAG)) {
+        __atomic_add_fetch(&unsolicited, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    op = &pending[cport % GB_BENCH_CPORT_COUNT][le16_to_cpu(hdr->id)];
+    if (cport >= GB_BENCH_CPORT_COUNT ||
+        !__atomic_exchange_n(&op->active, false, __ATOMIC_ACQUIRE)) {
+        __atomic_add_fetch(&unmatched, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    stats_record(cport, hdr->type & ~GB_TYPE_RESPONSE_FLAG, now - op->start,
+                 hdr->result);
+    __atomic_add_fetch(&responses, 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&last_response, now, __ATOMIC_RELAXED);
+    sem_post(&credits);
+}
+
+static void bench_transport_init(void)
+{
+}
+
+static void bench_transport_exit(void)
+{
+}
+
+static int bench_listen(unsigned int cport)
+{
+    return 0;
+}
+
+static int bench_stop_listening(unsigned int cport)
+{
+    return 0;
+}
+
+static int bench_send(unsigned int cport, const void *buf, size_t len)
+{
+    bench_receive(cport, buf, len);
+    return 0;
+}
+
+static void *bench_alloc_buf(size_t size)
+{
+    return malloc(size);
+}
+
+static void bench_free_buf(void *ptr)
+{
+    free(ptr);
+}
+
+static void *bench_alloc_tx_buf(unsigned int cport, size_t size)
+{
+    return malloc(size);
+}
+
+static int bench_send_tx_buf(unsigned int cport, void *buf, size_t len)
+{
+    bench_receive(cport, buf, len);
+    free(buf);
+    return 0;
+}
+
+static struct gb_transport_backend bench_transport = {
+    .init = bench_transport_init,
+    .exit = bench_transport_exit,
+    .listen = bench_listen,
+    .stop_listening = bench_stop_listening,
+    .send = bench_send,
+    .alloc_buf = bench_alloc_buf,
+    .free_buf = bench_free_buf,
+    .alloc_tx_buf = bench_alloc_tx_buf,
+    .send_tx_buf = bench_send_tx_buf,
+};
+
+/*
+ * gb_tape on top of the host file system. When replaying, the payload read
+ * is the last step before greybus_rx_handler(): the read waits for a window
+ * credit and starts the latency measurement of the request.
+ */
+
+static bool tape_replaying;
+
+static int tape_open(const char *pathname, int mode)
+{
+    int fd;
+
+    if (mode == GB_TAPE_RDONLY)
+        fd = open(pathname, O_RDONLY);
+    else
+        fd = open(pathname, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+    return fd < 0 ? -errno : fd;
+}
+
+static void tape_close(int fd)
+{
+    close(fd);
+}
+
+static ssize_t tape_write(int fd, const void *data, size_t size)
+{
+    return write(fd, data, size);
+}
+
+static ssize_t tape_read(int fd, void *data, size_t size)
+{
+    static unsigned int cport;
+    struct gb_operation_hdr *hdr = data;
+    ssize_t nread;
+
+    nread = read(fd, data, size);
+    if (!tape_replaying || nread <= 0)
+        return nread;
+
+    /* record header: remember the cport of the message that follows */
+    if (size == 2 * sizeof(uint16_t)) {
+        cport = ((uint16_t *) data)[1];
+        return nread;
+    }
+
+    if (nread >= sizeof(*hdr) && hdr->id &&
+        !(hdr->type & GB_TYPE_RESPONSE_FLAG) &&
+        cport < GB_BENCH_CPORT_COUNT) {
+        sem_wait(&credits);
+        mark_pending(cport, le16_to_cpu(hdr->id));
+    }
+
+    return nread;
+}
+
+static struct gb_tape_mechanism tape_mechanism = {
+    .open = tape_open,
+    .close = tape_close,
+    .write = tape_write,
+    .read = tape_read,
+};
+
+/*
+ * Workloads
+ */
+
+static int prepare_synthetic(unsigned int count)
+{
+    struct bench_protocol *proto;
+    unsigned int enabled = 0;
+    unsigned int share;
+    int i, j;
+    int retval;
+
+    for (i = 0; i < ARRAY_SIZE(protocols); i++)
+        enabled += protocols[i].enabled;
+
+    for (i = 0; i < ARRAY_SIZE(protocols); i++) {
+        proto = &protocols[i];
+        if (!proto->enabled)
+            continue;
+
+        share = count / enabled + 1;
+        for (j = 0; j < proto->op_count; j++) {
+            retval = stats_alloc(proto->cport, proto->ops[j].type,
+                                 proto->ops[j].name,
+                                 share / proto->op_count + 1);
+            if (retval)
+                return retval;
+        }
+    }
+
+    return 0;
+}
+
+static unsigned int run_synthetic(unsigned int count, size_t size)
+{
+    static uint8_t buffer[GB_MTU];
+    struct gb_operation_hdr *hdr = (struct gb_operation_hdr *) buffer;
+    struct bench_protocol *enabled[ARRAY_SIZE(protocols)];
+    const struct bench_op *op;
+    unsigned int nenabled = 0;
+    unsigned int sent = 0;
+    unsigned int cport;
+    uint16_t id = 0;
+    unsigned int i;
+    size_t len;
+
+    for (i = 0; i < ARRAY_SIZE(protocols); i++) {
+        if (protocols[i].enabled)
+            enabled[nenabled++] = &protocols[i];
+    }
+
+    for (i = 0; i < count; i++) {
+        cport = enabled[i % nenabled]->cport;
+        op = &enabled[i % nenabled]->ops[(i / nenabled) %
+                                         enabled[i % nenabled]->op_count];
+
+        /* id 0 is for unidirectional operations */
+        if (!++id)
+            id = 1;
+
+        len = sizeof(*hdr) + op->build(hdr + 1, size, i);
+        hdr->size = cpu_to_le16(len);
+        hdr->id = cpu_to_le16(id);
+        hdr->type = op->type;
+        hdr->result = 0;
+
+        sem_wait(&credits);
+        mark_pending(cport, id);
+        if (greybus_rx_handler(cport, buffer, len)) {
+            pending[cport][id].active = false;
+            sem_post(&credits);
+            continue;
+        }
+        sent++;
+    }
+
+    return sent;
+}
+
+/* count the requests of a capture to size the statistics */
+static int prepare_replay(const char *pathname)
+{
+    unsigned int counts[GB_BENCH_CPORT_COUNT][GB_TYPE_RESPONSE_FLAG] = { };
+    struct gb_operation_hdr hdr;
+    uint16_t record[2];
+    int retval = 0;
+    int i, j;
+    FILE *fp;
+
+    fp = fopen(pathname, "r");
+    if (!fp)
+        return -errno;
+
+    while (fread(record, sizeof(record), 1, fp) == 1) {
+        if (record[0] < sizeof(hdr) ||
+            fread(&hdr, sizeof(hdr), 1, fp) != 1 ||
+            fseek(fp, record[0] - sizeof(hdr), SEEK_CUR)) {
+            retval = -EIO;
+            break;
+        }
+
+        if (record[1] < GB_BENCH_CPORT_COUNT &&
+            !(hdr.type & GB_TYPE_RESPONSE_FLAG))
+            counts[record[1]][hdr.type]++;
+    }
+
+    fclose(fp);
+
+    for (i = 0; !retval && i < GB_BENCH_CPORT_COUNT; i++) {
+        for (j = 0; !retval && j < GB_TYPE_RESPONSE_FLAG; j++) {
+            if (counts[i][j])
+                retval = stats_alloc(i, j, find_op_name(i, j), counts[i][j]);
+        }
+    }
+
+    return retval;
+}
+
+/* wait for the requests still in flight */
+static void drain(unsigned int window)
+{
+    struct timespec ts;
+
+    while (window--) {
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_sec += DRAIN_TIMEOUT_SEC;
+        if (sem_timedwait(&credits, &ts) && errno == ETIMEDOUT) {
+            fprintf(stderr, "%u requests never got a response\n", window + 1);
+            break;
+        }
+    }
+}
+
+static int parse_protocols(char *list)
+{
+    struct bench_protocol *proto;
+    char *name;
+    int i;
+
+    for (i = 0; i < ARRAY_SIZE(protocols); i++)
+        protocols[i].enabled = false;
+
+    for (name = strtok(list, ","); name; name = strtok(NULL, ",")) {
+        proto = find_protocol(name, strlen(name));
+        if (!proto) {
+            fprintf(stderr, "unknown protocol '%s'\n", name);
+            return -EINVAL;
+        }
+        proto->enabled = true;
+    }
+
+    return 0;
+}
+
+static int parse_mapping(const char *mapping)
+{
+    struct bench_protocol *proto;
+    const char *eq = strchr(mapping, '=');
+    unsigned int cport;
+    int i;
+
+    if (!eq)
+        return -EINVAL;
+
+    proto = find_protocol(mapping, eq - mapping);
+    cport = strtoul(eq + 1, NULL, 0);
+    if (!proto || cport >= GB_BENCH_CPORT_COUNT)
+        return -EINVAL;
+
+    /* swap with the protocol using that cport, if any */
+    for (i = 0; i < ARRAY_SIZE(protocols); i++) {
+        if (protocols[i].cport == cport)
+            protocols[i].cport = proto->cport;
+    }
+    proto->cport = cport;
+
+    return 0;
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr,
+            "usage: %s [-p protocols] [-n count] [-s size] [-w window]\n"
+            "          [-P protocol=cport] [-c capture] [-r capture] [-l]\n"
+            "\n"
+            "  -p  comma separated list of loopback,gpio,i2c,spi,uart\n"
+            "      (default: all)\n"
+            "  -n  number of requests to generate (default: %d)\n"
+            "  -s  data size of the transfer operations (default: %d)\n"
+            "  -w  number of requests in flight, 1 to %d (default: %d)\n"
+            "  -P  move a protocol to another cport (0 to %d)\n"
+            "  -c  record the generated requests to a gb_tape capture\n"
+            "  -r  replay a gb_tape capture instead of generating requests\n"
+            "  -l  dump the latency histograms of the Greybus core\n",
+            name, DEFAULT_COUNT, DEFAULT_SIZE, MAX_WINDOW, DEFAULT_WINDOW,
+            GB_BENCH_CPORT_COUNT - 1);
+}
+
+int main(int argc, char **argv)
+{
+    unsigned long allocs_start, frees_start;
+    unsigned long allocs_end, frees_end;
+    unsigned int count = DEFAULT_COUNT;
+    unsigned int window = DEFAULT_WINDOW;
+    size_t size = DEFAULT_SIZE;
+    const char *capture = NULL;
+    const char *replay = NULL;
+    bool dump_latency = false;
+    static char latency[4096];
+    uint32_t start;
+    int retval;
+    int opt;
+    int i;
+
+    for (i = 0; i < ARRAY_SIZE(protocols); i++)
+        protocols[i].enabled = true;
+
+    while ((opt = getopt(argc, argv, "p:n:s:w:P:c:r:lh")) != -1) {
+        switch (opt) {
+        case 'p':
+            if (parse_protocols(optarg))
+                return EXIT_FAILURE;
+            break;
+        case 'n':
+            count = strtoul(optarg, NULL, 0);
+            break;
+        case 's':
+            size = strtoul(optarg, NULL, 0);
+            break;
+        case 'w':
+            window = strtoul(optarg, NULL, 0);
+            break;
+        case 'P':
+            if (parse_mapping(optarg)) {
+                fprintf(stderr, "invalid mapping '%s'\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'c':
+            capture = optarg;
+            break;
+        case 'r':
+            replay = optarg;
+            break;
+        case 'l':
+            dump_latency = true;
+            break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+
+    if (!window || window > MAX_WINDOW || !count) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    retval = replay ? prepare_replay(replay) : prepare_synthetic(count);
+    if (retval) {
+        fprintf(stderr, "cannot prepare the run: %s\n", strerror(-retval));
+        return EXIT_FAILURE;
+    }
+
+    sem_init(&credits, 0, window);
+
+    retval = host_init();
+    if (retval) {
+        fprintf(stderr, "cannot start the watchdog thread\n");
+        return EXIT_FAILURE;
+    }
+
+    gb_init(&bench_transport);
+    gb_tape_register_mechanism(&tape_mechanism);
+
+    for (i = 0; i < ARRAY_SIZE(protocols); i++) {
+        if (protocols[i].enabled || replay)
+            protocols[i].init(protocols[i].cport);
+    }
+
+    if (capture) {
+        retval = gb_tape_communication(capture);
+        if (retval) {
+            fprintf(stderr, "cannot record to '%s': %s\n", capture,
+                    strerror(-retval));
+            goto out;
+        }
+    }
+
+    gb_latency_reset();
+    host_heap_stats(&allocs_start, &frees_start);
+    start = hrt_getusec();
+    last_response = start;
+
+    if (replay) {
+        tape_replaying = true;
+        retval = gb_tape_replay(replay);
+        if (retval)
+            fprintf(stderr, "replay of '%s' failed: %s\n", replay,
+                    strerror(-retval));
+    } else {
+        run_synthetic(count, size);
+    }
+
+    drain(window);
+    host_heap_stats(&allocs_end, &frees_end);
+
+    if (capture)
+        gb_tape_stop();
+
+    stats_report(last_response - start, allocs_end - allocs_start,
+                 frees_end - frees_start);
+
+    if (dump_latency) {
+        gb_latency_dump(latency, sizeof(latency));
+        printf("\n%s", latency);
+    }
+
+out:
+    gb_deinit();
+    host_exit();
+    sem_destroy(&credits);
+    stats_free();
+
+    return retval ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,75 @@
+/*
+ * Copyright (c) 2016 Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __GB_BENCH_H
+#define __GB_BENCH_H
+
+#include <semaphore.h>
+
+/* CPorts of the protocols under test, they can be remapped with -P */
+#define GB_BENCH_CPORT_LOOPBACK     0
+#define GB_BENCH_CPORT_GPIO         1
+#define GB_BENCH_CPORT_I2C          2
+#define GB_BENCH_CPORT_SPI          3
+#define GB_BENCH_CPORT_UART         4
+#define GB_BENCH_CPORT_COUNT        8
+
+int host_init(void);
+void host_exit(void);
+void host_heap_stats(unsigned long *allocs, unsigned long *frees);
+
+/* activity of the mock SPI device */
+struct mock_spi_stats {
+    unsigned int setmode;
+    unsigned int setbits;
+    unsigned int setfrequency;
+    unsigned int selects;
+    unsigned int exchanges;
+    /* exchanges done with the chip select deasserted */
+    unsigned int unselected;
+};
+
+uint8_t mock_spi_answer(uint8_t byte, uint16_t mode, int nbits,
+                        uint32_t frequency);
+void mock_spi_get_stats(struct mock_spi_stats *stats);
+void mock_spi_reset_stats(void);
+
+/*
+ * The next gpio_get_value() posts stalled then waits for release, holding
+ * the worker of the GPIO cport
+ */
+void mock_gpio_stall(sem_t *stalled, sem_t *release);
+
+/* registration functions of the protocol drivers not exported by greybus.h */
+void gb_loopback_register(int cport);
+void gb_spi_register(int cport);
+
+/* interrupt handler of the GPIO protocol driver */
+int gb_gpio_irq_event(int irq, void *context);
+
+#endif /* __GB_BENCH_H */
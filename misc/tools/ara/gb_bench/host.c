@@ -0,0 +1,297 @@
+/*
+ * Copyright (c) 2016 Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Host implementation of the few OS services the Greybus core and the
+ * protocol drivers use: critical sections, watchdogs, the high resolution
+ * timer and the UniPro buffer hooks. Heap calls are wrapped at link time so
+ * the harness can report the allocations done per message.
+ */
+
+#include <nuttx/config.h>
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <arch/irq.h>
+#include <nuttx/clock.h>
+#include <nuttx/wdog.h>
+#include <nuttx/hires_tmr.h>
+
+#include "gb_bench.h"
+
+#define HOST_STACK_MIN      (64 * 1024)
+
+static pthread_mutex_t irq_lock = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
+
+static struct wdog_s *wd_active;
+static pthread_t wd_thread;
+static volatile bool wd_thread_stop;
+
+static volatile unsigned long heap_allocs;
+static volatile unsigned long heap_frees;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t nmemb, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void __real_free(void *ptr);
+int __real_pthread_attr_setstacksize(pthread_attr_t *attr, size_t stacksize);
+
+irqstate_t irqsave(void)
+{
+    pthread_mutex_lock(&irq_lock);
+    return 0;
+}
+
+void irqrestore(irqstate_t flags)
+{
+    pthread_mutex_unlock(&irq_lock);
+}
+
+uint32_t hrt_getusec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * USEC_PER_SEC + ts.tv_nsec / NSEC_PER_USEC;
+}
+
+int lowsyslog(const char *fmt, ...)
+{
+    va_list ap;
+    int retval;
+
+    va_start(ap, fmt);
+    retval = vfprintf(stderr, fmt, ap);
+    va_end(ap);
+
+    return retval;
+}
+
+/*
+ * Heap accounting
+ */
+
+void *__wrap_malloc(size_t size)
+{
+    __atomic_add_fetch(&heap_allocs, 1, __ATOMIC_RELAXED);
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t nmemb, size_t size)
+{
+    __atomic_add_fetch(&heap_allocs, 1, __ATOMIC_RELAXED);
+    return __real_calloc(nmemb, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+    if (!ptr)
+        __atomic_add_fetch(&heap_allocs, 1, __ATOMIC_RELAXED);
+    return __real_realloc(ptr, size);
+}
+
+void __wrap_free(void *ptr)
+{
+    if (ptr)
+        __atomic_add_fetch(&heap_frees, 1, __ATOMIC_RELAXED);
+    __real_free(ptr);
+}
+
+void *zalloc(size_t size)
+{
+    return calloc(1, size);
+}
+
+void host_heap_stats(unsigned long *allocs, unsigned long *frees)
+{
+    *allocs = __atomic_load_n(&heap_allocs, __ATOMIC_RELAXED);
+    *frees = __atomic_load_n(&heap_frees, __ATOMIC_RELAXED);
+}
+
+/*
+ * The Greybus workers are sized for the target and their stacks would be
+ * smaller than what the host C library accepts.
+ */
+int __wrap_pthread_attr_setstacksize(pthread_attr_t *attr, size_t stacksize)
+{
+    if (stacksize < HOST_STACK_MIN)
+        stacksize = HOST_STACK_MIN;
+    return __real_pthread_attr_setstacksize(attr, stacksize);
+}
+
+/*
+ * Watchdogs
+ *
+ * The active watchdogs are kept in a list walked by a thread ticking every
+ * CONFIG_USEC_PER_TICK. Expired handlers run with the irq lock held, as
+ * they would from the timer interrupt on target.
+ */
+
+static void wd_unlink(struct wdog_s *wdog)
+{
+    struct wdog_s **prev;
+
+    for (prev = &wd_active; *prev; prev = &(*prev)->next) {
+        if (*prev == wdog) {
+            *prev = wdog->next;
+            break;
+        }
+    }
+
+    wdog->next = NULL;
+    wdog->flags &= ~WDOGF_ACTIVE;
+}
+
+static void *wd_tick_thread(void *data)
+{
+    struct wdog_s *wdog;
+    irqstate_t flags;
+
+    while (!wd_thread_stop) {
+        usleep(CONFIG_USEC_PER_TICK);
+
+        flags = irqsave();
+
+        for (wdog = wd_active; wdog; wdog = wdog->next)
+            wdog->lag--;
+
+        /* handlers may start or cancel watchdogs: rescan after each one */
+        do {
+            for (wdog = wd_active; wdog && wdog->lag > 0; wdog = wdog->next)
+                ;
+
+            if (wdog) {
+                wd_unlink(wdog);
+                wdog->func(wdog->argc, wdog->parm[0], wdog->parm[1],
+                           wdog->parm[2], wdog->parm[3]);
+            }
+        } while (wdog);
+
+        irqrestore(flags);
+    }
+
+    return NULL;
+}
+
+WDOG_ID wd_create(void)
+{
+    struct wdog_s *wdog = zalloc(sizeof(*wdog));
+
+    if (wdog)
+        wdog->flags = WDOGF_ALLOCED;
+    return wdog;
+}
+
+int wd_start(WDOG_ID wdog, int delay, wdentry_t wdentry, int argc, ...)
+{
+    irqstate_t flags;
+    va_list ap;
+    int i;
+
+    if (!wdog || !wdentry || argc > CONFIG_MAX_WDOGPARMS || delay < 0)
+        return -EINVAL;
+
+    flags = irqsave();
+
+    if (WDOG_ISACTIVE(wdog))
+        wd_unlink(wdog);
+
+    va_start(ap, argc);
+    for (i = 0; i < argc; i++)
+        wdog->parm[i] = va_arg(ap, uint32_t);
+    va_end(ap);
+
+    wdog->func = wdentry;
+    wdog->argc = argc;
+    wdog->lag = delay > 0 ? delay : 1;
+    wdog->flags |= WDOGF_ACTIVE;
+    wdog->next = wd_active;
+    wd_active = wdog;
+
+    irqrestore(flags);
+    return OK;
+}
+
+int wd_cancel(WDOG_ID wdog)
+{
+    irqstate_t flags;
+
+    if (!wdog)
+        return -EINVAL;
+
+    flags = irqsave();
+    if (WDOG_ISACTIVE(wdog))
+        wd_unlink(wdog);
+    irqrestore(flags);
+
+    return OK;
+}
+
+int wd_delete(WDOG_ID wdog)
+{
+    if (!wdog)
+        return -EINVAL;
+
+    wd_cancel(wdog);
+    if (WDOG_ISALLOCED(wdog))
+        free(wdog);
+
+    return OK;
+}
+
+/*
+ * UniPro
+ */
+
+unsigned int unipro_cport_count(void)
+{
+    return GB_BENCH_CPORT_COUNT;
+}
+
+void unipro_rxbuf_free(unsigned int cportid, void *ptr)
+{
+    free(ptr);
+}
+
+int host_init(void)
+{
+    wd_thread_stop = false;
+    return -pthread_create(&wd_thread, NULL, wd_tick_thread, NULL);
+}
+
+void host_exit(void)
+{
+    wd_thread_stop = true;
+    pthread_join(wd_thread, NULL);
+}
@@ -0,0 +1,64 @@
+/*
+ * Copyright (c) 2016 Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Configuration of the host build of the Greybus core
+ */
+
+#ifndef __GB_BENCH_NUTTX_CONFIG_H
+#define __GB_BENCH_NUTTX_CONFIG_H
+
+#define CONFIG_GREYBUS 1
+#define CONFIG_GREYBUS_LOOPBACK 1
+#define CONFIG_GREYBUS_GPIO_PHY 1
+#define CONFIG_GREYBUS_I2C_PHY 1
+#define CONFIG_GREYBUS_LATENCY 1
+#define CONFIG_GREYBUS_LATENCY_TYPES 4
+#define CONFIG_GREYBUS_UART_RX_OPERATIONS 5
+#define CONFIG_GREYBUS_UART_RX_BUFSIZE 256
+#define CONFIG_GREYBUS_UART_RX_IDLE_TIMEOUT 5000
+
+/* "make MEMPOOL=y" builds the core with its preallocated message pools */
+#ifdef GB_BENCH_MEMPOOL
+#define CONFIG_GREYBUS_MEMPOOL 1
+#define CONFIG_GREYBUS_MEMPOOL_OPERATIONS 32
+#define CONFIG_GREYBUS_MEMPOOL_SMALL_SIZE 64
+#define CONFIG_GREYBUS_MEMPOOL_SMALL_COUNT 32
+#define CONFIG_GREYBUS_MEMPOOL_MEDIUM_SIZE 256
+#define CONFIG_GREYBUS_MEMPOOL_MEDIUM_COUNT 8
+#define CONFIG_GREYBUS_MEMPOOL_LARGE_SIZE 2048
+#define CONFIG_GREYBUS_MEMPOOL_LARGE_COUNT 2
+#endif
+
+#define CONFIG_ARCH_HAVE_HIRES_TIMER 1
+
+#define CONFIG_USEC_PER_TICK 10000
+#define CONFIG_MAX_WDOGPARMS 4
+#define CONFIG_PREALLOC_WDOGS 32
+
+#endif /* __GB_BENCH_NUTTX_CONFIG_H */
@@ -0,0 +1,411 @@
+/*
+ * Copyright (c) 2016 Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Greybus in-flight request test
+ *
+ * Sends thousands of requests that wait for a response on a cport, then
+ * answers them through greybus_rx_handler() in a random order. Some get an
+ * error result, some never get a response and time out, and some get a
+ * second response, or one after their timeout. Checks that:
+ * - every request completes exactly once;
+ * - the response handed to the callback is the one of that request, with
+ *   its result, and the requests left unanswered complete with a timeout;
+ * - late and duplicate responses are dropped;
+ * - no operation is leaked once everything completed.
+ */
+
+#include <nuttx/config.h>
+
+#include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <arch/byteorder.h>
+#include <nuttx/util.h>
+#include <nuttx/greybus/greybus.h>
+
+#include "gb_bench.h"
+
+#define TEST_CPORT          0
+#define TEST_TYPE           0x42
+#define TEST_OPERATIONS     4096
+#define TEST_LATE           8
+#define TEST_SEED           1
+/* longer than the timeout of the core, 1s */
+#define COMPLETE_TIMEOUT_SEC 3
+
+/* requests answered with an error, and left to time out */
+#define TEST_IS_ERROR(i)    ((i) % 5 == 0)
+#define TEST_IS_TIMEOUT(i)  ((i) % 7 == 3)
+
+struct test_request {
+    __le32 index;
+} __packed;
+
+struct test_response {
+    __le32 cookie;
+} __packed;
+
+static struct {
+    uint16_t id;
+    bool sent;
+    unsigned int completions;
+    uint8_t result;
+    bool cookie_ok;
+} requests[TEST_OPERATIONS];
+
+static pthread_mutex_t requests_lock = PTHREAD_MUTEX_INITIALIZER;
+static unsigned int unknown_completions;
+static sem_t complete_sem;
+
+static uint32_t test_cookie(uint32_t index)
+{
+    return index * 2654435761u;
+}
+
+static int test_send(unsigned int cport, const void *buf, size_t len)
+{
+    const struct gb_operation_hdr *hdr = buf;
+    const struct test_request *req = (const void *) (hdr + 1);
+    uint32_t index;
+
+    /* called with the irq lock held: only record the request ID */
+    if (hdr->type != TEST_TYPE || len < sizeof(*hdr) + sizeof(*req))
+        return -EINVAL;
+
+    index = le32_to_cpu(req->index);
+    if (index >= TEST_OPERATIONS)
+        return -EINVAL;
+
+    requests[index].id = le16_to_cpu(hdr->id);
+    requests[index].sent = true;
+    return 0;
+}
+
+static void test_noop(void)
+{
+}
+
+static int test_listen(unsigned int cport)
+{
+    return 0;
+}
+
+static void *test_alloc_buf(size_t size)
+{
+    return malloc(size);
+}
+
+static void test_free_buf(void *ptr)
+{
+    free(ptr);
+}
+
+static struct gb_transport_backend test_transport = {
+    .init = test_noop,
+    .exit = test_noop,
+    .listen = test_listen,
+    .stop_listening = test_listen,
+    .send = test_send,
+    .alloc_buf = test_alloc_buf,
+    .free_buf = test_free_buf,
+};
+
+/* the cport only receives responses, the driver needs a handler anyway */
+static uint8_t test_request_handler(struct gb_operation *operation)
+{
+    return GB_OP_PROTOCOL_BAD;
+}
+
+static struct gb_operation_handler test_handlers[] = {
+    GB_HANDLER(TEST_TYPE, test_request_handler),
+};
+
+static struct gb_driver test_driver = {
+    .op_handlers = test_handlers,
+    .op_handlers_count = ARRAY_SIZE(test_handlers),
+};
+
+static void test_callback(struct gb_operation *operation)
+{
+    struct test_request *req = gb_operation_get_request_payload(operation);
+    struct gb_operation *response = gb_operation_get_response_op(operation);
+    uint32_t index = le32_to_cpu(req->index);
+    struct test_response *resp;
+
+    pthread_mutex_lock(&requests_lock);
+
+    if (index >= TEST_OPERATIONS) {
+        unknown_completions++;
+    } else {
+        requests[index].completions++;
+        requests[index].result = gb_operation_get_request_result(operation);
+        requests[index].cookie_ok = true;
+
+        if (response && requests[index].result == GB_OP_SUCCESS) {
+            resp = gb_operation_get_request_payload(response);
+            requests[index].cookie_ok =
+                gb_operation_get_request_payload_size(response) ==
+                sizeof(*resp) &&
+                le32_to_cpu(resp->cookie) == test_cookie(index);
+        }
+    }
+
+    pthread_mutex_unlock(&requests_lock);
+    sem_post(&complete_sem);
+}
+
+static int send_response(unsigned int index)
+{
+    struct {
+        struct gb_operation_hdr hdr;
+        struct test_response resp;
+    } __packed response = {
+        .hdr = {
+            .id = cpu_to_le16(requests[index].id),
+            .type = TEST_TYPE | GB_TYPE_RESPONSE_FLAG,
+        },
+        .resp = {
+            .cookie = cpu_to_le32(test_cookie(index)),
+        },
+    };
+    size_t size = sizeof(response);
+
+    /* error responses only have a header */
+    if (TEST_IS_ERROR(index)) {
+        response.hdr.result = GB_OP_INVALID;
+        size = sizeof(response.hdr);
+    }
+    response.hdr.size = cpu_to_le16(size);
+
+    return greybus_rx_handler(TEST_CPORT, &response, size);
+}
+
+static int timed_wait(sem_t *sem)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += COMPLETE_TIMEOUT_SEC;
+
+    while (sem_timedwait(sem, &ts)) {
+        if (errno != EINTR)
+            return -errno;
+    }
+
+    return 0;
+}
+
+static void shuffle(unsigned int *order, unsigned int count)
+{
+    unsigned int seed = TEST_SEED;
+    unsigned int i, j, tmp;
+
+    for (i = 0; i < count; i++)
+        order[i] = i;
+
+    for (i = count - 1; i > 0; i--) {
+        j = rand_r(&seed) % (i + 1);
+        tmp = order[i];
+        order[i] = order[j];
+        order[j] = tmp;
+    }
+}
+
+static int send_requests(void)
+{
+    struct gb_operation *operation;
+    struct test_request *req;
+    unsigned int i;
+    int retval;
+
+    for (i = 0; i < TEST_OPERATIONS; i++) {
+        operation = gb_operation_create(TEST_CPORT, TEST_TYPE, sizeof(*req));
+        if (!operation) {
+            fprintf(stderr, "request %u: cannot create the operation\n", i);
+            return -1;
+        }
+
+        req = gb_operation_get_request_payload(operation);
+        req->index = cpu_to_le32(i);
+
+        retval = gb_operation_send_request(operation, test_callback, true);
+        /* the core holds its own reference until completion */
+        gb_operation_destroy(operation);
+        if (retval || !requests[i].sent) {
+            fprintf(stderr, "request %u: not sent (%d)\n", i, retval);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/* Answer everything but the requests meant to time out, in random order */
+static int send_responses(void)
+{
+    static unsigned int order[TEST_OPERATIONS];
+    unsigned int i, index;
+
+    shuffle(order, TEST_OPERATIONS);
+
+    for (i = 0; i < TEST_OPERATIONS; i++) {
+        index = order[i];
+        if (TEST_IS_TIMEOUT(index))
+            continue;
+
+        if (send_response(index)) {
+            fprintf(stderr, "response %u: rejected\n", index);
+            return -1;
+        }
+
+        /* a duplicate of an earlier response, in the middle of the others */
+        if (i % 64 == 63 && !TEST_IS_TIMEOUT(order[i / 2]) &&
+            send_response(order[i / 2])) {
+            fprintf(stderr, "response %u: duplicate rejected\n", order[i / 2]);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/* Responses to requests that already timed out */
+static int send_late_responses(void)
+{
+    unsigned int i, late = 0;
+
+    for (i = 0; i < TEST_OPERATIONS && late < TEST_LATE; i++) {
+        if (!TEST_IS_TIMEOUT(i))
+            continue;
+
+        if (send_response(i)) {
+            fprintf(stderr, "late response %u: rejected\n", i);
+            return -1;
+        }
+        late++;
+    }
+
+    return 0;
+}
+
+static int check_completions(void)
+{
+    unsigned int i, failed = 0;
+    uint8_t expected;
+
+    if (unknown_completions) {
+        fprintf(stderr, "%u completions of unknown requests\n",
+                unknown_completions);
+        failed++;
+    }
+
+    for (i = 0; i < TEST_OPERATIONS; i++) {
+        if (TEST_IS_TIMEOUT(i))
+            expected = GB_OP_TIMEOUT;
+        else if (TEST_IS_ERROR(i))
+            expected = GB_OP_INVALID;
+        else
+            expected = GB_OP_SUCCESS;
+
+        if (requests[i].completions != 1 || requests[i].result != expected ||
+            !requests[i].cookie_ok) {
+            if (failed++ < 10) {
+                fprintf(stderr, "request %u: %u completions, result %u "
+                        "expected %u, %s response\n", i,
+                        requests[i].completions, requests[i].result,
+                        expected, requests[i].cookie_ok ? "good" : "bad");
+            }
+        }
+    }
+
+    return failed ? -1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+    unsigned long allocs, frees, allocs_after, frees_after;
+    unsigned int i;
+    int retval;
+
+    sem_init(&complete_sem, 0, 0);
+
+    retval = host_init();
+    if (retval) {
+        fprintf(stderr, "cannot start the watchdog thread\n");
+        return EXIT_FAILURE;
+    }
+
+    gb_init(&test_transport);
+    gb_register_driver(TEST_CPORT, &test_driver);
+    host_heap_stats(&allocs, &frees);
+
+    retval = send_requests();
+    if (!retval)
+        retval = send_responses();
+
+    /* the last completions are the timeouts */
+    for (i = 0; !retval && i < TEST_OPERATIONS; i++) {
+        retval = timed_wait(&complete_sem);
+        if (retval)
+            fprintf(stderr, "%u requests completed, expected %u\n", i,
+                    TEST_OPERATIONS);
+    }
+
+    if (!retval)
+        retval = send_late_responses();
+
+    /* let the worker drop the late responses */
+    usleep(100000);
+
+    if (!retval)
+        retval = check_completions();
+
+    host_heap_stats(&allocs_after, &frees_after);
+    if (!retval && allocs_after - allocs != frees_after - frees) {
+        fprintf(stderr, "%lu allocations not freed\n",
+                (allocs_after - allocs) - (frees_after - frees));
+        retval = -1;
+    }
+
+    printf("in-flight requests: %s\n", retval ? "FAIL" : "ok");
+
+    gb_unregister_driver(TEST_CPORT);
+    gb_deinit();
+    host_exit();
+    sem_destroy(&complete_sem);
+
+    return retval ? EXIT_FAILURE : EXIT_SUCCESS;
+}
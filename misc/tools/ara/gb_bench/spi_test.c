@@ -0,0 +1,321 @@
+/*
+ * Copyright (c) 2016 Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Greybus SPI transfer test
+ *
+ * Sends SPI transfer requests through greybus-core.c to spi.c, on top of the
+ * mock SPI device of devices.c, and checks that:
+ * - every byte read back was exchanged with the settings of its descriptor;
+ * - consecutive descriptors with the same settings, no delay and no chip
+ *   select change are merged into one exchange, with the chip select kept
+ *   asserted;
+ * - each request configures the device once, as another user may have
+ *   changed it while the bus was unlocked, then only reconfigures it when a
+ *   setting changes.
+ */
+
+#include <nuttx/config.h>
+
+#include <errno.h>
+#include <semaphore.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <arch/byteorder.h>
+#include <nuttx/util.h>
+#include <nuttx/greybus/greybus.h>
+
+#include "spi-gb.h"
+
+#include "gb_bench.h"
+
+#define TEST_CPORT          0
+#define TEST_MAX_DESCS      8
+#define RESPONSE_TIMEOUT_SEC 2
+
+#define MHZ                 1000000
+
+struct test_desc {
+    uint32_t len;
+    uint32_t speed_hz;
+    uint8_t bits_per_word;
+    uint16_t delay_usecs;
+    uint8_t cs_change;
+};
+
+struct test_case {
+    const char *name;
+    uint16_t mode;
+    struct test_desc descs[TEST_MAX_DESCS];
+    int count;
+    /* expected activity of the device */
+    struct mock_spi_stats expected;
+};
+
+static const struct test_case test_cases[] = {
+    {
+        /* the first transfer of each request configures everything */
+        .name = "merge",
+        .descs = {
+            { 16, 1 * MHZ, 8 }, { 16, 1 * MHZ, 8 }, { 16, 1 * MHZ, 8 },
+            { 16, 1 * MHZ, 8 }, { 16, 1 * MHZ, 8 }, { 16, 1 * MHZ, 8 },
+            { 16, 1 * MHZ, 8 }, { 100, 1 * MHZ, 8 },
+        },
+        .count = 8,
+        .expected = { .setmode = 1, .setbits = 1, .setfrequency = 1,
+                      .selects = 1, .exchanges = 1 },
+    }, {
+        /* same settings as the previous request, applied again */
+        .name = "unlocked settings",
+        .descs = { { 32, 1 * MHZ, 8 }, { 1, 1 * MHZ, 8 } },
+        .count = 2,
+        .expected = { .setmode = 1, .setbits = 1, .setfrequency = 1,
+                      .selects = 1, .exchanges = 1 },
+    }, {
+        .name = "frequency changes",
+        .descs = {
+            { 8, 1 * MHZ, 8 }, { 8, 1 * MHZ, 8 }, { 8, 2 * MHZ, 8 },
+            { 8, 2 * MHZ, 8 }, { 8, 1 * MHZ, 8 },
+        },
+        .count = 5,
+        .expected = { .setmode = 1, .setbits = 1, .setfrequency = 3,
+                      .selects = 1, .exchanges = 3 },
+    }, {
+        .name = "bits per word changes",
+        .descs = { { 4, 1 * MHZ, 8 }, { 4, 1 * MHZ, 16 }, { 4, 1 * MHZ, 8 } },
+        .count = 3,
+        .expected = { .setmode = 1, .setbits = 3, .setfrequency = 1,
+                      .selects = 1, .exchanges = 3 },
+    }, {
+        .name = "chip select change",
+        .descs = {
+            { 8, 1 * MHZ, 8 }, { 8, 1 * MHZ, 8, 0, 1 }, { 8, 1 * MHZ, 8 },
+            { 8, 1 * MHZ, 8 },
+        },
+        .count = 4,
+        .expected = { .setmode = 1, .setbits = 1, .setfrequency = 1,
+                      .selects = 2, .exchanges = 2 },
+    }, {
+        .name = "delay",
+        .descs = { { 8, 1 * MHZ, 8, 10 }, { 8, 1 * MHZ, 8 }, { 8, 1 * MHZ, 8 } },
+        .count = 3,
+        .expected = { .setmode = 1, .setbits = 1, .setfrequency = 1,
+                      .selects = 1, .exchanges = 2 },
+    }, {
+        .name = "mode change",
+        .mode = 3,
+        .descs = { { 64, 1 * MHZ, 8 }, { 64, 1 * MHZ, 8 } },
+        .count = 2,
+        .expected = { .setmode = 1, .setbits = 1, .setfrequency = 1,
+                      .selects = 1, .exchanges = 1 },
+    },
+};
+
+static uint8_t request_buf[GB_MTU];
+static uint8_t response_buf[GB_MTU];
+static size_t response_len;
+static sem_t response_sem;
+
+static int test_send(unsigned int cport, const void *buf, size_t len)
+{
+    memcpy(response_buf, buf, MIN(len, sizeof(response_buf)));
+    response_len = len;
+    sem_post(&response_sem);
+    return 0;
+}
+
+static void test_noop(void)
+{
+}
+
+static int test_listen(unsigned int cport)
+{
+    return 0;
+}
+
+static void *test_alloc_buf(size_t size)
+{
+    return malloc(size);
+}
+
+static void test_free_buf(void *ptr)
+{
+    free(ptr);
+}
+
+static struct gb_transport_backend test_transport = {
+    .init = test_noop,
+    .exit = test_noop,
+    .listen = test_listen,
+    .stop_listening = test_listen,
+    .send = test_send,
+    .alloc_buf = test_alloc_buf,
+    .free_buf = test_free_buf,
+};
+
+static int wait_response(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += RESPONSE_TIMEOUT_SEC;
+
+    while (sem_timedwait(&response_sem, &ts)) {
+        if (errno != EINTR)
+            return -errno;
+    }
+
+    return 0;
+}
+
+static int check_stats(const struct test_case *test,
+                       const struct mock_spi_stats *stats)
+{
+    const struct mock_spi_stats *expected = &test->expected;
+
+    if (!memcmp(stats, expected, sizeof(*stats)))
+        return 0;
+
+    fprintf(stderr, "%s: device activity "
+            "mode %u bits %u frequency %u selects %u exchanges %u "
+            "unselected %u, expected %u %u %u %u %u %u\n", test->name,
+            stats->setmode, stats->setbits, stats->setfrequency,
+            stats->selects, stats->exchanges, stats->unselected,
+            expected->setmode, expected->setbits, expected->setfrequency,
+            expected->selects, expected->exchanges, expected->unselected);
+    return -1;
+}
+
+static int run_test(const struct test_case *test, uint16_t id)
+{
+    struct gb_operation_hdr *hdr = (struct gb_operation_hdr *) request_buf;
+    struct gb_operation_hdr *resp_hdr =
+        (struct gb_operation_hdr *) response_buf;
+    struct gb_spi_transfer_request *req = (void *) (hdr + 1);
+    struct mock_spi_stats stats;
+    const struct test_desc *desc;
+    const uint8_t *tx, *rx;
+    uint8_t *write_data;
+    size_t size = 0;
+    size_t len;
+    uint32_t i;
+    int d;
+
+    req->chip_select = 0;
+    req->mode = test->mode;
+    req->count = cpu_to_le16(test->count);
+    write_data = (uint8_t *) &req->transfers[test->count];
+
+    for (d = 0; d < test->count; d++) {
+        desc = &test->descs[d];
+        req->transfers[d].speed_hz = cpu_to_le32(desc->speed_hz);
+        req->transfers[d].len = cpu_to_le32(desc->len);
+        req->transfers[d].delay_usecs = cpu_to_le16(desc->delay_usecs);
+        req->transfers[d].cs_change = desc->cs_change;
+        req->transfers[d].bits_per_word = desc->bits_per_word;
+        for (i = 0; i < desc->len; i++, size++)
+            write_data[size] = size * 7 + id;
+    }
+
+    len = write_data + size - request_buf;
+    hdr->size = cpu_to_le16(len);
+    hdr->id = cpu_to_le16(id);
+    hdr->type = GB_SPI_PROTOCOL_TRANSFER;
+    hdr->result = 0;
+
+    mock_spi_reset_stats();
+
+    if (greybus_rx_handler(TEST_CPORT, request_buf, len)) {
+        fprintf(stderr, "%s: request rejected\n", test->name);
+        return -1;
+    }
+
+    if (wait_response()) {
+        fprintf(stderr, "%s: no response\n", test->name);
+        return -1;
+    }
+
+    if (resp_hdr->result || le16_to_cpu(resp_hdr->id) != id ||
+        response_len != sizeof(*resp_hdr) + size) {
+        fprintf(stderr, "%s: bad response, result %u, %zu bytes\n",
+                test->name, resp_hdr->result, response_len);
+        return -1;
+    }
+
+    /* check each byte against the settings of its descriptor */
+    tx = write_data;
+    rx = (const uint8_t *) (resp_hdr + 1);
+    for (d = 0; d < test->count; d++) {
+        desc = &test->descs[d];
+        for (i = 0; i < desc->len; i++, tx++, rx++) {
+            if (*rx != mock_spi_answer(*tx, test->mode, desc->bits_per_word,
+                                       desc->speed_hz)) {
+                fprintf(stderr, "%s: descriptor %d byte %u: read 0x%02x\n",
+                        test->name, d, i, *rx);
+                return -1;
+            }
+        }
+    }
+
+    mock_spi_get_stats(&stats);
+    return check_stats(test, &stats);
+}
+
+int main(int argc, char **argv)
+{
+    int failed = 0;
+    int retval;
+    int i;
+
+    sem_init(&response_sem, 0, 0);
+
+    retval = host_init();
+    if (retval) {
+        fprintf(stderr, "cannot start the watchdog thread\n");
+        return EXIT_FAILURE;
+    }
+
+    gb_init(&test_transport);
+    gb_spi_register(TEST_CPORT);
+
+    for (i = 0; i < ARRAY_SIZE(test_cases); i++) {
+        retval = run_test(&test_cases[i], i + 1);
+        printf("%s: %s\n", test_cases[i].name, retval ? "FAIL" : "ok");
+        failed += !!retval;
+    }
+
+    gb_deinit();
+    host_exit();
+    sem_destroy(&response_sem);
+
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,948 @@
+/*
+ * Copyright (c) 2016 Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Register-model test of the I2S DMA transfer module (tsb_i2s_xfer_dma.c).
+ *
+ * The module is built for the host against a model of the pieces it drives:
+ * the SO/SI blocks (INTSTAT, INTMASK, a 64-word FIFO drained by the speaker
+ * or filled by the microphone one word per tick) and a GDMAC that moves a
+ * few words per tick between memory and a FIFO while the block's DMA request
+ * is unmasked.  Completed operations are reported from a "DMA thread" run
+ * from the main loop after each tick, as tsb_dma.c does on target.
+ *
+ * Every test streams sequence numbers through a ring of buffers and checks
+ * the ring walk: data order, one callback per entry, at most two operations
+ * per channel, no register access on the data path, the underrun/overrun
+ * counters and the handling of operations still in flight across a stop.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#include <nuttx/device.h>
+#include <nuttx/device_dma.h>
+#include <nuttx/device_i2s.h>
+#include <nuttx/ring_buf.h>
+
+#include "tsb_i2s.h"
+#include "tsb_i2s_xfer.h"
+
+#define FIFO_WORDS              64
+#define DMA_WORDS_PER_TICK      4
+#define DMA_MAX_CHANS           4
+#define DMA_MAX_QUEUE           8
+
+#define ENTRY_WORDS             48
+#define ENTRY_BYTES             (ENTRY_WORDS * sizeof(uint32_t))
+
+#define SO_BASE                 0x1000
+#define SI_BASE                 0x2000
+
+#define MAX_WORDS               (1 << 16)
+
+#define CHECK(cond)                                                         \
+    do {                                                                    \
+        if (!(cond)) {                                                      \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __func__,          \
+                    __LINE__, #cond);                                       \
+            exit(1);                                                        \
+        }                                                                   \
+    } while (0)
+
+/* Register model */
+
+struct model_block {
+    uint32_t            intstat;
+    uint32_t            intmask;
+    bool                started;
+    bool                primed;
+    uint32_t            fifo[FIFO_WORDS];
+    unsigned int        head;
+    unsigned int        count;
+    unsigned int        xruns;
+};
+
+static struct model_block so_blk;
+static struct model_block si_blk;
+static unsigned long reg_reads;
+static unsigned long reg_writes;
+
+int host_irq_depth;
+
+struct device *saved_dev;
+
+static struct model_block *model_block(enum tsb_i2s_block block)
+{
+    CHECK(block == TSB_I2S_BLOCK_SO || block == TSB_I2S_BLOCK_SI);
+
+    return block == TSB_I2S_BLOCK_SO ? &so_blk : &si_blk;
+}
+
+static void fifo_push(struct model_block *b, uint32_t word)
+{
+    b->fifo[(b->head + b->count++) % FIFO_WORDS] = word;
+}
+
+static uint32_t fifo_pop(struct model_block *b)
+{
+    uint32_t word = b->fifo[b->head];
+
+    b->head = (b->head + 1) % FIFO_WORDS;
+    b->count--;
+
+    return word;
+}
+
+uint32_t tsb_i2s_read_raw(struct tsb_i2s_info *info,
+                          enum tsb_i2s_block block, unsigned int reg)
+{
+    struct model_block *b = model_block(block);
+
+    reg_reads++;
+
+    switch (reg) {
+    case TSB_I2S_REG_INTSTAT:
+        return b->intstat;
+    case TSB_I2S_REG_INTMASK:
+        return b->intmask;
+    default:
+        return 0;
+    }
+}
+
+uint32_t tsb_i2s_read(struct tsb_i2s_info *info,
+                      enum tsb_i2s_block block, unsigned int reg)
+{
+    return tsb_i2s_read_raw(info, block, reg);
+}
+
+void tsb_i2s_write_raw(struct tsb_i2s_info *info, enum tsb_i2s_block block,
+                       unsigned int reg, uint32_t val)
+{
+    model_block(block);
+    reg_writes++;
+}
+
+void tsb_i2s_clear_irqs(struct tsb_i2s_info *info, enum tsb_i2s_block block,
+                        uint32_t mask)
+{
+    model_block(block)->intstat &= ~mask;
+    reg_writes++;
+}
+
+void tsb_i2s_mask_irqs(struct tsb_i2s_info *info, enum tsb_i2s_block block,
+                       uint32_t mask)
+{
+    model_block(block)->intmask |= mask;
+    reg_writes++;
+}
+
+void tsb_i2s_unmask_irqs(struct tsb_i2s_info *info, enum tsb_i2s_block block,
+                         uint32_t mask)
+{
+    model_block(block)->intmask &= ~mask;
+    reg_writes++;
+}
+
+enum device_i2s_event tsb_i2s_intstat2event(uint32_t intstat)
+{
+    if (intstat & TSB_I2S_REG_INT_OR)
+        return DEVICE_I2S_EVENT_OVERRUN;
+    if (intstat & TSB_I2S_REG_INT_UR)
+        return DEVICE_I2S_EVENT_UNDERRUN;
+
+    return DEVICE_I2S_EVENT_NONE;
+}
+
+int tsb_i2s_rx_is_active(struct tsb_i2s_info *info)
+{
+    return !!(info->flags & TSB_I2S_FLAG_RX_ACTIVE);
+}
+
+int tsb_i2s_tx_is_active(struct tsb_i2s_info *info)
+{
+    return !!(info->flags & TSB_I2S_FLAG_TX_ACTIVE);
+}
+
+int tsb_i2s_start(struct tsb_i2s_info *info, enum tsb_i2s_block block)
+{
+    struct model_block *b = model_block(block);
+
+    b->started = true;
+    b->primed = false;
+
+    return 0;
+}
+
+void tsb_i2s_stop(struct tsb_i2s_info *info, enum tsb_i2s_block block,
+                  int is_err)
+{
+    struct model_block *b = model_block(block);
+
+    b->started = false;
+    b->head = 0;
+    b->count = 0;
+}
+
+/* GDMAC model */
+
+enum model_op_state {
+    MODEL_OP_IDLE,
+    MODEL_OP_QUEUED,
+    MODEL_OP_RUNNING,
+    MODEL_OP_COMPLETING,
+    MODEL_OP_COMPLETED,
+};
+
+struct model_op {
+    enum model_op_state state;
+    size_t              done;
+    struct device_dma_op op;
+};
+
+struct model_chan {
+    bool                allocated;
+    struct device_dma_params params;
+    struct model_op     *queue[DMA_MAX_QUEUE];
+    unsigned int        count;
+    unsigned int        max_count;
+    unsigned int        started;
+};
+
+static struct model_chan dma_chans[DMA_MAX_CHANS];
+static struct model_op *dma_completed[DMA_MAX_CHANS * DMA_MAX_QUEUE];
+static unsigned int dma_completed_count;
+static unsigned int dma_callbacks;
+
+static struct model_op *model_op(struct device_dma_op *op)
+{
+    return (struct model_op *)((char *)op - offsetof(struct model_op, op));
+}
+
+static int model_dma_chan_alloc(struct device *dev,
+                                struct device_dma_params *params, void **chanp)
+{
+    unsigned int i;
+
+    for (i = 0; i < DMA_MAX_CHANS; i++) {
+        if (!dma_chans[i].allocated) {
+            memset(&dma_chans[i], 0, sizeof(dma_chans[i]));
+            dma_chans[i].allocated = true;
+            dma_chans[i].params = *params;
+            *chanp = &dma_chans[i];
+            return 0;
+        }
+    }
+
+    return -ENOMEM;
+}
+
+static int model_dma_chan_free(struct device *dev, void *chan)
+{
+    struct model_chan *c = chan;
+
+    if (c->count)
+        return -EIO;
+
+    c->allocated = false;
+
+    return 0;
+}
+
+static int model_dma_op_alloc(struct device *dev, unsigned int sg_count,
+                              unsigned int extra, struct device_dma_op **opp)
+{
+    struct model_op *mop;
+
+    mop = calloc(1, sizeof(*mop) + sg_count * sizeof(struct device_dma_sg) +
+                    extra);
+    if (!mop)
+        return -ENOMEM;
+
+    *opp = &mop->op;
+
+    return 0;
+}
+
+static int model_dma_op_free(struct device *dev, struct device_dma_op *op)
+{
+    struct model_op *mop = model_op(op);
+
+    if ((mop->state != MODEL_OP_IDLE) && (mop->state != MODEL_OP_COMPLETED))
+        return -EINVAL;
+
+    free(mop);
+
+    return 0;
+}
+
+static int model_dma_op_get_error(struct device *dev, struct device_dma_op *op,
+                                  enum device_dma_error *error)
+{
+    *error = DEVICE_DMA_ERROR_NONE;
+
+    return 0;
+}
+
+static int model_dma_enqueue(struct device *dev, void *chan,
+                             struct device_dma_op *op)
+{
+    struct model_chan *c = chan;
+    struct model_op *mop = model_op(op);
+
+    if ((mop->state != MODEL_OP_IDLE) && (mop->state != MODEL_OP_COMPLETED))
+        return -EBUSY;
+
+    CHECK(c->count < DMA_MAX_QUEUE);
+    CHECK(op->sg_count == 1);
+    CHECK(op->sg[0].len && !(op->sg[0].len % sizeof(uint32_t)));
+
+    mop->state = MODEL_OP_QUEUED;
+    mop->done = 0;
+    c->queue[c->count++] = mop;
+
+    if (c->count > c->max_count)
+        c->max_count = c->count;
+
+    return 0;
+}
+
+static int model_dma_dequeue(struct device *dev, void *chan,
+                             struct device_dma_op *op)
+{
+    struct model_chan *c = chan;
+    struct model_op *mop = model_op(op);
+    unsigned int i;
+
+    /* Started ops are aborted like tsb_dma.c does, completed ones are gone */
+    if ((mop->state != MODEL_OP_QUEUED) && (mop->state != MODEL_OP_RUNNING))
+        return -EIO;
+
+    for (i = 0; i < c->count; i++) {
+        if (c->queue[i] == mop) {
+            memmove(&c->queue[i], &c->queue[i + 1],
+                    (c->count - i - 1) * sizeof(c->queue[0]));
+            c->count--;
+            mop->state = MODEL_OP_IDLE;
+            return 0;
+        }
+    }
+
+    return -EIO;
+}
+
+static struct device_dma_type_ops model_dma_type_ops = {
+    .chan_alloc     = model_dma_chan_alloc,
+    .chan_free      = model_dma_chan_free,
+    .op_alloc       = model_dma_op_alloc,
+    .op_free        = model_dma_op_free,
+    .op_get_error   = model_dma_op_get_error,
+    .enqueue        = model_dma_enqueue,
+    .dequeue        = model_dma_dequeue,
+};
+
+static struct device_driver_ops model_dma_driver_ops = {
+    .type_ops       = &model_dma_type_ops,
+};
+
+static struct device_driver model_dma_driver = {
+    .type           = DEVICE_TYPE_DMA_HW,
+    .name           = "model_dma",
+    .ops            = &model_dma_driver_ops,
+};
+
+static struct device model_dma_dev = {
+    .type           = DEVICE_TYPE_DMA_HW,
+    .name           = "model_dma",
+    .state          = DEVICE_STATE_PROBED,
+    .driver         = &model_dma_driver,
+};
+
+struct device *device_open(char *type, unsigned int id)
+{
+    if (strcmp(type, DEVICE_TYPE_DMA_HW) || id ||
+        (model_dma_dev.state != DEVICE_STATE_PROBED))
+        return NULL;
+
+    model_dma_dev.state = DEVICE_STATE_OPEN;
+
+    return &model_dma_dev;
+}
+
+void device_close(struct device *dev)
+{
+    if (dev)
+        dev->state = DEVICE_STATE_PROBED;
+}
+
+void *zalloc(size_t size)
+{
+    return calloc(1, size);
+}
+
+/* Moves up to DMA_WORDS_PER_TICK words for the operation at each queue head */
+static void model_dma_tick(void)
+{
+    struct model_chan *c;
+    struct model_op *mop;
+    struct device_dma_sg *sg;
+    struct model_block *b;
+    unsigned int i, w;
+
+    for (i = 0; i < DMA_MAX_CHANS; i++) {
+        c = &dma_chans[i];
+        if (!c->allocated || !c->count)
+            continue;
+
+        mop = c->queue[0];
+        if (mop->state == MODEL_OP_QUEUED) {
+            mop->state = MODEL_OP_RUNNING;
+            c->started++;
+        }
+        sg = &mop->op.sg[0];
+
+        for (w = 0; (w < DMA_WORDS_PER_TICK) && (mop->done < sg->len); w++) {
+            if (c->params.dst_dev == DEVICE_DMA_DEV_IO) {
+                CHECK(sg->dst_addr == SO_BASE + TSB_I2S_REG_LMEM00);
+                b = &so_blk;
+                if ((b->intmask & TSB_I2S_REG_INT_DMACMSK) ||
+                    (b->count == FIFO_WORDS))
+                    break;
+                fifo_push(b, *(uint32_t *)(sg->src_addr + mop->done));
+            } else {
+                CHECK(sg->src_addr == SI_BASE + TSB_I2S_REG_LMEM00);
+                b = &si_blk;
+                if ((b->intmask & TSB_I2S_REG_INT_DMACMSK) || !b->count)
+                    break;
+                *(uint32_t *)(sg->dst_addr + mop->done) = fifo_pop(b);
+            }
+
+            mop->done += sizeof(uint32_t);
+        }
+
+        if (mop->done == sg->len) {
+            memmove(&c->queue[0], &c->queue[1],
+                    (c->count - 1) * sizeof(c->queue[0]));
+            c->count--;
+            mop->state = MODEL_OP_COMPLETING;
+            dma_completed[dma_completed_count++] = mop;
+        }
+    }
+}
+
+/* What the DMA irq_thread does on target: report completions in order */
+static void model_dma_thread(void)
+{
+    struct model_op *mop;
+    unsigned int i;
+
+    for (i = 0; i < dma_completed_count; i++) {
+        mop = dma_completed[i];
+        mop->state = MODEL_OP_COMPLETED;
+        dma_callbacks++;
+
+        CHECK(host_irq_depth == 0);
+        mop->op.callback(&model_dma_dev, NULL, &mop->op,
+                         DEVICE_DMA_CALLBACK_EVENT_COMPLETE,
+                         mop->op.callback_arg);
+    }
+
+    dma_completed_count = 0;
+}
+
+static struct model_chan *model_dma_find_chan(enum device_dma_dev dst_dev)
+{
+    unsigned int i;
+
+    for (i = 0; i < DMA_MAX_CHANS; i++)
+        if (dma_chans[i].allocated && (dma_chans[i].params.dst_dev == dst_dev))
+            return &dma_chans[i];
+
+    return NULL;
+}
+
+/* Audio side: the speaker drains SO, the microphone fills SI */
+
+static uint32_t played[MAX_WORDS];
+static unsigned int played_count;
+static uint32_t mic_seq;
+
+static void model_audio_tick(void)
+{
+    if (so_blk.started) {
+        if (!so_blk.primed && (so_blk.count >= TSB_I2S_TX_START_THRESHOLD))
+            so_blk.primed = true;
+
+        if (so_blk.primed) {
+            if (so_blk.count) {
+                CHECK(played_count < MAX_WORDS);
+                played[played_count++] = fifo_pop(&so_blk);
+            } else {
+                so_blk.intstat |= TSB_I2S_REG_INT_UR;
+                so_blk.xruns++;
+            }
+        }
+    }
+
+    if (si_blk.started) {
+        if (si_blk.count == FIFO_WORDS) {
+            si_blk.intstat |= TSB_I2S_REG_INT_OR;
+            si_blk.xruns++;
+            mic_seq++;
+        } else {
+            fifo_push(&si_blk, mic_seq++);
+        }
+    }
+}
+
+static void tick(void)
+{
+    model_dma_tick();
+    model_audio_tick();
+    model_dma_thread();
+    CHECK(host_irq_depth == 0);
+}
+
+/* I2S device user */
+
+static struct tsb_i2s_info info;
+static struct ring_buf *app_rb;
+static uint32_t app_seq;
+static unsigned int app_completes;
+static enum device_i2s_event app_last_event;
+static bool app_hold_rx;
+static unsigned int app_gaps;
+
+static void app_callback(struct ring_buf *rb, enum device_i2s_event event,
+                         void *arg)
+{
+    uint32_t *dp;
+    unsigned int i;
+
+    if ((event != DEVICE_I2S_EVENT_TX_COMPLETE) &&
+        (event != DEVICE_I2S_EVENT_RX_COMPLETE)) {
+        app_last_event = event;
+        return;
+    }
+
+    app_completes++;
+
+    if (event == DEVICE_I2S_EVENT_TX_COMPLETE) {
+        CHECK(ring_buf_is_producers(rb) && ring_buf_is_empty(rb));
+        return;
+    }
+
+    CHECK(ring_buf_is_consumers(rb) && (ring_buf_len(rb) == ENTRY_BYTES));
+
+    dp = ring_buf_get_head(rb);
+    for (i = 0; i < ENTRY_WORDS; i++, app_seq++) {
+        if (dp[i] != app_seq) {
+            CHECK(dp[i] > app_seq);
+            app_gaps++;
+            app_seq = dp[i];
+        }
+    }
+
+    /* Hand the entry straight back like the Greybus audio driver does */
+    if (!app_hold_rx) {
+        ring_buf_reset(rb);
+        ring_buf_pass(rb);
+    }
+}
+
+/* Fill every free TX entry, as a Greybus audio stream would, and kick */
+static int app_tx_fill(unsigned int max_entries)
+{
+    unsigned int n;
+    uint32_t *dp;
+    unsigned int i;
+
+    for (n = 0; (n < max_entries) && ring_buf_is_producers(app_rb); n++) {
+        dp = ring_buf_get_tail(app_rb);
+        for (i = 0; i < ENTRY_WORDS; i++)
+            dp[i] = app_seq++;
+
+        ring_buf_put(app_rb, ENTRY_BYTES);
+        ring_buf_pass(app_rb);
+        app_rb = ring_buf_get_next(app_rb);
+    }
+
+    if (n)
+        return tsb_i2s_start_transmitter(&info);
+
+    return 0;
+}
+
+static void check_played(unsigned int from, uint32_t first)
+{
+    unsigned int i;
+
+    for (i = from; i < played_count; i++)
+        CHECK(played[i] == first + (i - from));
+}
+
+static void setup(unsigned int entries, bool tx)
+{
+    memset(&so_blk, 0, sizeof(so_blk));
+    memset(&si_blk, 0, sizeof(si_blk));
+    so_blk.intmask = si_blk.intmask = 0xffffffff;
+    reg_reads = reg_writes = 0;
+    dma_callbacks = 0;
+    played_count = 0;
+    mic_seq = 0;
+
+    memset(&info, 0, sizeof(info));
+    info.so_base = SO_BASE;
+    info.si_base = SI_BASE;
+
+    app_rb = ring_buf_alloc_ring(entries, 0, ENTRY_BYTES, 0, NULL, NULL, NULL);
+    CHECK(app_rb);
+    app_seq = 0;
+    app_completes = 0;
+    app_last_event = DEVICE_I2S_EVENT_NONE;
+    app_hold_rx = false;
+    app_gaps = 0;
+
+    if (tx) {
+        info.tx_rb = app_rb;
+        info.tx_callback = app_callback;
+        info.flags = TSB_I2S_FLAG_TX_PREPARED;
+        CHECK(!tsb_i2s_xfer_prepare_transmitter(&info));
+    } else {
+        info.rx_rb = app_rb;
+        info.rx_callback = app_callback;
+        info.flags = TSB_I2S_FLAG_RX_PREPARED;
+        CHECK(!tsb_i2s_xfer_prepare_receiver(&info));
+    }
+}
+
+static void teardown(bool tx, struct ring_buf *ring)
+{
+    if (tx) {
+        if (tsb_i2s_tx_is_active(&info))
+            tsb_i2s_stop_transmitter(&info, 0);
+        tsb_i2s_xfer_shutdown_transmitter(&info);
+    } else {
+        if (tsb_i2s_rx_is_active(&info))
+            tsb_i2s_stop_receiver(&info, 0);
+        tsb_i2s_xfer_shutdown_receiver(&info);
+    }
+
+    ring_buf_free_ring(ring, NULL, NULL);
+}
+
+static void test_tx_stream(void)
+{
+    struct ring_buf *ring;
+    struct model_chan *chan;
+    unsigned int t;
+
+    setup(4, true);
+    ring = app_rb;
+
+    CHECK(!app_tx_fill(4));
+    CHECK(tsb_i2s_tx_is_active(&info));
+    CHECK(!(so_blk.intmask & TSB_I2S_REG_INT_DMACMSK));
+    CHECK(so_blk.intmask & TSB_I2S_REG_INT_INT);
+
+    chan = model_dma_find_chan(DEVICE_DMA_DEV_IO);
+    CHECK(chan);
+
+    for (t = 0; t < 200 * ENTRY_WORDS; t++) {
+        tick();
+        CHECK(!app_tx_fill(4));
+    }
+
+    CHECK(app_completes >= 190);
+    CHECK(dma_callbacks == app_completes);
+    CHECK(chan->max_count == 2);
+    CHECK(so_blk.xruns == 0);
+    CHECK(info.tx_underruns == 0);
+    CHECK(reg_reads == 0);
+    check_played(0, 0);
+
+    printf("tx stream: %u entries of %u words, %u played, %u callbacks, "
+           "%lu register writes, max %u ops queued\n", app_completes,
+           (unsigned int)ENTRY_WORDS, played_count, dma_callbacks, reg_writes,
+           chan->max_count);
+
+    teardown(true, ring);
+}
+
+static void test_tx_underrun(void)
+{
+    struct ring_buf *ring;
+    unsigned int t, resume;
+
+    setup(4, true);
+    ring = app_rb;
+
+    CHECK(!app_tx_fill(3));
+
+    /* The producer stalls long enough for the FIFO to run dry */
+    for (t = 0; t < 5 * ENTRY_WORDS; t++)
+        tick();
+
+    CHECK(app_completes == 3);
+    CHECK(info.tx_underruns == 1);
+    CHECK(so_blk.xruns > 0);
+    resume = played_count;
+
+    for (t = 0; t < 20 * ENTRY_WORDS; t++) {
+        CHECK(!app_tx_fill(4));
+        tick();
+    }
+
+    CHECK(info.tx_underruns == 1);
+    CHECK(app_completes > 15);
+    check_played(0, 0);
+    CHECK(played_count > resume);
+
+    printf("tx underrun: counted %u, stream resumed with %u words in order\n",
+           info.tx_underruns, played_count - resume);
+
+    teardown(true, ring);
+}
+
+static void test_tx_single_entry(void)
+{
+    struct ring_buf *ring;
+    struct model_chan *chan;
+    unsigned int t;
+
+    setup(1, true);
+    ring = app_rb;
+
+    for (t = 0; t < 20 * ENTRY_WORDS; t++) {
+        CHECK(!app_tx_fill(1));
+        tick();
+    }
+
+    chan = model_dma_find_chan(DEVICE_DMA_DEV_IO);
+    CHECK(chan->max_count == 1);
+    CHECK(app_completes >= 10);
+    check_played(0, 0);
+
+    printf("tx single entry ring: %u entries, never more than one op queued\n",
+           app_completes);
+
+    teardown(true, ring);
+}
+
+static void test_tx_stop(void)
+{
+    struct ring_buf *ring;
+    struct model_chan *chan;
+    unsigned int t;
+
+    setup(4, true);
+    ring = app_rb;
+
+    CHECK(!app_tx_fill(4));
+    for (t = 0; t < ENTRY_WORDS / 2; t++)
+        tick();
+
+    /* Stop with one op transferring and one queued behind it */
+    chan = model_dma_find_chan(DEVICE_DMA_DEV_IO);
+    CHECK(chan->count == 2);
+    CHECK(chan->queue[0]->state == MODEL_OP_RUNNING);
+    tsb_i2s_stop_transmitter(&info, 0);
+    CHECK(so_blk.intmask & TSB_I2S_REG_INT_DMACMSK);
+    CHECK(chan->count == 0);
+
+    tsb_i2s_xfer_shutdown_transmitter(&info);
+    CHECK(!chan->allocated);
+    CHECK(model_dma_dev.state == DEVICE_STATE_PROBED);
+
+    printf("tx stop: started and queued ops dequeued, channel released\n");
+
+    teardown(true, ring);
+}
+
+static void test_tx_restart(void)
+{
+    struct ring_buf *ring;
+    struct model_chan *chan;
+    unsigned int t, callbacks, from;
+
+    setup(4, true);
+    ring = app_rb;
+
+    /* Stop after the first op completed but before its callback ran */
+    CHECK(!app_tx_fill(4));
+    while (!dma_completed_count) {
+        model_dma_tick();
+        model_audio_tick();
+    }
+
+    chan = model_dma_find_chan(DEVICE_DMA_DEV_IO);
+    tsb_i2s_stop_transmitter(&info, 0);
+    CHECK(chan->count == 0);
+
+    /* Its channel has to outlive the stream */
+    tsb_i2s_xfer_shutdown_transmitter(&info);
+    CHECK(chan->allocated);
+
+    callbacks = dma_callbacks;
+    model_dma_thread();
+    CHECK(dma_callbacks == callbacks + 1);
+    CHECK(app_completes == 0);
+
+    /* The next stream reuses it and starts over from the same entry */
+    CHECK(!tsb_i2s_xfer_prepare_transmitter(&info));
+    CHECK(model_dma_find_chan(DEVICE_DMA_DEV_IO) == chan);
+
+    from = played_count;
+    CHECK(!tsb_i2s_start_transmitter(&info));
+    for (t = 0; t < 20 * ENTRY_WORDS; t++) {
+        tick();
+        CHECK(!app_tx_fill(4));
+    }
+
+    CHECK(app_completes > 15);
+    CHECK(info.tx_underruns == 0);
+    check_played(from, 0);
+
+    printf("tx restart: stale completion retired, %u entries after restart\n",
+           app_completes);
+
+    teardown(true, ring);
+    CHECK(!chan->allocated);
+    CHECK(model_dma_dev.state == DEVICE_STATE_PROBED);
+}
+
+static void test_tx_data_len(void)
+{
+    struct ring_buf *ring;
+
+    setup(2, true);
+    ring = app_rb;
+
+    ring_buf_put(app_rb, 6);
+    ring_buf_pass(app_rb);
+
+    CHECK(tsb_i2s_start_transmitter(&info) == -EINVAL);
+    CHECK(app_last_event == DEVICE_I2S_EVENT_DATA_LEN);
+    CHECK(!tsb_i2s_tx_is_active(&info));
+    CHECK(model_dma_find_chan(DEVICE_DMA_DEV_IO)->count == 0);
+
+    printf("tx data length: rejected with DEVICE_I2S_EVENT_DATA_LEN\n");
+
+    teardown(true, ring);
+}
+
+static void test_rx_stream(void)
+{
+    struct ring_buf *ring;
+    struct model_chan *chan;
+    unsigned int t;
+
+    setup(4, false);
+    ring = app_rb;
+
+    CHECK(!tsb_i2s_start_receiver(&info));
+    CHECK(tsb_i2s_rx_is_active(&info));
+    CHECK(!(si_blk.intmask & TSB_I2S_REG_INT_DMACMSK));
+
+    chan = model_dma_find_chan(DEVICE_DMA_DEV_MEM);
+    CHECK(chan);
+
+    for (t = 0; t < 200 * ENTRY_WORDS; t++)
+        tick();
+
+    CHECK(app_completes >= 190);
+    CHECK(dma_callbacks == app_completes);
+    CHECK(chan->max_count == 2);
+    CHECK(app_gaps == 0);
+    CHECK(si_blk.xruns == 0);
+    CHECK(info.rx_overruns == 0);
+    CHECK(reg_reads == 0);
+
+    printf("rx stream: %u entries of %u words in order, %u callbacks\n",
+           app_completes, (unsigned int)ENTRY_WORDS, dma_callbacks);
+
+    teardown(false, ring);
+}
+
+static void test_rx_overrun(void)
+{
+    struct ring_buf *ring, *rb;
+    unsigned int t, i;
+
+    setup(4, false);
+    ring = app_rb;
+
+    /* The consumer keeps every entry it is given */
+    app_hold_rx = true;
+    CHECK(!tsb_i2s_start_receiver(&info));
+
+    for (t = 0; t < 8 * ENTRY_WORDS; t++)
+        tick();
+
+    CHECK(app_completes == 4);
+    CHECK(info.rx_overruns == 1);
+    CHECK(si_blk.xruns > 0);
+
+    /* Give everything back and kick the receiver again */
+    app_hold_rx = false;
+    for (i = 0, rb = ring; i < 4; i++, rb = ring_buf_get_next(rb)) {
+        ring_buf_reset(rb);
+        ring_buf_pass(rb);
+    }
+    CHECK(!tsb_i2s_start_receiver(&info));
+
+    for (t = 0; t < 20 * ENTRY_WORDS; t++)
+        tick();
+
+    CHECK(app_completes > 20);
+    CHECK(app_gaps == 1);
+    CHECK(info.rx_overruns == 1);
+
+    printf("rx overrun: counted %u, stream resumed after one gap\n",
+           info.rx_overruns);
+
+    teardown(false, ring);
+}
+
+int main(int argc, char *argv[])
+{
+    test_tx_stream();
+    test_tx_underrun();
+    test_tx_single_entry();
+    test_tx_stop();
+    test_tx_restart();
+    test_tx_data_len();
+    test_rx_stream();
+    test_rx_overrun();
+
+    printf("all tests passed\n");
+
+    return 0;
+}
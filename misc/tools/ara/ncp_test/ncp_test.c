@@ -0,0 +1,506 @@
+/*
+ * Copyright (c) 2016 Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Switch NCP batch test
+ *
+ * Runs switch_ncp_batch_flush() against a fake switch that answers every
+ * request from an attribute table, and injects faults in chosen CNFs to
+ * check that:
+ * - each CNF is matched to its request and GET values reach the caller;
+ * - a CNF for another port or another function is a protocol error;
+ * - the first failing NCP resultCode is returned, the other CNFs are
+ *   still processed;
+ * - a full batch is flushed by the next request, and an error of that
+ *   flush is returned to it;
+ * - without a batch transfer op, the requests are sent one by one.
+ */
+
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <arch/byteorder.h>
+#include <nuttx/util.h>
+
+#include <ara_debug.h>
+
+#include "tsb_switch.h"
+
+#define TEST_ATTRS          64
+#define TEST_PORTS          4
+#define TEST_REQ_SIZE       8
+#define NO_FAULT            -1
+
+/* Request layout of the fake switch */
+struct __attribute__ ((__packed__)) test_req {
+    uint8_t function_id;
+    uint8_t portid;
+    uint16_t attrid;
+    uint32_t attr_val;
+};
+
+/* Same layout as the DME (peer) set/get CNFs */
+struct __attribute__ ((__packed__)) test_cnf {
+    uint8_t portid;
+    uint8_t function_id;
+    uint8_t reserved;
+    uint8_t rc;
+    uint32_t attr_val;
+};
+
+enum test_fault {
+    FAULT_PORT,
+    FAULT_FUNCTION,
+    FAULT_RC,
+};
+
+dbg_ctrl_t dbg_ctrl;
+
+/* Local and peer attributes of each port */
+static uint32_t attrs[2][TEST_PORTS][TEST_ATTRS];
+
+/* Requests answered since the last reset, faults are set by their index */
+static unsigned int requests;
+static int fault_index[2] = { NO_FAULT, NO_FAULT };
+static enum test_fault fault_kind[2];
+static uint8_t fault_rc[2];
+
+/* Transfers seen by the fake switch */
+static unsigned int batch_transfers;
+static unsigned int single_transfers;
+static unsigned int last_count;
+
+int lowsyslog(const char *fmt, ...)
+{
+    va_list ap;
+    int ret;
+
+    va_start(ap, fmt);
+    ret = vfprintf(stderr, fmt, ap);
+    va_end(ap);
+
+    return ret;
+}
+
+static void fill_req(uint8_t function_id, uint8_t portid, uint16_t attrid,
+                     uint32_t attr_value, uint8_t *req, size_t *req_size)
+{
+    struct test_req *r = (struct test_req *) req;
+
+    DEBUGASSERT(*req_size >= sizeof(*r));
+
+    r->function_id = function_id;
+    r->portid = portid;
+    r->attrid = cpu_to_be16(attrid);
+    r->attr_val = cpu_to_be32(attr_value);
+    *req_size = sizeof(*r);
+}
+
+static void test_set_req(struct tsb_switch *sw, uint8_t portid,
+                         uint16_t attrid, uint16_t select_index,
+                         uint32_t attr_value, uint8_t *req, size_t *req_size)
+{
+    fill_req(NCP_SETREQ, portid, attrid, attr_value, req, req_size);
+}
+
+static void test_get_req(struct tsb_switch *sw, uint8_t portid,
+                         uint16_t attrid, uint16_t select_index,
+                         uint8_t *req, size_t *req_size)
+{
+    fill_req(NCP_GETREQ, portid, attrid, 0, req, req_size);
+}
+
+static void test_peer_set_req(struct tsb_switch *sw, uint8_t portid,
+                              uint16_t attrid, uint16_t select_index,
+                              uint32_t attr_value,
+                              uint8_t *req, size_t *req_size)
+{
+    fill_req(NCP_PEERSETREQ, portid, attrid, attr_value, req, req_size);
+}
+
+static void test_peer_get_req(struct tsb_switch *sw, uint8_t portid,
+                              uint16_t attrid, uint16_t select_index,
+                              uint8_t *req, size_t *req_size)
+{
+    fill_req(NCP_PEERGETREQ, portid, attrid, 0, req, req_size);
+}
+
+/* Execute one request and write its CNF, faults included */
+static void answer(const uint8_t *req, uint8_t *cnf_buf, size_t cnf_size)
+{
+    const struct test_req *r = (const struct test_req *) req;
+    struct test_cnf cnf;
+    uint16_t attrid = be16_to_cpu(r->attrid);
+    bool peer = r->function_id == NCP_PEERSETREQ ||
+                r->function_id == NCP_PEERGETREQ;
+    uint32_t *attr;
+    unsigned int i;
+
+    DEBUGASSERT(r->portid < TEST_PORTS && attrid < TEST_ATTRS);
+    attr = &attrs[peer][r->portid][attrid];
+
+    memset(&cnf, 0, sizeof(cnf));
+    cnf.portid = r->portid;
+    cnf.function_id = r->function_id + 1;
+
+    for (i = 0; i < ARRAY_SIZE(fault_index); i++) {
+        if (fault_index[i] != requests) {
+            continue;
+        }
+
+        switch (fault_kind[i]) {
+        case FAULT_PORT:
+            cnf.portid = (r->portid + 1) % TEST_PORTS;
+            break;
+        case FAULT_FUNCTION:
+            cnf.function_id = NCP_LUTSETCNF;
+            break;
+        case FAULT_RC:
+            cnf.rc = fault_rc[i];
+            break;
+        }
+    }
+
+    if (!cnf.rc) {
+        if (r->function_id == NCP_SETREQ || r->function_id == NCP_PEERSETREQ)
+            *attr = be32_to_cpu(r->attr_val);
+        else
+            cnf.attr_val = cpu_to_be32(*attr);
+    }
+
+    DEBUGASSERT(cnf_size <= sizeof(cnf));
+    memcpy(cnf_buf, &cnf, cnf_size);
+    requests++;
+}
+
+static int test_ncp_transfer(struct tsb_switch *sw,
+                             uint8_t *tx_buf, size_t tx_size,
+                             uint8_t *rx_buf, size_t rx_size)
+{
+    single_transfers++;
+    answer(tx_buf, rx_buf, rx_size);
+    return 0;
+}
+
+static int test_ncp_batch_transfer(struct tsb_switch *sw,
+                                   struct switch_ncp_batch *batch,
+                                   unsigned int count)
+{
+    unsigned int i;
+
+    batch_transfers++;
+    last_count = count;
+
+    for (i = 0; i < count; i++) {
+        struct switch_ncp_cmd *cmd = &batch->cmds[i];
+
+        if (cmd->req_size != TEST_REQ_SIZE)
+            return -EINVAL;
+        answer(cmd->req, cmd->cnf, cmd->cnf_size);
+    }
+
+    return 0;
+}
+
+static struct tsb_switch_ops test_ops = {
+    .set_req = test_set_req,
+    .get_req = test_get_req,
+    .peer_set_req = test_peer_set_req,
+    .peer_get_req = test_peer_get_req,
+    .__ncp_transfer = test_ncp_transfer,
+    .__ncp_batch_transfer = test_ncp_batch_transfer,
+};
+
+static struct tsb_switch test_switch = {
+    .ops = &test_ops,
+};
+
+static void reset(void)
+{
+    memset(attrs, 0, sizeof(attrs));
+    requests = 0;
+    fault_index[0] = fault_index[1] = NO_FAULT;
+    batch_transfers = single_transfers = last_count = 0;
+}
+
+static void inject(unsigned int slot, int index, enum test_fault kind,
+                   uint8_t rc)
+{
+    fault_index[slot] = index;
+    fault_kind[slot] = kind;
+    fault_rc[slot] = rc;
+}
+
+/* set, peer set, get and peer get of two attributes on two ports */
+static int queue_mixed(struct switch_ncp_batch *batch, uint32_t *values)
+{
+    return switch_ncp_batch_dme_set(batch, 1, 10, 0, 0x1111) ||
+           switch_ncp_batch_dme_peer_set(batch, 2, 20, 0, 0x2222) ||
+           switch_ncp_batch_dme_get(batch, 1, 10, 0, &values[0]) ||
+           switch_ncp_batch_dme_peer_get(batch, 2, 20, 0, &values[1]);
+}
+
+static int test_in_order(void)
+{
+    struct switch_ncp_batch batch;
+    uint32_t values[2] = { 0, 0 };
+    int rc;
+
+    reset();
+    switch_ncp_batch_init(&test_switch, &batch);
+
+    if (queue_mixed(&batch, values)) {
+        fprintf(stderr, "in order: cannot queue\n");
+        return -1;
+    }
+
+    rc = switch_ncp_batch_flush(&batch);
+    if (rc || values[0] != 0x1111 || values[1] != 0x2222) {
+        fprintf(stderr, "in order: rc=%d, values 0x%x 0x%x\n",
+                rc, values[0], values[1]);
+        return -1;
+    }
+
+    if (batch_transfers != 1 || last_count != 4 || batch.total != 4 ||
+        batch.bursts != 1 || batch.count) {
+        fprintf(stderr, "in order: %u transfers of %u, total %u, "
+                "bursts %u, count %u\n", batch_transfers, last_count,
+                batch.total, batch.bursts, batch.count);
+        return -1;
+    }
+
+    return 0;
+}
+
+static int test_mismatch(const char *name, enum test_fault kind)
+{
+    struct switch_ncp_batch batch;
+    uint32_t values[2] = { 0xdead, 0xdead };
+    int rc;
+
+    reset();
+    switch_ncp_batch_init(&test_switch, &batch);
+    /* the CNF of the first GET comes back wrong */
+    inject(0, 2, kind, 0);
+
+    if (queue_mixed(&batch, values)) {
+        fprintf(stderr, "%s: cannot queue\n", name);
+        return -1;
+    }
+
+    rc = switch_ncp_batch_flush(&batch);
+    if (rc != -EPROTO) {
+        fprintf(stderr, "%s: rc=%d, expected %d\n", name, rc, -EPROTO);
+        return -1;
+    }
+
+    /* nothing is taken from a CNF that may belong to another request */
+    if (values[0] != 0xdead || values[1] != 0xdead) {
+        fprintf(stderr, "%s: values 0x%x 0x%x were written\n", name,
+                values[0], values[1]);
+        return -1;
+    }
+
+    return 0;
+}
+
+static int test_port_mismatch(void)
+{
+    return test_mismatch("port mismatch", FAULT_PORT);
+}
+
+static int test_function_mismatch(void)
+{
+    return test_mismatch("function mismatch", FAULT_FUNCTION);
+}
+
+static int test_first_rc(void)
+{
+    struct switch_ncp_batch batch;
+    uint32_t values[2] = { 0, 0 };
+    int rc;
+
+    reset();
+    switch_ncp_batch_init(&test_switch, &batch);
+    /* the peer set and the peer get fail */
+    inject(0, 1, FAULT_RC, 5);
+    inject(1, 3, FAULT_RC, 7);
+
+    if (queue_mixed(&batch, values)) {
+        fprintf(stderr, "first rc: cannot queue\n");
+        return -1;
+    }
+
+    rc = switch_ncp_batch_flush(&batch);
+    if (rc != 5) {
+        fprintf(stderr, "first rc: rc=%d, expected 5\n", rc);
+        return -1;
+    }
+
+    /* the CNFs after the first failure are still checked and used */
+    if (values[0] != 0x1111 || values[1]) {
+        fprintf(stderr, "first rc: values 0x%x 0x%x\n", values[0],
+                values[1]);
+        return -1;
+    }
+
+    return 0;
+}
+
+static int test_auto_flush(void)
+{
+    struct switch_ncp_batch batch;
+    uint32_t value = 0;
+    unsigned int i;
+    int rc;
+
+    reset();
+    switch_ncp_batch_init(&test_switch, &batch);
+
+    for (i = 0; i < SWITCH_NCP_BATCH_MAX; i++) {
+        rc = switch_ncp_batch_dme_set(&batch, 0, i, 0, i + 1);
+        if (rc || batch_transfers) {
+            fprintf(stderr, "auto flush: set %u: rc=%d, %u transfers\n", i,
+                    rc, batch_transfers);
+            return -1;
+        }
+    }
+
+    /* no room left: the full batch goes out first */
+    rc = switch_ncp_batch_dme_get(&batch, 0, 0, 0, &value);
+    if (rc || batch_transfers != 1 || last_count != SWITCH_NCP_BATCH_MAX ||
+        batch.count != 1) {
+        fprintf(stderr, "auto flush: rc=%d, %u transfers of %u, count %u\n",
+                rc, batch_transfers, last_count, batch.count);
+        return -1;
+    }
+
+    rc = switch_ncp_batch_flush(&batch);
+    if (rc || value != 1 || batch_transfers != 2 || last_count != 1 ||
+        batch.total != SWITCH_NCP_BATCH_MAX + 1 || batch.bursts != 2) {
+        fprintf(stderr, "auto flush: rc=%d, value %u, %u transfers, "
+                "total %u, bursts %u\n", rc, value, batch_transfers,
+                batch.total, batch.bursts);
+        return -1;
+    }
+
+    return 0;
+}
+
+static int test_auto_flush_error(void)
+{
+    struct switch_ncp_batch batch;
+    unsigned int i;
+    int rc;
+
+    reset();
+    switch_ncp_batch_init(&test_switch, &batch);
+    inject(0, 3, FAULT_RC, 9);
+
+    for (i = 0; i < SWITCH_NCP_BATCH_MAX; i++) {
+        if (switch_ncp_batch_dme_set(&batch, 0, i, 0, i)) {
+            fprintf(stderr, "auto flush error: cannot queue\n");
+            return -1;
+        }
+    }
+
+    /* the request that triggered the flush gets its error */
+    rc = switch_ncp_batch_dme_set(&batch, 0, 0, 0, 0);
+    if (rc != 9 || batch.count) {
+        fprintf(stderr, "auto flush error: rc=%d, count %u\n", rc,
+                batch.count);
+        return -1;
+    }
+
+    return 0;
+}
+
+static int test_single_transfers(void)
+{
+    struct switch_ncp_batch batch;
+    uint32_t values[2] = { 0, 0 };
+    int rc;
+
+    reset();
+    test_ops.__ncp_batch_transfer = NULL;
+    switch_ncp_batch_init(&test_switch, &batch);
+
+    rc = queue_mixed(&batch, values);
+    if (!rc)
+        rc = switch_ncp_batch_flush(&batch);
+    test_ops.__ncp_batch_transfer = test_ncp_batch_transfer;
+
+    if (rc || values[0] != 0x1111 || values[1] != 0x2222) {
+        fprintf(stderr, "single transfers: rc=%d, values 0x%x 0x%x\n",
+                rc, values[0], values[1]);
+        return -1;
+    }
+
+    if (batch_transfers || single_transfers != 4 || batch.bursts != 4) {
+        fprintf(stderr, "single transfers: %u batch, %u single, "
+                "bursts %u\n", batch_transfers, single_transfers,
+                batch.bursts);
+        return -1;
+    }
+
+    return 0;
+}
+
+static const struct {
+    const char *name;
+    int (*run)(void);
+} tests[] = {
+    { "in order", test_in_order },
+    { "port mismatch", test_port_mismatch },
+    { "function mismatch", test_function_mismatch },
+    { "first rc", test_first_rc },
+    { "auto flush", test_auto_flush },
+    { "auto flush error", test_auto_flush_error },
+    { "single transfers", test_single_transfers },
+};
+
+int main(int argc, char **argv)
+{
+    int failed = 0;
+    int retval;
+    int i;
+
+    /* only the errors the tests expect would be printed */
+    dbg_ctrl.comp = 0;
+
+    for (i = 0; i < ARRAY_SIZE(tests); i++) {
+        retval = tests[i].run();
+        printf("%s: %s\n", tests[i].name, retval ? "FAIL" : "ok");
+        failed += !!retval;
+    }
+
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -111,6 +111,9 @@
 #define GDMAC_ID_REGS_ADDRESS       \
     (gdmac_resource_info.reg_base + GDMAC_ID_REGS_OFFSET)
 
+/* DBGSTATUS: the debug instruction is still executing */
+#define GDMAC_DBG_STATUS_BUSY       (1 << 0)
+
 /* Define PL330 events associated with each channel. */
 #define GDMAC_EVENT_MASK(event)              (1 << event)
 #define IRQN_TO_DMA_EVENT(irqn)              \
@@ -1932,6 +1935,43 @@ int gdmac_start_op(struct device *dev, struct tsb_dma_chan *tsb_chan,
     return retval;
 }
 
+int gdmac_abort_op(struct device *dev, struct tsb_dma_chan *tsb_chan)
+{
+    struct tsb_dma_gdmac_control_regs *control_regs =
+            (struct tsb_dma_gdmac_control_regs*) GDMAC_CONTROL_REGS_ADDRESS;
+    struct tsb_dma_gdmac_dbg_regs *dbg_regs =
+            (struct tsb_dma_gdmac_dbg_regs*) GDMAC_DBG_REGS_ADDRESS;
+    struct gdmac_chan *gdmac_chan =
+            containerof(tsb_chan, struct gdmac_chan, tsb_chan);
+    unsigned int index;
+    uint32_t value;
+
+    /* Kill the channel's thread, wherever its program is */
+    value = (DMAKILL << 16) | tsb_chan->chan_id << 8 | 0x01;
+    putreg32(value, &dbg_regs->dbg_inst_0);
+    putreg32(0, &dbg_regs->dbg_inst_1);
+
+    /* Get going */
+    putreg32(0, &dbg_regs->dbg_cmd);
+
+    while (getreg32(&dbg_regs->dbg_status) & GDMAC_DBG_STATUS_BUSY)
+        ;
+
+    /*
+     * The thread may have signaled the end of the aborted op just before it
+     * was killed. Drop that interrupt, or it would complete the next op
+     * started on the channel.
+     */
+    for (index = 0; index < GDMAC_NUMBER_OF_EVENTS; index++) {
+        if (gdmac_event_to_chan_map[index].dma_chan == gdmac_chan) {
+            putreg32(GDMAC_EVENT_MASK(index), &control_regs->intclr);
+            tsb_irq_clear_pending(GDMAC_EVENT_TO_IRQN(index));
+        }
+    }
+
+    return OK;
+}
+
 int gdmac_irq_abort_handler(int irq, void *context)
 {
     struct tsb_dma_gdmac_control_regs *control_regs =
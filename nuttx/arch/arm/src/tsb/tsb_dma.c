@@ -37,6 +37,7 @@
 #include <nuttx/arch.h>
 #include <nuttx/device.h>
 #include <nuttx/device_dma.h>
+#include <nuttx/hires_tmr.h>
 #include <nuttx/list.h>
 
 #include "debug.h"
@@ -62,6 +63,7 @@ struct tsb_dma_op {
     enum tsb_dma_op_state state;
     enum device_dma_error error;
     unsigned int events;
+    uint32_t completed_usec;
     struct device_dma_op op;
 };
 
@@ -71,7 +73,9 @@ struct tsb_dma_info {
     unsigned int max_chan;
     unsigned int avail_chan;
 
+#ifndef CONFIG_ARCH_TSB_DMA_COMPLETION_RING
     struct list_head completed_queue;
+#endif
     sem_t op_completed_sem;
     pthread_t irq_thread;
     bool driver_closed;
@@ -79,65 +83,260 @@ struct tsb_dma_info {
     struct tsb_dma_chan *chans[0];
 };
 
-static int tsb_dma_restart_chan(struct device *dev,
+#ifdef CONFIG_ARCH_TSB_DMA_COMPLETION_RING
+#define TSB_DMA_RING_MASK (CONFIG_ARCH_TSB_DMA_RING_SIZE - 1)
+
+/*
+ * Each channel has a ring of completed ops. Only the completion interrupt
+ * puts ops in the ring and only the completion thread gets them out, so
+ * the ring needs no locking. The ring can't overflow since an op is only
+ * started, from the interrupt or from a thread, when there is still room
+ * left for it. Ops left queued for lack of room are started by the
+ * completion thread once it has drained the ring.
+ */
+static inline unsigned int tsb_dma_ring_count(struct tsb_dma_chan *dma_chan)
+{
+    return dma_chan->ring_head - dma_chan->ring_tail;
+}
+
+static inline void tsb_dma_ring_put(struct tsb_dma_chan *dma_chan,
+        struct tsb_dma_op *dma_op)
+{
+    dma_chan->ring[dma_chan->ring_head & TSB_DMA_RING_MASK] = dma_op;
+    dma_chan->ring_head++;
+}
+
+static inline struct tsb_dma_op *tsb_dma_ring_get(
         struct tsb_dma_chan *dma_chan)
 {
-    struct list_head *next_op = NULL;
+    struct tsb_dma_op *dma_op;
+
+    if (dma_chan->ring_tail == dma_chan->ring_head) {
+        return NULL;
+    }
+
+    dma_op = dma_chan->ring[dma_chan->ring_tail & TSB_DMA_RING_MASK];
+    dma_chan->ring_tail++;
+
+    return dma_op;
+}
+
+static inline bool tsb_dma_chan_irq_callback(struct tsb_dma_chan *dma_chan)
+{
+    return !!(dma_chan->chan_params.flags & DEVICE_DMA_CHAN_FLAG_IRQ_CALLBACK);
+}
+#else
+static inline bool tsb_dma_chan_irq_callback(struct tsb_dma_chan *dma_chan)
+{
+    return false;
+}
+#endif
+
+/* Report a completed op to its owner and account for it. */
+static void tsb_dma_notify_op(struct device *dev,
+        struct tsb_dma_chan *dma_chan, struct tsb_dma_op *dma_op)
+{
+    struct tsb_dma_chan_stats *stats = &dma_chan->stats;
+    uint32_t callback_events = dma_op->op.callback_events;
+    uint32_t latency = hrt_getusec() - dma_op->completed_usec;
+
+    stats->ops++;
+    stats->latency_total += latency;
+    if (latency > stats->latency_max) {
+        stats->latency_max = latency;
+    }
+
+    if (dma_op->error != DEVICE_DMA_ERROR_NONE) {
+        dma_op->state = TSB_DMA_OP_STATE_ERROR;
+        stats->errors++;
+    } else {
+        dma_op->state = TSB_DMA_OP_STATE_COMPLETED;
+    }
+
+    if (dma_op->op.callback == NULL) {
+        lldbg("Invalid callback\n");
+        return;
+    }
+
+    if (callback_events & DEVICE_DMA_CALLBACK_EVENT_COMPLETE) {
+        dma_op->op.callback(dev, dma_chan, (void *) &dma_op->op,
+                DEVICE_DMA_CALLBACK_EVENT_COMPLETE,
+                dma_op->op.callback_arg);
+    }
+
+    if ((callback_events & DEVICE_DMA_CALLBACK_EVENT_ERROR) &&
+        (dma_op->state == TSB_DMA_OP_STATE_ERROR)) {
+        dma_op->op.callback(dev, dma_chan, (void *) &dma_op->op,
+                DEVICE_DMA_CALLBACK_EVENT_ERROR,
+                dma_op->op.callback_arg);
+    }
+}
+
+/*
+ * Hand an op that could not be started back to its owner. It leaves the
+ * queue and goes through the completion path like an op the DMAC failed.
+ *
+ * @note Called with interrupts disabled.
+ */
+static void tsb_dma_fail_op(struct device *dev,
+        struct tsb_dma_chan *dma_chan, struct tsb_dma_op *dma_op)
+{
+    struct tsb_dma_info *info = device_get_private(dev);
+
+    dma_op->state = TSB_DMA_OP_STATE_COMPLETING;
+    dma_op->error = DEVICE_DMA_ERROR_DMA_FAILED;
+    dma_op->completed_usec = hrt_getusec();
+
+    list_del(&dma_op->list_node);
+    dma_chan->stats.depth--;
+
+#ifdef CONFIG_ARCH_TSB_DMA_COMPLETION_RING
+    if (tsb_dma_chan_irq_callback(dma_chan)) {
+        tsb_dma_notify_op(dev, dma_chan, dma_op);
+        return;
+    }
+
+    tsb_dma_ring_put(dma_chan, dma_op);
+#else
+    list_add(&info->completed_queue, &dma_op->list_node);
+#endif
+
+    sem_post(&info->op_completed_sem);
+}
+
+/*
+ * Start the first op on the channel if it is still queued. When called to
+ * chain ops from the completion interrupt, an op that wants its START
+ * callback is left for the completion thread. An op that fails to start is
+ * reported to its owner and the next one is tried.
+ */
+static int tsb_dma_start_queued_op(struct device *dev,
+        struct tsb_dma_chan *dma_chan, bool chaining)
+{
+    struct tsb_dma_op *dma_op;
+    uint32_t callback_events;
     irqstate_t flags;
     int retval = OK;
 
-    pthread_mutex_lock(&dma_chan->chan_mutex);
-
     flags = irqsave();
 
-    list_foreach(&dma_chan->queue, next_op)
-    {
-        struct tsb_dma_op
-        *dma_op = list_entry(next_op, struct tsb_dma_op, list_node);
+    while (!list_is_empty(&dma_chan->queue)) {
+#ifdef CONFIG_ARCH_TSB_DMA_COMPLETION_RING
+        /* The op takes a ring entry when it completes: keep it queued if the
+         * ring is full.
+         */
+        if (tsb_dma_ring_count(dma_chan) >= CONFIG_ARCH_TSB_DMA_RING_SIZE) {
+            break;
+        }
+#endif
+
+        dma_op = list_entry(dma_chan->queue.next, struct tsb_dma_op,
+                            list_node);
+        if (dma_op->state != TSB_DMA_OP_STATE_QUEUED) {
+            break;
+        }
 
-        if (dma_op->state == TSB_DMA_OP_STATE_QUEUED) {
-            uint32_t callback_events = dma_op->op.callback_events;
+        callback_events = dma_op->op.callback_events;
+        if (chaining && (dma_op->op.callback != NULL) &&
+            (callback_events & DEVICE_DMA_CALLBACK_EVENT_START)) {
+            break;
+        }
 
-            dma_op->state = TSB_DMA_OP_STATE_STARTING;
+        dma_op->state = TSB_DMA_OP_STATE_STARTING;
 
-            if ((dma_op->op.callback != NULL) &&
-                (callback_events & DEVICE_DMA_CALLBACK_EVENT_START)) {
-                dma_op->op.callback(dev, dma_chan,
-                                    (void *) &dma_op->op,
-                                    DEVICE_DMA_CALLBACK_EVENT_START,
-                                    dma_op->op.callback_arg);
-            }
+        if ((dma_op->op.callback != NULL) &&
+            (callback_events & DEVICE_DMA_CALLBACK_EVENT_START)) {
+            dma_op->op.callback(dev, dma_chan,
+                                (void *) &dma_op->op,
+                                DEVICE_DMA_CALLBACK_EVENT_START,
+                                dma_op->op.callback_arg);
+        }
 
-            irqrestore(flags);
+        irqrestore(flags);
 
-            retval = gdmac_start_op(dev, dma_chan, &dma_op->op, &dma_op->error);
+        retval = gdmac_start_op(dev, dma_chan, &dma_op->op, &dma_op->error);
 
-            flags = irqsave();
+        flags = irqsave();
 
-            if (retval == OK) {
-                /* there is a chance the op already completed when we get to
-                 * here. If that is the case we don't need to set the op state
-                 * to running because it might already set to completed state.
-                 */
-                if (dma_op->state == TSB_DMA_OP_STATE_STARTING) {
-                    dma_op->state = TSB_DMA_OP_STATE_RUNNING;
-                }
-            } else {
-                lldbg("failed to start op.\n");
-                dma_op->error = DEVICE_DMA_ERROR_DMA_FAILED;
-                dma_op->state = TSB_DMA_OP_STATE_ERROR;
+        if (retval == OK) {
+            /* there is a chance the op already completed when we get to
+             * here. If that is the case we don't need to set the op state
+             * to running because it might already set to completed state.
+             */
+            if (dma_op->state == TSB_DMA_OP_STATE_STARTING) {
+                dma_op->state = TSB_DMA_OP_STATE_RUNNING;
             }
+            if (chaining) {
+                dma_chan->stats.chained++;
+            }
+            break;
         }
-        break;
+
+        lldbg("failed to start op.\n");
+        tsb_dma_fail_op(dev, dma_chan, dma_op);
     }
 
     irqrestore(flags);
 
-    pthread_mutex_unlock(&dma_chan->chan_mutex);
+    return retval;
+}
+
+static int tsb_dma_restart_chan(struct device *dev,
+        struct tsb_dma_chan *dma_chan)
+{
+    bool irq_callback = tsb_dma_chan_irq_callback(dma_chan);
+    int retval;
+
+    /* Channels with interrupt callbacks are also restarted from the
+     * interrupt, where the mutex can't be taken.
+     */
+    if (!irq_callback) {
+        pthread_mutex_lock(&dma_chan->chan_mutex);
+    }
+
+    retval = tsb_dma_start_queued_op(dev, dma_chan, false);
+
+    if (!irq_callback) {
+        pthread_mutex_unlock(&dma_chan->chan_mutex);
+    }
 
     return retval;
 }
 
+#ifdef CONFIG_ARCH_TSB_DMA_COMPLETION_RING
+static void *tsb_dma_process_completed_op(void *arg)
+{
+    struct device *dev = arg;
+    struct tsb_dma_info *dma_info = device_get_private(dev);
+
+    while (dma_info->driver_closed == 0) {
+        unsigned int chan_id;
+
+        sem_wait(&dma_info->op_completed_sem);
+
+        for (chan_id = 0; chan_id < dma_info->max_chan; chan_id++) {
+            struct tsb_dma_chan *dma_chan = dma_info->chans[chan_id];
+            struct tsb_dma_op *dma_op;
+            bool completed = false;
+
+            if (dma_chan == NULL) {
+                continue;
+            }
+
+            while ((dma_op = tsb_dma_ring_get(dma_chan)) != NULL) {
+                tsb_dma_notify_op(dev, dma_chan, dma_op);
+                completed = true;
+            }
+
+            if (completed) {
+                tsb_dma_restart_chan(dev, dma_chan);
+            }
+        }
+    }
+
+    return NULL;
+}
+#else
 static void *tsb_dma_process_completed_op(void *arg)
 {
     struct device *dev = arg;
@@ -150,40 +349,24 @@ static void *tsb_dma_process_completed_op(void *arg)
 
         list_foreach_safe(&dma_info->completed_queue, node, next_node) {
             struct tsb_dma_op* dma_op;
-            int chan_id;
+            struct tsb_dma_chan *dma_chan;
+            irqstate_t flags;
 
+            flags = irqsave();
             list_del(node);
-            dma_op = list_entry(node, struct tsb_dma_op, list_node);
-            chan_id = dma_op->chan_id;
-
-            if (dma_op->op.callback == NULL) {
-                lldbg("Invalid callback\n");
-            } else {
-                uint32_t callback_events = dma_op->op.callback_events;
-
-                if ((callback_events & DEVICE_DMA_CALLBACK_EVENT_COMPLETE) &&
-                    (dma_op->state = TSB_DMA_OP_STATE_COMPLETED)) {
-                    dma_op->op.callback(dev, &dma_info->chans[chan_id],
-                            (void *) &dma_op->op,
-                            DEVICE_DMA_CALLBACK_EVENT_COMPLETE,
-                            dma_op->op.callback_arg);
-                }
+            irqrestore(flags);
 
-                if ((callback_events & DEVICE_DMA_CALLBACK_EVENT_ERROR) &&
-                    (dma_op->state = TSB_DMA_OP_STATE_ERROR)) {
-                    dma_op->op.callback(dev, &dma_info->chans[chan_id],
-                            (void *) &dma_op->op,
-                            DEVICE_DMA_CALLBACK_EVENT_ERROR,
-                            dma_op->op.callback_arg);
-                }
-            }
+            dma_op = list_entry(node, struct tsb_dma_op, list_node);
+            dma_chan = dma_info->chans[dma_op->chan_id];
 
-            tsb_dma_restart_chan(dev, dma_info->chans[chan_id]);
+            tsb_dma_notify_op(dev, dma_chan, dma_op);
+            tsb_dma_restart_chan(dev, dma_chan);
         }
     }
 
     return NULL;
 }
+#endif
 
 static int tsb_dma_open(struct device *dev)
 {
@@ -212,7 +395,9 @@ static int tsb_dma_open(struct device *dev)
     info->max_chan = chan;
     info->avail_chan = chan;
 
+#ifndef CONFIG_ARCH_TSB_DMA_COMPLETION_RING
     list_init(&info->completed_queue);
+#endif
 
     device_set_private(dev, info);
 
@@ -360,6 +545,11 @@ static int tsb_dma_chan_alloc(struct device *dev,
                  * parameters against its.
                  */
                 memcpy(&dma_chan->chan_params, params, sizeof(*params));
+                memset(&dma_chan->stats, 0, sizeof(dma_chan->stats));
+#ifdef CONFIG_ARCH_TSB_DMA_COMPLETION_RING
+                dma_chan->ring_head = 0;
+                dma_chan->ring_tail = 0;
+#endif
 
                 info->chans[index] = dma_chan;
 
@@ -407,7 +597,8 @@ static int tsb_dma_chan_free(struct device *dev, void *chan)
                 struct device_dma_op *dev_op = &dma_op->op;
                 list_del(node);
 
-                dma_op->state = DEVICE_DMA_CALLBACK_EVENT_DEQUEUED;
+                dma_chan->stats.depth--;
+                dma_op->state = TSB_DMA_OP_STATE_IDLE;
                 if ((dev_op->callback != NULL) &&
                     (dev_op->callback_events &
                             DEVICE_DMA_CALLBACK_EVENT_DEQUEUED)) {
@@ -422,6 +613,11 @@ static int tsb_dma_chan_free(struct device *dev, void *chan)
 
         if (list_is_empty(&dma_chan->queue) != true) {
             retval = -EIO;
+#ifdef CONFIG_ARCH_TSB_DMA_COMPLETION_RING
+        } else if (tsb_dma_ring_count(dma_chan) != 0) {
+            /* completed ops still wait for their callbacks */
+            retval = -EIO;
+#endif
         } else {
             pthread_mutex_destroy(&dma_chan->chan_mutex);
 
@@ -579,16 +775,34 @@ static int tsb_dma_enqueue(struct device *dev, void *chan,
 
     flags = irqsave();
 
-    /* Add the op to the queue on the channel */
-    if (dma_op->state == TSB_DMA_OP_STATE_IDLE) {
+    /*
+     * Add the op to the queue on the channel.  An op that has completed,
+     * successfully or not, may be queued again, one that is still queued
+     * or running may not.
+     */
+    if ((dma_op->state == TSB_DMA_OP_STATE_IDLE) ||
+        (dma_op->state == TSB_DMA_OP_STATE_COMPLETED) ||
+        (dma_op->state == TSB_DMA_OP_STATE_ERROR)) {
         list_add(&dma_chan->queue, &dma_op->list_node);
+        dma_op->chan_id = dma_chan->chan_id;
         dma_op->state = TSB_DMA_OP_STATE_QUEUED;
+        dma_op->error = DEVICE_DMA_ERROR_NONE;
+        if (++dma_chan->stats.depth > dma_chan->stats.max_depth) {
+            dma_chan->stats.max_depth = dma_chan->stats.depth;
+        }
         retval = OK;
+    } else {
+        retval = -EBUSY;
     }
 
     irqrestore(flags);
 
-    tsb_dma_restart_chan(dev, dma_chan);
+    /* An op that failed to start was already reported through its callback:
+     * the one passed here was queued either way.
+     */
+    if (tsb_dma_restart_chan(dev, dma_chan) != OK) {
+        lldbg("channel %u: failed to start queued op.\n", dma_chan->chan_id);
+    }
 
     return retval;
 }
@@ -598,10 +812,12 @@ static int tsb_dma_dequeue(struct device *dev, void *chan,
 {
     struct tsb_dma_info *info;
     struct tsb_dma_op *dma_op;
+    struct tsb_dma_chan *dma_chan = (struct tsb_dma_chan *) chan;
     irqstate_t flags;
+    bool restart = false;
     int retval = -EIO;
 
-    if ((dev == NULL) || (op == NULL)) {
+    if ((dev == NULL) || (chan == NULL) || (op == NULL)) {
         return -EINVAL;
     }
 
@@ -614,16 +830,25 @@ static int tsb_dma_dequeue(struct device *dev, void *chan,
 
     flags = irqsave();
 
-    /* Make sure if the op is in the queued state before we dequeue it from
-     * from the queue. If the op is already started, we can't stop the DMAC
-     * and delete it.
+    /* A queued op is simply removed from the queue. An op that has started
+     * is taken back by killing the channel's DMAC thread, which also drops
+     * the completion interrupt it may have raised, and the next op on the
+     * channel is started in its place. An op that has completed is
+     * already on its way to the callback and can't be dequeued any more.
      */
-    if (dma_op->state == TSB_DMA_OP_STATE_QUEUED) {
+    if ((dma_op->state == TSB_DMA_OP_STATE_STARTING) ||
+        (dma_op->state == TSB_DMA_OP_STATE_RUNNING)) {
+        gdmac_abort_op(dev, dma_chan);
+        restart = true;
+    }
+
+    if (restart || (dma_op->state == TSB_DMA_OP_STATE_QUEUED)) {
         struct device_dma_op *dev_op = &dma_op->op;
 
         list_del(&dma_op->list_node);
 
-        dma_op->state = DEVICE_DMA_CALLBACK_EVENT_DEQUEUED;
+        dma_chan->stats.depth--;
+        dma_op->state = TSB_DMA_OP_STATE_IDLE;
         if ((dev_op->callback != NULL) &&
             (dev_op->callback_events &
                     DEVICE_DMA_CALLBACK_EVENT_DEQUEUED)) {
@@ -636,6 +861,10 @@ static int tsb_dma_dequeue(struct device *dev, void *chan,
 
     irqrestore(flags);
 
+    if (restart) {
+        tsb_dma_restart_chan(dev, dma_chan);
+    }
+
     return retval;
 }
 
@@ -643,34 +872,94 @@ int tsb_dma_callback(struct device *dev, struct tsb_dma_chan *dma_chan,
         int event)
 {
     struct tsb_dma_info *info = device_get_private(dev);
-    struct list_head *next_op;
+    struct tsb_dma_op *dma_op;
+    uint32_t now;
 
     /* This routine runs in the interrupt context, so there is no other
      * thread would manipulate the the op other than the user callback
-     * routine which wouldn't happen until the op is removed from the
-     * completed queue.
+     * routine which wouldn't happen until the op is handed to the
+     * completion thread.
      */
-    list_foreach(&dma_chan->queue, next_op)
-    {
-        struct tsb_dma_op
-        *dma_op = list_entry(next_op, struct tsb_dma_op, list_node);
+    if (list_is_empty(&dma_chan->queue)) {
+        return OK;
+    }
 
-        /* Make sure the op is in either starting or running state. */
-        if ((dma_op->state == TSB_DMA_OP_STATE_STARTING)
-                || (dma_op->state == TSB_DMA_OP_STATE_RUNNING)) {
-            dma_op->state = TSB_DMA_OP_STATE_COMPLETING;
+    dma_op = list_entry(dma_chan->queue.next, struct tsb_dma_op, list_node);
 
-            list_del(next_op);
-            list_add(&info->completed_queue, next_op);
+    /* Make sure the op is in either starting or running state. */
+    if ((dma_op->state != TSB_DMA_OP_STATE_STARTING) &&
+        (dma_op->state != TSB_DMA_OP_STATE_RUNNING)) {
+        return OK;
+    }
 
-            sem_post(&info->op_completed_sem);
-        }
-        break;
+    now = hrt_getusec();
+
+    dma_op->state = TSB_DMA_OP_STATE_COMPLETING;
+    dma_op->completed_usec = now;
+    if (event != DEVICE_DMA_CALLBACK_EVENT_COMPLETE) {
+        dma_op->error = DEVICE_DMA_ERROR_DMA_FAILED;
     }
 
+    list_del(&dma_op->list_node);
+
+    dma_chan->stats.depth--;
+    if (dma_chan->stats.first == 0) {
+        dma_chan->stats.first = now;
+    }
+    dma_chan->stats.last = now;
+
+#ifdef CONFIG_ARCH_TSB_DMA_COMPLETION_RING
+    if (tsb_dma_chan_irq_callback(dma_chan)) {
+        tsb_dma_notify_op(dev, dma_chan, dma_op);
+        tsb_dma_restart_chan(dev, dma_chan);
+        return OK;
+    }
+
+    tsb_dma_ring_put(dma_chan, dma_op);
+
+    /* Keep the channel busy while the thread catches up with the callbacks */
+    tsb_dma_start_queued_op(dev, dma_chan, true);
+#else
+    list_add(&info->completed_queue, &dma_op->list_node);
+#endif
+
+    sem_post(&info->op_completed_sem);
+
     return OK;
 }
 
+void tsb_dma_dump(struct device *dev)
+{
+    struct tsb_dma_info *info = device_get_private(dev);
+    unsigned int chan_id;
+
+    if (!info) {
+        return;
+    }
+
+    for (chan_id = 0; chan_id < info->max_chan; chan_id++) {
+        struct tsb_dma_chan *dma_chan = info->chans[chan_id];
+        struct tsb_dma_chan_stats *stats;
+        uint32_t elapsed;
+
+        if (dma_chan == NULL) {
+            continue;
+        }
+
+        stats = &dma_chan->stats;
+        elapsed = stats->last - stats->first;
+
+        lldbg("dma chan %u: %u ops (%u chained), %u errors, depth %u/%u\n",
+              chan_id, stats->ops, stats->chained, stats->errors,
+              stats->depth, stats->max_depth);
+        lldbg("    latency avg %u us max %u us, %u ops/s\n",
+              stats->ops ? (uint32_t)(stats->latency_total / stats->ops) : 0,
+              stats->latency_max,
+              elapsed ? (uint32_t)((uint64_t)stats->ops * 1000000 / elapsed)
+                      : 0);
+    }
+}
+
 static struct device_dma_type_ops tsb_dma_type_ops = {
         .get_caps = tsb_dma_get_caps,
         .chan_free_count = tsb_dma_chan_free_count,
@@ -39,6 +39,20 @@
 #define TSB_DMA_SG_MAX				2
 
 struct gdmac_chan;
+struct tsb_dma_op;
+
+/* DMA channel statistics, times in microseconds. */
+struct tsb_dma_chan_stats {
+    uint32_t ops;
+    uint32_t errors;
+    uint32_t chained;       /* ops started from the completion interrupt */
+    uint32_t depth;         /* ops queued or running */
+    uint32_t max_depth;
+    uint64_t latency_total; /* from the interrupt to the callback */
+    uint32_t latency_max;
+    uint32_t first;         /* first and last completions */
+    uint32_t last;
+};
 
 /* structure for GDMAC channel information. */
 struct tsb_dma_chan {
@@ -46,6 +60,13 @@ struct tsb_dma_chan {
     pthread_mutex_t chan_mutex;
     struct list_head queue;
     struct device_dma_params chan_params;
+    struct tsb_dma_chan_stats stats;
+#ifdef CONFIG_ARCH_TSB_DMA_COMPLETION_RING
+    /* Completed ops, put by the interrupt and got by the completion thread */
+    struct tsb_dma_op *ring[CONFIG_ARCH_TSB_DMA_RING_SIZE];
+    volatile unsigned int ring_head;
+    volatile unsigned int ring_tail;
+#endif
 };
 
 extern int gdmac_max_number_of_channels(void);
@@ -59,7 +80,9 @@ extern int gdmac_start_op(struct device *dev, struct tsb_dma_chan *tsb_chan,
         struct device_dma_op *op, enum device_dma_error *error);
 extern int gdmac_chan_check_op_params(struct device *dev,
         struct tsb_dma_chan *tsb_chan, struct device_dma_op *op);
+extern int gdmac_abort_op(struct device *dev, struct tsb_dma_chan *tsb_chan);
 
 extern int tsb_dma_callback(struct device *dev, struct tsb_dma_chan *tsb_chan,
         int event);
+extern void tsb_dma_dump(struct device *dev);
 #endif /* __TSB_DMA_GDMAC_H */
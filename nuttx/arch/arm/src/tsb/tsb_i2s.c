@@ -905,6 +905,10 @@ static int tsb_i2s_op_prepare_receiver(struct device *dev,
         goto err_unlock;
     }
 
+    ret = tsb_i2s_xfer_prepare_receiver(info);
+    if (ret)
+        goto err_unlock;
+
     if (!tsb_i2s_tx_is_prepared(info)) {
         tsb_i2s_enable(info);
 
@@ -933,6 +937,8 @@ static int tsb_i2s_op_prepare_receiver(struct device *dev,
 err_disable:
     if (!tsb_i2s_tx_is_prepared(info))
         tsb_i2s_disable(info);
+
+    tsb_i2s_xfer_shutdown_receiver(info);
 err_unlock:
     sem_post(&info->lock);
 
@@ -999,6 +1005,8 @@ static int tsb_i2s_op_shutdown_receiver(struct device *dev)
     up_disable_irq(info->si_irq);
     up_disable_irq(info->sierr_irq);
 
+    tsb_i2s_xfer_shutdown_receiver(info);
+
     if (!tsb_i2s_tx_is_prepared(info)) {
         tsb_i2s_stop_clocks(info);
         tsb_i2s_disable(info);
@@ -1034,6 +1042,10 @@ static int tsb_i2s_op_prepare_transmitter(struct device *dev,
         goto err_unlock;
     }
 
+    ret = tsb_i2s_xfer_prepare_transmitter(info);
+    if (ret)
+        goto err_unlock;
+
     if (!tsb_i2s_rx_is_prepared(info)) {
         tsb_i2s_enable(info);
 
@@ -1062,6 +1074,8 @@ static int tsb_i2s_op_prepare_transmitter(struct device *dev,
 err_disable:
     if (!tsb_i2s_rx_is_prepared(info))
         tsb_i2s_disable(info);
+
+    tsb_i2s_xfer_shutdown_transmitter(info);
 err_unlock:
     sem_post(&info->lock);
 
@@ -1128,6 +1142,8 @@ static int tsb_i2s_op_shutdown_transmitter(struct device *dev)
     up_disable_irq(info->so_irq);
     up_disable_irq(info->soerr_irq);
 
+    tsb_i2s_xfer_shutdown_transmitter(info);
+
     if (!tsb_i2s_rx_is_prepared(info)) {
         tsb_i2s_stop_clocks(info);
         tsb_i2s_disable(info);
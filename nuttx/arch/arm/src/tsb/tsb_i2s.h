@@ -197,6 +197,10 @@ struct tsb_i2s_info {
     uint8_t                         mclk_role;
     uint8_t                         bclk_role;
     uint8_t                         wclk_role;
+#ifdef CONFIG_ARCH_I2S_USE_DMA
+    unsigned int                    rx_overruns;  /* no free entry to fill */
+    unsigned int                    tx_underruns; /* no entry left to send */
+#endif
 };
 
 
@@ -220,6 +220,24 @@ static int tsb_i2s_tx_data(struct tsb_i2s_info *info)
     return ret;
 }
 
+int tsb_i2s_xfer_prepare_receiver(struct tsb_i2s_info *info)
+{
+    return 0;
+}
+
+void tsb_i2s_xfer_shutdown_receiver(struct tsb_i2s_info *info)
+{
+}
+
+int tsb_i2s_xfer_prepare_transmitter(struct tsb_i2s_info *info)
+{
+    return 0;
+}
+
+void tsb_i2s_xfer_shutdown_transmitter(struct tsb_i2s_info *info)
+{
+}
+
 int tsb_i2s_start_receiver(struct tsb_i2s_info *info)
 {
     irqstate_t flags;
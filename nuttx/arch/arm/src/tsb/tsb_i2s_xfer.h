@@ -40,6 +40,11 @@
 int tsb_i2s_xfer_irq_attach(struct tsb_i2s_info *info);
 int tsb_i2s_xfer_irq_detach(struct tsb_i2s_info *info);
 
+int tsb_i2s_xfer_prepare_receiver(struct tsb_i2s_info *info);
+void tsb_i2s_xfer_shutdown_receiver(struct tsb_i2s_info *info);
+int tsb_i2s_xfer_prepare_transmitter(struct tsb_i2s_info *info);
+void tsb_i2s_xfer_shutdown_transmitter(struct tsb_i2s_info *info);
+
 int tsb_i2s_start_receiver(struct tsb_i2s_info *info);
 void tsb_i2s_stop_receiver(struct tsb_i2s_info *info, int is_err);
 int tsb_i2s_start_transmitter(struct tsb_i2s_info *info);
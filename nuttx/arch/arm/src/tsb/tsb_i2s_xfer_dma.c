@@ -0,0 +1,644 @@
+/**
+ * Copyright (c) 2016 Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @brief TSB I2S device driver's DMA data movement module.
+ */
+/*
+ * Each ring buffer entry is moved by a single GDMAC operation between the
+ * entry's data area and the SO/SI LMEM FIFO window, with the I2S block pacing
+ * the transfer through its DMA request line (DMACMSK).  Two operations are
+ * kept per direction: while one is transferring, the next entry is already
+ * queued behind it so the DMA never has to wait for the completion callback
+ * to be serviced.  The completion callback retires the oldest operation,
+ * hands its ring buffer entry back and queues the next ready entry.
+ *
+ * Stopping a stream dequeues both operations.  One that has already completed
+ * but whose callback hasn't run yet can't be dequeued: it is retired as stale
+ * when the callback runs, and its channel is kept until then and reused by
+ * the next stream.
+ */
+
+#include <string.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <semaphore.h>
+#include <debug.h>
+#include <nuttx/device.h>
+#include <nuttx/device_dma.h>
+#include <nuttx/device_i2s.h>
+#include <nuttx/ring_buf.h>
+
+#include <arch/irq.h>
+
+#include "up_arch.h"
+
+#include "tsb_i2s.h"
+#include "tsb_i2s_xfer.h"
+
+/* One operation transferring and one queued behind it */
+#define TSB_I2S_DMA_OP_COUNT    2
+
+struct tsb_i2s_dma_slot {
+    struct device_dma_op    *op;
+    bool                    busy; /* owned by the DMA driver */
+};
+
+struct tsb_i2s_dma_dir {
+    void                    *chan;
+    struct tsb_i2s_dma_slot slot[TSB_I2S_DMA_OP_COUNT];
+    unsigned int            head;       /* next slot to queue */
+    unsigned int            tail;       /* oldest slot in flight */
+    unsigned int            in_flight;
+    struct ring_buf         *next_rb;   /* next entry to queue */
+};
+
+static struct {
+    struct device           *dev;
+    struct tsb_i2s_dma_dir  rx;
+    struct tsb_i2s_dma_dir  tx;
+} tsb_i2s_dma;
+
+static int tsb_i2s_dma_rx_callback(struct device *dev, void *chan,
+                                   struct device_dma_op *op,
+                                   unsigned int event, void *arg);
+static int tsb_i2s_dma_tx_callback(struct device *dev, void *chan,
+                                   struct device_dma_op *op,
+                                   unsigned int event, void *arg);
+
+static int tsb_i2s_dma_dir_is_idle(struct tsb_i2s_dma_dir *dir)
+{
+    unsigned int i;
+
+    for (i = 0; i < TSB_I2S_DMA_OP_COUNT; i++)
+        if (dir->slot[i].busy)
+            return 0;
+
+    return 1;
+}
+
+static void tsb_i2s_dma_dir_free(struct tsb_i2s_dma_dir *dir)
+{
+    unsigned int i;
+
+    for (i = 0; i < TSB_I2S_DMA_OP_COUNT; i++) {
+        if (dir->slot[i].op)
+            device_dma_op_free(tsb_i2s_dma.dev, dir->slot[i].op);
+    }
+
+    if (dir->chan)
+        device_dma_chan_free(tsb_i2s_dma.dev, dir->chan);
+
+    memset(dir, 0, sizeof(*dir));
+
+    if (!tsb_i2s_dma.rx.chan && !tsb_i2s_dma.tx.chan) {
+        device_close(tsb_i2s_dma.dev);
+        tsb_i2s_dma.dev = NULL;
+    }
+}
+
+static int tsb_i2s_dma_dir_alloc(struct tsb_i2s_dma_dir *dir,
+                                 struct device_dma_params *params,
+                                 device_dma_op_callback callback, void *arg)
+{
+    struct device_dma_op *op;
+    unsigned int i;
+    int ret;
+
+    /* Still allocated when the last stream left a completion behind */
+    if (dir->chan)
+        return 0;
+
+    if (!tsb_i2s_dma.dev) {
+        tsb_i2s_dma.dev = device_open(DEVICE_TYPE_DMA_HW, 0);
+        if (!tsb_i2s_dma.dev) {
+            lldbg("I2S: cannot open DMA device\n");
+            return -EIO;
+        }
+    }
+
+    ret = device_dma_chan_alloc(tsb_i2s_dma.dev, params, &dir->chan);
+    if (ret) {
+        dir->chan = NULL;
+        goto err_free;
+    }
+
+    for (i = 0; i < TSB_I2S_DMA_OP_COUNT; i++) {
+        ret = device_dma_op_alloc(tsb_i2s_dma.dev, 1, 0, &op);
+        if (ret)
+            goto err_free;
+
+        op->callback = callback;
+        op->callback_arg = arg;
+        op->callback_events = DEVICE_DMA_CALLBACK_EVENT_COMPLETE;
+        op->sg_count = 1;
+
+        dir->slot[i].op = op;
+    }
+
+    return 0;
+
+err_free:
+    tsb_i2s_dma_dir_free(dir);
+
+    return ret;
+}
+
+/* Called with the stream stopped; the caller holds interrupts off */
+static void tsb_i2s_dma_dir_cancel(struct tsb_i2s_dma_dir *dir)
+{
+    struct tsb_i2s_dma_slot *slot;
+    unsigned int i;
+
+    for (i = 0; i < TSB_I2S_DMA_OP_COUNT; i++) {
+        slot = &dir->slot[i];
+
+        if (slot->busy &&
+            !device_dma_dequeue(tsb_i2s_dma.dev, dir->chan, slot->op))
+            slot->busy = false;
+    }
+
+    /* Anything still busy has completed and will be retired as stale */
+    dir->in_flight = 0;
+    dir->tail = dir->head;
+    dir->next_rb = NULL;
+}
+
+/*
+ * Retire a completed operation.  Returns 1 when it is the oldest operation of
+ * the current stream and 0 when it was left over from a stopped stream.
+ */
+static int tsb_i2s_dma_dir_retire(struct tsb_i2s_dma_dir *dir,
+                                  struct device_dma_op *op)
+{
+    struct tsb_i2s_dma_slot *slot = &dir->slot[dir->tail];
+    unsigned int i;
+
+    if (dir->in_flight && (slot->op == op)) {
+        slot->busy = false;
+        dir->tail = (dir->tail + 1) % TSB_I2S_DMA_OP_COUNT;
+        dir->in_flight--;
+        return 1;
+    }
+
+    for (i = 0; i < TSB_I2S_DMA_OP_COUNT; i++)
+        if (dir->slot[i].op == op)
+            dir->slot[i].busy = false;
+
+    return 0;
+}
+
+/*
+ * Hand the ring buffer entry 'rb' to the DMA.  'first' is the oldest entry
+ * that hasn't completed yet; the walk stops when it wraps back around to it.
+ */
+static int tsb_i2s_dma_dir_queue(struct tsb_i2s_dma_dir *dir,
+                                 struct ring_buf *first, struct ring_buf *rb,
+                                 off_t src_addr, off_t dst_addr, size_t len)
+{
+    struct tsb_i2s_dma_slot *slot = &dir->slot[dir->head];
+    int ret;
+
+    if ((dir->in_flight >= TSB_I2S_DMA_OP_COUNT) || slot->busy ||
+        (dir->in_flight && (rb == first)))
+        return -EBUSY;
+
+    slot->op->sg[0].src_addr = src_addr;
+    slot->op->sg[0].dst_addr = dst_addr;
+    slot->op->sg[0].len = len;
+    slot->busy = true;
+
+    dir->head = (dir->head + 1) % TSB_I2S_DMA_OP_COUNT;
+    dir->in_flight++;
+    dir->next_rb = ring_buf_get_next(rb);
+
+    ret = device_dma_enqueue(tsb_i2s_dma.dev, dir->chan, slot->op);
+    if (ret) {
+        slot->busy = false;
+        dir->head = (dir->head + TSB_I2S_DMA_OP_COUNT - 1) %
+                    TSB_I2S_DMA_OP_COUNT;
+        dir->in_flight--;
+        dir->next_rb = rb;
+    }
+
+    return ret;
+}
+
+static void tsb_i2s_dma_rx_error(struct tsb_i2s_info *info,
+                                 enum device_i2s_event event)
+{
+    tsb_i2s_stop_receiver(info, 1);
+
+    if (info->rx_callback)
+        info->rx_callback(info->rx_rb, event, info->rx_arg);
+}
+
+static void tsb_i2s_dma_tx_error(struct tsb_i2s_info *info,
+                                 enum device_i2s_event event)
+{
+    tsb_i2s_stop_transmitter(info, 1);
+
+    if (info->tx_callback)
+        info->tx_callback(info->tx_rb, event, info->tx_arg);
+}
+
+static int tsb_i2s_rx_data(struct tsb_i2s_info *info)
+{
+    struct tsb_i2s_dma_dir *dir = &tsb_i2s_dma.rx;
+    struct ring_buf *rb;
+    int ret;
+
+    if (!dir->in_flight)
+        dir->next_rb = info->rx_rb;
+
+    while (dir->in_flight < TSB_I2S_DMA_OP_COUNT) {
+        rb = dir->next_rb;
+
+        if (!ring_buf_is_producers(rb))
+            break;
+
+        if ((ring_buf_space(rb) % 4) || !ring_buf_space(rb)) {
+            tsb_i2s_dma_rx_error(info, DEVICE_I2S_EVENT_DATA_LEN);
+            return -EINVAL;
+        }
+
+        ret = tsb_i2s_dma_dir_queue(dir, info->rx_rb, rb,
+                                    info->si_base + TSB_I2S_REG_LMEM00,
+                                    (off_t)ring_buf_get_tail(rb),
+                                    ring_buf_space(rb));
+        if (ret == -EBUSY)
+            break;
+
+        if (ret) {
+            tsb_i2s_dma_rx_error(info, DEVICE_I2S_EVENT_UNSPECIFIED);
+            return ret;
+        }
+    }
+
+    return 0;
+}
+
+static int tsb_i2s_tx_data(struct tsb_i2s_info *info)
+{
+    struct tsb_i2s_dma_dir *dir = &tsb_i2s_dma.tx;
+    struct ring_buf *rb;
+    int ret;
+
+    if (!dir->in_flight)
+        dir->next_rb = info->tx_rb;
+
+    while (dir->in_flight < TSB_I2S_DMA_OP_COUNT) {
+        rb = dir->next_rb;
+
+        if (!ring_buf_is_consumers(rb))
+            break;
+
+        if ((ring_buf_len(rb) % 4) || !ring_buf_len(rb)) {
+            tsb_i2s_dma_tx_error(info, DEVICE_I2S_EVENT_DATA_LEN);
+            return -EINVAL;
+        }
+
+        ret = tsb_i2s_dma_dir_queue(dir, info->tx_rb, rb,
+                                    (off_t)ring_buf_get_head(rb),
+                                    info->so_base + TSB_I2S_REG_LMEM00,
+                                    ring_buf_len(rb));
+        if (ret == -EBUSY)
+            break;
+
+        if (ret) {
+            tsb_i2s_dma_tx_error(info, DEVICE_I2S_EVENT_UNSPECIFIED);
+            return ret;
+        }
+    }
+
+    return 0;
+}
+
+static int tsb_i2s_dma_rx_callback(struct device *dev, void *chan,
+                                   struct device_dma_op *op,
+                                   unsigned int event, void *arg)
+{
+    struct tsb_i2s_info *info = arg;
+    struct tsb_i2s_dma_dir *dir = &tsb_i2s_dma.rx;
+    enum device_dma_error error = DEVICE_DMA_ERROR_NONE;
+    struct ring_buf *rb;
+    irqstate_t flags;
+
+    if (event != DEVICE_DMA_CALLBACK_EVENT_COMPLETE)
+        return OK;
+
+    flags = irqsave();
+
+    if (!tsb_i2s_dma_dir_retire(dir, op)) {
+        if (tsb_i2s_rx_is_active(info))
+            tsb_i2s_rx_data(info);
+        goto out;
+    }
+
+    device_dma_op_get_error(dev, op, &error);
+    if (error != DEVICE_DMA_ERROR_NONE) {
+        tsb_i2s_dma_rx_error(info, DEVICE_I2S_EVENT_UNSPECIFIED);
+        goto out;
+    }
+
+    rb = info->rx_rb;
+    info->rx_rb = ring_buf_get_next(rb);
+
+    ring_buf_put(rb, op->sg[0].len);
+    ring_buf_pass(rb);
+
+    if (info->rx_callback)
+        info->rx_callback(rb, DEVICE_I2S_EVENT_RX_COMPLETE, info->rx_arg);
+
+    if (!tsb_i2s_rx_is_active(info) || tsb_i2s_rx_data(info))
+        goto out;
+
+    /* No free entry to receive into; the SI FIFO will overflow */
+    if (!dir->in_flight)
+        info->rx_overruns++;
+
+out:
+    irqrestore(flags);
+
+    return OK;
+}
+
+static int tsb_i2s_dma_tx_callback(struct device *dev, void *chan,
+                                   struct device_dma_op *op,
+                                   unsigned int event, void *arg)
+{
+    struct tsb_i2s_info *info = arg;
+    struct tsb_i2s_dma_dir *dir = &tsb_i2s_dma.tx;
+    enum device_dma_error error = DEVICE_DMA_ERROR_NONE;
+    struct ring_buf *rb;
+    irqstate_t flags;
+
+    if (event != DEVICE_DMA_CALLBACK_EVENT_COMPLETE)
+        return OK;
+
+    flags = irqsave();
+
+    if (!tsb_i2s_dma_dir_retire(dir, op)) {
+        if (tsb_i2s_tx_is_active(info))
+            tsb_i2s_tx_data(info);
+        goto out;
+    }
+
+    device_dma_op_get_error(dev, op, &error);
+    if (error != DEVICE_DMA_ERROR_NONE) {
+        tsb_i2s_dma_tx_error(info, DEVICE_I2S_EVENT_UNSPECIFIED);
+        goto out;
+    }
+
+    rb = info->tx_rb;
+    info->tx_rb = ring_buf_get_next(rb);
+
+    ring_buf_reset(rb);
+    ring_buf_pass(rb);
+
+    if (info->tx_callback)
+        info->tx_callback(rb, DEVICE_I2S_EVENT_TX_COMPLETE, info->tx_arg);
+
+    if (!tsb_i2s_tx_is_active(info) || tsb_i2s_tx_data(info))
+        goto out;
+
+    /* Nothing left to send; the SO FIFO will run dry */
+    if (!dir->in_flight)
+        info->tx_underruns++;
+
+out:
+    irqrestore(flags);
+
+    return OK;
+}
+
+int tsb_i2s_xfer_prepare_receiver(struct tsb_i2s_info *info)
+{
+    struct device_dma_params params = {
+        .src_dev            = DEVICE_DMA_DEV_IO,
+        .src_devid          = CONFIG_ARCH_I2S_DMA_SI_REQUEST,
+        .src_inc_options    = DEVICE_DMA_INC_NOAUTO,
+        .dst_dev            = DEVICE_DMA_DEV_MEM,
+        .dst_devid          = 0,
+        .dst_inc_options    = DEVICE_DMA_INC_AUTO,
+        .transfer_size      = DEVICE_DMA_TRANSFER_SIZE_32,
+        .burst_len          = DEVICE_DMA_BURST_LEN_1,
+        .swap               = DEVICE_DMA_SWAP_SIZE_NONE,
+        .flags              = DEVICE_DMA_CHAN_FLAG_IRQ_CALLBACK,
+    };
+
+    info->rx_overruns = 0;
+
+    return tsb_i2s_dma_dir_alloc(&tsb_i2s_dma.rx, &params,
+                                 tsb_i2s_dma_rx_callback, info);
+}
+
+void tsb_i2s_xfer_shutdown_receiver(struct tsb_i2s_info *info)
+{
+    irqstate_t flags;
+
+    flags = irqsave();
+
+    if (tsb_i2s_dma_dir_is_idle(&tsb_i2s_dma.rx))
+        tsb_i2s_dma_dir_free(&tsb_i2s_dma.rx);
+
+    irqrestore(flags);
+}
+
+int tsb_i2s_xfer_prepare_transmitter(struct tsb_i2s_info *info)
+{
+    struct device_dma_params params = {
+        .src_dev            = DEVICE_DMA_DEV_MEM,
+        .src_devid          = 0,
+        .src_inc_options    = DEVICE_DMA_INC_AUTO,
+        .dst_dev            = DEVICE_DMA_DEV_IO,
+        .dst_devid          = CONFIG_ARCH_I2S_DMA_SO_REQUEST,
+        .dst_inc_options    = DEVICE_DMA_INC_NOAUTO,
+        .transfer_size      = DEVICE_DMA_TRANSFER_SIZE_32,
+        .burst_len          = DEVICE_DMA_BURST_LEN_1,
+        .swap               = DEVICE_DMA_SWAP_SIZE_NONE,
+        .flags              = DEVICE_DMA_CHAN_FLAG_IRQ_CALLBACK,
+    };
+
+    info->tx_underruns = 0;
+
+    return tsb_i2s_dma_dir_alloc(&tsb_i2s_dma.tx, &params,
+                                 tsb_i2s_dma_tx_callback, info);
+}
+
+void tsb_i2s_xfer_shutdown_transmitter(struct tsb_i2s_info *info)
+{
+    irqstate_t flags;
+
+    flags = irqsave();
+
+    if (tsb_i2s_dma_dir_is_idle(&tsb_i2s_dma.tx))
+        tsb_i2s_dma_dir_free(&tsb_i2s_dma.tx);
+
+    irqrestore(flags);
+}
+
+int tsb_i2s_start_receiver(struct tsb_i2s_info *info)
+{
+    irqstate_t flags;
+    int ret;
+
+    flags = irqsave();
+
+    ret = tsb_i2s_rx_data(info);
+    if (ret)
+        goto err_irqrestore;
+
+    if (tsb_i2s_rx_is_active(info))
+        goto err_irqrestore;
+
+    tsb_i2s_clear_irqs(info, TSB_I2S_BLOCK_SI,
+                       TSB_I2S_REG_INT_LRCK | TSB_I2S_REG_INT_UR |
+                       TSB_I2S_REG_INT_OR | TSB_I2S_REG_INT_INT);
+    tsb_i2s_unmask_irqs(info, TSB_I2S_BLOCK_SI,
+                        TSB_I2S_REG_INT_DMACMSK | TSB_I2S_REG_INT_LRCK |
+                        TSB_I2S_REG_INT_UR | TSB_I2S_REG_INT_OR);
+
+    ret = tsb_i2s_start(info, TSB_I2S_BLOCK_SI);
+    if (ret)
+        goto err_cancel;
+
+    info->flags |= TSB_I2S_FLAG_RX_ACTIVE;
+
+    irqrestore(flags);
+
+    return 0;
+
+err_cancel:
+    tsb_i2s_mask_irqs(info, TSB_I2S_BLOCK_SI,
+                      TSB_I2S_REG_INT_DMACMSK | TSB_I2S_REG_INT_LRCK |
+                      TSB_I2S_REG_INT_UR | TSB_I2S_REG_INT_OR);
+    tsb_i2s_dma_dir_cancel(&tsb_i2s_dma.rx);
+err_irqrestore:
+    irqrestore(flags);
+
+    return ret;
+}
+
+void tsb_i2s_stop_receiver(struct tsb_i2s_info *info, int is_err)
+{
+    irqstate_t flags;
+
+    flags = irqsave();
+
+    tsb_i2s_stop(info, TSB_I2S_BLOCK_SI, is_err);
+
+    tsb_i2s_mask_irqs(info, TSB_I2S_BLOCK_SI,
+                      TSB_I2S_REG_INT_DMACMSK | TSB_I2S_REG_INT_LRCK |
+                      TSB_I2S_REG_INT_UR | TSB_I2S_REG_INT_OR |
+                      TSB_I2S_REG_INT_INT);
+    tsb_i2s_clear_irqs(info, TSB_I2S_BLOCK_SI,
+                       TSB_I2S_REG_INT_LRCK | TSB_I2S_REG_INT_UR |
+                       TSB_I2S_REG_INT_OR | TSB_I2S_REG_INT_INT);
+
+    tsb_i2s_dma_dir_cancel(&tsb_i2s_dma.rx);
+
+    info->flags &= ~TSB_I2S_FLAG_RX_ACTIVE;
+
+    irqrestore(flags);
+}
+
+int tsb_i2s_start_transmitter(struct tsb_i2s_info *info)
+{
+    irqstate_t flags;
+    int ret;
+
+    flags = irqsave();
+
+    /* Queue the first entries before starting so the FIFO fills up first */
+    ret = tsb_i2s_tx_data(info);
+    if (ret)
+        goto err_irqrestore;
+
+    if (tsb_i2s_tx_is_active(info))
+        goto err_irqrestore;
+
+    tsb_i2s_clear_irqs(info, TSB_I2S_BLOCK_SO,
+                       TSB_I2S_REG_INT_LRCK | TSB_I2S_REG_INT_UR |
+                       TSB_I2S_REG_INT_OR | TSB_I2S_REG_INT_INT);
+    tsb_i2s_unmask_irqs(info, TSB_I2S_BLOCK_SO,
+                        TSB_I2S_REG_INT_DMACMSK | TSB_I2S_REG_INT_LRCK |
+                        TSB_I2S_REG_INT_UR | TSB_I2S_REG_INT_OR);
+
+    ret = tsb_i2s_start(info, TSB_I2S_BLOCK_SO);
+    if (ret)
+        goto err_cancel;
+
+    info->flags |= TSB_I2S_FLAG_TX_ACTIVE;
+
+    irqrestore(flags);
+
+    return 0;
+
+err_cancel:
+    tsb_i2s_mask_irqs(info, TSB_I2S_BLOCK_SO,
+                      TSB_I2S_REG_INT_DMACMSK | TSB_I2S_REG_INT_LRCK |
+                      TSB_I2S_REG_INT_UR | TSB_I2S_REG_INT_OR);
+    tsb_i2s_dma_dir_cancel(&tsb_i2s_dma.tx);
+err_irqrestore:
+    irqrestore(flags);
+
+    return ret;
+}
+
+void tsb_i2s_stop_transmitter(struct tsb_i2s_info *info, int is_err)
+{
+    irqstate_t flags;
+
+    flags = irqsave();
+
+    tsb_i2s_stop(info, TSB_I2S_BLOCK_SO, is_err);
+
+    tsb_i2s_mask_irqs(info, TSB_I2S_BLOCK_SO,
+                      TSB_I2S_REG_INT_DMACMSK | TSB_I2S_REG_INT_LRCK |
+                      TSB_I2S_REG_INT_UR | TSB_I2S_REG_INT_OR |
+                      TSB_I2S_REG_INT_INT);
+    tsb_i2s_clear_irqs(info, TSB_I2S_BLOCK_SO,
+                       TSB_I2S_REG_INT_LRCK | TSB_I2S_REG_INT_UR |
+                       TSB_I2S_REG_INT_OR | TSB_I2S_REG_INT_INT);
+
+    tsb_i2s_dma_dir_cancel(&tsb_i2s_dma.tx);
+
+    info->flags &= ~TSB_I2S_FLAG_TX_ACTIVE;
+
+    irqrestore(flags);
+}
+
+/* The SO/SI data irqs stay masked; only the error irqs are used */
+int tsb_i2s_xfer_irq_attach(struct tsb_i2s_info *info)
+{
+    return OK;
+}
+
+int tsb_i2s_xfer_irq_detach(struct tsb_i2s_info *info)
+{
+    return OK;
+}
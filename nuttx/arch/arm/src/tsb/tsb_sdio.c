@@ -1324,8 +1324,8 @@ static int sdio_irq_handler(int irq, void *context)
  * @brief Write data from buffer to FIFO.
  *
  * This function put the data from buffer to FIFO until the buffer is
- * empty. If buffer is empty, it calls the up layer callback
- * function in case of non-blocking mode.
+ * empty. Once the transfer is over, successfully or not, it calls the up
+ * layer callback function in case of non-blocking mode.
  *
  * @param info The SDIO driver information.
  * @return None.
@@ -1338,6 +1338,7 @@ static void sdio_write_fifo_data(struct tsb_sdio_info *info)
                          DAT_LINE_ACTIVE | COMMAND_INHIBIT_DAT;
     int16_t remaining = 0, i = 0;
     uint8_t *wbuf = info->write_buf.buffer;
+    int ret = 0;
 
     presentstate = sdio_getreg(info->sdio_reg_base, PRESENTSTATE);
     while (presentstate & data_mask) {
@@ -1346,6 +1347,7 @@ static void sdio_write_fifo_data(struct tsb_sdio_info *info)
             /* Recover error interrupt */
             sdio_error_interrupt_recovery(info);
             info->data_timeout = false;
+            ret = -ETIMEDOUT;
             break;
         }
 
@@ -1383,26 +1385,28 @@ static void sdio_write_fifo_data(struct tsb_sdio_info *info)
                 info->write_buf.head = info->write_buf.tail;
             }
             sdio_putreg(info->sdio_reg_base, DATAPORTREG, buf_port);
-
-            /* More blocks? */
-            if (info->write_buf.head == info->write_buf.tail) { /* No */
-                if (info->write_callback) { /* Non-blocking */
-                    info->flags &= ~SDIO_FLAG_WRITE;
-                    info->write_callback(info->write_buf.head, info->blksz,
-                                         info->write_buf.buffer, 0);
-                }
-            }
         }
         presentstate = sdio_getreg(info->sdio_reg_base, PRESENTSTATE);
     }
+
+    /* The loop also ends early on errors: report them to the up layer */
+    if (!ret && info->write_buf.head != info->write_buf.tail) {
+        ret = -EIO;
+    }
+
+    if (info->write_callback) { /* Non-blocking */
+        info->flags &= ~SDIO_FLAG_WRITE;
+        info->write_callback(info->blocks, info->blksz,
+                             info->write_buf.buffer, ret);
+    }
 }
 
 /**
  * @brief Read data from FIFO to buffer.
  *
  * This function put the data from buffer to FIFO until the buffer is
- * empty. If buffer is empty, it calls the up layer callback
- * function in case of non-blocking mode.
+ * empty. Once the transfer is over, successfully or not, it calls the up
+ * layer callback function in case of non-blocking mode.
  *
  * @param info The SDIO driver information.
  * @return None.
@@ -1415,6 +1419,7 @@ static void sdio_read_fifo_data(struct tsb_sdio_info *info)
                          DAT_LINE_ACTIVE | COMMAND_INHIBIT_DAT;
     int16_t remaining = 0, i = 0;
     uint8_t *rbuf = info->read_buf.buffer;
+    int ret = 0;
 
     presentstate = sdio_getreg(info->sdio_reg_base, PRESENTSTATE);
     while (presentstate & data_mask) {
@@ -1423,6 +1428,7 @@ static void sdio_read_fifo_data(struct tsb_sdio_info *info)
             /* Recover error interrupt */
             sdio_error_interrupt_recovery(info);
             info->data_timeout = false;
+            ret = -ETIMEDOUT;
             break;
         }
 
@@ -1463,18 +1469,20 @@ static void sdio_read_fifo_data(struct tsb_sdio_info *info)
                 }
                 info->read_buf.head = info->read_buf.tail;
             }
-
-            /* More blocks? */
-            if (info->read_buf.head == info->read_buf.tail) { /* No */
-                if (info->read_callback) { /* Non-blocking */
-                    info->flags &= ~SDIO_FLAG_READ;
-                    info->read_callback(info->read_buf.head, info->blksz,
-                                        info->read_buf.buffer, 0);
-                }
-            }
         }
         presentstate = sdio_getreg(info->sdio_reg_base, PRESENTSTATE);
     }
+
+    /* The loop also ends early on errors: report them to the up layer */
+    if (!ret && info->read_buf.head != info->read_buf.tail) {
+        ret = -EIO;
+    }
+
+    if (info->read_callback) { /* Non-blocking */
+        info->flags &= ~SDIO_FLAG_READ;
+        info->read_callback(info->blocks, info->blksz,
+                            info->read_buf.buffer, ret);
+    }
 }
 
 /**
@@ -1110,6 +1110,45 @@ static int tsb_uart_stop_receiver(struct device *dev)
     return 0;
 }
 
+/**
+* @brief Flush the receiver.
+*
+* The function completes the non-blocking receiving with the characters
+* already in the buffer. The receiver FIFO is not reset, the characters it
+* holds are read by the next receiving.
+*
+* @param dev The pointer to the UART device structure.
+* @return 0 for success, -errno for failure.
+*/
+static int tsb_uart_flush_receiver(struct device *dev)
+{
+    struct tsb_uart_info *uart_info = NULL;
+    irqstate_t flags;
+
+    if (dev == NULL) {
+        return -EINVAL;
+    }
+
+    uart_info = device_get_private(dev);
+
+    flags = irqsave();
+
+    if (!(uart_info->flags & TSB_UART_FLAG_RECV) || !uart_info->rx_callback) {
+        irqrestore(flags);
+        return -EINVAL;
+    }
+
+    /* Disable receive interrupt. */
+    ua_reg_bit_clr(uart_info->reg_base, UA_IER_DLH, UA_IER_ERBFI | UA_IER_ELSI);
+    uart_info->flags &= ~TSB_UART_FLAG_RECV;
+    uart_info->rx_callback(uart_info->recv.buffer, uart_info->recv.head,
+                           uart_info->line_err);
+
+    irqrestore(flags);
+
+    return 0;
+}
+
 /**
 * @brief The device open function.
 *
@@ -1360,6 +1399,7 @@ static struct device_uart_type_ops tsb_uart_type_ops = {
     .stop_transmitter   = tsb_uart_stop_transmitter,
     .start_receiver     = tsb_uart_start_receiver,
     .stop_receiver      = tsb_uart_stop_receiver,
+    .flush_receiver     = tsb_uart_flush_receiver,
 };
 
 static struct device_driver_ops tsb_uart_driver_ops = {
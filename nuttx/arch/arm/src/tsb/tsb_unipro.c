@@ -230,6 +230,9 @@ static int unipro_init_cport(unsigned int cportid)
     cport->max_inflight_buf_count = CONFIG_TSB_UNIPRO_MAX_INFLIGHT_BUFCOUNT;
 #endif
     cport->switch_buf_on_free = false;
+    cport->rx_hold = false;
+
+    unipro_rxbuf_ring_fill(cport);
 
     cport->rx_buf = unipro_rxbuf_alloc(cportid);
     if (!cport->rx_buf) {
@@ -392,12 +395,13 @@ static int irq_rx_eom(int irq, void *context) {
                 data);
 
     if (cport->driver->rx_handler) {
-        newbuf = unipro_rxbuf_alloc(cport->cportid);
+        newbuf = cport->rx_hold ? NULL : unipro_rxbuf_alloc(cport->cportid);
         if (newbuf) {
             unipro_switch_rxbuf(cport->cportid, newbuf);
             unipro_unpause_rx(cport->cportid);
         } else {
             cport->switch_buf_on_free = true;
+            cport->rx_pause_count++;
             DBG_UNIPRO("cport %u: switch buf when available\n", cport->cportid);
         }
 
@@ -709,9 +713,25 @@ static void dump_regs(void) {
             DBG_CPORT_ATTR(T_RXTOKENVALUE, i);
             DBG_CPORT_ATTR(T_TXTOKENVALUE, i);
             DBG_CPORT_ATTR(T_CONNECTIONSTATE, i);
+            lldbg("    RX ring: %u/%u free, %u inflight, %u fallback allocs\n",
+                  cport->rx_ring_count, cport->rx_ring_depth,
+                  atomic_get(&cport->inflight_buf_count),
+                  cport->rx_ring_fallback_count);
+            lldbg("    RX paused: %u, resumed: %u\n",
+                  cport->rx_pause_count, cport->rx_resume_count);
+            lldbg("    TX class: %u, weight: %u\n",
+                  cport->tx_class, cport->tx_weight);
+            lldbg("    TX batches: %u, messages: %u, bytes: %u\n",
+                  cport->tx_batch_count, cport->tx_batch_msg_count,
+                  cport->tx_batch_byte_count);
         }
     }
 
+    unipro_tx_sched_dump();
+#ifdef CONFIG_ARCH_UNIPROTX_USE_DMA
+    unipro_tx_dma_dump();
+#endif
+
     lldbg("NVIC:\n");
     lldbg("========================================\n");
     tsb_dumpnvic();
@@ -778,6 +798,8 @@ void unipro_init(void)
         return;
     }
 
+    unipro_tx_sched_init();
+
     retval = unipro_tx_init();
     if (retval) {
         free(cporttable);
@@ -791,6 +813,8 @@ void unipro_init(void)
         cport->cportid = i;
         cport->connected = 0;
         list_init(&cport->tx_fifo);
+        cport->rx_ring_depth = CONFIG_TSB_UNIPRO_RX_RING_DEPTH;
+        unipro_tx_sched_init_cport(cport);
 
         _unipro_reset_cport(i);
     }
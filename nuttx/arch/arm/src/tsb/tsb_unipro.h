@@ -60,8 +60,34 @@ struct cport {
     atomic_t inflight_buf_count;
     size_t max_inflight_buf_count;
     bool switch_buf_on_free;
+    bool rx_hold;                   // RX paused by the CPort's user
+
+    /* Preallocated RX buffers */
+    void *rx_ring[CONFIG_TSB_UNIPRO_RX_RING_SIZE];
+    unsigned int rx_ring_head;
+    unsigned int rx_ring_count;
+    unsigned int rx_ring_depth;     // ring size wanted for this CPort
+    unsigned int rx_ring_missing;   // buffers the ring lacks, bufram was short
+    unsigned int rx_ring_fallback_count;
+    unsigned int rx_pause_count;
+    unsigned int rx_resume_count;
 
     struct list_head tx_fifo;
+    unsigned int tx_fifo_len;
+
+    /* TX scheduler */
+    struct list_head tx_sched_node;
+    bool tx_sched_active;
+    bool tx_sched_blocked;
+    uint8_t tx_class;
+    uint16_t tx_weight;
+    int tx_deficit;
+    unsigned int tx_burst;
+
+    /* TX batching statistics */
+    unsigned int tx_batch_count;
+    unsigned int tx_batch_msg_count;
+    unsigned int tx_batch_byte_count;
 };
 
 struct cport *cport_handle(unsigned int cportid);
@@ -69,7 +95,22 @@ uint16_t unipro_get_tx_free_buffer_space(struct cport *cport);
 int unipro_tx_init(void);
 int _unipro_reset_cport(unsigned int cportid);
 void unipro_reset_notify(unsigned int cportid);
+
+void unipro_tx_sched_init(void);
+void unipro_tx_sched_init_cport(struct cport *cport);
+void unipro_tx_sched_wake(struct cport *cport);
+void unipro_tx_sched_block(struct cport *cport);
+void unipro_tx_sched_unblock(struct cport *cport);
+void unipro_tx_sched_yield(struct cport *cport);
+struct cport *unipro_tx_sched_next(void);
+void unipro_tx_sched_started(struct cport *cport, uint32_t queued);
+void unipro_tx_sched_sent(struct cport *cport, size_t len);
+void unipro_tx_sched_dump(void);
+#ifdef CONFIG_ARCH_UNIPROTX_USE_DMA
+void unipro_tx_dma_dump(void);
+#endif
 void unipro_switch_rxbuf(unsigned int cportid, void *buffer);
+int unipro_rxbuf_ring_fill(struct cport *cport);
 int unipro_unpause_rx(unsigned int cportid);
 
 #endif /* __TSB_UNIPRO_H__ */
@@ -29,13 +29,161 @@
  */
 
 #include <stddef.h>
+#include <stdbool.h>
 #include <errno.h>
 
 #include "tsb_unipro.h"
 
 #include <nuttx/bufram.h>
+#include <nuttx/util.h>
 #include <nuttx/unipro/unipro.h>
 #include <nuttx/arch.h>
+#include <arch/irq.h>
+
+#include "debug.h"
+
+/*
+ * Each CPort owns a ring of preallocated RX buffers, filled when the CPort
+ * gets connected, so that the RX interrupt only has to pop a buffer from it.
+ * The ring holds up to max_inflight_buf_count buffers, capped to the depth
+ * of the CPort (CONFIG_TSB_UNIPRO_RX_RING_DEPTH unless changed). Only CPorts
+ * allowed to have more inflight buffers than that fall back to bufram once
+ * their ring is empty.
+ *
+ * When bufram runs short, a ring may be left partially filled. The buffers
+ * it lacks are counted, and the ring gets topped up later: buffers freed by
+ * other CPorts with a full ring are handed to it rather than to bufram, and
+ * its CPort may allocate the missing ones from bufram when its ring is
+ * empty.
+ */
+
+/* Buffers missing from all the rings */
+static unsigned int rx_ring_missing;
+
+static unsigned int rx_ring_depth(struct cport *cport)
+{
+    return MIN(cport->rx_ring_depth, ARRAY_SIZE(cport->rx_ring));
+}
+
+static unsigned int rx_ring_target(struct cport *cport)
+{
+    if (cport->max_inflight_buf_count == INFINITE_MAX_INFLIGHT_BUFCOUNT)
+        return rx_ring_depth(cport);
+
+    return MIN(cport->max_inflight_buf_count, rx_ring_depth(cport));
+}
+
+/* Must be called from an atomic context */
+static void rx_ring_set_missing(struct cport *cport, unsigned int missing)
+{
+    rx_ring_missing -= cport->rx_ring_missing;
+    rx_ring_missing += missing;
+    cport->rx_ring_missing = missing;
+}
+
+/* Must be called from an atomic context */
+static void *rx_ring_pop(struct cport *cport)
+{
+    void *buf;
+
+    if (!cport->rx_ring_count)
+        return NULL;
+
+    buf = cport->rx_ring[cport->rx_ring_head];
+    cport->rx_ring_head = (cport->rx_ring_head + 1) % ARRAY_SIZE(cport->rx_ring);
+    cport->rx_ring_count--;
+
+    return buf;
+}
+
+/* Must be called from an atomic context */
+static bool rx_ring_push(struct cport *cport, void *buf)
+{
+    unsigned int tail;
+
+    if (cport->rx_ring_count >= rx_ring_target(cport))
+        return false;
+
+    tail = (cport->rx_ring_head + cport->rx_ring_count) %
+           ARRAY_SIZE(cport->rx_ring);
+    cport->rx_ring[tail] = buf;
+    cport->rx_ring_count++;
+
+    return true;
+}
+
+/*
+ * Give a buffer to a connected CPort whose ring could not be filled.
+ * Must be called from an atomic context
+ */
+static bool rx_ring_give(void *buf)
+{
+    struct cport *cport;
+    unsigned int i;
+
+    for (i = 0; i < unipro_cport_count(); i++) {
+        cport = cport_handle(i);
+        if (!cport || !cport->rx_ring_missing)
+            continue;
+
+        if (cport->connected && rx_ring_push(cport, buf)) {
+            rx_ring_set_missing(cport, cport->rx_ring_missing - 1);
+            return true;
+        }
+
+        /* Disconnected, or the ring got full some other way */
+        rx_ring_set_missing(cport, 0);
+    }
+
+    return false;
+}
+
+/**
+ * @brief Fill or trim the RX buffer ring of a CPort to its target size
+ * @param cport CPort whose ring to refill
+ * @return 0 on success, -ENOMEM if the ring could not be filled completely
+ */
+int unipro_rxbuf_ring_fill(struct cport *cport)
+{
+    size_t page_count = bufram_size_to_page_count(CPORT_BUF_SIZE);
+    irqstate_t flags;
+    bool pushed;
+    void *buf;
+
+    flags = irqsave();
+    rx_ring_set_missing(cport, 0);
+    while (cport->rx_ring_count > rx_ring_target(cport)) {
+        cport->rx_ring_count--;
+        buf = cport->rx_ring[(cport->rx_ring_head + cport->rx_ring_count) %
+                             ARRAY_SIZE(cport->rx_ring)];
+        bufram_page_free(buf, page_count);
+    }
+    irqrestore(flags);
+
+    while (cport->rx_ring_count < rx_ring_target(cport)) {
+        buf = bufram_page_alloc(page_count);
+        if (!buf) {
+            lowsyslog("unipro: couldn't fill RX ring of CP%u\n",
+                      cport->cportid);
+            flags = irqsave();
+            rx_ring_set_missing(cport,
+                                rx_ring_target(cport) - cport->rx_ring_count);
+            irqrestore(flags);
+            return -ENOMEM;
+        }
+
+        flags = irqsave();
+        pushed = rx_ring_push(cport, buf);
+        irqrestore(flags);
+
+        if (!pushed) {
+            bufram_page_free(buf, page_count);
+            break;
+        }
+    }
+
+    return 0;
+}
 
 int unipro_set_max_inflight_rxbuf_count(unsigned int cportid,
                                         size_t max_inflight_buf)
@@ -45,12 +193,38 @@ int unipro_set_max_inflight_rxbuf_count(unsigned int cportid,
         return -EINVAL;
 
     cport->max_inflight_buf_count = max_inflight_buf;
+
+    if (cport->connected)
+        return unipro_rxbuf_ring_fill(cport);
+
+    return 0;
+}
+
+/**
+ * @brief Set how many RX buffers are preallocated for a CPort
+ * @param cportid CPort to configure
+ * @param depth number of buffers, from 1 to CONFIG_TSB_UNIPRO_RX_RING_SIZE
+ * @return 0 on success, -EINVAL on invalid parameters, -ENOMEM if the ring
+ *         of a connected CPort could not be filled completely
+ */
+int unipro_set_rxbuf_ring_depth(unsigned int cportid, size_t depth)
+{
+    struct cport *cport = cport_handle(cportid);
+    if (!cport || !depth || depth > ARRAY_SIZE(cport->rx_ring))
+        return -EINVAL;
+
+    cport->rx_ring_depth = depth;
+
+    if (cport->connected)
+        return unipro_rxbuf_ring_fill(cport);
+
     return 0;
 }
 
 void *unipro_rxbuf_alloc(unsigned int cportid)
 {
     struct cport *cport = cport_handle(cportid);
+    irqstate_t flags;
     void *buf;
 
     if (!cport)
@@ -65,10 +239,33 @@ void *unipro_rxbuf_alloc(unsigned int cportid)
         return NULL;
     }
 
-    buf = bufram_page_alloc(bufram_size_to_page_count(CPORT_BUF_SIZE));
+    flags = irqsave();
+    buf = rx_ring_pop(cport);
+    irqrestore(flags);
+
     if (!buf) {
-        DBG_UNIPRO("Couldn't allocate rx buf for CP%u: no bufram\n", cportid);
-        return NULL;
+        if (!cport->rx_ring_missing &&
+            cport->max_inflight_buf_count != INFINITE_MAX_INFLIGHT_BUFCOUNT &&
+            cport->max_inflight_buf_count <= rx_ring_depth(cport)) {
+            DBG_UNIPRO("Couldn't allocate rx buf for CP%u: ring empty\n",
+                       cportid);
+            return NULL;
+        }
+
+        buf = bufram_page_alloc(bufram_size_to_page_count(CPORT_BUF_SIZE));
+        if (!buf) {
+            DBG_UNIPRO("Couldn't allocate rx buf for CP%u: no bufram\n",
+                       cportid);
+            return NULL;
+        }
+
+        /* A buffer the ring lacked: it goes to the ring once freed */
+        flags = irqsave();
+        if (cport->rx_ring_missing)
+            rx_ring_set_missing(cport, cport->rx_ring_missing - 1);
+        else
+            cport->rx_ring_fallback_count++;
+        irqrestore(flags);
     }
 
     atomic_inc(&cport->inflight_buf_count);
@@ -86,8 +283,9 @@ void unipro_rxbuf_free(unsigned int cportid, void *ptr)
 
     flags = irqsave();
 
-    if (cport->switch_buf_on_free) {
+    if (cport->switch_buf_on_free && !cport->rx_hold) {
         cport->switch_buf_on_free = false;
+        cport->rx_resume_count++;
         irqrestore(flags);
 
         unipro_switch_rxbuf(cportid, ptr);
@@ -95,8 +293,69 @@ void unipro_rxbuf_free(unsigned int cportid, void *ptr)
         return;
     }
 
+    atomic_dec(&cport->inflight_buf_count);
+
+    if (rx_ring_push(cport, ptr) || (rx_ring_missing && rx_ring_give(ptr))) {
+        irqrestore(flags);
+        return;
+    }
+
     irqrestore(flags);
 
-    atomic_dec(&cport->inflight_buf_count);
     bufram_page_free(ptr, bufram_size_to_page_count(CPORT_BUF_SIZE));
 }
+
+/**
+ * @brief Pause RX on a CPort until unipro_release_rx() is called
+ *
+ * The message being received is still delivered, but the CPort is given no
+ * new buffer after it, which flow controls the sender.
+ */
+int unipro_hold_rx(unsigned int cportid)
+{
+    struct cport *cport = cport_handle(cportid);
+
+    if (!cport)
+        return -EINVAL;
+
+    cport->rx_hold = true;
+    return 0;
+}
+
+/**
+ * @brief Resume RX on a CPort paused by unipro_hold_rx()
+ */
+int unipro_release_rx(unsigned int cportid)
+{
+    struct cport *cport = cport_handle(cportid);
+    irqstate_t flags;
+    void *buf = NULL;
+
+    if (!cport)
+        return -EINVAL;
+
+    flags = irqsave();
+
+    cport->rx_hold = false;
+
+    /*
+     * If no buffer could be given to the CPort while it was held, give it
+     * one now. Otherwise the next freed buffer will do.
+     */
+    if (cport->switch_buf_on_free) {
+        buf = unipro_rxbuf_alloc(cportid);
+        if (buf) {
+            cport->switch_buf_on_free = false;
+            cport->rx_resume_count++;
+        }
+    }
+
+    irqrestore(flags);
+
+    if (buf) {
+        unipro_switch_rxbuf(cportid, buf);
+        unipro_unpause_rx(cportid);
+    }
+
+    return 0;
+}
@@ -34,6 +34,9 @@
 #include <nuttx/irq.h>
 #include <nuttx/arch.h>
 #include <nuttx/list.h>
+#include <nuttx/wdog.h>
+#include <nuttx/clock.h>
+#include <nuttx/hires_tmr.h>
 #include <nuttx/unipro/unipro.h>
 
 #include "debug.h"
@@ -55,8 +58,48 @@ struct unipro_buffer {
     int byte_sent;
     int len;
     const void *data;
+    uint32_t queued;
 };
 
+static struct unipro_buffer tx_buffers[CONFIG_ARCH_UNIPRO_TX_DESC_COUNT];
+static struct list_head tx_buffer_pool;
+#if CONFIG_ARCH_UNIPRO_TX_FLUSH_USEC > 0
+static struct wdog_s tx_flush_wd;
+#endif
+
+static struct unipro_buffer *unipro_alloc_tx_buffer(void)
+{
+    struct unipro_buffer *buffer;
+    irqstate_t flags;
+
+    flags = irqsave();
+    if (list_is_empty(&tx_buffer_pool)) {
+        irqrestore(flags);
+        return zalloc(sizeof(*buffer));
+    }
+
+    buffer = list_entry(tx_buffer_pool.next, struct unipro_buffer, list);
+    list_del(&buffer->list);
+    irqrestore(flags);
+
+    memset(buffer, 0, sizeof(*buffer));
+    return buffer;
+}
+
+static void unipro_free_tx_buffer(struct unipro_buffer *buffer)
+{
+    irqstate_t flags;
+
+    if (buffer < tx_buffers || buffer >= &tx_buffers[ARRAY_SIZE(tx_buffers)]) {
+        free(buffer);
+        return;
+    }
+
+    flags = irqsave();
+    list_add(&tx_buffer_pool, &buffer->list);
+    irqrestore(flags);
+}
+
 static int unipro_send_sync(unsigned int cportid,
                             const void *buf, size_t len, bool som);
 
@@ -69,7 +112,8 @@ static inline void unipro_set_eom_flag(struct cport *cport)
     putreg8(1, CPORT_EOM_BIT(cport));
 }
 
-static void unipro_dequeue_tx_buffer(struct unipro_buffer *buffer, int status)
+static void unipro_dequeue_tx_buffer(struct cport *cport,
+                                     struct unipro_buffer *buffer, int status)
 {
     irqstate_t flags;
 
@@ -77,13 +121,18 @@ static void unipro_dequeue_tx_buffer(struct unipro_buffer *buffer, int status)
 
     flags = irqsave();
     list_del(&buffer->list);
+    cport->tx_fifo_len--;
     irqrestore(flags);
 
+    if (!status) {
+        unipro_tx_sched_sent(cport, buffer->len);
+    }
+
     if (buffer->callback) {
         buffer->callback(status, buffer->data, buffer->priv);
     }
 
-    free(buffer);
+    unipro_free_tx_buffer(buffer);
 }
 
 static void unipro_flush_cport(struct cport *cport)
@@ -102,7 +151,7 @@ static void unipro_flush_cport(struct cport *cport)
 
     while (!list_is_empty(&cport->tx_fifo)) {
         buffer = list_entry(cport->tx_fifo.next, struct unipro_buffer, list);
-        unipro_dequeue_tx_buffer(buffer, -ECONNRESET);
+        unipro_dequeue_tx_buffer(cport, buffer, -ECONNRESET);
     }
 
 reset:
@@ -150,13 +199,18 @@ static int unipro_send_tx_buffer(struct cport *cport)
 
     if (cport->pending_reset) {
         unipro_flush_cport(cport);
+        return 0;
+    }
+
+    if (buffer->som) {
+        unipro_tx_sched_started(cport, buffer->queued);
     }
 
     retval = unipro_send_sync(cport->cportid,
                               buffer->data + buffer->byte_sent,
                               buffer->len - buffer->byte_sent, buffer->som);
     if (retval < 0) {
-        unipro_dequeue_tx_buffer(buffer, retval);
+        unipro_dequeue_tx_buffer(cport, buffer, retval);
         lldbg("unipro_send_sync failed. Dropping message...\n");
         return -EINVAL;
     }
@@ -166,7 +220,7 @@ static int unipro_send_tx_buffer(struct cport *cport)
 
     if (buffer->byte_sent >= buffer->len) {
         unipro_set_eom_flag(cport);
-        unipro_dequeue_tx_buffer(buffer, 0);
+        unipro_dequeue_tx_buffer(cport, buffer, 0);
         return 0;
     }
 
@@ -175,43 +229,75 @@ static int unipro_send_tx_buffer(struct cport *cport)
 
 /**
  * @brief           Send data buffer(s) on CPort whenever ready.
- *                  Ensure that TX queues are reinspected until
- *                  all CPorts have no work available.
+ *                  The TX scheduler picks the CPort to serve until no CPort
+ *                  has work available.
  *                  Then suspend again until new data is available.
  */
 static void *unipro_tx_worker(void *data)
 {
-    int i;
-    bool is_busy;
+    struct cport *cport;
     int retval;
-    unsigned int cport_count = unipro_cport_count();
 
     while (1) {
         /* Block until a buffer is pending on any CPort */
         sem_wait(&worker.tx_fifo_lock);
 
-        do {
-            is_busy = false;
-
-            for (i = 0; i < cport_count; i++) {
-                /* Browse all CPorts sending any pending buffers */
-                retval = unipro_send_tx_buffer(cport_handle(i));
-                if (retval == -EBUSY) {
-                    /*
-                     * Buffer only partially sent, have to try again for
-                     * remaining part.
-                     */
-                    is_busy = true;
-                }
+        while ((cport = unipro_tx_sched_next()) != NULL) {
+            retval = unipro_send_tx_buffer(cport);
+            if (retval == -EBUSY) {
+                /*
+                 * Buffer only partially sent, let the other CPorts of the
+                 * same class go first before trying again for the remaining
+                 * part.
+                 */
+                unipro_tx_sched_yield(cport);
             }
-        } while (is_busy); /* exit when CPort(s) current pending buffer sent */
+        }
     }
 
     return NULL;
 }
 
+#if CONFIG_ARCH_UNIPRO_TX_FLUSH_USEC > 0
+static void unipro_tx_flush(int argc, uint32_t arg, ...)
+{
+    sem_post(&worker.tx_fifo_lock);
+}
+#endif
+
+/**
+ * @brief           Decide whether the TX worker must be woken up right after
+ *                  a buffer has been queued, or if the flush can be delayed
+ *                  to batch it with the next buffers of the CPort.
+ * @note            This function should be called from an atomic context
+ */
+static bool unipro_tx_should_flush(struct cport *cport)
+{
+#if CONFIG_ARCH_UNIPRO_TX_FLUSH_USEC > 0
+    if (cport->tx_fifo_len < CONFIG_ARCH_UNIPRO_TX_BATCH) {
+        if (!WDOG_ISACTIVE(&tx_flush_wd)) {
+            wd_start(&tx_flush_wd,
+                     USEC2TICK(CONFIG_ARCH_UNIPRO_TX_FLUSH_USEC) + 1,
+                     unipro_tx_flush, 0);
+        }
+        return false;
+    }
+#endif
+
+    return true;
+}
+
 void unipro_reset_notify(unsigned int cportid)
 {
+    struct cport *cport = cport_handle(cportid);
+    irqstate_t flags;
+
+    if (cport) {
+        flags = irqsave();
+        unipro_tx_sched_wake(cport);
+        irqrestore(flags);
+    }
+
     /*
      * if the tx worker is blocked on the semaphore, post something on it
      * in order to unlock it and have the reset happen right away.
@@ -255,7 +341,7 @@ int unipro_send_async(unsigned int cportid, const void *buf, size_t len,
 
     DEBUGASSERT(TRANSFER_MODE == 2);
 
-    buffer = zalloc(sizeof(*buffer));
+    buffer = unipro_alloc_tx_buffer();
     if (!buffer) {
         return -ENOMEM;
     }
@@ -265,12 +351,17 @@ int unipro_send_async(unsigned int cportid, const void *buf, size_t len,
     buffer->callback = callback;
     buffer->priv = priv;
     buffer->data = buf;
+    buffer->queued = hrt_getusec();
 
     flags = irqsave();
     list_add(&cport->tx_fifo, &buffer->list);
+    cport->tx_fifo_len++;
+    unipro_tx_sched_wake(cport);
+    if (unipro_tx_should_flush(cport)) {
+        sem_post(&worker.tx_fifo_lock);
+    }
     irqrestore(flags);
 
-    sem_post(&worker.tx_fifo_lock);
     return 0;
 }
 
@@ -375,9 +466,19 @@ static int unipro_send_sync(unsigned int cportid,
 int unipro_tx_init(void)
 {
     int retval;
+    int i;
 
     sem_init(&worker.tx_fifo_lock, 0, 0);
 
+    list_init(&tx_buffer_pool);
+    for (i = 0; i < ARRAY_SIZE(tx_buffers); i++) {
+        list_add(&tx_buffer_pool, &tx_buffers[i].list);
+    }
+
+#if CONFIG_ARCH_UNIPRO_TX_FLUSH_USEC > 0
+    wd_static(&tx_flush_wd);
+#endif
+
     retval = pthread_create(&worker.thread, NULL, unipro_tx_worker, NULL);
     if (retval) {
         lldbg("Failed to create worker thread: %s.\n", strerror(errno));
@@ -36,6 +36,9 @@
 #include <nuttx/irq.h>
 #include <nuttx/arch.h>
 #include <nuttx/list.h>
+#include <nuttx/wdog.h>
+#include <nuttx/clock.h>
+#include <nuttx/hires_tmr.h>
 #include <nuttx/unipro/unipro.h>
 #include <nuttx/device_dma.h>
 #include "nuttx/device_atabl.h"
@@ -43,6 +46,7 @@
 #include "debug.h"
 #include "up_arch.h"
 #include "tsb_scm.h"
+#include "tsb_dma.h"
 #include "tsb_unipro.h"
 #include "tsb_unipro_es2.h"
 
@@ -77,6 +81,7 @@ struct unipro_xfer_descriptor {
 
     size_t data_offset;
     void *channel;
+    uint32_t queued;
 
     struct list_head list;
 };
@@ -100,6 +105,48 @@ static struct {
     int max_channel;
 } unipro_dma;
 
+static struct unipro_xfer_descriptor tx_descs[CONFIG_ARCH_UNIPRO_TX_DESC_COUNT];
+static struct list_head tx_desc_pool;
+#if CONFIG_ARCH_UNIPRO_TX_FLUSH_USEC > 0
+static struct wdog_s tx_flush_wd;
+#endif
+
+static int unipro_dma_xfer(struct unipro_xfer_descriptor *desc,
+                           struct dma_channel *channel);
+
+static struct unipro_xfer_descriptor *unipro_alloc_tx_desc(void)
+{
+    struct unipro_xfer_descriptor *desc;
+    irqstate_t flags;
+
+    flags = irqsave();
+    if (list_is_empty(&tx_desc_pool)) {
+        irqrestore(flags);
+        return zalloc(sizeof(*desc));
+    }
+
+    desc = containerof(tx_desc_pool.next, struct unipro_xfer_descriptor, list);
+    list_del(&desc->list);
+    irqrestore(flags);
+
+    memset(desc, 0, sizeof(*desc));
+    return desc;
+}
+
+static void unipro_free_tx_desc(struct unipro_xfer_descriptor *desc)
+{
+    irqstate_t flags;
+
+    if (desc < tx_descs || desc >= &tx_descs[ARRAY_SIZE(tx_descs)]) {
+        free(desc);
+        return;
+    }
+
+    flags = irqsave();
+    list_add(&tx_desc_pool, &desc->list);
+    irqrestore(flags);
+}
+
 static uint32_t unipro_read(uint32_t offset) {
     return getreg32((volatile unsigned int*)(AIO_UNIPRO_BASE + offset));
 }
@@ -125,13 +172,14 @@ static void unipro_dequeue_tx_desc(struct unipro_xfer_descriptor *desc, int stat
 
     flags = irqsave();
     list_del(&desc->list);
+    desc->cport->tx_fifo_len--;
     irqrestore(flags);
 
     if (desc->callback) {
         desc->callback(status, desc->data, desc->priv);
     }
 
-    free(desc);
+    unipro_free_tx_desc(desc);
 }
 
 static void unipro_flush_cport(struct cport *cport)
@@ -159,41 +207,54 @@ reset:
     cport->reset_completion_cb = cport->reset_completion_cb_priv = NULL;
 }
 
-static struct unipro_xfer_descriptor *pick_tx_descriptor(unsigned int cportid)
+/**
+ * @brief           Reserve the descriptor at the head of a CPort TX queue for
+ *                  a DMA channel, if it is not already being transferred and
+ *                  the CPort has room for it.
+ *                  Otherwise the CPort is blocked in the TX scheduler until
+ *                  its current transfer completes.
+ * @return          The reserved descriptor, or NULL
+ */
+static struct unipro_xfer_descriptor *
+unipro_claim_tx_descriptor(struct cport *cport, struct dma_channel *channel)
 {
-    struct unipro_xfer_descriptor *desc;
-    unsigned int cport_count = unipro_cport_count();
-    int i;
+    struct unipro_xfer_descriptor *desc = NULL;
+    irqstate_t flags;
 
-    for (i = 0; i < cport_count; i++, cportid++) {
-        struct cport *cport;
+    flags = irqsave();
 
-        cportid = cportid % cport_count;
-        cport = cport_handle(cportid);
-        if (!cport)
-            continue;
+    if (list_is_empty(&cport->tx_fifo) || cport->pending_reset)
+        goto out;
 
-        if (list_is_empty(&cport->tx_fifo)) {
-            if (cport->pending_reset) {
-                unipro_flush_cport(cport);
-            }
+    desc = containerof(cport->tx_fifo.next, struct unipro_xfer_descriptor,
+                       list);
+    if (desc->channel || !unipro_get_tx_free_buffer_space(cport)) {
+        unipro_tx_sched_block(cport);
+        desc = NULL;
+        goto out;
+    }
 
-            continue;
-        }
+    desc->channel = channel;
 
-        if (cport->pending_reset) {
-            unipro_flush_cport(cport);
-        }
+out:
+    irqrestore(flags);
+    return desc;
+}
 
-        desc = containerof(cport->tx_fifo.next, struct unipro_xfer_descriptor,
-                list);
-        if (desc->channel)
-            continue;
+static struct unipro_xfer_descriptor *pick_tx_descriptor(void)
+{
+    struct unipro_xfer_descriptor *desc;
+    struct cport *cport;
 
-        if (!unipro_get_tx_free_buffer_space(desc->cport))
+    while ((cport = unipro_tx_sched_next()) != NULL) {
+        if (cport->pending_reset) {
+            unipro_flush_cport(cport);
             continue;
+        }
 
-        return desc;
+        desc = unipro_claim_tx_descriptor(cport, pick_dma_channel(cport));
+        if (desc)
+            return desc;
     }
 
     return NULL;
@@ -210,9 +271,10 @@ static void unipro_xfer_dequeue_descriptor(struct unipro_xfer_descriptor *desc)
 
     flags = irqsave();
     list_del(&desc->list);
+    desc->cport->tx_fifo_len--;
     irqrestore(flags);
 
-    free(desc);
+    unipro_free_tx_desc(desc);
 }
 
 static int unipro_dma_tx_callback(struct device *dev, void *chan,
@@ -263,12 +325,19 @@ static int unipro_dma_tx_callback(struct device *dev, void *chan,
     if (event & DEVICE_DMA_CALLBACK_EVENT_COMPLETE) {
         if (desc->data_offset >= desc->len) {
             struct dma_channel *desc_chan = desc->channel;
+            struct cport *cport = desc->cport;
+            struct unipro_xfer_descriptor *next = NULL;
+            irqstate_t flags;
 
-            unipro_dma_tx_set_eom_flag(desc->cport);
+            unipro_dma_tx_set_eom_flag(cport);
 
+            flags = irqsave();
             list_del(&desc->list);
+            irqrestore(flags);
             device_dma_op_free(unipro_dma.dev, op);
 
+            unipro_tx_sched_sent(cport, desc->len);
+
             if (desc->callback != NULL) {
                 desc->callback(0, desc->data, desc->priv);
             }
@@ -278,9 +347,30 @@ static int unipro_dma_tx_callback(struct device *dev, void *chan,
                                                 desc_chan->req);
             }
 
+            /*
+             * If the scheduler still elects this CPort, chain its next
+             * message on this channel right away instead of going through
+             * the TX worker.
+             */
+            if (unipro_tx_sched_next() == cport) {
+                next = unipro_claim_tx_descriptor(cport, desc_chan);
+            }
+
             unipro_xfer_dequeue_descriptor(desc);
+
+            if (next) {
+                unipro_tx_sched_started(cport, next->queued);
+                retval = unipro_dma_xfer(next, desc_chan);
+                if (retval) {
+                    unipro_dequeue_tx_desc(next, retval);
+                    retval = OK;
+                }
+            }
+
+            sem_post(&worker.tx_fifo_lock);
         } else {
             desc->channel = NULL;
+            unipro_tx_sched_unblock(desc->cport);
 
             sem_post(&worker.tx_fifo_lock);
         }
@@ -355,20 +445,22 @@ static int unipro_dma_xfer(struct unipro_xfer_descriptor *desc,
 
 static void *unipro_tx_worker(void *data)
 {
-    struct dma_channel *channel;
     struct unipro_xfer_descriptor *desc;
-    unsigned int next_cport;
+    int retval;
 
     while (1) {
         /* Block until a buffer is pending on any CPort */
         sem_wait(&worker.tx_fifo_lock);
 
-        next_cport = 0;
-        while ((desc = pick_tx_descriptor(next_cport)) != NULL) {
-            next_cport = desc->cport->cportid + 1;
-            channel = pick_dma_channel(desc->cport);
+        while ((desc = pick_tx_descriptor()) != NULL) {
+            if (desc->data_offset == 0) {
+                unipro_tx_sched_started(desc->cport, desc->queued);
+            }
 
-            unipro_dma_xfer(desc, channel);
+            retval = unipro_dma_xfer(desc, desc->channel);
+            if (retval) {
+                unipro_dequeue_tx_desc(desc, retval);
+            }
         }
     }
 
@@ -377,6 +469,15 @@ static void *unipro_tx_worker(void *data)
 
 void unipro_reset_notify(unsigned int cportid)
 {
+    struct cport *cport = cport_handle(cportid);
+    irqstate_t flags;
+
+    if (cport) {
+        flags = irqsave();
+        unipro_tx_sched_wake(cport);
+        irqrestore(flags);
+    }
+
     /*
      * if the tx worker is blocked on the semaphore, post something on it
      * in order to unlock it and have the reset happen right away.
@@ -384,6 +485,35 @@ void unipro_reset_notify(unsigned int cportid)
     sem_post(&worker.tx_fifo_lock);
 }
 
+#if CONFIG_ARCH_UNIPRO_TX_FLUSH_USEC > 0
+static void unipro_tx_flush(int argc, uint32_t arg, ...)
+{
+    sem_post(&worker.tx_fifo_lock);
+}
+#endif
+
+/**
+ * @brief           Decide whether the TX worker must be woken up right after
+ *                  a descriptor has been queued, or if the flush can be
+ *                  delayed to batch it with the next messages of the CPort.
+ * @note            This function should be called from an atomic context
+ */
+static bool unipro_tx_should_flush(struct cport *cport)
+{
+#if CONFIG_ARCH_UNIPRO_TX_FLUSH_USEC > 0
+    if (cport->tx_fifo_len < CONFIG_ARCH_UNIPRO_TX_BATCH) {
+        if (!WDOG_ISACTIVE(&tx_flush_wd)) {
+            wd_start(&tx_flush_wd,
+                     USEC2TICK(CONFIG_ARCH_UNIPRO_TX_FLUSH_USEC) + 1,
+                     unipro_tx_flush, 0);
+        }
+        return false;
+    }
+#endif
+
+    return true;
+}
+
 int unipro_send_async(unsigned int cportid, const void *buf, size_t len,
         unipro_send_completion_t callback, void *priv)
 {
@@ -402,7 +532,7 @@ int unipro_send_async(unsigned int cportid, const void *buf, size_t len,
         return -EPIPE;
     }
 
-    desc = zalloc(sizeof(*desc));
+    desc = unipro_alloc_tx_desc();
     if (!desc)
         return -ENOMEM;
 
@@ -412,15 +542,19 @@ int unipro_send_async(unsigned int cportid, const void *buf, size_t len,
     desc->callback = callback;
     desc->priv = priv;
     desc->cport = cport;
+    desc->queued = hrt_getusec();
 
     list_init(&desc->list);
 
     flags = irqsave();
     list_add(&cport->tx_fifo, &desc->list);
+    cport->tx_fifo_len++;
+    unipro_tx_sched_wake(cport);
+    if (unipro_tx_should_flush(cport)) {
+        sem_post(&worker.tx_fifo_lock);
+    }
     irqrestore(flags);
 
-    sem_post(&worker.tx_fifo_lock);
-
     return 0;
 }
 
@@ -458,6 +592,13 @@ out:
     return retval;
 }
 
+void unipro_tx_dma_dump(void)
+{
+    if (unipro_dma.dev) {
+        tsb_dma_dump(unipro_dma.dev);
+    }
+}
+
 int unipro_tx_init(void)
 {
     int i;
@@ -468,6 +609,15 @@ int unipro_tx_init(void)
     sem_init(&worker.tx_fifo_lock, 0, 0);
     sem_init(&unipro_dma.dma_channel_lock, 0, 0);
 
+    list_init(&tx_desc_pool);
+    for (i = 0; i < ARRAY_SIZE(tx_descs); i++) {
+        list_add(&tx_desc_pool, &tx_descs[i].list);
+    }
+
+#if CONFIG_ARCH_UNIPRO_TX_FLUSH_USEC > 0
+    wd_static(&tx_flush_wd);
+#endif
+
     unipro_dma.dev = device_open(DEVICE_TYPE_DMA_HW, 0);
     if (!unipro_dma.dev) {
         lldbg("Failed to open DMA driver.\n");
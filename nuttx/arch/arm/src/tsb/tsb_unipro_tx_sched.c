@@ -0,0 +1,332 @@
+/*
+ * Copyright (c) 2016 Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * UniPro TX scheduler
+ *
+ * CPorts with pending TX messages are kept in one ready list per priority
+ * class. Classes are served in strict priority order, and the CPorts of a
+ * class share the link using deficit round robin: on each visit a CPort
+ * receives a quantum of CONFIG_ARCH_UNIPRO_TX_QUANTUM bytes multiplied by
+ * its weight, and keeps being served until it has used it up or has sent
+ * CONFIG_ARCH_UNIPRO_TX_BATCH messages in a row.
+ */
+
+#include <errno.h>
+#include <stdint.h>
+
+#include <nuttx/util.h>
+#include <nuttx/irq.h>
+#include <nuttx/list.h>
+#include <nuttx/hires_tmr.h>
+#include <nuttx/unipro/unipro.h>
+
+#include "debug.h"
+#include "tsb_unipro.h"
+
+struct unipro_tx_class_stats {
+    unsigned int msg_count;
+    unsigned int byte_count;
+    unsigned int delay_count;
+    uint64_t delay_total;
+    uint32_t delay_max;
+};
+
+static struct {
+    struct list_head ready[UNIPRO_TX_CLASS_COUNT];
+    unsigned int ready_count[UNIPRO_TX_CLASS_COUNT];
+    uint32_t active;
+    struct unipro_tx_class_stats stats[UNIPRO_TX_CLASS_COUNT];
+} tx_sched;
+
+static const char *class_name[UNIPRO_TX_CLASS_COUNT] = {
+    [UNIPRO_TX_CLASS_ISOC] = "isoc",
+    [UNIPRO_TX_CLASS_NORMAL] = "normal",
+    [UNIPRO_TX_CLASS_BULK] = "bulk",
+};
+
+/* Must be called from an atomic context */
+static void unipro_tx_sched_remove(struct cport *cport)
+{
+    list_del(&cport->tx_sched_node);
+    if (--tx_sched.ready_count[cport->tx_class] == 0) {
+        tx_sched.active &= ~(1 << cport->tx_class);
+    }
+
+    cport->tx_sched_active = false;
+    cport->tx_deficit = 0;
+    cport->tx_burst = 0;
+}
+
+/* Must be called from an atomic context */
+static void unipro_tx_sched_insert(struct cport *cport)
+{
+    list_add(&tx_sched.ready[cport->tx_class], &cport->tx_sched_node);
+    tx_sched.ready_count[cport->tx_class]++;
+    tx_sched.active |= 1 << cport->tx_class;
+    cport->tx_sched_active = true;
+}
+
+/**
+ * @brief           Mark a CPort as having work for the TX worker: pending
+ *                  messages or a pending reset.
+ * @note            This function should be called from an atomic context
+ */
+void unipro_tx_sched_wake(struct cport *cport)
+{
+    if (!cport->tx_sched_active) {
+        unipro_tx_sched_insert(cport);
+    }
+}
+
+/**
+ * @brief           Prevent a CPort from being picked until its current
+ *                  message has been sent.
+ * @note            This function should be called from an atomic context
+ */
+void unipro_tx_sched_block(struct cport *cport)
+{
+    cport->tx_sched_blocked = true;
+}
+
+void unipro_tx_sched_unblock(struct cport *cport)
+{
+    cport->tx_sched_blocked = false;
+}
+
+/**
+ * @brief           Move a CPort that cannot make progress right now to the
+ *                  end of its ready list, so that the other CPorts of its
+ *                  class get served meanwhile.
+ */
+void unipro_tx_sched_yield(struct cport *cport)
+{
+    irqstate_t flags;
+
+    flags = irqsave();
+    if (cport->tx_sched_active) {
+        list_del(&cport->tx_sched_node);
+        list_add(&tx_sched.ready[cport->tx_class], &cport->tx_sched_node);
+    }
+    irqrestore(flags);
+}
+
+static struct cport *unipro_tx_sched_pick(enum unipro_tx_class class)
+{
+    struct list_head *head = &tx_sched.ready[class];
+    unsigned int count = tx_sched.ready_count[class];
+    struct cport *cport;
+    unsigned int i;
+
+    /*
+     * The first pass over the list hands out new quanta to the CPorts that
+     * have used theirs, so two passes are enough to find a CPort to serve,
+     * unless all of them are blocked.
+     */
+    for (i = 0; i < 2 * count && !list_is_empty(head); i++) {
+        cport = list_entry(head->next, struct cport, tx_sched_node);
+
+        if (list_is_empty(&cport->tx_fifo) && !cport->pending_reset) {
+            unipro_tx_sched_remove(cport);
+            continue;
+        }
+
+        if (cport->pending_reset) {
+            return cport;
+        }
+
+        if (!cport->tx_sched_blocked && cport->tx_deficit > 0 &&
+            cport->tx_burst < CONFIG_ARCH_UNIPRO_TX_BATCH) {
+            return cport;
+        }
+
+        if (!cport->tx_sched_blocked) {
+            cport->tx_burst = 0;
+            while (cport->tx_deficit <= 0) {
+                cport->tx_deficit +=
+                    CONFIG_ARCH_UNIPRO_TX_QUANTUM * cport->tx_weight;
+            }
+        }
+
+        list_del(&cport->tx_sched_node);
+        list_add(head, &cport->tx_sched_node);
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief           Pick the next CPort the TX worker should send a message
+ *                  from.
+ * @return          CPort to serve, or NULL if there is nothing to send
+ */
+struct cport *unipro_tx_sched_next(void)
+{
+    struct cport *cport = NULL;
+    uint32_t pending;
+    irqstate_t flags;
+    int class;
+
+    flags = irqsave();
+
+    pending = tx_sched.active;
+    while (pending) {
+        class = __builtin_ffs(pending) - 1;
+        pending &= ~(1 << class);
+
+        cport = unipro_tx_sched_pick(class);
+        if (cport) {
+            break;
+        }
+    }
+
+    irqrestore(flags);
+
+    return cport;
+}
+
+/**
+ * @brief           Account for the queueing delay of a message whose
+ *                  transmission is starting.
+ * @param queued    hrt_getusec() timestamp of when the message was queued
+ */
+void unipro_tx_sched_started(struct cport *cport, uint32_t queued)
+{
+    struct unipro_tx_class_stats *stats = &tx_sched.stats[cport->tx_class];
+    uint32_t delay = hrt_getusec() - queued;
+    irqstate_t flags;
+
+    flags = irqsave();
+    stats->delay_count++;
+    stats->delay_total += delay;
+    if (delay > stats->delay_max) {
+        stats->delay_max = delay;
+    }
+    irqrestore(flags);
+}
+
+/**
+ * @brief           Charge a CPort for a message that has been sent.
+ */
+void unipro_tx_sched_sent(struct cport *cport, size_t len)
+{
+    struct unipro_tx_class_stats *stats = &tx_sched.stats[cport->tx_class];
+    irqstate_t flags;
+
+    flags = irqsave();
+
+    stats->msg_count++;
+    stats->byte_count += len;
+
+    if (cport->tx_burst++ == 0) {
+        cport->tx_batch_count++;
+    }
+    cport->tx_batch_msg_count++;
+    cport->tx_batch_byte_count += len;
+
+    cport->tx_deficit -= len;
+    cport->tx_sched_blocked = false;
+
+    if (cport->tx_sched_active && list_is_empty(&cport->tx_fifo) &&
+        !cport->pending_reset) {
+        unipro_tx_sched_remove(cport);
+    }
+
+    irqrestore(flags);
+}
+
+/**
+ * @brief           Set the TX priority class and weight of a CPort.
+ * @param cportid   CPort to configure
+ * @param class     priority class of the CPort
+ * @param weight    share of the link the CPort gets relatively to the other
+ *                  CPorts of its class
+ * @return          0 on success, -EINVAL on invalid parameters
+ */
+int unipro_set_cport_priority(unsigned int cportid,
+                              enum unipro_tx_class class, unsigned int weight)
+{
+    struct cport *cport = cport_handle(cportid);
+    irqstate_t flags;
+    bool active;
+
+    if (!cport || class >= UNIPRO_TX_CLASS_COUNT || !weight ||
+        weight > UINT16_MAX) {
+        return -EINVAL;
+    }
+
+    flags = irqsave();
+
+    active = cport->tx_sched_active;
+    if (active) {
+        unipro_tx_sched_remove(cport);
+    }
+
+    cport->tx_class = class;
+    cport->tx_weight = weight;
+
+    if (active) {
+        unipro_tx_sched_insert(cport);
+    }
+
+    irqrestore(flags);
+
+    return 0;
+}
+
+void unipro_tx_sched_init_cport(struct cport *cport)
+{
+    cport->tx_class = UNIPRO_TX_CLASS_NORMAL;
+    cport->tx_weight = 1;
+    list_init(&cport->tx_sched_node);
+}
+
+void unipro_tx_sched_init(void)
+{
+    int i;
+
+    for (i = 0; i < UNIPRO_TX_CLASS_COUNT; i++) {
+        list_init(&tx_sched.ready[i]);
+    }
+}
+
+void unipro_tx_sched_dump(void)
+{
+    struct unipro_tx_class_stats *stats;
+    int i;
+
+    lldbg("TX scheduler:\n");
+    for (i = 0; i < UNIPRO_TX_CLASS_COUNT; i++) {
+        stats = &tx_sched.stats[i];
+        lldbg("    %-6s: messages: %u, bytes: %u, avg delay: %u us, max delay: %u us\n",
+              class_name[i], stats->msg_count, stats->byte_count,
+              stats->delay_count ?
+                  (uint32_t) (stats->delay_total / stats->delay_count) : 0,
+              stats->delay_max);
+    }
+}
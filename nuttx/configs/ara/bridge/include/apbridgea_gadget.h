@@ -43,6 +43,7 @@
 #define APBRIDGE_RWREQUEST_CSI_TX_CONTROL       (0x08)
 #define APBRIDGE_RWREQUEST_AUDIO_APBRIDGEA      (0x09)
 #define APBRIDGE_WOREQUEST_SET_REQUEST_COUNT    (0x0a)
+#define APBRIDGE_RWREQUEST_CPORT_PRIORITY       (0x0b)
 
 struct apbridge_dev_s;
 
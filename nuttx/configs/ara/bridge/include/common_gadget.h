@@ -89,6 +89,8 @@ struct usbdev_req_s *find_request_by_priv(const void *priv);
 struct usbdev_ep_s *request_to_ep(struct usbdev_req_s *req);
 void request_set_priv(struct usbdev_req_s *req, void *priv);
 void *request_get_priv(struct usbdev_req_s *req);
+void request_set_time(struct usbdev_req_s *req, uint32_t time);
+uint32_t request_get_time(struct usbdev_req_s *req);
 
 int gadget_control_handler(struct gadget_descriptor *g_desc,
                            struct usbdev_s *dev,
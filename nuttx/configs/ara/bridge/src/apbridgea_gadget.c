@@ -55,6 +55,7 @@
 #include <nuttx/list.h>
 #include <nuttx/kmalloc.h>
 #include <nuttx/arch.h>
+#include <nuttx/hires_tmr.h>
 #include <nuttx/serial/serial.h>
 #include <nuttx/usb_device.h>
 #include <nuttx/usb/usb.h>
@@ -123,11 +124,17 @@
   ((epno - CONFIG_APBRIDGE_EPBULKOUT) >> 1)
 #define BULKEP_TO_N(ep) \
   BULKEPNO_TO_N(USB_EPNO(ep->eplog))
+#define BULKEPINNO_TO_N(epno) \
+  ((epno - CONFIG_APBRIDGE_EPBULKIN) >> 1)
+#define BULKEPIN_TO_N(ep) \
+  BULKEPINNO_TO_N(USB_EPNO(ep->eplog))
 
 /* Number of requests for dedicated endpoints */
 #define APBRIDGE_NREQS_DEDICATED     (2)
 /* Muxed bulk endpoint pair number */
 #define APBRIDGE_MUXED_BULK_EP       (0)
+/* Lowest CPort priority given a bulk IN endpoint of its own */
+#define APBRIDGE_DEDICATED_PRIORITY  (2)
 #define APBRIDGE_REQ_SIZE            (2048)
 
 #define APBRIDGE_CONFIG_ATTR \
@@ -179,12 +186,53 @@
  * Private Types
  ****************************************************************************/
 
+/* A message from UniPro waiting for a free request on a bulk IN endpoint */
 struct apbridge_msg_s {
-    struct list_head list;
-    struct usbdev_ep_s *ep;
     const void *buf;
     size_t len;
-    void *priv;
+    unsigned int cportid;
+    uint32_t time;              /* arrival from UniPro, in usec */
+};
+
+/*
+ * Preallocated ring of waiting messages, one per bulk IN endpoint.
+ * CPorts that keep queuing once the ring is half full have their UniPro RX
+ * paused until the ring drains back to a quarter.
+ *
+ * Once all IN requests are in flight, each completed request goes to one
+ * of the rings with waiting messages, picked by weighted round robin:
+ * a ring gets up to weight requests per round.
+ */
+struct apbridge_msg_ring {
+    struct apbridge_msg_s *msgs;
+    unsigned int size;
+    unsigned int head;
+    unsigned int count;
+    unsigned int paused;        /* CPorts paused on this ring */
+    unsigned int weight;
+    unsigned int credit;        /* requests left in this round */
+};
+
+struct apbridge_cport_stats {
+    uint16_t queued;            /* messages waiting in the endpoint ring */
+    uint16_t queued_max;
+    uint16_t queued_max_logged;
+    uint8_t paused_ring;        /* ring index + 1, 0 when not paused */
+    uint8_t priority;
+    bool dedicated;             /* IN endpoint allocated by priority */
+    unsigned int pause_count;
+    unsigned int drop_count;
+};
+
+/* Bulk IN endpoint statistics, times in usec */
+struct apbridge_ep_stats {
+    unsigned int messages;
+    unsigned int messages_logged;
+    uint64_t bytes;
+    uint64_t latency_total;     /* from UniPro arrival to USB completion */
+    uint32_t latency_max;
+    uint32_t first;
+    uint32_t last;
 };
 
 /* This structure describes the internal state of the driver */
@@ -198,7 +246,12 @@ struct apbridge_dev_s {
 
     struct usbdev_ep_s *ep[APBRIDGE_MAX_ENDPOINTS];
 
-    struct list_head msg_queue;
+    struct apbridge_msg_ring msg_ring[APBRIDGE_NBULKS];
+    struct apbridge_ep_stats ep_stats[APBRIDGE_NBULKS];
+    struct apbridge_cport_stats *cport_stats;
+    unsigned int arb_next;      /* next ring for the arbiter to look at */
+    unsigned int in_flight;     /* bulk IN requests submitted */
+    unsigned int in_budget;     /* bulk IN requests preallocated */
 
     int *cport_to_epin_n;
     int epout_to_cport_n[APBRIDGE_NBULKS];
@@ -662,53 +715,239 @@ static int set_request_count_vendor_request_out(struct usbdev_s *dev,
     return ep_set_requests_count(priv, ep, value);
 }
 
-static int apbridge_queue(struct apbridge_dev_s *priv, struct usbdev_ep_s *ep,
-                          const void *payload, size_t len, void *data)
+static unsigned int bulk_request_count(int n)
 {
-    irqstate_t flags;
-    struct apbridge_msg_s *info;
+    return n == APBRIDGE_MUXED_BULK_EP ? unipro_cport_count() :
+                                         APBRIDGE_NREQS_DEDICATED;
+}
+
+static void msg_rings_free(struct apbridge_dev_s *priv)
+{
+    int i;
+
+    for (i = 0; i < APBRIDGE_NBULKS; i++) {
+        kmm_free(priv->msg_ring[i].msgs);
+        priv->msg_ring[i].msgs = NULL;
+    }
+    kmm_free(priv->cport_stats);
+    priv->cport_stats = NULL;
+}
+
+static int msg_rings_init(struct apbridge_dev_s *priv)
+{
+    struct apbridge_msg_ring *ring;
+    int i;
 
-    info = malloc(sizeof(*info));
-    if (!info) {
+    priv->cport_stats = kmm_zalloc(sizeof(struct apbridge_cport_stats) *
+                                   unipro_cport_count());
+    if (!priv->cport_stats) {
         return -ENOMEM;
     }
 
-    info->ep = ep;
-    info->buf = payload;
-    info->len = len;
-    info->priv = data;
+    /*
+     * Size each ring from the request count of its endpoint, with room
+     * for the messages still arriving after their CPort got paused: UniPro
+     * has switched to a new RX buffer before the message that triggers the
+     * pause is queued, so one more message per CPort can follow it.
+     */
+    for (i = 0; i < APBRIDGE_NBULKS; i++) {
+        ring = &priv->msg_ring[i];
+        ring->weight = 1;
+        ring->credit = 1;
+        ring->size = 2 * bulk_request_count(i);
+        ring->msgs = kmm_malloc(sizeof(struct apbridge_msg_s) * ring->size);
+        if (!ring->msgs) {
+            msg_rings_free(priv);
+            return -ENOMEM;
+        }
+    }
+
+    return 0;
+}
+
+static void apbridge_resume_cports(struct apbridge_dev_s *priv, int n)
+{
+    struct apbridge_cport_stats *stats;
+    unsigned int cportid;
+
+    for (cportid = 0; cportid < unipro_cport_count(); cportid++) {
+        stats = &priv->cport_stats[cportid];
+        if (stats->paused_ring == n + 1) {
+            stats->paused_ring = 0;
+            unipro_release_rx(cportid);
+        }
+    }
+    priv->msg_ring[n].paused = 0;
+}
+
+static int apbridge_queue(struct apbridge_dev_s *priv, struct usbdev_ep_s *ep,
+                          const void *payload, size_t len,
+                          unsigned int cportid, uint32_t time)
+{
+    int n = BULKEPIN_TO_N(ep);
+    struct apbridge_msg_ring *ring = &priv->msg_ring[n];
+    struct apbridge_cport_stats *stats = &priv->cport_stats[cportid];
+    struct apbridge_msg_s *msg;
+    irqstate_t flags;
 
     flags = irqsave();
-    list_add(&priv->msg_queue, &info->list);
+
+    if (ring->count == ring->size) {
+        stats->drop_count++;
+        irqrestore(flags);
+        return -ENOSPC;
+    }
+
+    msg = &ring->msgs[(ring->head + ring->count) % ring->size];
+    msg->buf = payload;
+    msg->len = len;
+    msg->cportid = cportid;
+    msg->time = time;
+    ring->count++;
+
+    if (++stats->queued > stats->queued_max) {
+        stats->queued_max = stats->queued;
+    }
+
+    if (ring->count > ring->size / 2 && !stats->paused_ring) {
+        stats->paused_ring = n + 1;
+        stats->pause_count++;
+        ring->paused++;
+        unipro_hold_rx(cportid);
+    }
+
     irqrestore(flags);
 
     return OK;
 }
 
-static struct apbridge_msg_s *apbridge_dequeue(struct apbridge_dev_s *priv)
+static int apbridge_dequeue(struct apbridge_dev_s *priv, int n,
+                            struct apbridge_msg_s *msg)
 {
+    struct apbridge_msg_ring *ring = &priv->msg_ring[n];
     irqstate_t flags;
-    struct list_head *list;
 
     flags = irqsave();
-    if (list_is_empty(&priv->msg_queue)) {
+
+    if (!ring->count) {
         irqrestore(flags);
-        return NULL;
+        return -ENOENT;
+    }
+
+    *msg = ring->msgs[ring->head];
+    ring->head = (ring->head + 1) % ring->size;
+    ring->count--;
+    priv->cport_stats[msg->cportid].queued--;
+
+    if (ring->paused && ring->count <= ring->size / 4) {
+        apbridge_resume_cports(priv, n);
     }
 
-    list = priv->msg_queue.next;
-    list_del(list);
     irqrestore(flags);
-    return list_entry(list, struct apbridge_msg_s, list);
+
+    return OK;
+}
+
+/*
+ * Pick the ring to give a free IN request to, or -1 if no message waits.
+ * Called with interrupts disabled.
+ */
+static int apbridge_arbitrate(struct apbridge_dev_s *priv)
+{
+    struct apbridge_msg_ring *ring;
+    int pass;
+    int i;
+    int n;
+
+    for (pass = 0; pass < 2; pass++) {
+        for (i = 0; i < APBRIDGE_NBULKS; i++) {
+            n = (priv->arb_next + i) % APBRIDGE_NBULKS;
+            ring = &priv->msg_ring[n];
+            if (ring->count && ring->credit) {
+                ring->credit--;
+                priv->arb_next = ring->credit ? n : (n + 1) % APBRIDGE_NBULKS;
+                return n;
+            }
+        }
+
+        /* Every ring with waiting messages used its share: next round */
+        for (n = 0; n < APBRIDGE_NBULKS; n++) {
+            priv->msg_ring[n].credit = priv->msg_ring[n].weight;
+        }
+    }
+
+    return -1;
+}
+
+static void apbridge_ep_account(struct apbridge_dev_s *priv, int n,
+                                struct usbdev_req_s *req)
+{
+    struct apbridge_ep_stats *stats = &priv->ep_stats[n];
+    uint32_t now = hrt_getusec();
+    uint32_t latency = now - request_get_time(req);
+
+    if (!stats->messages) {
+        stats->first = now;
+    }
+    stats->last = now;
+    stats->messages++;
+    stats->bytes += req->xfrd;
+    stats->latency_total += latency;
+    if (latency > stats->latency_max) {
+        stats->latency_max = latency;
+    }
+}
+
+/* Report the statistics that changed since last time */
+static void apbridge_log_stats(struct apbridge_dev_s *priv)
+{
+    struct apbridge_cport_stats *stats;
+    struct apbridge_ep_stats *ep_stats;
+    unsigned int cportid;
+    uint32_t elapsed;
+    int n;
+
+    for (n = 0; n < APBRIDGE_NBULKS; n++) {
+        ep_stats = &priv->ep_stats[n];
+        if (ep_stats->messages == ep_stats->messages_logged) {
+            continue;
+        }
+
+        ep_stats->messages_logged = ep_stats->messages;
+        elapsed = ep_stats->last - ep_stats->first;
+        lowsyslog("apbridge: EP%u IN %u msgs, %u kB/s, latency avg %u max %u us\n",
+                  CONFIG_APBRIDGE_EPBULKIN + n * 2, ep_stats->messages,
+                  elapsed ? (uint32_t)(ep_stats->bytes * 1000 / elapsed) : 0,
+                  (uint32_t)(ep_stats->latency_total / ep_stats->messages),
+                  ep_stats->latency_max);
+    }
+
+    for (cportid = 0; cportid < unipro_cport_count(); cportid++) {
+        stats = &priv->cport_stats[cportid];
+        if (stats->queued_max == stats->queued_max_logged) {
+            continue;
+        }
+
+        stats->queued_max_logged = stats->queued_max;
+        lowsyslog("apbridge: CP%u queued max %u, paused %u, dropped %u\n",
+                  cportid, stats->queued_max, stats->pause_count,
+                  stats->drop_count);
+    }
 }
 
 void set_cport_id(struct usbdev_ep_s *ep, struct usbdev_req_s *req,
                   unsigned int cportid)
 {
     struct gb_operation_hdr *hdr;
+    struct apbridge_dev_s *priv = ep_to_apbridge(ep);
     uint8_t epno = USB_EPNO(ep->eplog);
 
-    if (epno == CONFIG_APBRIDGE_EPBULKIN) {
+    /*
+     * Endpoints given by priority are not known to the AP, which finds the
+     * CPort in the header as it does on the muxed endpoint.
+     */
+    if (epno == CONFIG_APBRIDGE_EPBULKIN ||
+        priv->cport_stats[cportid].dedicated) {
         hdr = (struct gb_operation_hdr *)req->buf;
         hdr->pad[0] = cportid & 0xff;
     }
@@ -730,15 +969,47 @@ unsigned int get_cport_id(struct apbridge_dev_s *priv,
     return cportid;
 }
 
+/*
+ * Give back a bulk IN request that is no longer in flight. in_flight is
+ * zeroed when the configuration is reset, so late completions of requests
+ * submitted before must not make it wrap.
+ */
+static void apbridge_put_in_request(struct apbridge_dev_s *priv,
+                                    struct usbdev_req_s *req)
+{
+    irqstate_t flags;
+
+    flags = irqsave();
+    if (priv->in_flight) {
+        priv->in_flight--;
+    }
+    put_request(req);
+    irqrestore(flags);
+}
+
+/* Drop the messages waiting for an IN request, which will not come back */
+static void apbridge_flush_rings(struct apbridge_dev_s *priv)
+{
+    struct apbridge_msg_s msg;
+    int n;
+
+    for (n = 0; n < APBRIDGE_NBULKS; n++) {
+        while (!apbridge_dequeue(priv, n, &msg)) {
+            unipro_rxbuf_free(msg.cportid, (void *) msg.buf);
+        }
+    }
+}
+
 static int _to_usb_submit(struct usbdev_ep_s *ep, struct usbdev_req_s *req,
                           unsigned int cportid, const void *payload,
-                          size_t len)
+                          size_t len, uint32_t time)
 {
     struct gb_operation_hdr *gbhdr;
     struct apbridge_dev_s *priv;
     int ret;
 
     priv = ep->priv;
+    request_set_time(req, time);
     req->len = len;
     req->flags = USBDEV_REQFLAGS_NULLPKT;
 
@@ -759,6 +1030,9 @@ static int _to_usb_submit(struct usbdev_ep_s *ep, struct usbdev_req_s *req,
     ret = EP_SUBMIT(ep, req);
     if (ret != OK) {
         usbtrace(TRACE_CLSERROR(USBSER_TRACEERR_SUBMITFAIL), (uint16_t) - ret);
+        /* The request won't complete: drop the message, keep the request */
+        unipro_rxbuf_free(cportid, (void *) payload);
+        apbridge_put_in_request(priv, req);
         return ret;
     }
 
@@ -777,7 +1051,10 @@ int unipro_to_usb(struct apbridge_dev_s *priv, unsigned int cportid,
                   const void *payload, size_t len)
 {
     struct usbdev_ep_s *ep;
-    struct usbdev_req_s *req;
+    struct usbdev_req_s *req = NULL;
+    uint32_t time = hrt_getusec();
+    irqstate_t flags;
+    int ret;
 
     if (len > APBRIDGE_REQ_SIZE)
         return -EINVAL;
@@ -788,14 +1065,96 @@ int unipro_to_usb(struct apbridge_dev_s *priv, unsigned int cportid,
         return unipro_offloaded(priv, cportid, payload, len);
     }
 
-    /* Bulk in request use UniPro buffer so only get a request without buffer */
-    req = get_request(ep, usbclass_wrcomplete, 0,
-                      (void*) cportid);
+    /*
+     * Bulk in request use UniPro buffer so only get a request without buffer.
+     * Messages wait in their endpoint ring once all requests are in flight,
+     * or behind other messages already waiting there.
+     */
+    flags = irqsave();
+    if (priv->in_flight < priv->in_budget &&
+        !priv->msg_ring[BULKEPIN_TO_N(ep)].count) {
+        req = get_request(ep, usbclass_wrcomplete, 0, (void*) cportid);
+        if (req) {
+            priv->in_flight++;
+        }
+    }
+
     if (!req) {
-        return apbridge_queue(priv, ep, payload, len, (void*) cportid);
+        ret = apbridge_queue(priv, ep, payload, len, cportid, time);
+        irqrestore(flags);
+        if (ret) {
+            /* No room left to keep it: drop it rather than leak the buffer */
+            unipro_rxbuf_free(cportid, (void *) payload);
+        }
+        return ret;
+    }
+    irqrestore(flags);
+
+    return _to_usb_submit(ep, req, cportid, payload, len, time);
+}
+
+/*
+ * Give a bulk IN endpoint of its own to a high priority CPort, so that its
+ * messages don't wait behind bulk traffic on the muxed endpoint, and give
+ * that endpoint a share of the IN requests matching the priority.
+ * Lowering the priority returns the CPort to the muxed endpoint.
+ * The endpoint is not changed while messages of the CPort wait in a ring,
+ * which would let newer messages overtake them.
+ * Returns the IN endpoint number used by the CPort.
+ */
+static int apbridge_set_cport_priority(struct apbridge_dev_s *priv,
+                                       unsigned int cportid,
+                                       unsigned int priority)
+{
+    struct apbridge_cport_stats *stats = &priv->cport_stats[cportid];
+    uint8_t epno = priv->cport_to_epin_n[cportid];
+    unsigned int i;
+    int n;
+
+    stats->priority = priority;
+
+    if (stats->queued) {
+        return epno;
+    }
+
+    if (priority >= APBRIDGE_DEDICATED_PRIORITY && !stats->dedicated &&
+        epno == CONFIG_APBRIDGE_EPBULKIN) {
+        /* Look for an IN endpoint no CPort uses */
+        for (n = APBRIDGE_MUXED_BULK_EP + 1; n < APBRIDGE_NBULKS; n++) {
+            epno = CONFIG_APBRIDGE_EPBULKIN + n * 2;
+            for (i = 0; i < unipro_cport_count(); i++) {
+                if (priv->cport_to_epin_n[i] == epno)
+                    break;
+            }
+            if (i == unipro_cport_count())
+                break;
+        }
+
+        if (n == APBRIDGE_NBULKS) {
+            return CONFIG_APBRIDGE_EPBULKIN;
+        }
+
+        stats->dedicated = true;
+        cportid_set_epno(priv, epno, cportid);
+        if (priv->driver->unipro_cport_mapping) {
+            priv->driver->unipro_cport_mapping(cportid, DIRECT_EP);
+        }
+    } else if (priority < APBRIDGE_DEDICATED_PRIORITY && stats->dedicated) {
+        priv->msg_ring[BULKEPINNO_TO_N(epno)].weight = 1;
+        stats->dedicated = false;
+        cportid_set_epno(priv, CONFIG_APBRIDGE_EPBULKIN, cportid);
+        if (priv->driver->unipro_cport_mapping) {
+            priv->driver->unipro_cport_mapping(cportid, MULTIPLEXED_EP);
+        }
+        return CONFIG_APBRIDGE_EPBULKIN;
     }
 
-    return _to_usb_submit(ep, req, cportid, payload, len);
+    if (stats->dedicated || epno != CONFIG_APBRIDGE_EPBULKIN) {
+        n = BULKEPINNO_TO_N(epno);
+        priv->msg_ring[n].weight = priority ? priority : 1;
+    }
+
+    return priv->cport_to_epin_n[cportid];
 }
 
 int usb_release_buffer(struct apbridge_dev_s *priv, const void *buf)
@@ -835,6 +1194,8 @@ void map_cport_to_ep(struct apbridge_dev_s *priv,
     unsigned int cportid = le16_to_cpu(cport_to_ep->cport_id);
     bool is_multiplexed = cport_to_ep->endpoint_in == CONFIG_APBRIDGE_EPBULKIN;
 
+    /* The AP knows about this mapping, it overrides the priority one */
+    priv->cport_stats[cportid].dedicated = false;
     cportid_set_epno(priv, cport_to_ep->endpoint_in, cportid);
     epno_set_cportid(priv, cport_to_ep->endpoint_out, cportid);
 
@@ -881,6 +1242,7 @@ static inline void usbclass_mkepdesc(const struct usb_epdesc_s *indesc,
 
 static void usbclass_resetconfig(struct apbridge_dev_s *priv)
 {
+    irqstate_t flags;
     int i;
 
     /* Are we configured? */
@@ -896,6 +1258,15 @@ static void usbclass_resetconfig(struct apbridge_dev_s *priv)
 
         for (i = 1; i < APBRIDGE_MAX_ENDPOINTS; i++)
             EP_DISABLE(priv->ep[i]);
+
+        /*
+         * Whatever is still in flight will not complete normally, and the
+         * messages waiting for it would block their endpoint forever.
+         */
+        flags = irqsave();
+        priv->in_flight = 0;
+        apbridge_flush_rings(priv);
+        irqrestore(flags);
     }
 }
 
@@ -963,17 +1334,10 @@ static int usbclass_setconfig(struct apbridge_dev_s *priv, uint8_t config)
 
     /* Queue read requests in the bulk OUT endpoint */
     for (i = 0; i < APBRIDGE_NBULKS; i++) {
-        int count;
         struct usbdev_ep_s *ep;
 
-        if (i == APBRIDGE_MUXED_BULK_EP) {
-            count = unipro_cport_count();
-        } else {
-            count = APBRIDGE_NREQS_DEDICATED;
-        }
-
         ep = priv->ep[CONFIG_APBRIDGE_EPBULKOUT + i * 2];
-        ret = ep_set_requests_count(priv, ep, count);
+        ret = ep_set_requests_count(priv, ep, bulk_request_count(i));
         if (ret) {
             goto errout;
         }
@@ -1075,8 +1439,10 @@ static void usbclass_rdcomplete(struct usbdev_ep_s *ep,
 static void usbclass_wrcomplete(struct usbdev_ep_s *ep,
                               struct usbdev_req_s *req)
 {
-    struct apbridge_msg_s *info;
+    struct apbridge_msg_s msg;
     struct apbridge_dev_s *priv;
+    irqstate_t flags;
+    int n;
 
     /* Sanity check */
 #ifdef CONFIG_DEBUG
@@ -1089,15 +1455,19 @@ static void usbclass_wrcomplete(struct usbdev_ep_s *ep,
     unipro_rxbuf_free((unsigned int) request_get_priv(req), req->buf);
 
     priv = ep_to_apbridge(ep);
-    info = apbridge_dequeue(priv);
-    if (info) {
-        request_set_priv(req, info->priv);
-        _to_usb_submit(info->ep, req,
-                       (unsigned int)info->priv, info->buf, info->len);
-        free(info);
+    apbridge_ep_account(priv, BULKEPIN_TO_N(ep), req);
+
+    /* Hand the request to the endpoint whose turn it is */
+    flags = irqsave();
+    n = apbridge_arbitrate(priv);
+    if (n >= 0 && !apbridge_dequeue(priv, n, &msg)) {
+        request_set_priv(req, (void *) msg.cportid);
+        _to_usb_submit(priv->ep[CONFIG_APBRIDGE_EPBULKIN + n * 2], req,
+                       msg.cportid, msg.buf, msg.len, msg.time);
     } else {
-        put_request(req);
+        apbridge_put_in_request(priv, req);
     }
+    irqrestore(flags);
 
     switch (req->result) {
     case OK:                   /* Normal completion */
@@ -1226,6 +1596,7 @@ static int usbclass_bind(struct usbdevclass_driver_s *driver,
                           APBRIDGE_REQ_SIZE, n);
     /* Bulk in request use UniPro buffer so only get a request without buffer */
     request_pool_prealloc(priv->ep[CONFIG_APBRIDGE_EPBULKIN], 0, n);
+    priv->in_budget = n;
 
     /* TODO test result of prealloc */
 
@@ -1348,6 +1719,8 @@ static int greybus_log_vendor_request_in(struct usbdev_s *dev, uint8_t req,
 {
     int ret;
 
+    apbridge_log_stats(usbdev_to_apbridge(dev));
+
 #if defined(CONFIG_APB_USB_LOG)
     ret = usb_get_log(buf, len);
 #else
@@ -1357,6 +1730,28 @@ static int greybus_log_vendor_request_in(struct usbdev_s *dev, uint8_t req,
     return ret;
 }
 
+static int cport_priority_vendor_request_in(struct usbdev_s *dev, uint8_t req,
+                                            uint16_t index, uint16_t value,
+                                            void *buf, uint16_t len)
+{
+    struct apbridge_dev_s *priv = usbdev_to_apbridge(dev);
+    irqstate_t flags;
+    int epno;
+
+    if (index >= unipro_cport_count() || len < 1)
+        return -EINVAL;
+
+    if (cportid_to_ep(priv, index) == OFFLOADED_EP)
+        return -EBUSY;
+
+    flags = irqsave();
+    epno = apbridge_set_cport_priority(priv, index, value);
+    irqrestore(flags);
+
+    *(uint8_t *)buf = USB_DIR_IN | epno;
+    return 1;
+}
+
 static int ep_mapping_vendor_request_out(struct usbdev_s *dev, uint8_t req,
                                          uint16_t index, uint16_t value,
                                          void *buf, uint16_t len)
@@ -1690,6 +2085,9 @@ int usbdev_apbinitialize(struct device *dev,
     if (register_vendor_request(APBRIDGE_WOREQUEST_SET_REQUEST_COUNT, VENDOR_REQ_OUT,
                                 set_request_count_vendor_request_out))
         goto errout_vendor_req;
+    if (register_vendor_request(APBRIDGE_RWREQUEST_CPORT_PRIORITY, VENDOR_REQ_IN,
+                                cport_priority_vendor_request_in))
+        goto errout_vendor_req;
 
 #ifdef CONFIG_APBRIDGEA_AUDIO
     if (register_vendor_request(APBRIDGE_RWREQUEST_AUDIO_APBRIDGEA,
@@ -1730,8 +2128,12 @@ int usbdev_apbinitialize(struct device *dev,
     for (i = 0; i < cport_count; i++) {
         priv->ts[i].tag = false;
     }
+    ret = msg_rings_init(priv);
+    if (ret) {
+        goto errout_with_msg_rings;
+    }
+
     sem_init(&priv->config_sem, 0, 0);
-    list_init(&priv->msg_queue);
     gb_timestamp_init();
 
     /* Initialize the USB class driver structure */
@@ -1757,6 +2159,8 @@ int usbdev_apbinitialize(struct device *dev,
  errout_with_init:
     device_usbdev_unregister_gadget(dev, drvr);
 errout_cport_table:
+    msg_rings_free(priv);
+errout_with_msg_rings:
     kmm_free(priv->ts);
 errout_with_alloc_ts:
     map_table_free(priv);
@@ -42,6 +42,7 @@ struct request_list {
     struct usbdev_req_s *req;
     size_t len;                 /* size of allocated buffer */
     void *priv;
+    uint32_t time;              /* user timestamp */
 };
 
 struct request_pool {
@@ -184,6 +185,28 @@ void *request_get_priv(struct usbdev_req_s *req)
     return req_list->priv;
 }
 
+/*
+ * Assign a timestamp to request
+ * \param req request's pointer
+ * \param time timestamp, in a unit of the caller's choosing
+ */
+void request_set_time(struct usbdev_req_s *req, uint32_t time)
+{
+    struct request_list *req_list = req->priv;
+    req_list->time = time;
+}
+
+/*
+ * Get the timestamp of request
+ * \param req request's pointer
+ * \return the timestamp set by request_set_time()
+ */
+uint32_t request_get_time(struct usbdev_req_s *req)
+{
+    struct request_list *req_list = req->priv;
+    return req_list->time;
+}
+
 /*
  * \brief Get a request from request manager
  * Allocate a new request a return one from the request pool.
@@ -108,6 +108,12 @@ struct ara_board_info {
     struct interface **interfaces;
     size_t nr_interfaces;
     size_t nr_spring_interfaces;
+    /*
+     * Maximum number of interfaces sent a WAKEOUT pulse at the same
+     * time during bring-up, e.g. to limit inrush current. 0 means no
+     * limit.
+     */
+    unsigned int max_parallel_wakeouts;
 
     /* Switch data */
     struct tsb_switch_data sw_data;
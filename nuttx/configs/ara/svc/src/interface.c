@@ -42,6 +42,7 @@
 #include <errno.h>
 
 #include <ara_debug.h>
+#include "ara_board.h"
 #include "interface.h"
 #include "vreg.h"
 #include "string.h"
@@ -56,6 +57,8 @@
 static struct interface **interfaces;
 static unsigned int nr_interfaces;
 static unsigned int nr_spring_interfaces;
+/* Time at which interface_early_init() powered all interfaces off */
+static uint32_t power_off_ticks;
 
 static void interface_uninstall_wd_handler(struct wd_data *wd);
 static int interface_install_wd_handler(struct interface *iface, bool);
@@ -170,6 +173,30 @@ int interface_pwr_disable(struct interface *iface)
 }
 
 
+/*
+ * Start a WAKEOUT pulse on the WD line of the interface, which must
+ * have one.
+ */
+static void interface_wakeout_assert(struct interface *iface)
+{
+    bool polarity = iface->detect_in.polarity;
+
+    /* First uninstall the interrupt handler on the pin */
+    interface_uninstall_wd_handler(&iface->detect_in);
+    /* Then configure the pin as output and assert it */
+    gpio_direction_out(iface->detect_in.gpio, polarity ? 0 : 1);
+}
+
+/*
+ * End a WAKEOUT pulse started by interface_wakeout_assert()
+ */
+static int interface_wakeout_release(struct interface *iface)
+{
+    /* Re-install the interrupt handler on the pin */
+    return interface_install_wd_handler(iface, true);
+}
+
+
 /*
  * @brief Generate a WAKEOUT signal to wake-up/power-up modules.
  * If assert is true, keep the WAKEOUT lines asserted.
@@ -201,20 +228,15 @@ int interface_generate_wakeout(struct interface *iface, bool assert,
      * from the DETECT_IN polarity.
      */
     if (iface->detect_in.gpio) {
-        bool polarity = iface->detect_in.polarity;
         int pulse_len = (length > 0) ?
                         length : MODULE_PORT_WAKEOUT_PULSE_DURATION_IN_US;
 
-        /* First uninstall the interrupt handler on the pin */
-        interface_uninstall_wd_handler(&iface->detect_in);
-        /* Then configure the pin as output and assert it */
-	gpio_direction_out(iface->detect_in.gpio, polarity ? 0 : 1);
+        interface_wakeout_assert(iface);
 
         /* Keep the line asserted for the given duration */
         up_udelay(pulse_len);
 
-        /* Finally re-install the interrupt handler on the pin */
-        rc = interface_install_wd_handler(iface, true);
+        rc = interface_wakeout_release(iface);
         if (rc) {
             return rc;
         }
@@ -239,6 +261,35 @@ enum ara_iface_pwr_state interface_get_pwr_state(struct interface *iface)
 }
 
 
+/*
+ * Enable the switch port of a powered interface and request a LinkUp.
+ * The LinkUp itself is handled asynchronously by the switch.
+ */
+static int interface_link_up(struct interface *iface)
+{
+    int rc;
+
+    /* Enable Switch port */
+    rc = switch_enable_port(svc->sw, iface->switch_portid, true);
+    if (rc && (rc != -EOPNOTSUPP)) {
+        dbg_error("Failed to enable switch port for interface %s: %d.\n",
+                  iface->name, rc);
+        return rc;
+    }
+
+    /* Request manual LinkUp of the Unipro port */
+    struct tsb_switch_event e;
+    e.type = TSB_SWITCH_EVENT_LINKUP;
+    e.linkup.port = iface->switch_portid;
+    e.linkup.val = SW_LINKUP_INITIATE;
+    rc = tsb_switch_event_notify(svc->sw, &e);
+    if (rc) {
+        dbg_error("Failed to request LinkUp for interface %s\n", iface->name);
+    }
+
+    return 0;
+}
+
 /*
  * Interface power control helper, to be used by the DETECT_IN/hotplug
  * mechanism.
@@ -302,25 +353,7 @@ static int interface_power_on(struct interface *iface)
         return rc;
     }
 
-    /* Enable Switch port */
-    rc = switch_enable_port(svc->sw, iface->switch_portid, true);
-    if (rc && (rc != -EOPNOTSUPP)) {
-        dbg_error("Failed to enable switch port for interface %s: %d.\n",
-                  iface->name, rc);
-        return rc;
-    }
-
-    /* Request manual LinkUp of the Unipro port */
-    struct tsb_switch_event e;
-    e.type = TSB_SWITCH_EVENT_LINKUP;
-    e.linkup.port = iface->switch_portid;
-    e.linkup.val = SW_LINKUP_INITIATE;
-    rc = tsb_switch_event_notify(svc->sw, &e);
-    if (rc) {
-        dbg_error("Failed to request LinkUp for interface %s\n", iface->name);
-    }
-
-    return 0;
+    return interface_link_up(iface);
 }
 
 
@@ -1006,8 +1039,13 @@ int interface_early_init(struct interface **ints,
         return -1;
     }
 
-    /* Let everything settle for a good long while.*/
-    up_udelay(POWER_OFF_TIME_IN_US);
+    /*
+     * Everything needs to settle for a good long while before being
+     * powered on again. Rather than waiting here, let the caller get
+     * on with other work (e.g. the switch init) and have
+     * interface_init() wait out whatever is left.
+     */
+    power_off_ticks = clock_systimer();
 
     return 0;
 }
@@ -1024,7 +1062,9 @@ int interface_early_init(struct interface **ints,
  */
 int interface_init(struct interface **ints,
                    size_t nr_ints, size_t nr_spring_ints) {
-    unsigned int i;
+    unsigned int i, j;
+    unsigned int group;
+    uint32_t elapsed;
     int rc;
     struct interface *ifc;
 
@@ -1038,6 +1078,26 @@ int interface_init(struct interface **ints,
     nr_interfaces = nr_ints;
     nr_spring_interfaces = nr_spring_ints;
 
+    /*
+     * Wait out the remainder of the power off time started in
+     * interface_early_init(), with one tick of margin.
+     */
+    elapsed = TICK2USEC(clock_systimer() - power_off_ticks);
+    if (elapsed < POWER_OFF_TIME_IN_US + USEC_PER_TICK) {
+        up_udelay(POWER_OFF_TIME_IN_US + USEC_PER_TICK - elapsed);
+    }
+
+    /*
+     * Bring the interfaces up in stages rather than one after the
+     * other, so that the long WAKEOUT pulses overlap:
+     *
+     * 1. Power the rails of the plugged interfaces, in board order.
+     *    The regulators honour their own hold times.
+     * 2. Pulse WAKEOUT on the powered interfaces, at most
+     *    max_parallel_wakeouts of them at once.
+     * 3. Enable the switch ports and request the LinkUps, which
+     *    complete asynchronously in the switch IRQ worker.
+     */
     interface_foreach(ifc, i) {
         /* Initialize the hotplug state */
         ifc->hp_state = interface_get_hotplug_state(ifc);
@@ -1045,7 +1105,8 @@ int interface_init(struct interface **ints,
         switch (ifc->hp_state) {
         case HOTPLUG_ST_PLUGGED:
             /* Port is plugged in, power ON the interface */
-            if (interface_power_on(ifc) < 0) {
+            if (!interface_get_pwr_state(ifc) &&
+                interface_pwr_enable(ifc) < 0) {
                 dbg_error("Failed to power ON interface %s\n", ifc->name);
             }
             break;
@@ -1059,6 +1120,53 @@ int interface_init(struct interface **ints,
         default:
             break;
         }
+    }
+    svc_boot_stage_done(SVC_BOOT_INTF_POWER);
+
+    group = svc->board_info ? svc->board_info->max_parallel_wakeouts : 0;
+    if (!group) {
+        group = nr_interfaces;
+    }
+
+    for (i = 0; i < nr_interfaces; i += group) {
+        bool pulsed = false;
+
+        for (j = i; j < i + group && j < nr_interfaces; j++) {
+            ifc = interfaces[j];
+            if (ifc->hp_state == HOTPLUG_ST_PLUGGED &&
+                interface_get_pwr_state(ifc) == ARA_IFACE_PWR_UP &&
+                ifc->detect_in.gpio) {
+                dbg_info("Generating WAKEOUT on interface %s\n", ifc->name);
+                interface_wakeout_assert(ifc);
+                pulsed = true;
+            }
+        }
+
+        if (!pulsed) {
+            continue;
+        }
+
+        /* Keep the lines asserted for the pulse duration */
+        up_udelay(MODULE_PORT_WAKEOUT_PULSE_DURATION_IN_US);
+
+        for (j = i; j < i + group && j < nr_interfaces; j++) {
+            ifc = interfaces[j];
+            if (ifc->hp_state == HOTPLUG_ST_PLUGGED &&
+                interface_get_pwr_state(ifc) == ARA_IFACE_PWR_UP &&
+                ifc->detect_in.gpio &&
+                interface_wakeout_release(ifc)) {
+                dbg_error("Failed to generate wakeout on interface %s\n",
+                          ifc->name);
+            }
+        }
+    }
+    svc_boot_stage_done(SVC_BOOT_INTF_WAKEOUT);
+
+    interface_foreach(ifc, i) {
+        if (ifc->hp_state == HOTPLUG_ST_PLUGGED &&
+            interface_get_pwr_state(ifc) == ARA_IFACE_PWR_UP) {
+            interface_link_up(ifc);
+        }
 
         /* Install handlers for DETECT_IN signal */
         ifc->detect_in.db_state = WD_ST_INVALID;
@@ -1068,6 +1176,7 @@ int interface_init(struct interface **ints,
             return rc;
         }
     }
+    svc_boot_stage_done(SVC_BOOT_INTF_LINKUP);
 
     return 0;
 }
@@ -223,6 +223,8 @@ int pwrmon_dev_count(void)
  * @brief           Initialize the power measurement HW and SW library.
  *                  To be called once, before any other call to the library.
  * @return          0 on success, standard error codes otherwise.
+ *                  -EBUSY if the library is already in use (e.g. by the
+ *                  background sampler).
  * @param[in]       current_lsb_uA: current measurement precision (LSB) in uA
  * @param[in]       ct: sampling conversion time to be used
  * @param[in]       avg_count: averaging sample count (>0)
@@ -232,40 +234,51 @@ int pwrmon_init(uint32_t current_lsb_uA,
                ina230_avg_count avg_count,
                size_t *num_devs)
 {
+    pwrmon_board_info *info;
+
     dbg_verbose("%s(): Initializing with options lsb=%uuA, ct=%u, avg_count=%u...\n",
                 __func__, current_lsb_uA, ct, avg_count);
 
+    if (board_info) {
+        dbg_error("%s(): already initialized\n", __func__);
+        return -EBUSY;
+    }
+
     /* Retrieve board specific info */
-    board_info = board_get_pwrmon_info();
-    if (!board_info) {
+    info = board_get_pwrmon_info();
+    if (!info) {
         dbg_error("%s(): No pwrmon board info found, aborting\n", __func__);
         return -ENODEV;
     }
 
-    if (!board_info->num_devs) {
+    if (!info->num_devs) {
         fprintf(stderr, "%s(): No pwrmon device found, aborting\n", __func__);
         return -ENODEV;
     }
 
-    /* Initialize I2C internal structs */
-    i2c_dev = up_i2cinitialize(board_info->i2c_bus);
-    if (!i2c_dev) {
-        dbg_error("%s(): Failed to get I2C bus %u\n", __func__,
-                  board_info->i2c_bus);
-        return -ENXIO;
-    }
-
-    pwrmon_current_lsb = current_lsb_uA;
     if (ct >= ina230_ct_count) {
         dbg_error("%s(): invalid conversion time! (%u)\n", __func__, ct);
-        up_i2cuninitialize(i2c_dev);
         return -EINVAL;
     }
     if (avg_count >= ina230_avg_count_max) {
         dbg_error("%s(): invalid average count! (%u)\n", __func__, avg_count);
-        up_i2cuninitialize(i2c_dev);
         return -EINVAL;
     }
+
+    /* Initialize I2C internal structs */
+    i2c_dev = up_i2cinitialize(info->i2c_bus);
+    if (!i2c_dev) {
+        dbg_error("%s(): Failed to get I2C bus %u\n", __func__,
+                  info->i2c_bus);
+        return -ENXIO;
+    }
+
+    /*
+     * Only publish the board info once initialization can no longer fail,
+     * it doubles as the "library in use" flag.
+     */
+    board_info = info;
+    pwrmon_current_lsb = current_lsb_uA;
     pwrmon_ct = ct;
     pwrmon_avg_count = avg_count;
     *num_devs = board_info->num_devs;
@@ -37,6 +37,7 @@
 
 #include <stdint.h>
 #include <sys/types.h>
+#include <nuttx/fs/ioctl.h>
 #include <nuttx/sensors/ina230.h>
 
 struct pwrmon_rail_ctx {
@@ -104,4 +105,68 @@ int pwrmon_dev_rail_count(uint8_t dev);
 void pwrmon_deinit_rail(pwrmon_rail *pwrmon_dev);
 void pwrmon_deinit(void);
 
+#ifdef CONFIG_SVC_PWRMON_STREAM
+/*
+ * Background sampling of all the rails of the board, streamed through a
+ * character device. read() returns whole struct pwrmon_stream_sample
+ * records, oldest first. While the stream runs it owns the power
+ * measurement library: pwrmon_init() returns -EBUSY.
+ */
+#define PWRMON_STREAM_DEVPATH       "/dev/pwrmon"
+
+#define PWRMONIOC_START     _SNIOC(0x0080) /* Arg: struct pwrmon_stream_cfg * */
+#define PWRMONIOC_STOP      _SNIOC(0x0081) /* Arg: None */
+#define PWRMONIOC_GETWINDOW _SNIOC(0x0082) /* Arg: struct pwrmon_stream_window * */
+#define PWRMONIOC_GETSTATS  _SNIOC(0x0083) /* Arg: struct pwrmon_stream_stats * */
+
+struct pwrmon_stream_cfg {
+    uint32_t current_lsb_uA;
+    ina230_conversion_time ct;
+    ina230_avg_count avg_count;
+    /*
+     * Time between two sweeps over all the rails, in microseconds. Raised
+     * to the INA230 sampling time if shorter, 0 to sample as fast as the
+     * devices convert.
+     */
+    uint32_t period_us;
+    /* Number of sweeps aggregated in a min/max/avg window */
+    uint32_t window;
+};
+
+struct pwrmon_stream_sample {
+    /* Microseconds since the stream was started (wraps after ~71 min) */
+    uint32_t usec;
+    uint8_t dev;
+    uint8_t rail;
+    ina230_sample m;
+};
+
+struct pwrmon_stream_window {
+    /* Set by the caller */
+    uint8_t dev;
+    uint8_t rail;
+    /* Last completed window of that rail, count is 0 if there is none yet */
+    uint32_t count;
+    uint32_t start_usec;
+    uint32_t end_usec;
+    ina230_sample min;
+    ina230_sample max;
+    ina230_sample avg;
+};
+
+struct pwrmon_stream_stats {
+    uint32_t sweeps;
+    uint32_t samples;
+    /* Samples lost because the reader did not keep up */
+    uint32_t dropped;
+    /* Rail reads which failed */
+    uint32_t errors;
+    /* Sweeps which took longer than the configured period */
+    uint32_t overruns;
+    uint32_t period_us;
+};
+
+int pwrmon_stream_register(void);
+#endif
+
 #endif
@@ -0,0 +1,558 @@
+/*
+ * Copyright (c) 2016 Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * Background power sampling.
+ *
+ * A sampler task sweeps over all the rails of the board, one device after
+ * the other so that the I2C mux is only switched once per device, and
+ * pushes the timestamped samples into a single-producer single-consumer
+ * ring read through PWRMON_STREAM_DEVPATH. The sampler never blocks on the
+ * reader: when the ring is full, new samples are dropped and counted.
+ *
+ * The sampler also keeps min/max/avg aggregates over a window of sweeps for
+ * every rail, so that a slow reader can still get meaningful figures with
+ * PWRMONIOC_GETWINDOW.
+ */
+
+#define DBG_COMP ARADBG_POWER
+
+#include <nuttx/config.h>
+#include <nuttx/arch.h>
+#include <nuttx/clock.h>
+#include <nuttx/fs/fs.h>
+#include <nuttx/util.h>
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include <arch/irq.h>
+#include <ara_debug.h>
+
+#include "up_arch.h"
+#include "nvic.h"
+#include "pwr_mon.h"
+
+#define PWRMON_STREAM_STACK_SIZE    2048
+
+#define PWRMON_STREAM_RING_SIZE     CONFIG_SVC_PWRMON_STREAM_SAMPLES
+#define PWRMON_STREAM_RING_MASK     (PWRMON_STREAM_RING_SIZE - 1)
+
+#if (PWRMON_STREAM_RING_SIZE & PWRMON_STREAM_RING_MASK) != 0
+#error "CONFIG_SVC_PWRMON_STREAM_SAMPLES must be a power of two"
+#endif
+
+/* Keep the compiler from moving ring accesses across index updates */
+#define pwrmon_stream_barrier()     __asm__ __volatile__("" ::: "memory")
+
+struct pwrmon_stream_acc {
+    uint32_t count;
+    uint32_t start_usec;
+    ina230_sample min;
+    ina230_sample max;
+    int64_t sum_uV;
+    int64_t sum_uA;
+    int64_t sum_uW;
+};
+
+struct pwrmon_stream_rail {
+    pwrmon_rail *rail;
+    /* Window being accumulated, only touched by the sampler */
+    struct pwrmon_stream_acc acc;
+    /* Last completed window */
+    struct pwrmon_stream_window last;
+};
+
+struct pwrmon_stream {
+    /* Serializes start, stop and readers against the ring going away */
+    sem_t lock;
+    /* Posted by the sampler after each sweep */
+    sem_t data;
+    bool running;
+    volatile bool stop;
+    pid_t sampler;
+
+    struct pwrmon_stream_cfg cfg;
+    uint32_t period_us;
+    uint64_t start_usec;
+
+    struct pwrmon_stream_rail *rails;
+    size_t num_rails;
+
+    struct pwrmon_stream_sample *ring;
+    /* Only written by the sampler */
+    volatile uint32_t head;
+    /* Only written by the reader */
+    volatile uint32_t tail;
+
+    struct pwrmon_stream_stats stats;
+};
+
+static struct pwrmon_stream g_stream;
+
+/*
+ * The SVC has no free-running high resolution timer, so interpolate within
+ * the current system tick using the SysTick down-counter.
+ */
+static uint64_t pwrmon_stream_usec(void)
+{
+    irqstate_t flags;
+    uint32_t ticks, reload, current;
+
+    flags = irqsave();
+    ticks = clock_systimer();
+    current = getreg32(NVIC_SYSTICK_CURRENT);
+    if (getreg32(NVIC_INTCTRL) & NVIC_INTCTRL_PENDSTSET) {
+        /* The counter wrapped, but the tick has not been accounted yet */
+        ticks++;
+        current = getreg32(NVIC_SYSTICK_CURRENT);
+    }
+    irqrestore(flags);
+
+    reload = getreg32(NVIC_SYSTICK_RELOAD) & NVIC_SYSTICK_RELOAD_MASK;
+    current &= NVIC_SYSTICK_CURRENT_MASK;
+
+    return (uint64_t)TICK2USEC(ticks) +
+           (uint64_t)(reload - current) * USEC_PER_TICK / (reload + 1);
+}
+
+static void pwrmon_stream_wait_until(struct pwrmon_stream *s,
+                                     uint64_t deadline)
+{
+    uint64_t now;
+    uint64_t remaining;
+
+    while (!s->stop && (now = pwrmon_stream_usec()) < deadline) {
+        remaining = deadline - now;
+        /* usleep() rounds up to whole ticks, poll the last one */
+        if (remaining > USEC_PER_TICK) {
+            usleep(remaining - USEC_PER_TICK);
+        } else {
+            sched_yield();
+        }
+    }
+}
+
+static void pwrmon_stream_push(struct pwrmon_stream *s,
+                               struct pwrmon_stream_rail *r,
+                               uint32_t usec, const ina230_sample *m)
+{
+    struct pwrmon_stream_sample *sample;
+    uint32_t head = s->head;
+
+    if (head - s->tail >= PWRMON_STREAM_RING_SIZE) {
+        s->stats.dropped++;
+        return;
+    }
+
+    sample = &s->ring[head & PWRMON_STREAM_RING_MASK];
+    sample->usec = usec;
+    sample->dev = r->last.dev;
+    sample->rail = r->last.rail;
+    sample->m = *m;
+
+    pwrmon_stream_barrier();
+    s->head = head + 1;
+}
+
+static void pwrmon_stream_aggregate(struct pwrmon_stream *s,
+                                    struct pwrmon_stream_rail *r,
+                                    uint32_t usec, const ina230_sample *m)
+{
+    struct pwrmon_stream_acc *acc = &r->acc;
+    struct pwrmon_stream_window w;
+    irqstate_t flags;
+
+    if (!acc->count) {
+        acc->start_usec = usec;
+        acc->min = *m;
+        acc->max = *m;
+        acc->sum_uV = 0;
+        acc->sum_uA = 0;
+        acc->sum_uW = 0;
+    }
+
+    acc->min.uV = MIN(acc->min.uV, m->uV);
+    acc->min.uA = MIN(acc->min.uA, m->uA);
+    acc->min.uW = MIN(acc->min.uW, m->uW);
+    acc->max.uV = MAX(acc->max.uV, m->uV);
+    acc->max.uA = MAX(acc->max.uA, m->uA);
+    acc->max.uW = MAX(acc->max.uW, m->uW);
+    acc->sum_uV += m->uV;
+    acc->sum_uA += m->uA;
+    acc->sum_uW += m->uW;
+
+    if (++acc->count < s->cfg.window) {
+        return;
+    }
+
+    w.dev = r->last.dev;
+    w.rail = r->last.rail;
+    w.count = acc->count;
+    w.start_usec = acc->start_usec;
+    w.end_usec = usec;
+    w.min = acc->min;
+    w.max = acc->max;
+    w.avg.uV = acc->sum_uV / acc->count;
+    w.avg.uA = acc->sum_uA / acc->count;
+    w.avg.uW = acc->sum_uW / acc->count;
+
+    flags = irqsave();
+    r->last = w;
+    irqrestore(flags);
+
+    acc->count = 0;
+}
+
+static void pwrmon_stream_sweep(struct pwrmon_stream *s)
+{
+    struct pwrmon_stream_rail *r;
+    ina230_sample m;
+    uint32_t usec;
+    int value;
+    size_t i;
+
+    for (i = 0; i < s->num_rails && !s->stop; i++) {
+        r = &s->rails[i];
+
+        if (pwrmon_measure_rail(r->rail, &m)) {
+            s->stats.errors++;
+            continue;
+        }
+
+        usec = (uint32_t)(pwrmon_stream_usec() - s->start_usec);
+        pwrmon_stream_push(s, r, usec, &m);
+        pwrmon_stream_aggregate(s, r, usec, &m);
+        s->stats.samples++;
+    }
+    s->stats.sweeps++;
+
+    sem_getvalue(&s->data, &value);
+    if (value <= 0) {
+        sem_post(&s->data);
+    }
+}
+
+static int pwrmon_stream_sampler(int argc, char *argv[])
+{
+    struct pwrmon_stream *s = &g_stream;
+    uint64_t next, now;
+
+    /*
+     * The devices only have a first result after a full sampling time,
+     * see pwrmon_init_rail().
+     */
+    next = pwrmon_stream_usec() + s->period_us;
+    pwrmon_stream_wait_until(s, next);
+
+    while (!s->stop) {
+        pwrmon_stream_sweep(s);
+
+        next += s->period_us;
+        now = pwrmon_stream_usec();
+        if (now >= next) {
+            s->stats.overruns++;
+            next = now;
+            continue;
+        }
+        pwrmon_stream_wait_until(s, next);
+    }
+
+    return 0;
+}
+
+static void pwrmon_stream_release(struct pwrmon_stream *s)
+{
+    size_t i;
+
+    if (s->rails) {
+        for (i = 0; i < s->num_rails; i++) {
+            if (s->rails[i].rail) {
+                pwrmon_deinit_rail(s->rails[i].rail);
+            }
+        }
+        free(s->rails);
+        s->rails = NULL;
+    }
+    s->num_rails = 0;
+
+    free(s->ring);
+    s->ring = NULL;
+
+    pwrmon_deinit();
+}
+
+static int pwrmon_stream_start(struct pwrmon_stream *s,
+                               const struct pwrmon_stream_cfg *cfg)
+{
+    size_t num_devs, num_rails = 0;
+    uint32_t stime;
+    uint8_t d, r;
+    size_t i = 0;
+    int ret;
+
+    if (!cfg) {
+        return -EINVAL;
+    }
+
+    if (s->running) {
+        return -EBUSY;
+    }
+
+    ret = pwrmon_init(cfg->current_lsb_uA, cfg->ct, cfg->avg_count,
+                      &num_devs);
+    if (ret) {
+        return ret;
+    }
+
+    for (d = 0; d < num_devs; d++) {
+        ret = pwrmon_dev_rail_count(d);
+        if (ret > 0) {
+            num_rails += ret;
+        }
+    }
+
+    s->rails = zalloc(num_rails * sizeof(*s->rails));
+    s->ring = malloc(PWRMON_STREAM_RING_SIZE * sizeof(*s->ring));
+    if (!num_rails || !s->rails || !s->ring) {
+        ret = num_rails ? -ENOMEM : -ENODEV;
+        goto error;
+    }
+
+    /* Grouped by device, so the I2C mux only switches once per device */
+    for (d = 0; d < num_devs; d++) {
+        for (r = 0; r < pwrmon_dev_rail_count(d); r++, i++) {
+            s->rails[i].rail = pwrmon_init_rail(d, r);
+            s->rails[i].last.dev = d;
+            s->rails[i].last.rail = r;
+            s->num_rails = i + 1;
+            if (!s->rails[i].rail) {
+                dbg_error("%s(): failed to init %s rail\n", __func__,
+                          pwrmon_rail_name(d, r));
+                ret = -EIO;
+                goto error;
+            }
+        }
+    }
+
+    s->cfg = *cfg;
+    if (!s->cfg.window) {
+        s->cfg.window = 1;
+    }
+
+    stime = pwrmon_get_sampling_time(s->rails[0].rail);
+    s->period_us = MAX(cfg->period_us, stime);
+
+    memset(&s->stats, 0, sizeof(s->stats));
+    s->stats.period_us = s->period_us;
+    s->head = 0;
+    s->tail = 0;
+    s->stop = false;
+    s->start_usec = pwrmon_stream_usec();
+
+    ret = task_create("pwrmon_stream", CONFIG_SVC_PWRMON_STREAM_PRIORITY,
+                      PWRMON_STREAM_STACK_SIZE, pwrmon_stream_sampler, NULL);
+    if (ret == ERROR) {
+        dbg_error("%s(): failed to create sampler task\n", __func__);
+        ret = -ENOMEM;
+        goto error;
+    }
+    s->sampler = ret;
+    s->running = true;
+
+    dbg_info("%s(): sampling %u rails every %uus\n", __func__,
+             s->num_rails, s->period_us);
+
+    return 0;
+
+error:
+    pwrmon_stream_release(s);
+    return ret;
+}
+
+static int pwrmon_stream_stop(struct pwrmon_stream *s)
+{
+    int status;
+
+    if (!s->running) {
+        return 0;
+    }
+
+    s->stop = true;
+    if (waitpid(s->sampler, &status, 0) < 0) {
+        dbg_warn("%s(): waitpid failed (%d)\n", __func__, errno);
+    }
+    s->running = false;
+
+    pwrmon_stream_release(s);
+
+    /* Readers blocked on an empty ring get end of file */
+    sem_post(&s->data);
+
+    return 0;
+}
+
+static int pwrmon_stream_get_window(struct pwrmon_stream *s,
+                                    struct pwrmon_stream_window *w)
+{
+    irqstate_t flags;
+    size_t i;
+
+    if (!w) {
+        return -EINVAL;
+    }
+
+    if (!s->running) {
+        return -ENODATA;
+    }
+
+    for (i = 0; i < s->num_rails; i++) {
+        if (s->rails[i].last.dev == w->dev &&
+            s->rails[i].last.rail == w->rail) {
+            flags = irqsave();
+            *w = s->rails[i].last;
+            irqrestore(flags);
+            return 0;
+        }
+    }
+
+    return -ENODEV;
+}
+
+static ssize_t pwrmon_stream_read(struct file *filep, char *buffer,
+                                  size_t buflen)
+{
+    struct pwrmon_stream *s = &g_stream;
+    struct pwrmon_stream_sample *samples =
+        (struct pwrmon_stream_sample *)buffer;
+    size_t count = buflen / sizeof(*samples);
+    size_t n = 0;
+    uint32_t tail;
+
+    if (!count) {
+        return -EINVAL;
+    }
+
+    while (!n) {
+        if (sem_wait(&s->lock)) {
+            return -EINTR;
+        }
+
+        if (!s->running) {
+            sem_post(&s->lock);
+            return 0;
+        }
+
+        tail = s->tail;
+        while (n < count && tail != s->head) {
+            pwrmon_stream_barrier();
+            samples[n++] = s->ring[tail++ & PWRMON_STREAM_RING_MASK];
+        }
+        pwrmon_stream_barrier();
+        s->tail = tail;
+
+        sem_post(&s->lock);
+
+        if (!n) {
+            if (filep->f_oflags & O_NONBLOCK) {
+                return -EAGAIN;
+            }
+            if (sem_wait(&s->data)) {
+                return -EINTR;
+            }
+        }
+    }
+
+    return n * sizeof(*samples);
+}
+
+static int pwrmon_stream_ioctl(struct file *filep, int cmd, unsigned long arg)
+{
+    struct pwrmon_stream *s = &g_stream;
+    irqstate_t flags;
+    int ret;
+
+    if (sem_wait(&s->lock)) {
+        return -EINTR;
+    }
+
+    switch (cmd) {
+    case PWRMONIOC_START:
+        ret = pwrmon_stream_start(s, (struct pwrmon_stream_cfg *)arg);
+        break;
+    case PWRMONIOC_STOP:
+        ret = pwrmon_stream_stop(s);
+        break;
+    case PWRMONIOC_GETWINDOW:
+        ret = pwrmon_stream_get_window(s,
+                                       (struct pwrmon_stream_window *)arg);
+        break;
+    case PWRMONIOC_GETSTATS:
+        if (!arg) {
+            ret = -EINVAL;
+            break;
+        }
+        flags = irqsave();
+        *(struct pwrmon_stream_stats *)arg = s->stats;
+        irqrestore(flags);
+        ret = 0;
+        break;
+    default:
+        ret = -ENOTTY;
+        break;
+    }
+
+    sem_post(&s->lock);
+
+    return ret;
+}
+
+static const struct file_operations pwrmon_stream_ops = {
+    .read = pwrmon_stream_read,
+    .ioctl = pwrmon_stream_ioctl,
+};
+
+/**
+ * @brief           Register the power sampling stream character device.
+ * @return          0 on success, standard error codes otherwise.
+ */
+int pwrmon_stream_register(void)
+{
+    sem_init(&g_stream.lock, 0, 1);
+    sem_init(&g_stream.data, 0, 0);
+
+    return register_driver(PWRMON_STREAM_DEVPATH, &pwrmon_stream_ops, 0666,
+                           NULL);
+}
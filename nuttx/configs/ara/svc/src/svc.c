@@ -30,6 +30,7 @@
 
 #include <nuttx/config.h>
 #include <nuttx/arch.h>
+#include <nuttx/clock.h>
 #include <nuttx/util.h>
 #include <nuttx/greybus/greybus.h>
 #include <nuttx/unipro/unipro.h>
@@ -866,11 +867,49 @@ static inline void svcd_set_state(enum svc_state state) {
     svc->state = state;
 }
 
+static const char *svc_boot_stage_names[SVC_BOOT_NR_STAGES] = {
+    [SVC_BOOT_BOARD_INIT]       = "board init",
+    [SVC_BOOT_INTF_EARLY_INIT]  = "interfaces off",
+    [SVC_BOOT_SWITCH_INIT]      = "switch init",
+    [SVC_BOOT_EVENT_INIT]       = "event init",
+    [SVC_BOOT_INTF_POWER]       = "interfaces powered",
+    [SVC_BOOT_INTF_WAKEOUT]     = "interfaces woken",
+    [SVC_BOOT_INTF_LINKUP]      = "link up requested",
+    [SVC_BOOT_GB_INIT]          = "greybus init",
+    [SVC_BOOT_AP_READY]         = "AP ready",
+};
+
+const char *svc_boot_stage_name(enum svc_boot_stage stage) {
+    if (stage >= SVC_BOOT_NR_STAGES) {
+        return "unknown";
+    }
+
+    return svc_boot_stage_names[stage];
+}
+
+/**
+ * @brief Record the completion of a bring-up stage in the boot timeline
+ */
+void svc_boot_stage_done(enum svc_boot_stage stage) {
+    uint32_t ticks;
+
+    if (stage >= SVC_BOOT_NR_STAGES) {
+        return;
+    }
+
+    /* Never record 0, which means "not reached" */
+    ticks = clock_systimer() - svc->boot_start;
+    svc->boot_ticks[stage] = ticks ? ticks : 1;
+}
+
 static int svcd_startup(void) {
     struct ara_board_info *info;
     struct tsb_switch *sw;
     int rc;
 
+    svc->boot_start = clock_systimer();
+    memset(svc->boot_ticks, 0, sizeof(svc->boot_ticks));
+
     /*
      * Board-specific initialization, all boards must define this.
      */
@@ -880,12 +919,20 @@ static int svcd_startup(void) {
         goto error0;
     }
     svc->board_info = info;
+    svc_boot_stage_done(SVC_BOOT_BOARD_INIT);
+
+    /*
+     * Power off the interfaces. They need to stay off for a while,
+     * which interface_init() waits out, so the switch init overlaps
+     * with it.
+     */
     rc = interface_early_init(info->interfaces,
                               info->nr_interfaces, info->nr_spring_interfaces);
     if (rc < 0) {
         dbg_error("%s: Failed to power off interfaces\n", __func__);
         goto error0;
     }
+    svc_boot_stage_done(SVC_BOOT_INTF_EARLY_INIT);
 
     /* Init Switch */
     sw = switch_init(&info->sw_data);
@@ -894,6 +941,7 @@ static int svcd_startup(void) {
         goto error1;
     }
     svc->sw = sw;
+    svc_boot_stage_done(SVC_BOOT_SWITCH_INIT);
 
     /* Enable the switch IRQ */
     rc = switch_irq_enable(sw, true);
@@ -909,6 +957,7 @@ static int svcd_startup(void) {
     if (rc) {
         goto error2;
     }
+    svc_boot_stage_done(SVC_BOOT_EVENT_INIT);
 
     /* Power on all provided interfaces */
     if (!info->interfaces) {
@@ -928,6 +977,7 @@ static int svcd_startup(void) {
         dbg_error("%s: Failed to initialize SVC protocol\n", __func__);
         goto error3;
     }
+    svc_boot_stage_done(SVC_BOOT_GB_INIT);
 
     /*
      * enable the ARA key IRQ
@@ -994,6 +1044,7 @@ static int svcd_main(int argc, char **argv) {
 
             dbg_info("AP initialized on interface %u\n", svc->ap_intf_id);
             svc->ap_initialized = 1;
+            svc_boot_stage_done(SVC_BOOT_AP_READY);
 
             /* Send hotplug events to the AP */
             svc_consume_hotplug_events();
@@ -36,6 +36,23 @@ enum svc_state {
     SVC_STATE_RUNNING,
 };
 
+/*
+ * svcd bring-up stages, in the order they complete. The time at which
+ * each stage completed is recorded in the boot timeline.
+ */
+enum svc_boot_stage {
+    SVC_BOOT_BOARD_INIT,
+    SVC_BOOT_INTF_EARLY_INIT,
+    SVC_BOOT_SWITCH_INIT,
+    SVC_BOOT_EVENT_INIT,
+    SVC_BOOT_INTF_POWER,
+    SVC_BOOT_INTF_WAKEOUT,
+    SVC_BOOT_INTF_LINKUP,
+    SVC_BOOT_GB_INIT,
+    SVC_BOOT_AP_READY,
+    SVC_BOOT_NR_STAGES,
+};
+
 struct unipro_link_cfg;
 
 struct svc {
@@ -50,6 +67,10 @@ struct svc {
 
     uint8_t ap_intf_id;
     bool ap_initialized;
+
+    /* Boot timeline: ticks since svcd start, 0 if not reached */
+    uint32_t boot_start;
+    uint32_t boot_ticks[SVC_BOOT_NR_STAGES];
 };
 
 extern struct svc *svc;
@@ -69,6 +90,9 @@ int svc_intf_set_power_mode(uint8_t, struct unipro_link_cfg *);
 int svcd_start(void);
 void svcd_stop(void);
 
+void svc_boot_stage_done(enum svc_boot_stage stage);
+const char *svc_boot_stage_name(enum svc_boot_stage stage);
+
 struct interface;
 
 int svc_connect_interfaces(struct interface *iface1, uint16_t cportid1,
@@ -34,6 +34,7 @@
 #define DBG_COMP    ARADBG_SWITCH
 #include <nuttx/config.h>
 #include <nuttx/arch.h>
+#include <nuttx/clock.h>
 #include <nuttx/unipro/unipro.h>
 #include <arch/byteorder.h>
 #include <errno.h>
@@ -322,6 +323,10 @@ int switch_enable_port(struct tsb_switch *sw,
     if (!sw->ops->enable_port) {
         return -EOPNOTSUPP;
     }
+
+    /* The port's attributes are reset along with it */
+    switch_cache_invalidate_port(sw, portid);
+
     return sw->ops->enable_port(sw, portid, enable);
 }
 
@@ -1464,46 +1469,40 @@ int switch_qos_set_in_wdt_count(struct tsb_switch *sw, uint32_t val) {
     return switch_qos_attr_set(sw, SWITCH_PORT_ID, RT_WDT, val);
 }
 
-static int switch_set_port_l4attr(struct tsb_switch *sw,
-                                  uint8_t portid,
-                                  uint16_t attrid,
-                                  uint16_t selector,
-                                  uint32_t val) {
-    int rc;
-
+static int switch_batch_set_port_l4attr(struct switch_ncp_batch *batch,
+                                        uint8_t portid,
+                                        uint16_t attrid,
+                                        uint16_t selector,
+                                        uint32_t val) {
     if (portid == SWITCH_PORT_ID) {
-        rc = switch_dme_set(sw, portid, attrid, selector, val);
+        return switch_ncp_batch_dme_set(batch, portid, attrid, selector, val);
     } else {
-        rc = switch_dme_peer_set(sw, portid, attrid, selector, val);
+        return switch_ncp_batch_dme_peer_set(batch, portid, attrid, selector,
+                                             val);
     }
-
-    return rc;
 }
 
-static int switch_get_port_l4attr(struct tsb_switch *sw,
-                                  uint8_t portid,
-                                  uint16_t attrid,
-                                  uint16_t selector,
-                                  uint32_t *val) {
-    int rc;
-
+static int switch_batch_get_port_l4attr(struct switch_ncp_batch *batch,
+                                        uint8_t portid,
+                                        uint16_t attrid,
+                                        uint16_t selector,
+                                        uint32_t *val) {
     if (portid == SWITCH_PORT_ID) {
-        rc = switch_dme_get(sw, portid, attrid, selector, val);
+        return switch_ncp_batch_dme_get(batch, portid, attrid, selector, val);
     } else {
-        rc = switch_dme_peer_get(sw, portid, attrid, selector, val);
+        return switch_ncp_batch_dme_peer_get(batch, portid, attrid, selector,
+                                             val);
     }
-
-    return rc;
 }
 
-
-static int switch_set_pair_attr(struct tsb_switch *sw,
-                                struct unipro_connection *c,
-                                uint16_t attrid,
-                                uint32_t val0,
-                                uint32_t val1) {
+static int switch_batch_set_pair_attr(struct switch_ncp_batch *batch,
+                                      struct unipro_connection *c,
+                                      uint16_t attrid,
+                                      uint32_t val0,
+                                      uint32_t val1) {
     int rc;
-    rc = switch_set_port_l4attr(sw,
+
+    rc = switch_batch_set_port_l4attr(batch,
             c->port_id0,
             attrid,
             c->cport_id0,
@@ -1512,26 +1511,30 @@ static int switch_set_pair_attr(struct tsb_switch *sw,
         return rc;
     }
 
-    rc = switch_set_port_l4attr(sw,
+    return switch_batch_set_port_l4attr(batch,
             c->port_id1,
             attrid,
             c->cport_id1,
             val1);
-    if (rc) {
-        return rc;
-    }
-
-    return 0;
 }
 
+/*
+ * The connection is set up in as few SPI bursts as possible: requests
+ * are queued in a batch, which is only flushed when a later request
+ * depends on an earlier result (T_LocalBufferSpace), and before the
+ * connection is finally established.
+ */
 static int switch_cport_connect(struct tsb_switch *sw,
+                                struct switch_ncp_batch *b,
                                 struct unipro_connection *c) {
     int e2efc_enabled = (!!(c->flags & CPORT_FLAGS_E2EFC) == 1);
     int csd_enabled = (!!(c->flags & CPORT_FLAGS_CSD_N) == 0);
+    uint32_t cport0_local = 0;
+    uint32_t cport1_local = 0;
     int rc = 0;
 
     /* Disable any existing connection(s). */
-    rc = switch_set_pair_attr(sw, c, T_CONNECTIONSTATE, 0, 0);
+    rc = switch_batch_set_pair_attr(b, c, T_CONNECTIONSTATE, 0, 0);
     if (rc) {
         return rc;
     }
@@ -1539,11 +1542,11 @@ static int switch_cport_connect(struct tsb_switch *sw,
     /*
      * Point each device at the other.
      */
-    rc = switch_set_pair_attr(sw,
-                              c,
-                              T_PEERDEVICEID,
-                              c->device_id1,
-                              c->device_id0);
+    rc = switch_batch_set_pair_attr(b,
+                                    c,
+                                    T_PEERDEVICEID,
+                                    c->device_id1,
+                                    c->device_id0);
     if (rc) {
         return rc;
     }
@@ -1551,7 +1554,8 @@ static int switch_cport_connect(struct tsb_switch *sw,
     /*
      * Point each CPort at the other.
      */
-    rc = switch_set_pair_attr(sw, c, T_PEERCPORTID, c->cport_id1, c->cport_id0);
+    rc = switch_batch_set_pair_attr(b, c, T_PEERCPORTID,
+                                    c->cport_id1, c->cport_id0);
     if (rc) {
         return rc;
     }
@@ -1559,7 +1563,7 @@ static int switch_cport_connect(struct tsb_switch *sw,
     /*
      * Match up traffic classes.
      */
-    rc = switch_set_pair_attr(sw, c, T_TRAFFICCLASS, c->tc, c->tc);
+    rc = switch_batch_set_pair_attr(b, c, T_TRAFFICCLASS, c->tc, c->tc);
     if (rc) {
         return rc;
     }
@@ -1567,11 +1571,11 @@ static int switch_cport_connect(struct tsb_switch *sw,
     /*
      * Make sure the protocol IDs are equal. (We don't use them otherwise.)
      */
-    rc = switch_set_pair_attr(sw,
-                              c,
-                              T_PROTOCOLID,
-                              CPORT_DEFAULT_T_PROTOCOLID,
-                              CPORT_DEFAULT_T_PROTOCOLID);
+    rc = switch_batch_set_pair_attr(b,
+                                    c,
+                                    T_PROTOCOLID,
+                                    CPORT_DEFAULT_T_PROTOCOLID,
+                                    CPORT_DEFAULT_T_PROTOCOLID);
     if (rc) {
         return rc;
     }
@@ -1583,20 +1587,20 @@ static int switch_cport_connect(struct tsb_switch *sw,
      * enabled, so don't change them to different values unless you
      * also patch up the E2EFC case, below.
      */
-    rc = switch_set_pair_attr(sw,
-                              c,
-                              T_TXTOKENVALUE,
-                              CPORT_DEFAULT_TOKENVALUE,
-                              CPORT_DEFAULT_TOKENVALUE);
+    rc = switch_batch_set_pair_attr(b,
+                                    c,
+                                    T_TXTOKENVALUE,
+                                    CPORT_DEFAULT_TOKENVALUE,
+                                    CPORT_DEFAULT_TOKENVALUE);
     if (rc) {
         return rc;
     }
 
-    rc = switch_set_pair_attr(sw,
-                              c,
-                              T_RXTOKENVALUE,
-                              CPORT_DEFAULT_TOKENVALUE,
-                              CPORT_DEFAULT_TOKENVALUE);
+    rc = switch_batch_set_pair_attr(b,
+                                    c,
+                                    T_RXTOKENVALUE,
+                                    CPORT_DEFAULT_TOKENVALUE,
+                                    CPORT_DEFAULT_TOKENVALUE);
     if (rc) {
         return rc;
     }
@@ -1608,7 +1612,7 @@ static int switch_cport_connect(struct tsb_switch *sw,
      * (E2EFC needs to be the same on both sides, which is handled by
      * having a single flags value for now.)
      */
-    rc = switch_set_pair_attr(sw, c, T_CPORTFLAGS, c->flags, c->flags);
+    rc = switch_batch_set_pair_attr(b, c, T_CPORTFLAGS, c->flags, c->flags);
     if (rc) {
         return rc;
     }
@@ -1619,9 +1623,7 @@ static int switch_cport_connect(struct tsb_switch *sw,
      * T_LocalBufferSpace.
      */
     if (e2efc_enabled || (!e2efc_enabled && csd_enabled)) {
-        uint32_t cport0_local = 0;
-        uint32_t cport1_local = 0;
-        rc = switch_get_port_l4attr(sw,
+        rc = switch_batch_get_port_l4attr(b,
                 c->port_id0,
                 T_LOCALBUFFERSPACE,
                 c->cport_id0,
@@ -1630,7 +1632,7 @@ static int switch_cport_connect(struct tsb_switch *sw,
             return rc;
         }
 
-        rc = switch_get_port_l4attr(sw,
+        rc = switch_batch_get_port_l4attr(b,
                 c->port_id1,
                 T_LOCALBUFFERSPACE,
                 c->cport_id1,
@@ -1639,11 +1641,17 @@ static int switch_cport_connect(struct tsb_switch *sw,
             return rc;
         }
 
-        rc = switch_set_pair_attr(sw,
-                                  c,
-                                  T_LOCALBUFFERSPACE,
-                                  cport0_local,
-                                  cport1_local);
+        /* The values read are needed for the next request. */
+        rc = switch_ncp_batch_flush(b);
+        if (rc) {
+            return rc;
+        }
+
+        rc = switch_batch_set_pair_attr(b,
+                                        c,
+                                        T_LOCALBUFFERSPACE,
+                                        cport0_local,
+                                        cport1_local);
         if (rc) {
             return rc;
         }
@@ -1652,11 +1660,11 @@ static int switch_cport_connect(struct tsb_switch *sw,
     /*
      * Ensure the CPorts aren't in test mode.
      */
-    rc = switch_set_pair_attr(sw,
-                              c,
-                              T_CPORTMODE,
-                              CPORT_MODE_APPLICATION,
-                              CPORT_MODE_APPLICATION);
+    rc = switch_batch_set_pair_attr(b,
+                                    c,
+                                    T_CPORTMODE,
+                                    CPORT_MODE_APPLICATION,
+                                    CPORT_MODE_APPLICATION);
     if (rc) {
         return rc;
     }
@@ -1664,7 +1672,7 @@ static int switch_cport_connect(struct tsb_switch *sw,
     /*
      * Clear out the credits to send on each side.
      */
-    rc = switch_set_pair_attr(sw, c, T_CREDITSTOSEND, 0, 0);
+    rc = switch_batch_set_pair_attr(b, c, T_CREDITSTOSEND, 0, 0);
     if (rc) {
         return rc;
     }
@@ -1672,23 +1680,33 @@ static int switch_cport_connect(struct tsb_switch *sw,
     /*
      * XXX Toshiba-specific TSB_MaxSegmentConfig (move to bridge ASIC code.)
      */
-    rc = switch_set_pair_attr(sw,
-                              c,
-                              TSB_MAXSEGMENTCONFIG,
-                              CPORT_DEFAULT_TSB_MAXSEGMENTCONFIG,
-                              CPORT_DEFAULT_TSB_MAXSEGMENTCONFIG);
+    rc = switch_batch_set_pair_attr(b,
+                                    c,
+                                    TSB_MAXSEGMENTCONFIG,
+                                    CPORT_DEFAULT_TSB_MAXSEGMENTCONFIG,
+                                    CPORT_DEFAULT_TSB_MAXSEGMENTCONFIG);
     if (rc) {
         return rc;
     }
+
+    /*
+     * Only establish the connections once everything else has been
+     * accepted.
+     */
+    rc = switch_ncp_batch_flush(b);
+    if (rc) {
+        return rc;
+    }
+
     /*
      * Establish the connections!
      */
-    rc = switch_set_pair_attr(sw, c, T_CONNECTIONSTATE, 1, 1);
+    rc = switch_batch_set_pair_attr(b, c, T_CONNECTIONSTATE, 1, 1);
     if (rc) {
         return rc;
     }
 
-    return rc;
+    return switch_ncp_batch_flush(b);
 }
 
 static int switch_cport_disconnect(struct tsb_switch *sw,
@@ -1851,11 +1869,60 @@ int switch_invalidate_routing_table(struct tsb_switch *sw,
     return 0;
 }
 
+static void switch_connection_stats_update(struct tsb_switch *sw,
+                                           struct switch_ncp_batch *batch,
+                                           uint32_t ticks, int rc) {
+    struct switch_connection_stats *stats = &sw->conn_stats;
+    irqstate_t flags;
+    uint32_t usec = TICK2USEC(ticks);
+
+    flags = irqsave();
+
+    if (rc) {
+        stats->failures++;
+    } else {
+        stats->count++;
+        stats->last_usec = usec;
+        stats->total_usec += usec;
+        if (usec > stats->max_usec) {
+            stats->max_usec = usec;
+        }
+    }
+    stats->ncp_cmds += batch->total;
+    stats->ncp_bursts += batch->bursts;
+
+    irqrestore(flags);
+}
+
+/**
+ * @brief Get a snapshot of the connection setup statistics
+ */
+void switch_connection_stats_get(struct tsb_switch *sw,
+                                 struct switch_connection_stats *stats) {
+    irqstate_t flags;
+
+    flags = irqsave();
+    *stats = sw->conn_stats;
+    irqrestore(flags);
+}
+
+/**
+ * @brief Clear the connection setup statistics
+ */
+void switch_connection_stats_reset(struct tsb_switch *sw) {
+    irqstate_t flags;
+
+    flags = irqsave();
+    memset(&sw->conn_stats, 0, sizeof(sw->conn_stats));
+    irqrestore(flags);
+}
+
 /**
  * @brief Create a connection between two cports
  */
 int switch_connection_create(struct tsb_switch *sw,
                              struct unipro_connection *c) {
+    uint32_t start;
     int rc;
 
     if (!c) {
@@ -1875,7 +1942,21 @@ int switch_connection_create(struct tsb_switch *sw,
              c->tc,
              c->flags);
 
-    rc = switch_cport_connect(sw, c);
+    while (sem_wait(&sw->conn_lock) != OK) {
+        if (errno == EINVAL) {
+            rc = -EINVAL;
+            goto err0;
+        }
+    }
+
+    start = clock_systimer();
+    switch_ncp_batch_init(sw, &sw->conn_batch);
+    rc = switch_cport_connect(sw, &sw->conn_batch, c);
+    switch_connection_stats_update(sw, &sw->conn_batch,
+                                   clock_systimer() - start, rc);
+
+    sem_post(&sw->conn_lock);
+
     if (rc) {
         switch_cport_disconnect(sw,
                                 c->port_id0,
@@ -2418,6 +2499,10 @@ static int switch_apply_power_mode(struct tsb_switch *sw,
                              &val);
 
  out:
+    if (rc) {
+        /* The link may have been left in any state */
+        switch_cache_invalidate_port(sw, port_id);
+    }
     dbg_insane("%s(): exit, rc=%d\n", __func__, rc);
     return rc;
 }
@@ -2658,11 +2743,16 @@ struct tsb_switch *switch_init(struct tsb_switch_data *pdata) {
 
     sw->pdata = pdata;
     sem_init(&sw->sw_irq_lock, 0, 0);
+    sem_init(&sw->conn_lock, 0, 1);
     sw->worker_id = 0;
     sw->sw_irq_worker_exit = false;
 
     list_init(&sw->listeners);
 
+    if (switch_cache_init(sw)) {
+        dbg_error("%s: Failed to allocate the attribute cache\n", __func__);
+    }
+
     switch_power_on_reset(sw);
 
     stm32_configgpio(sw->pdata->spi_cs);
@@ -2793,6 +2883,7 @@ void switch_exit(struct tsb_switch *sw)
     };
 
     switch_power_off(sw);
+    switch_cache_exit(sw);
     free(sw);
 }
 
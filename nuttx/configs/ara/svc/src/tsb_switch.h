@@ -35,6 +35,7 @@
 #define  _TSB_SWITCH_H_
 
 #include <sched.h>
+#include <string.h>
 
 #include <nuttx/list.h>
 #include <nuttx/spi/spi.h>
@@ -349,6 +350,56 @@ struct tsb_link_cfg {
  */
 struct tsb_switch;
 
+/* Maximum number of NCP requests sent in a single SPI burst */
+#define SWITCH_NCP_BATCH_MAX        (16)
+/* Large enough for any DME (peer) set/get request */
+#define SWITCH_NCP_BATCH_REQ_SIZE   (20)
+/* Large enough for any DME (peer) set/get CNF */
+#define SWITCH_NCP_BATCH_CNF_SIZE   (8)
+
+/**
+ * @brief Batch of DME requests sent to the switch in one SPI burst
+ *
+ * The NCP protocol has no request identifiers; the switch processes
+ * requests in FIFO order, so each CNF is matched against its request
+ * by position, port ID and expected CNF function ID.
+ *
+ * @see switch_ncp_batch_init(), switch_ncp_batch_flush()
+ */
+struct switch_ncp_batch {
+    struct tsb_switch *sw;
+    unsigned int count;
+    /* Commands successfully sent over the batch lifetime */
+    unsigned int total;
+    /* Number of SPI bursts used to send them */
+    unsigned int bursts;
+    struct switch_ncp_cmd {
+        uint8_t req[SWITCH_NCP_BATCH_REQ_SIZE];
+        size_t req_size;
+        uint8_t cnf[SWITCH_NCP_BATCH_CNF_SIZE];
+        size_t cnf_size;
+        uint8_t portid;
+        uint8_t cnf_function_id;
+        uint16_t attrid;
+        uint32_t *value;
+    } cmds[SWITCH_NCP_BATCH_MAX];
+};
+
+struct switch_attr_cache;
+
+/**
+ * @brief Connection setup timing statistics
+ */
+struct switch_connection_stats {
+    uint32_t count;
+    uint32_t failures;
+    uint32_t ncp_cmds;
+    uint32_t ncp_bursts;
+    uint32_t last_usec;
+    uint32_t max_usec;
+    uint64_t total_usec;
+};
+
 struct tsb_switch_ops {
     int (*init_comm)(struct tsb_switch *);
 
@@ -451,6 +502,14 @@ struct tsb_switch_ops {
     int (*__ncp_transfer)(struct tsb_switch *sw,
                           uint8_t *tx_buf, size_t tx_size,
                           uint8_t *rx_buf, size_t rx_size);
+    /*
+     * Optional: send the first count requests of a batch back-to-back,
+     * then read their CNFs in the same order. Falls back to one
+     * __ncp_transfer() per request when not provided.
+     */
+    int (*__ncp_batch_transfer)(struct tsb_switch *sw,
+                                struct switch_ncp_batch *batch,
+                                unsigned int count);
     int (*__irq_fifo_rx)(struct tsb_switch *sw, unsigned int spi_fifo);
     int (*__set_valid_entry)(struct tsb_switch *sw,
                              uint8_t *table, int entry, bool valid);
@@ -471,6 +530,14 @@ struct tsb_switch {
     uint8_t                 dev_ids[SWITCH_PORT_MAX];
 
     struct list_head        listeners;
+
+    /* Serializes connection setup, which shares conn_batch */
+    sem_t                   conn_lock;
+    struct switch_ncp_batch conn_batch;
+    struct switch_connection_stats conn_stats;
+
+    /* Attribute shadow cache, see tsb_switch_cache.c */
+    struct switch_attr_cache *cache;
 };
 
 /*
@@ -541,6 +608,124 @@ int switch_dev_id_mask_set(struct tsb_switch *sw,
                            uint8_t unipro_portid,
                            uint8_t *mask);
 
+/*
+ * Attribute shadow cache
+ */
+
+/* Attribute spaces, as cache key types */
+#define SWITCH_CACHE_DME            (0) /* local DME, switch side */
+#define SWITCH_CACHE_QOS            (1)
+#define SWITCH_CACHE_LUT            (2) /* attrid is the LUT address */
+
+struct switch_cache_stats {
+    uint32_t hits;
+    uint32_t misses;
+    /* Reads of attributes which are never cached */
+    uint32_t uncached;
+    uint32_t writes;
+    /* Writes skipped because the value was already set */
+    uint32_t writes_skipped;
+    uint32_t invalidations;
+};
+
+#ifdef CONFIG_SVC_SWITCH_ATTR_CACHE
+int switch_cache_init(struct tsb_switch *sw);
+void switch_cache_exit(struct tsb_switch *sw);
+bool switch_cache_lookup(struct tsb_switch *sw, uint8_t type, uint8_t port,
+                         uint16_t attrid, uint16_t selector, uint32_t *val,
+                         uint32_t *epoch);
+void switch_cache_fill(struct tsb_switch *sw, uint8_t type, uint8_t port,
+                       uint16_t attrid, uint16_t selector, uint32_t val,
+                       uint32_t epoch);
+bool switch_cache_write_is_redundant(struct tsb_switch *sw, uint8_t type,
+                                     uint8_t port, uint16_t attrid,
+                                     uint16_t selector, uint32_t val);
+void switch_cache_write(struct tsb_switch *sw, uint8_t type, uint8_t port,
+                        uint16_t attrid, uint16_t selector, uint32_t val,
+                        bool ok);
+void switch_cache_invalidate_port(struct tsb_switch *sw, uint8_t port);
+void switch_cache_invalidate_all(struct tsb_switch *sw);
+void switch_cache_stats_get(struct tsb_switch *sw,
+                            struct switch_cache_stats *stats);
+void switch_cache_stats_reset(struct tsb_switch *sw);
+#else
+static inline int switch_cache_init(struct tsb_switch *sw) {
+    return 0;
+}
+static inline void switch_cache_exit(struct tsb_switch *sw) {
+}
+static inline bool switch_cache_lookup(struct tsb_switch *sw, uint8_t type,
+                                       uint8_t port, uint16_t attrid,
+                                       uint16_t selector, uint32_t *val,
+                                       uint32_t *epoch) {
+    return false;
+}
+static inline void switch_cache_fill(struct tsb_switch *sw, uint8_t type,
+                                     uint8_t port, uint16_t attrid,
+                                     uint16_t selector, uint32_t val,
+                                     uint32_t epoch) {
+}
+static inline bool switch_cache_write_is_redundant(struct tsb_switch *sw,
+                                                   uint8_t type, uint8_t port,
+                                                   uint16_t attrid,
+                                                   uint16_t selector,
+                                                   uint32_t val) {
+    return false;
+}
+static inline void switch_cache_write(struct tsb_switch *sw, uint8_t type,
+                                      uint8_t port, uint16_t attrid,
+                                      uint16_t selector, uint32_t val,
+                                      bool ok) {
+}
+static inline void switch_cache_invalidate_port(struct tsb_switch *sw,
+                                                uint8_t port) {
+}
+static inline void switch_cache_invalidate_all(struct tsb_switch *sw) {
+}
+static inline void switch_cache_stats_get(struct tsb_switch *sw,
+                                          struct switch_cache_stats *stats) {
+    memset(stats, 0, sizeof(*stats));
+}
+static inline void switch_cache_stats_reset(struct tsb_switch *sw) {
+}
+#endif
+
+/*
+ * Batched DME accessors
+ *
+ * Requests are queued into the batch and sent when the batch is full
+ * or flushed. Get results are only valid after a successful flush.
+ */
+
+void switch_ncp_batch_init(struct tsb_switch *sw,
+                           struct switch_ncp_batch *batch);
+
+int switch_ncp_batch_dme_set(struct switch_ncp_batch *batch,
+                             uint8_t portid,
+                             uint16_t attrid,
+                             uint16_t select_index,
+                             uint32_t attr_value);
+
+int switch_ncp_batch_dme_get(struct switch_ncp_batch *batch,
+                             uint8_t portid,
+                             uint16_t attrid,
+                             uint16_t select_index,
+                             uint32_t *attr_value);
+
+int switch_ncp_batch_dme_peer_set(struct switch_ncp_batch *batch,
+                                  uint8_t portid,
+                                  uint16_t attrid,
+                                  uint16_t select_index,
+                                  uint32_t attr_value);
+
+int switch_ncp_batch_dme_peer_get(struct switch_ncp_batch *batch,
+                                  uint8_t portid,
+                                  uint16_t attrid,
+                                  uint16_t select_index,
+                                  uint32_t *attr_value);
+
+int switch_ncp_batch_flush(struct switch_ncp_batch *batch);
+
 /*
  * Switch events
  */
@@ -586,6 +771,9 @@ int switch_connection_create(struct tsb_switch *sw,
                              struct unipro_connection *conn);
 int switch_connection_destroy(struct tsb_switch *sw,
                               struct unipro_connection *c);
+void switch_connection_stats_get(struct tsb_switch *sw,
+                                 struct switch_connection_stats *stats);
+void switch_connection_stats_reset(struct tsb_switch *sw);
 
 
 int switch_configure_link(struct tsb_switch *sw,
@@ -0,0 +1,437 @@
+/*
+ * Copyright (c) 2016 Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * Shadow copy of the switch configuration attributes.
+ *
+ * Reads of cached attributes are served from the shadow copy, and
+ * writes that would not change a cached value are skipped. Only
+ * attributes that are pure configuration, i.e. that the switch never
+ * changes on its own, are cached; everything else is read through.
+ *
+ * The cache is a direct-mapped table keyed by (type, port, attribute,
+ * selector). Every write or invalidation bumps an epoch, so that a
+ * value read from the hardware is not cached if it may have been
+ * overwritten in the meantime.
+ */
+
+#include <nuttx/config.h>
+#include <nuttx/arch.h>
+#include <nuttx/util.h>
+#include <nuttx/unipro/unipro.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <ara_debug.h>
+#include "tsb_switch.h"
+
+#define SWITCH_CACHE_ENTRIES    CONFIG_SVC_SWITCH_ATTR_CACHE_ENTRIES
+
+#if (SWITCH_CACHE_ENTRIES & (SWITCH_CACHE_ENTRIES - 1)) != 0
+#error "CONFIG_SVC_SWITCH_ATTR_CACHE_ENTRIES must be a power of two"
+#endif
+
+struct switch_cache_entry {
+    bool valid;
+    uint8_t type;
+    uint8_t port;
+    uint16_t attrid;
+    uint16_t selector;
+    uint32_t val;
+};
+
+struct switch_attr_cache {
+    uint32_t epoch;
+    struct switch_cache_stats stats;
+    struct switch_cache_entry entries[SWITCH_CACHE_ENTRIES];
+};
+
+/*
+ * L2 timeout values which the switch loads from PA_PWRModeUserData0-5
+ * on a power mode change.
+ */
+static const uint16_t switch_cache_l2_timeouts[] = {
+    DME_FC0PROTECTIONTIMEOUTVAL,
+    DME_TC0REPLAYTIMEOUTVAL,
+    DME_AFC0REQTIMEOUTVAL,
+    DME_FC1PROTECTIONTIMEOUTVAL,
+    DME_TC1REPLAYTIMEOUTVAL,
+    DME_AFC1REQTIMEOUTVAL,
+};
+
+static bool switch_cache_is_cacheable(uint8_t type, uint16_t attrid) {
+    switch (type) {
+    case SWITCH_CACHE_DME:
+        switch (attrid) {
+        case PA_ACTIVETXDATALANES:
+        case PA_TXGEAR:
+        case PA_TXTERMINATION:
+        case PA_HSSERIES:
+        case PA_ACTIVERXDATALANES:
+        case PA_RXGEAR:
+        case PA_RXTERMINATION:
+        case PA_SCRAMBLING:
+        case PA_PWRMODEUSERDATA0:
+        case PA_PWRMODEUSERDATA1:
+        case PA_PWRMODEUSERDATA2:
+        case PA_PWRMODEUSERDATA3:
+        case PA_PWRMODEUSERDATA4:
+        case PA_PWRMODEUSERDATA5:
+        case DME_FC0PROTECTIONTIMEOUTVAL:
+        case DME_TC0REPLAYTIMEOUTVAL:
+        case DME_AFC0REQTIMEOUTVAL:
+        case DME_FC1PROTECTIONTIMEOUTVAL:
+        case DME_TC1REPLAYTIMEOUTVAL:
+        case DME_AFC1REQTIMEOUTVAL:
+            return true;
+        default:
+            return false;
+        }
+    case SWITCH_CACHE_QOS:
+        /*
+         * Configuration only: no status, statistics or self-clearing
+         * control registers, and no broadcast addresses.
+         */
+        switch (attrid) {
+        case AR_CTRL:
+        case AR_WDT:
+        case AR_PRIOLUT:
+        case RT_WDT:
+        case RT_BCFGDEC0:
+        case RT_BCFGLIMIT0:
+        case RT_BCFGPERIOD0:
+        case RT_BCFGDEC1:
+        case RT_BCFGLIMIT1:
+        case RT_BCFGPERIOD1:
+            return true;
+        default:
+            return ((attrid >= AR_DRR1CFG_PERIOD(0) &&
+                     attrid < AR_DRR1CFG_LIMIT_BROADCAST &&
+                     (attrid & 0xf) != 0xf) ||
+                    (attrid >= AR_DRR2CFG_PERIOD(0) &&
+                     attrid < AR_DRR2CFG_LIMIT_BROADCAST &&
+                     (attrid & 0xf) != 0xf));
+        }
+    case SWITCH_CACHE_LUT:
+        return true;
+    default:
+        return false;
+    }
+}
+
+static struct switch_cache_entry *switch_cache_slot(
+        struct switch_attr_cache *cache, uint8_t type, uint8_t port,
+        uint16_t attrid, uint16_t selector) {
+    uint32_t hash;
+
+    hash = ((uint32_t)type << 24) ^ ((uint32_t)port << 16) ^ attrid ^
+           ((uint32_t)selector << 7);
+    hash *= 2654435761U;
+
+    return &cache->entries[(hash >> 16) & (SWITCH_CACHE_ENTRIES - 1)];
+}
+
+static bool switch_cache_match(struct switch_cache_entry *e, uint8_t type,
+                               uint8_t port, uint16_t attrid,
+                               uint16_t selector) {
+    return e->valid && e->type == type && e->port == port &&
+           e->attrid == attrid && e->selector == selector;
+}
+
+static void switch_cache_store(struct switch_cache_entry *e, uint8_t type,
+                               uint8_t port, uint16_t attrid,
+                               uint16_t selector, uint32_t val) {
+    e->valid = true;
+    e->type = type;
+    e->port = port;
+    e->attrid = attrid;
+    e->selector = selector;
+    e->val = val;
+}
+
+int switch_cache_init(struct tsb_switch *sw) {
+    sw->cache = zalloc(sizeof(struct switch_attr_cache));
+    if (!sw->cache) {
+        return -ENOMEM;
+    }
+
+    return 0;
+}
+
+void switch_cache_exit(struct tsb_switch *sw) {
+    free(sw->cache);
+    sw->cache = NULL;
+}
+
+/**
+ * @brief Look up a cached attribute value
+ *
+ * @param epoch Set to the current cache epoch, to be passed to
+ *              switch_cache_fill() after a miss.
+ * @return true on a hit, in which case *val is set
+ */
+bool switch_cache_lookup(struct tsb_switch *sw, uint8_t type, uint8_t port,
+                         uint16_t attrid, uint16_t selector, uint32_t *val,
+                         uint32_t *epoch) {
+    struct switch_attr_cache *cache = sw->cache;
+    struct switch_cache_entry *e;
+    irqstate_t flags;
+    bool hit = false;
+
+    if (!cache) {
+        return false;
+    }
+
+    flags = irqsave();
+
+    *epoch = cache->epoch;
+    if (!switch_cache_is_cacheable(type, attrid)) {
+        cache->stats.uncached++;
+        goto out;
+    }
+
+    e = switch_cache_slot(cache, type, port, attrid, selector);
+    if (switch_cache_match(e, type, port, attrid, selector)) {
+        *val = e->val;
+        cache->stats.hits++;
+        hit = true;
+    } else {
+        cache->stats.misses++;
+    }
+
+out:
+    irqrestore(flags);
+    return hit;
+}
+
+/**
+ * @brief Cache a value read from the switch after a lookup miss
+ */
+void switch_cache_fill(struct tsb_switch *sw, uint8_t type, uint8_t port,
+                       uint16_t attrid, uint16_t selector, uint32_t val,
+                       uint32_t epoch) {
+    struct switch_attr_cache *cache = sw->cache;
+    irqstate_t flags;
+
+    if (!cache || !switch_cache_is_cacheable(type, attrid)) {
+        return;
+    }
+
+    flags = irqsave();
+
+    /* Drop the value if anything was written since it was read */
+    if (cache->epoch == epoch) {
+        switch_cache_store(switch_cache_slot(cache, type, port, attrid,
+                                             selector),
+                           type, port, attrid, selector, val);
+    }
+
+    irqrestore(flags);
+}
+
+/**
+ * @brief Check whether a write can be skipped
+ *
+ * @return true if the attribute is cached with the same value already
+ */
+bool switch_cache_write_is_redundant(struct tsb_switch *sw, uint8_t type,
+                                     uint8_t port, uint16_t attrid,
+                                     uint16_t selector, uint32_t val) {
+    struct switch_attr_cache *cache = sw->cache;
+    struct switch_cache_entry *e;
+    irqstate_t flags;
+    bool redundant = false;
+
+    if (!cache || !switch_cache_is_cacheable(type, attrid)) {
+        return false;
+    }
+
+    flags = irqsave();
+
+    e = switch_cache_slot(cache, type, port, attrid, selector);
+    if (switch_cache_match(e, type, port, attrid, selector) &&
+        e->val == val) {
+        cache->stats.writes_skipped++;
+        redundant = true;
+    }
+
+    irqrestore(flags);
+    return redundant;
+}
+
+/**
+ * @brief Record the outcome of a write to the switch
+ *
+ * @param ok false if the write failed, in which case the switch state
+ *           is unknown and the cached value is dropped
+ */
+void switch_cache_write(struct tsb_switch *sw, uint8_t type, uint8_t port,
+                        uint16_t attrid, uint16_t selector, uint32_t val,
+                        bool ok) {
+    struct switch_attr_cache *cache = sw->cache;
+    struct switch_cache_entry *e;
+    struct switch_cache_entry *ud;
+    irqstate_t flags;
+    unsigned int i;
+
+    if (!cache) {
+        return;
+    }
+
+    flags = irqsave();
+
+    cache->epoch++;
+    cache->stats.writes++;
+
+    if (switch_cache_is_cacheable(type, attrid)) {
+        e = switch_cache_slot(cache, type, port, attrid, selector);
+        if (ok) {
+            switch_cache_store(e, type, port, attrid, selector, val);
+        } else if (switch_cache_match(e, type, port, attrid, selector)) {
+            e->valid = false;
+        }
+    }
+
+    /* A broadcast QoS write changes the whole register group */
+    if (type == SWITCH_CACHE_QOS && (attrid & 0xf) == 0xf) {
+        for (i = 0; i < SWITCH_CACHE_ENTRIES; i++) {
+            e = &cache->entries[i];
+            if (e->type == type && e->port == port &&
+                (e->attrid & 0xf0) == (attrid & 0xf0)) {
+                e->valid = false;
+            }
+        }
+    }
+
+    /*
+     * A power mode change loads the L2 timeout values from the power
+     * mode user data.
+     */
+    if (type == SWITCH_CACHE_DME && attrid == PA_PWRMODE) {
+        for (i = 0; i < ARRAY_SIZE(switch_cache_l2_timeouts); i++) {
+            e = switch_cache_slot(cache, type, port,
+                                  switch_cache_l2_timeouts[i],
+                                  UNIPRO_SELINDEX_NULL);
+            ud = switch_cache_slot(cache, type, port,
+                                   PA_PWRMODEUSERDATA0 + i,
+                                   UNIPRO_SELINDEX_NULL);
+            if (ok && switch_cache_match(ud, type, port,
+                                         PA_PWRMODEUSERDATA0 + i,
+                                         UNIPRO_SELINDEX_NULL)) {
+                switch_cache_store(e, type, port,
+                                   switch_cache_l2_timeouts[i],
+                                   UNIPRO_SELINDEX_NULL, ud->val);
+            } else if (switch_cache_match(e, type, port,
+                                          switch_cache_l2_timeouts[i],
+                                          UNIPRO_SELINDEX_NULL)) {
+                e->valid = false;
+            }
+        }
+    }
+
+    irqrestore(flags);
+}
+
+/**
+ * @brief Drop the cached DME attributes of a port
+ *
+ * To be called whenever the port's link is (re)started or reset.
+ */
+void switch_cache_invalidate_port(struct tsb_switch *sw, uint8_t port) {
+    struct switch_attr_cache *cache = sw->cache;
+    irqstate_t flags;
+    unsigned int i;
+
+    if (!cache) {
+        return;
+    }
+
+    flags = irqsave();
+
+    cache->epoch++;
+    cache->stats.invalidations++;
+    for (i = 0; i < SWITCH_CACHE_ENTRIES; i++) {
+        if (cache->entries[i].type == SWITCH_CACHE_DME &&
+            cache->entries[i].port == port) {
+            cache->entries[i].valid = false;
+        }
+    }
+
+    irqrestore(flags);
+}
+
+/**
+ * @brief Drop all cached attributes
+ */
+void switch_cache_invalidate_all(struct tsb_switch *sw) {
+    struct switch_attr_cache *cache = sw->cache;
+    irqstate_t flags;
+    unsigned int i;
+
+    if (!cache) {
+        return;
+    }
+
+    flags = irqsave();
+
+    cache->epoch++;
+    cache->stats.invalidations++;
+    for (i = 0; i < SWITCH_CACHE_ENTRIES; i++) {
+        cache->entries[i].valid = false;
+    }
+
+    irqrestore(flags);
+}
+
+void switch_cache_stats_get(struct tsb_switch *sw,
+                            struct switch_cache_stats *stats) {
+    irqstate_t flags;
+
+    memset(stats, 0, sizeof(*stats));
+    if (!sw->cache) {
+        return;
+    }
+
+    flags = irqsave();
+    *stats = sw->cache->stats;
+    irqrestore(flags);
+}
+
+void switch_cache_stats_reset(struct tsb_switch *sw) {
+    irqstate_t flags;
+
+    if (!sw->cache) {
+        return;
+    }
+
+    flags = irqsave();
+    memset(&sw->cache->stats, 0, sizeof(sw->cache->stats));
+    irqrestore(flags);
+}
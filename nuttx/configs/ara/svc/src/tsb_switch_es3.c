@@ -36,6 +36,8 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <nuttx/util.h>
+
 #include <ara_debug.h>
 #include "tsb_switch.h"
 
@@ -175,11 +177,10 @@ static bool es3_check_valid_entry(struct tsb_switch *sw,
 }
 
 
-static int es3_ncp_write(struct tsb_switch *sw,
-                         uint8_t cportid,
-                         uint8_t *tx_buf,
-                         size_t tx_size,
-                         size_t *out_size) {
+static size_t es3_ncp_send_frame(struct tsb_switch *sw,
+                                 uint8_t cportid,
+                                 uint8_t *tx_buf,
+                                 size_t tx_size) {
     struct spi_dev_s *spi_dev = sw->spi_dev;
 
     uint8_t write_header[] = {
@@ -193,32 +194,45 @@ static int es3_ncp_write(struct tsb_switch *sw,
         ENDP,
     };
 
-    if (tx_size >= SWITCH_CPORT_NCP_MAX_PAYLOAD) {
-        return -ENOMEM;
-    }
-
-    _switch_spi_select(sw, true);
-
     SPI_SNDBLOCK(spi_dev, write_header, sizeof write_header);
     SPI_SNDBLOCK(spi_dev, tx_buf, tx_size);
     SPI_SNDBLOCK(spi_dev, write_trailer, sizeof write_trailer);
-    *out_size = sizeof write_header + tx_size + sizeof write_trailer;
 
-    dbg_insane("TX Data (%d):\n", *out_size);
+    dbg_insane("TX Data (%d):\n",
+               sizeof write_header + tx_size + sizeof write_trailer);
     dbg_print_buf(ARADBG_INSANE, write_header, sizeof write_header);
     dbg_print_buf(ARADBG_INSANE, tx_buf, tx_size);
     dbg_print_buf(ARADBG_INSANE, write_trailer, sizeof write_trailer);
 
+    return sizeof write_header + tx_size + sizeof write_trailer;
+}
+
+static int es3_ncp_write(struct tsb_switch *sw,
+                         uint8_t cportid,
+                         uint8_t *tx_buf,
+                         size_t tx_size,
+                         size_t *out_size) {
+    if (tx_size >= SWITCH_CPORT_NCP_MAX_PAYLOAD) {
+        return -ENOMEM;
+    }
+
+    _switch_spi_select(sw, true);
+    *out_size = es3_ncp_send_frame(sw, cportid, tx_buf, tx_size);
     _switch_spi_select(sw, false);
 
     return OK;
 }
 
+/*
+ * Read a CNF into rx_buf. A response longer than rx_size is truncated;
+ * its full length is returned in resp_size when not NULL.
+ */
 static int es3_ncp_read(struct tsb_switch *sw,
                         uint8_t cportid,
                         uint8_t *rx_buf,
                         size_t rx_size,
-                        size_t out_size) {
+                        size_t out_size,
+                        size_t *resp_size) {
     struct sw_es3_priv *priv = sw->priv;
     struct spi_dev_s *spi_dev = sw->spi_dev;
     uint8_t *rxbuf = fifo_to_rxbuf(priv, cportid);
@@ -282,8 +296,21 @@ static int es3_ncp_read(struct tsb_switch *sw,
             if (rxbuf[i] == STRR) {
                 // STRR found, parse the reply length and data
                 resp_start = &rxbuf[i];
+                if (i + 4 > size) {
+                    break;
+                }
                 size_t resp_len = resp_start[2] << 8 | resp_start[3];
-                memcpy(rx_buf, &resp_start[4], resp_len);
+                /* Only copy what fits and what was actually read */
+                size_t copy_len = MIN(resp_len, rx_size);
+                copy_len = MIN(copy_len, size - i - 4);
+                if (copy_len < resp_len) {
+                    dbg_error("%s(): %u byte response truncated to %u\n",
+                              __func__, resp_len, copy_len);
+                }
+                memcpy(rx_buf, &resp_start[4], copy_len);
+                if (resp_size) {
+                    *resp_size = resp_len;
+                }
                 rcv_done = 1;
                 break;
             } else if (rxbuf[i] == NACK) {
@@ -323,7 +350,8 @@ static int es3_ncp_transfer(struct tsb_switch *sw,
     }
 
     /* Read the CNF, back-to-back after the NCP request */
-    rc = es3_ncp_read(sw, SWITCH_FIFO_NCP, rx_buf, rx_size, out_size);
+    rc = es3_ncp_read(sw, SWITCH_FIFO_NCP, rx_buf, rx_size, out_size,
+                      NULL);
     if (rc) {
         dbg_error("%s() read failed: rc=%d\n", __func__, rc);
         goto done;
@@ -335,6 +363,68 @@ done:
     return rc;
 }
 
+/*
+ * Send a batch of NCP requests in a single chip select, then collect
+ * the CNFs. The switch handles NCP requests in FIFO order, so the CNFs
+ * come back in request order.
+ */
+static int es3_ncp_batch_transfer(struct tsb_switch *sw,
+                                  struct switch_ncp_batch *batch,
+                                  unsigned int count) {
+    struct sw_es3_priv *priv = sw->priv;
+    struct switch_ncp_cmd *cmd;
+    size_t payload = 0;
+    size_t out_size = 0;
+    size_t resp_size = 0;
+    unsigned int i;
+    int rc = 0;
+
+    for (i = 0; i < count; i++) {
+        payload += batch->cmds[i].req_size;
+    }
+    if (payload > SWITCH_CPORT_NCP_FIFO_SIZE) {
+        return -ENOMEM;
+    }
+
+    pthread_mutex_lock(&priv->ncp_cport.lock);
+
+    /* Send all the requests back-to-back */
+    _switch_spi_select(sw, true);
+    for (i = 0; i < count; i++) {
+        cmd = &batch->cmds[i];
+        out_size += es3_ncp_send_frame(sw, SWITCH_FIFO_NCP,
+                                       cmd->req, cmd->req_size);
+    }
+    /* Keep the burst on a 16-bit frame boundary */
+    if (out_size & 0x1) {
+        SPI_SEND(sw->spi_dev, LNUL);
+    }
+    _switch_spi_select(sw, false);
+
+    /* Read the CNFs */
+    for (i = 0; i < count; i++) {
+        cmd = &batch->cmds[i];
+        rc = es3_ncp_read(sw, SWITCH_FIFO_NCP, cmd->cnf, cmd->cnf_size, 0,
+                          &resp_size);
+        if (rc) {
+            dbg_error("%s() read %u/%u failed: rc=%d\n",
+                      __func__, i + 1, count, rc);
+            break;
+        }
+        /* A CNF of another size belongs to another request */
+        if (resp_size != cmd->cnf_size) {
+            dbg_error("%s() read %u/%u: %u byte CNF, expected %u\n",
+                      __func__, i + 1, count, resp_size, cmd->cnf_size);
+            rc = -EPROTO;
+            break;
+        }
+    }
+
+    pthread_mutex_unlock(&priv->ncp_cport.lock);
+
+    return rc;
+}
+
 /* Status report data size */
 #define SRPT_REPORT_SIZE             (12)
 /* Status report total size: 7 bytes header + data + Switch reply delay */
@@ -1208,6 +1298,7 @@ static struct tsb_switch_ops es3_ops = {
     .__post_init_seq       = es3_post_init_seq,
     .__irq_fifo_rx         = es3_irq_fifo_rx,
     .__ncp_transfer        = es3_ncp_transfer,
+    .__ncp_batch_transfer  = es3_ncp_batch_transfer,
     .__set_valid_entry     = es3_set_valid_entry,
     .__check_valid_entry   = es3_check_valid_entry,
 };
@@ -241,6 +241,8 @@ static void switch_port_irq_reenable_hack(struct tsb_switch *sw, uint8_t port) {
         if (!attr_value) {
             dbg_insane("IRQ: port %u TSB_INTERRUPTENABLE=%d\n",
                        port, attr_value);
+            /* The port re-linked up behind our back */
+            switch_cache_invalidate_port(sw, port);
             switch_port_irq_enable(sw, port, true);
         }
     }
@@ -344,6 +346,8 @@ int switch_irq_handler(struct tsb_switch *sw) {
                         switch (irq_type) {
                         case IRQ_STATUS_LINKSTARTUPCNF: {
                             struct tsb_switch_event e;
+                            /* The link restarted with default attributes */
+                            switch_cache_invalidate_port(sw, port);
                             e.type = TSB_SWITCH_EVENT_LINKUP;
                             e.linkup.port = port;
                             e.linkup.val = attr_value;
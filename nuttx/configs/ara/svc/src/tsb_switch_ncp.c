@@ -29,6 +29,7 @@
 #include "tsb_switch.h"
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <string.h>
 
 #include <nuttx/config.h>
@@ -251,18 +252,29 @@ int switch_dme_set(struct tsb_switch *sw,
     dbg_verbose("%s(): portId=%d, attrId=0x%04x, selectIndex=%d, val=0x%04x\n",
                 __func__, portid, attrid, select_index, attr_value);
 
+    if (switch_cache_write_is_redundant(sw, SWITCH_CACHE_DME, portid, attrid,
+                                        select_index, attr_value)) {
+        return 0;
+    }
+
     get_dme_set_req(sw, portid, attrid, select_index, attr_value,
                     req, &req_size);
     rc = ncp_transfer(sw, req, req_size, (uint8_t*)&cnf, sizeof(struct cnf));
     if (rc) {
         dbg_error("%s(): portId=%u, attrId=0x%04x failed: rc=%d\n",
                   __func__, portid, attrid, rc);
+        switch_cache_write(sw, SWITCH_CACHE_DME, portid, attrid, select_index,
+                           attr_value, false);
         return rc;
     }
     if (cnf.function_id != NCP_SETCNF) {
         dbg_error("%s(): unexpected CNF 0x%x\n", __func__, cnf.function_id);
+        switch_cache_write(sw, SWITCH_CACHE_DME, portid, attrid, select_index,
+                           attr_value, false);
         return -EPROTO;
     }
+    switch_cache_write(sw, SWITCH_CACHE_DME, portid, attrid, select_index,
+                       attr_value, !cnf.rc);
 
     dbg_verbose("%s(): fid=0x%02x, rc=%u, attr(0x%04x)=0x%04x\n",
                 __func__, cnf.function_id, cnf.rc, attrid, attr_value);
@@ -275,6 +287,7 @@ int switch_dme_get(struct tsb_switch *sw,
                    uint16_t attrid,
                    uint16_t select_index,
                    uint32_t *attr_value) {
+    uint32_t epoch;
     int rc;
     size_t req_size = sw->rdata->ncp_req_max_size;
     uint8_t req[req_size];
@@ -289,6 +302,11 @@ int switch_dme_get(struct tsb_switch *sw,
     dbg_verbose("%s(): portId=%d, attrId=0x%04x, selectIndex=%d\n",
                 __func__, portid, attrid, select_index);
 
+    if (switch_cache_lookup(sw, SWITCH_CACHE_DME, portid, attrid,
+                            select_index, attr_value, &epoch)) {
+        return 0;
+    }
+
     get_dme_get_req(sw, portid, attrid, select_index,
                     req, &req_size);
     rc = ncp_transfer(sw, req, req_size, (uint8_t*)&cnf, sizeof(struct cnf));
@@ -302,6 +320,10 @@ int switch_dme_get(struct tsb_switch *sw,
     }
 
     *attr_value = be32_to_cpu(cnf.attr_val);
+    if (!cnf.rc) {
+        switch_cache_fill(sw, SWITCH_CACHE_DME, portid, attrid, select_index,
+                          *attr_value, epoch);
+    }
     dbg_verbose("%s(): fid=0x%02x, rc=%u, attr(0x%04x)=0x%04x\n",
                 __func__, cnf.function_id, cnf.rc, attrid, *attr_value);
 
@@ -384,6 +406,209 @@ int switch_dme_peer_get(struct tsb_switch *sw,
     return cnf.rc;
 }
 
+/*
+ * Batched DME commands
+ */
+
+/* Common CNF layout of the DME (peer) set/get commands */
+struct __attribute__ ((__packed__)) ncp_batch_cnf {
+    uint8_t portid;
+    uint8_t function_id;
+    uint8_t reserved;
+    uint8_t rc;
+    uint32_t attr_val;
+};
+
+void switch_ncp_batch_init(struct tsb_switch *sw,
+                           struct switch_ncp_batch *batch) {
+    memset(batch, 0, sizeof(*batch));
+    batch->sw = sw;
+}
+
+static int ncp_batch_reserve(struct switch_ncp_batch *batch,
+                             struct switch_ncp_cmd **cmd) {
+    int rc;
+
+    if (batch->count == SWITCH_NCP_BATCH_MAX) {
+        rc = switch_ncp_batch_flush(batch);
+        if (rc) {
+            return rc;
+        }
+    }
+
+    *cmd = &batch->cmds[batch->count];
+    (*cmd)->req_size = sizeof((*cmd)->req);
+
+    return 0;
+}
+
+int switch_ncp_batch_dme_set(struct switch_ncp_batch *batch,
+                             uint8_t portid,
+                             uint16_t attrid,
+                             uint16_t select_index,
+                             uint32_t attr_value) {
+    struct switch_ncp_cmd *cmd;
+    int rc;
+
+    rc = ncp_batch_reserve(batch, &cmd);
+    if (rc) {
+        return rc;
+    }
+
+    get_dme_set_req(batch->sw, portid, attrid, select_index, attr_value,
+                    cmd->req, &cmd->req_size);
+    cmd->cnf_size = offsetof(struct ncp_batch_cnf, attr_val);
+    cmd->cnf_function_id = NCP_SETCNF;
+    cmd->portid = portid;
+    cmd->attrid = attrid;
+    cmd->value = NULL;
+    batch->count++;
+
+    return 0;
+}
+
+int switch_ncp_batch_dme_get(struct switch_ncp_batch *batch,
+                             uint8_t portid,
+                             uint16_t attrid,
+                             uint16_t select_index,
+                             uint32_t *attr_value) {
+    struct switch_ncp_cmd *cmd;
+    int rc;
+
+    rc = ncp_batch_reserve(batch, &cmd);
+    if (rc) {
+        return rc;
+    }
+
+    get_dme_get_req(batch->sw, portid, attrid, select_index,
+                    cmd->req, &cmd->req_size);
+    cmd->cnf_size = sizeof(struct ncp_batch_cnf);
+    cmd->cnf_function_id = NCP_GETCNF;
+    cmd->portid = portid;
+    cmd->attrid = attrid;
+    cmd->value = attr_value;
+    batch->count++;
+
+    return 0;
+}
+
+int switch_ncp_batch_dme_peer_set(struct switch_ncp_batch *batch,
+                                  uint8_t portid,
+                                  uint16_t attrid,
+                                  uint16_t select_index,
+                                  uint32_t attr_value) {
+    struct switch_ncp_cmd *cmd;
+    int rc;
+
+    rc = ncp_batch_reserve(batch, &cmd);
+    if (rc) {
+        return rc;
+    }
+
+    get_dme_peer_set_req(batch->sw, portid, attrid, select_index, attr_value,
+                         cmd->req, &cmd->req_size);
+    cmd->cnf_size = offsetof(struct ncp_batch_cnf, attr_val);
+    cmd->cnf_function_id = NCP_PEERSETCNF;
+    cmd->portid = portid;
+    cmd->attrid = attrid;
+    cmd->value = NULL;
+    batch->count++;
+
+    return 0;
+}
+
+int switch_ncp_batch_dme_peer_get(struct switch_ncp_batch *batch,
+                                  uint8_t portid,
+                                  uint16_t attrid,
+                                  uint16_t select_index,
+                                  uint32_t *attr_value) {
+    struct switch_ncp_cmd *cmd;
+    int rc;
+
+    rc = ncp_batch_reserve(batch, &cmd);
+    if (rc) {
+        return rc;
+    }
+
+    get_dme_peer_get_req(batch->sw, portid, attrid, select_index,
+                         cmd->req, &cmd->req_size);
+    cmd->cnf_size = sizeof(struct ncp_batch_cnf);
+    cmd->cnf_function_id = NCP_PEERGETCNF;
+    cmd->portid = portid;
+    cmd->attrid = attrid;
+    cmd->value = attr_value;
+    batch->count++;
+
+    return 0;
+}
+
+/**
+ * @brief Send all queued requests and check their CNFs
+ *
+ * @return 0 on success, a negative errno on transfer or protocol
+ * error, or the first non-zero NCP resultCode.
+ */
+int switch_ncp_batch_flush(struct switch_ncp_batch *batch) {
+    struct tsb_switch *sw = batch->sw;
+    struct switch_ncp_cmd *cmd;
+    struct ncp_batch_cnf cnf;
+    unsigned int count = batch->count;
+    unsigned int i;
+    int rc = 0;
+
+    if (!count) {
+        return 0;
+    }
+    batch->count = 0;
+
+    if (sw->ops->__ncp_batch_transfer) {
+        rc = sw->ops->__ncp_batch_transfer(sw, batch, count);
+        batch->bursts++;
+    } else {
+        for (i = 0; i < count && !rc; i++) {
+            cmd = &batch->cmds[i];
+            rc = ncp_transfer(sw, cmd->req, cmd->req_size,
+                              cmd->cnf, cmd->cnf_size);
+            batch->bursts++;
+        }
+    }
+    if (rc) {
+        dbg_error("%s(): %u commands failed: rc=%d\n", __func__, count, rc);
+        return rc;
+    }
+    batch->total += count;
+
+    /* CNFs come back in request order */
+    for (i = 0; i < count; i++) {
+        cmd = &batch->cmds[i];
+        memcpy(&cnf, cmd->cnf, cmd->cnf_size);
+
+        if (cnf.function_id != cmd->cnf_function_id ||
+            cnf.portid != cmd->portid) {
+            dbg_error("%s(): unexpected CNF 0x%x for port %u, "
+                      "expected 0x%x for port %u\n",
+                      __func__, cnf.function_id, cnf.portid,
+                      cmd->cnf_function_id, cmd->portid);
+            return -EPROTO;
+        }
+
+        if (cnf.rc) {
+            dbg_error("%s(): portId=%u, attrId=0x%04x failed: rc=%u\n",
+                      __func__, cmd->portid, cmd->attrid, cnf.rc);
+            if (!rc) {
+                rc = cnf.rc;
+            }
+            continue;
+        }
+
+        if (cmd->value) {
+            *cmd->value = be32_to_cpu(cnf.attr_val);
+        }
+    }
+
+    return rc;
+}
+
 /*
  * Routing table configuration commands
  */
@@ -409,19 +634,30 @@ int switch_lut_set(struct tsb_switch *sw,
     dbg_verbose("%s(): unipro_portid=%d, lutAddress=%d, destPortId=%d\n",
                 __func__, unipro_portid, lut_address, dest_portid);
 
+    if (switch_cache_write_is_redundant(sw, SWITCH_CACHE_LUT, unipro_portid,
+                                        lut_address, 0, dest_portid)) {
+        return 0;
+    }
+
     get_lut_set_req(sw, unipro_portid, lut_address, dest_portid,
                     req, &req_size);
     rc = ncp_transfer(sw, req, req_size, (uint8_t*)&cnf, sizeof(struct cnf));
     if (rc) {
         dbg_error("%s(): unipro_portid=%d, destPortId=%d failed: rc=%d\n",
                   __func__, unipro_portid, dest_portid, rc);
+        switch_cache_write(sw, SWITCH_CACHE_LUT, unipro_portid, lut_address,
+                           0, dest_portid, false);
         return rc;
     }
 
     if (cnf.function_id != NCP_LUTSETCNF) {
         dbg_error("%s(): unexpected CNF 0x%x\n", __func__, cnf.function_id);
+        switch_cache_write(sw, SWITCH_CACHE_LUT, unipro_portid, lut_address,
+                           0, dest_portid, false);
         return -EPROTO;
     }
+    switch_cache_write(sw, SWITCH_CACHE_LUT, unipro_portid, lut_address, 0,
+                       dest_portid, !cnf.rc);
 
     dbg_verbose("%s(): fid=0x%02x, rc=%u\n",
                 __func__, cnf.function_id, cnf.rc);
@@ -434,6 +670,8 @@ int switch_lut_get(struct tsb_switch *sw,
                    uint8_t unipro_portid,
                    uint8_t lut_address,
                    uint8_t *dest_portid) {
+    uint32_t cached;
+    uint32_t epoch;
     int rc;
     size_t req_size = sw->rdata->ncp_req_max_size;
     uint8_t req[req_size];
@@ -447,6 +685,12 @@ int switch_lut_get(struct tsb_switch *sw,
     dbg_verbose("%s(): unipro_portid=%d, lutAddress=%d, destPortId=%d\n",
                 __func__, unipro_portid, lut_address, *dest_portid);
 
+    if (switch_cache_lookup(sw, SWITCH_CACHE_LUT, unipro_portid, lut_address,
+                            0, &cached, &epoch)) {
+        *dest_portid = cached;
+        return 0;
+    }
+
     get_lut_get_req(sw, unipro_portid, lut_address, req, &req_size);
     rc = ncp_transfer(sw, req, req_size, (uint8_t*)&cnf, sizeof(struct cnf));
     if (rc) {
@@ -461,6 +705,10 @@ int switch_lut_get(struct tsb_switch *sw,
     }
 
     *dest_portid = cnf.dest_portid;
+    if (!cnf.rc) {
+        switch_cache_fill(sw, SWITCH_CACHE_LUT, unipro_portid, lut_address, 0,
+                          cnf.dest_portid, epoch);
+    }
 
     dbg_verbose("%s(): fid=0x%02x, rc=%u, portID=%u\n", __func__,
                 cnf.function_id, cnf.rc, cnf.dest_portid);
@@ -677,10 +925,17 @@ int switch_qos_attr_set(struct tsb_switch *sw,
                 attrid,
                 attr_val);
 
+    if (switch_cache_write_is_redundant(sw, SWITCH_CACHE_QOS, portid, attrid,
+                                        0, attr_val)) {
+        return 0;
+    }
+
     get_qos_attr_set_req(sw, portid, attrid, attr_val, req, &req_size);
     rc = ncp_transfer(sw, req, req_size, (uint8_t*)&cnf, cnf_size);
     if (rc) {
         dbg_error("%s() failed: rc=%d\n", __func__, rc);
+        switch_cache_write(sw, SWITCH_CACHE_QOS, portid, attrid, 0, attr_val,
+                           false);
         return rc;
     }
 
@@ -703,13 +958,19 @@ int switch_qos_attr_set(struct tsb_switch *sw,
 
     if (*cnf_portid != portid) {
         dbg_error("%s(): unexpected portid 0x%x\n", __func__, *cnf_portid);
+        switch_cache_write(sw, SWITCH_CACHE_QOS, portid, attrid, 0, attr_val,
+                           false);
         return -EPROTO;
     }
 
     if (*cnf_function_id != NCP_QOSATTRSETCNF) {
         dbg_error("%s(): unexpected CNF 0x%x\n", __func__, *cnf_function_id);
+        switch_cache_write(sw, SWITCH_CACHE_QOS, portid, attrid, 0, attr_val,
+                           false);
         return -EPROTO;
     }
+    switch_cache_write(sw, SWITCH_CACHE_QOS, portid, attrid, 0, attr_val,
+                       !*cnf_rc);
 
     dbg_verbose("%s(): ret=0x%02x, portid=0x%02x, attr(0x%04x)=0x%04x\n",
                 __func__,
@@ -725,6 +986,7 @@ int switch_qos_attr_get(struct tsb_switch *sw,
                         uint8_t portid,
                         uint8_t attrid,
                         uint32_t *val) {
+    uint32_t epoch;
     int rc;
     size_t req_size = sw->rdata->ncp_req_max_size;
     uint8_t req[req_size];
@@ -738,6 +1000,11 @@ int switch_qos_attr_get(struct tsb_switch *sw,
 
     dbg_verbose("%s: portid: %u attrid: %u\n", __func__, portid, attrid);
 
+    if (switch_cache_lookup(sw, SWITCH_CACHE_QOS, portid, attrid, 0, val,
+                            &epoch)) {
+        return 0;
+    }
+
     get_qos_attr_get_req(sw, portid, attrid, req, &req_size);
     rc = ncp_transfer(sw, req, req_size, (uint8_t*)&cnf, sizeof(struct cnf));
 
@@ -757,6 +1024,10 @@ int switch_qos_attr_get(struct tsb_switch *sw,
     }
 
     *val = be32_to_cpu(cnf.attr_val);
+    if (!cnf.rc) {
+        switch_cache_fill(sw, SWITCH_CACHE_QOS, portid, attrid, 0, *val,
+                          epoch);
+    }
     dbg_verbose("%s(): ret=0x%02x, portid=0x%02x, attr(0x%04x)=0x%04x\n",
                     __func__,
                     cnf.rc,
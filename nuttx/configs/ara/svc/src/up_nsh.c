@@ -67,6 +67,8 @@
 #include <nuttx/config.h>
 #include <stdio.h>
 
+#include "pwr_mon.h"
+
 
 /****************************************************************************
  * Name: nsh_archinitialize
@@ -77,5 +79,10 @@
  ****************************************************************************/
 
 int nsh_archinitialize(void) {
+#ifdef CONFIG_SVC_PWRMON_STREAM
+	if (pwrmon_stream_register()) {
+		printf("Failed to register %s\n", PWRMON_STREAM_DEVPATH);
+	}
+#endif
 	return OK;
 }
@@ -29,9 +29,13 @@
  * @brief Greybus Audio Device Class Protocol Driver
  */
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <sched.h>
 
 #include <nuttx/config.h>
 #include <nuttx/list.h>
@@ -43,9 +47,11 @@
 #include <nuttx/util.h>
 #include <nuttx/wdog.h>
 #include <nuttx/list.h>
+#include <nuttx/hires_tmr.h>
 #include <nuttx/greybus/types.h>
 #include <nuttx/greybus/greybus.h>
 #include <nuttx/greybus/debug.h>
+#include <nuttx/greybus/audio.h>
 #include <nuttx/unipro/unipro.h>
 
 #include <arch/byteorder.h>
@@ -58,6 +64,9 @@
 #define GB_AUDIO_TX_RING_BUF_PAD            2
 #define GB_AUDIO_RX_RING_BUF_PAD            2
 
+/* Number of events of each type that can wait to be sent */
+#define GB_AUDIO_EVENTS                     4
+
 #define GB_AUDIO_FLAG_PCM_SET               BIT(0)
 #define GB_AUDIO_FLAG_TX_DATA_SIZE_SET      BIT(1)
 #define GB_AUDIO_FLAG_TX_ACTIVE             BIT(2)
@@ -66,6 +75,17 @@
 #define GB_AUDIO_FLAG_RX_ACTIVE             BIT(5)
 #define GB_AUDIO_FLAG_RX_STARTED            BIT(6)
 
+#define GB_AUDIO_HIST_BUCKETS               64
+#define GB_AUDIO_RX_HIST_BUCKET_US          100
+
+#ifdef CONFIG_GREYBUS_AUDIO_JITTER_BUFFER
+#define GB_AUDIO_JB_PPM                     1000000
+#define GB_AUDIO_JB_MAX_DRIFT_PPM           2000
+#define GB_AUDIO_JB_DRIFT_WINDOW_US         4000000
+#define GB_AUDIO_JB_AVG_SHIFT               4
+#define GB_AUDIO_JB_HIST_BUCKET_US          500
+#endif
+
 #define GB_AUDIO_IS_CONFIGURED(_dai, _type)                             \
             (((_dai)->flags & GB_AUDIO_FLAG_PCM_SET) &&                 \
              ((_dai)->flags & GB_AUDIO_FLAG_##_type##_DATA_SIZE_SET))
@@ -76,7 +96,59 @@ struct gb_audio_info { /* One per audio Bundle */
     struct device           *codec_dev;
     struct list_head        dai_list;   /* list of gb_audio_dai_info structs */
     struct list_head        list;       /* next gb_audio_info struct */
+    struct gb_event_channel streaming_events;
+    struct gb_event_channel jack_events;
+    struct gb_event_channel button_events;
+};
+
+/* Latency histogram, the last bucket also counts everything above */
+struct gb_audio_hist {
+    uint32_t                bucket_us;
+    uint32_t                max;
+    uint32_t                count[GB_AUDIO_HIST_BUCKETS];
+};
+
+struct gb_audio_rx_stats {
+    uint32_t                sent;
+    uint32_t                send_errors;
+    uint32_t                overruns;
+    uint32_t                max_batch;
+    struct gb_audio_hist    latency;    /* capture to send */
+};
+
+#ifdef CONFIG_GREYBUS_AUDIO_JITTER_BUFFER
+/*
+ * Playback jitter buffer state.  Depths and latencies are counted in
+ * samples.  The latency of a message is the audio queued ahead of it when
+ * it is received.
+ */
+struct gb_audio_jb {
+    unsigned int            high;       /* depth at which playback starts */
+    unsigned int            low;        /* depth under which we conceal */
+    unsigned int            target;     /* latency to hold once playing */
+    unsigned int            step;       /* samples inserted/dropped at once */
+    unsigned int            depth;      /* queued, playing entry included */
+    uint32_t                entry_start; /* when the playing entry started */
+    unsigned int            avg_latency; /* scaled by 2^GB_AUDIO_JB_AVG_SHIFT */
+    bool                    concealing;
+    struct ring_buf         *last_rb;   /* last entry filled by the AP */
+
+    uint32_t                window_start;
+    unsigned int            window_latency;
+    uint32_t                window_played;
+    int32_t                 window_adjust;
+    bool                    window_concealed;
+    int32_t                 drift_ppm;  /* AP clock relative to I2S clock */
+    int32_t                 correction;
+
+    uint32_t                underruns;
+    uint32_t                concealments;
+    uint32_t                overruns;
+    uint32_t                inserted;
+    uint32_t                dropped;
+    struct gb_audio_hist    latency;
 };
+#endif
 
 struct gb_audio_dai_info {
     uint32_t                flags;
@@ -96,10 +168,18 @@ struct gb_audio_dai_info {
     unsigned int            tx_data_size;
     unsigned int            tx_samples_per_msg;
     uint8_t                 *tx_dummy_data;
+#ifdef CONFIG_GREYBUS_AUDIO_JITTER_BUFFER
+    struct gb_audio_jb      tx_jb;
+#endif
 
     struct ring_buf         *rx_rb;
+    struct ring_buf         *rx_send_rb; /* next entry to send */
     unsigned int            rx_data_size;
     unsigned int            rx_samples_per_msg;
+    pthread_t               rx_thread;
+    sem_t                   rx_sem;
+    bool                    rx_thread_stop;
+    struct gb_audio_rx_stats rx_stats;
 
     struct gb_audio_info    *info;      /* parent gb_audio_info struct */
     struct list_head        list;       /* next gb_audio_dai_info struct */
@@ -186,23 +266,71 @@ static struct gb_audio_dai_info *gb_audio_find_dai(uint16_t data_cport)
 
 static void gb_audio_report_event(struct gb_audio_dai_info *dai, uint32_t event)
 {
-    struct gb_operation *operation;
-    struct gb_audio_streaming_event_request *request;
+    struct gb_audio_streaming_event_request request = {
+        .data_cport = dai->data_cport,
+        .event = event,
+    };
 
-    operation = gb_operation_create(dai->info->mgmt_cport,
-                                    GB_AUDIO_TYPE_STREAMING_EVENT,
-                                    sizeof(*request));
-    if (!operation) {
-        return;
+    /* TODO: What to do when this fails? */
+    gb_event_channel_send(&dai->info->streaming_events, &request);
+}
+
+static void gb_audio_hist_record(struct gb_audio_hist *hist, uint32_t usec)
+{
+    unsigned int bucket = usec / hist->bucket_us;
+
+    if (bucket >= GB_AUDIO_HIST_BUCKETS) {
+        bucket = GB_AUDIO_HIST_BUCKETS - 1;
     }
 
-    request = gb_operation_get_request_payload(operation);
-    request->data_cport = dai->data_cport;
-    request->event = event;
+    hist->count[bucket]++;
 
-    /* TODO: What to do when this fails? */
-    gb_operation_send_request(operation, NULL, false);
-    gb_operation_destroy(operation);
+    if (usec > hist->max) {
+        hist->max = usec;
+    }
+}
+
+static uint32_t gb_audio_hist_percentile(struct gb_audio_hist *hist,
+                                         uint32_t total, unsigned int percent)
+{
+    uint64_t count = 0;
+    int i;
+
+    for (i = 0; i < GB_AUDIO_HIST_BUCKETS - 1; i++) {
+        count += hist->count[i];
+        if (count * 100 >= (uint64_t)total * percent) {
+            break;
+        }
+    }
+
+    /* Bucket upper bounds may overshoot the largest sample */
+    if (i == GB_AUDIO_HIST_BUCKETS - 1 ||
+        (i + 1) * hist->bucket_us > hist->max) {
+        return hist->max;
+    }
+
+    return (i + 1) * hist->bucket_us;
+}
+
+static size_t gb_audio_hist_dump(struct gb_audio_hist *hist, char *buf,
+                                 size_t size)
+{
+    uint32_t total = 0;
+    int i;
+
+    for (i = 0; i < GB_AUDIO_HIST_BUCKETS; i++) {
+        total += hist->count[i];
+    }
+
+    if (!total) {
+        return snprintf(buf, size, "  latency(us) none\n");
+    }
+
+    return snprintf(buf, size, "  latency(us) p50 %u p90 %u p99 %u max %u\n",
+                    gb_audio_hist_percentile(hist, total, 50),
+                    gb_audio_hist_percentile(hist, total, 90),
+                    gb_audio_hist_percentile(hist, total, 99),
+                    hist->max);
 }
 
 static uint8_t gb_audio_protocol_version_handler(struct gb_operation *operation)
@@ -838,6 +966,120 @@ static uint8_t gb_audio_set_tx_data_size_handler(struct gb_operation *operation)
     return GB_OP_SUCCESS;
 }
 
+#ifdef CONFIG_GREYBUS_AUDIO_JITTER_BUFFER
+static unsigned int gb_audio_jb_us_to_samples(struct gb_audio_dai_info *dai,
+                                              uint32_t usec)
+{
+    return ((uint64_t)usec * dai->sample_freq) / 1000000;
+}
+
+static uint32_t gb_audio_jb_samples_to_us(struct gb_audio_dai_info *dai,
+                                          unsigned int samples)
+{
+    return ((uint64_t)samples * 1000000) / dai->sample_freq;
+}
+
+/* Queued audio at which playback starts, at least one message */
+static unsigned int gb_audio_jb_high(struct gb_audio_dai_info *dai)
+{
+    unsigned int high;
+
+    high = gb_audio_jb_us_to_samples(dai,
+                                     CONFIG_GREYBUS_AUDIO_JB_HIGH_WATERMARK);
+
+    return high > dai->tx_samples_per_msg ? high : dai->tx_samples_per_msg;
+}
+
+static void gb_audio_jb_init(struct gb_audio_dai_info *dai)
+{
+    struct gb_audio_jb *jb = &dai->tx_jb;
+
+    memset(jb, 0, sizeof(*jb));
+
+    jb->high = gb_audio_jb_high(dai);
+    jb->low = gb_audio_jb_us_to_samples(dai,
+                                        CONFIG_GREYBUS_AUDIO_JB_LOW_WATERMARK);
+    if (jb->low >= jb->high) {
+        jb->low = jb->high / 2;
+    }
+
+    /* The message that reaches the high watermark is not ahead of itself */
+    jb->target = jb->high - dai->tx_samples_per_msg;
+
+    jb->latency.bucket_us = GB_AUDIO_JB_HIST_BUCKET_US;
+
+    /* The I2S transmitter needs entry lengths that are multiples of 4 */
+    jb->step = 1;
+    while ((jb->step * dai->sample_size) % 4) {
+        jb->step++;
+    }
+}
+
+/* Audio queued ahead of a sample received now.  Interrupts disabled. */
+static unsigned int gb_audio_jb_latency(struct gb_audio_dai_info *dai)
+{
+    struct gb_audio_jb *jb = &dai->tx_jb;
+    unsigned int played;
+
+    if (!(dai->flags & GB_AUDIO_FLAG_TX_STARTED)) {
+        return jb->depth;
+    }
+
+    played = gb_audio_jb_us_to_samples(dai, hrt_getusec() - jb->entry_start);
+
+    return jb->depth > played ? jb->depth - played : 0;
+}
+
+/* Delay added by this driver to the samples sent by the AP */
+static uint32_t gb_audio_jb_delay(struct gb_audio_dai_info *dai)
+{
+    unsigned int samples;
+    irqstate_t flags;
+
+    flags = irqsave();
+
+    if (dai->flags & GB_AUDIO_FLAG_TX_STARTED) {
+        samples = dai->tx_jb.avg_latency >> GB_AUDIO_JB_AVG_SHIFT;
+    } else {
+        samples = gb_audio_jb_high(dai) - dai->tx_samples_per_msg;
+    }
+
+    irqrestore(flags);
+
+    return gb_audio_jb_samples_to_us(dai, samples);
+}
+
+static size_t gb_audio_jb_dump(struct gb_audio_dai_info *dai, char *buf,
+                               size_t size)
+{
+    struct gb_audio_jb jb;
+    bool started;
+    irqstate_t flags;
+    size_t len;
+
+    flags = irqsave();
+    jb = dai->tx_jb;
+    started = !!(dai->flags & GB_AUDIO_FLAG_TX_STARTED);
+    irqrestore(flags);
+
+    len = snprintf(buf, size,
+                   "cport %u tx: %s latency %u target %u low %u samples, "
+                   "drift %d ppm\n"
+                   "  underruns %u concealments %u overruns %u "
+                   "inserted %u dropped %u\n",
+                   dai->data_cport, started ? "playing" : "stopped",
+                   jb.avg_latency >> GB_AUDIO_JB_AVG_SHIFT, jb.target,
+                   jb.low, jb.drift_ppm,
+                   jb.underruns, jb.concealments, jb.overruns,
+                   jb.inserted, jb.dropped);
+    if (len >= size) {
+        return size;
+    }
+
+    return len + gb_audio_hist_dump(&jb.latency, buf + len, size - len);
+}
+#endif
+
 static uint8_t gb_audio_get_tx_delay_handler(struct gb_operation *operation)
 {
     struct gb_audio_get_tx_delay_request *request =
@@ -882,12 +1124,36 @@ static uint8_t gb_audio_get_tx_delay_handler(struct gb_operation *operation)
         return gb_errno_to_op_result(ret);
     }
 
+#ifdef CONFIG_GREYBUS_AUDIO_JITTER_BUFFER
+    response->delay = cpu_to_le32(codec_delay + i2s_delay +
+                                  gb_audio_jb_delay(dai));
+#else
     /* TODO: Determine delay from this driver and add in */
     response->delay = cpu_to_le32(codec_delay + i2s_delay);
+#endif
 
     return GB_OP_SUCCESS;
 }
 
+/* Hand the entry at dai->tx_rb, filled with len bytes, to the transmitter */
+static void gb_audio_i2s_queue(struct gb_audio_dai_info *dai, unsigned int len)
+{
+#ifdef CONFIG_GREYBUS_AUDIO_JITTER_BUFFER
+    unsigned int samples = len / dai->sample_size;
+
+    /* The transmitter resets the entry, so remember its length here */
+    ring_buf_set_priv(dai->tx_rb, (void *)(uintptr_t)samples);
+    dai->tx_jb.depth += samples;
+#endif
+
+    ring_buf_put(dai->tx_rb, len);
+    ring_buf_pass(dai->tx_rb);
+
+    dai->tx_rb = ring_buf_get_next(dai->tx_rb);
+
+    dai->tx_rb_count++;
+}
+
 static void gb_audio_i2s_tx(struct gb_audio_dai_info *dai, uint8_t *data)
 {
     ring_buf_reset(dai->tx_rb);
@@ -899,14 +1165,177 @@ static void gb_audio_i2s_tx(struct gb_audio_dai_info *dai, uint8_t *data)
      */
     memcpy(ring_buf_get_tail(dai->tx_rb), data, dai->tx_data_size);
 
-    ring_buf_put(dai->tx_rb, dai->tx_data_size);
-    ring_buf_pass(dai->tx_rb);
+    gb_audio_i2s_queue(dai, dai->tx_data_size);
+}
 
-    dai->tx_rb = ring_buf_get_next(dai->tx_rb);
+#ifdef CONFIG_GREYBUS_AUDIO_JITTER_BUFFER
+/* Must be called with interrupts disabled */
+static void gb_audio_jb_start(struct gb_audio_dai_info *dai)
+{
+    struct gb_audio_jb *jb = &dai->tx_jb;
+
+    jb->entry_start = hrt_getusec();
+    jb->avg_latency = jb->target << GB_AUDIO_JB_AVG_SHIFT;
+    jb->window_start = jb->entry_start;
+    jb->window_latency = jb->target;
+    jb->window_played = 0;
+    jb->window_adjust = 0;
+    jb->window_concealed = false;
+    jb->correction = 0;
+}
 
-    dai->tx_rb_count++;
+/*
+ * Queue a message from the AP.  Once playing, one step of samples is
+ * dropped or repeated at the end of the message when the estimated clock
+ * drift has accumulated to a full step, or when the average latency is
+ * more than a quarter of a message away from the target.
+ *
+ * Must be called with interrupts disabled.
+ */
+static void gb_audio_jb_tx(struct gb_audio_dai_info *dai, uint8_t *data)
+{
+    struct gb_audio_jb *jb = &dai->tx_jb;
+    unsigned int len = dai->tx_data_size;
+    unsigned int step_len = jb->step * dai->sample_size;
+    int32_t step_ppm = GB_AUDIO_JB_PPM * jb->step;
+    int deadband = dai->tx_samples_per_msg / 4;
+    unsigned int latency;
+    int error;
+    uint8_t *tail;
+
+    latency = gb_audio_jb_latency(dai);
+
+    ring_buf_reset(dai->tx_rb);
+    tail = ring_buf_get_tail(dai->tx_rb);
+    memcpy(tail, data, len);
+
+    jb->concealing = false;
+    jb->last_rb = dai->tx_rb;
+
+    if (dai->flags & GB_AUDIO_FLAG_TX_STARTED) {
+        jb->avg_latency += latency - (jb->avg_latency >> GB_AUDIO_JB_AVG_SHIFT);
+        gb_audio_hist_record(&jb->latency,
+                             gb_audio_jb_samples_to_us(dai, latency));
+
+        error = (int)(jb->avg_latency >> GB_AUDIO_JB_AVG_SHIFT) -
+                (int)jb->target;
+        jb->correction += jb->drift_ppm * (int32_t)dai->tx_samples_per_msg;
+
+        if (jb->correction >= step_ppm || error > deadband) {
+            /* The AP is ahead of the I2S clock */
+            len -= step_len;
+            jb->correction -= step_ppm;
+            jb->window_adjust += jb->step;
+            jb->dropped += jb->step;
+        } else if (jb->correction <= -step_ppm || error < -deadband) {
+            memcpy(tail + len, tail + len - step_len, step_len);
+            len += step_len;
+            jb->correction += step_ppm;
+            jb->window_adjust -= jb->step;
+            jb->inserted += jb->step;
+        }
+
+        /* Latency corrections must not build up a debt */
+        if (jb->correction > step_ppm) {
+            jb->correction = step_ppm;
+        } else if (jb->correction < -step_ppm) {
+            jb->correction = -step_ppm;
+        }
+    }
+
+    gb_audio_i2s_queue(dai, len);
+}
+
+/*
+ * Refill the ring up to the low watermark.  The first entry of an underrun
+ * repeats the last message of the AP if it is still queued, the following
+ * ones are silence.
+ *
+ * Must be called with interrupts disabled.
+ */
+static void gb_audio_jb_conceal(struct gb_audio_dai_info *dai)
+{
+    struct gb_audio_jb *jb = &dai->tx_jb;
+    uint8_t *data;
+
+    while (jb->depth < jb->low && ring_buf_is_producers(dai->tx_rb)) {
+        data = dai->tx_dummy_data;
+
+        if (!jb->concealing) {
+            jb->concealing = true;
+            jb->underruns++;
+
+            if (jb->last_rb && jb->last_rb != dai->tx_rb &&
+                ring_buf_is_consumers(jb->last_rb)) {
+                data = ring_buf_get_data(jb->last_rb);
+            }
+        }
+
+        gb_audio_i2s_tx(dai, data);
+
+        jb->concealments++;
+        jb->window_concealed = true;
+    }
 }
 
+/*
+ * Account for an entry played by the transmitter.  The drift is estimated
+ * every GB_AUDIO_JB_DRIFT_WINDOW_US from the change of the average latency
+ * plus the samples dropped or repeated, relative to the samples played.
+ * Windows with concealment are skipped since the AP was not streaming.
+ */
+static void gb_audio_jb_tx_complete(struct gb_audio_dai_info *dai,
+                                    struct ring_buf *rb)
+{
+    struct gb_audio_jb *jb = &dai->tx_jb;
+    unsigned int samples = (uintptr_t)ring_buf_get_priv(rb);
+    unsigned int latency;
+    int64_t drift;
+    uint32_t now;
+    irqstate_t flags;
+
+    flags = irqsave();
+
+    dai->tx_rb_count--;
+    jb->depth = jb->depth > samples ? jb->depth - samples : 0;
+
+    if (!(dai->flags & GB_AUDIO_FLAG_TX_STARTED)) {
+        irqrestore(flags);
+        return;
+    }
+
+    now = hrt_getusec();
+    jb->entry_start = now;
+    jb->window_played += samples;
+
+    if (now - jb->window_start >= GB_AUDIO_JB_DRIFT_WINDOW_US) {
+        latency = jb->avg_latency >> GB_AUDIO_JB_AVG_SHIFT;
+
+        if (jb->window_played && !jb->window_concealed) {
+            drift = ((int64_t)latency - jb->window_latency +
+                     jb->window_adjust) * GB_AUDIO_JB_PPM / jb->window_played;
+
+            if (drift <= GB_AUDIO_JB_MAX_DRIFT_PPM &&
+                drift >= -GB_AUDIO_JB_MAX_DRIFT_PPM) {
+                jb->drift_ppm += ((int32_t)drift - jb->drift_ppm) / 4;
+            }
+        }
+
+        jb->window_start = now;
+        jb->window_latency = latency;
+        jb->window_played = 0;
+        jb->window_adjust = 0;
+        jb->window_concealed = false;
+    }
+
+    if (jb->depth < jb->low) {
+        gb_audio_jb_conceal(dai);
+    }
+
+    irqrestore(flags);
+}
+#endif
+
 /* Callback for low-level i2s transmit operations */
 static void gb_audio_i2s_tx_cb(struct ring_buf *rb,
                                enum device_i2s_event event, void *arg)
@@ -916,12 +1345,16 @@ static void gb_audio_i2s_tx_cb(struct ring_buf *rb,
 
     switch (event) {
     case DEVICE_I2S_EVENT_TX_COMPLETE:
+#ifdef CONFIG_GREYBUS_AUDIO_JITTER_BUFFER
+        gb_audio_jb_tx_complete(dai, rb);
+#else
         /* TODO: Replace with smarter underrun prevention */
         dai->tx_rb_count--;
 
         if (dai->tx_rb_count < 2) {
             gb_audio_i2s_tx(dai, dai->tx_dummy_data);
         }
+#endif
         break;
     case DEVICE_I2S_EVENT_UNDERRUN:
         gb_event = GB_AUDIO_STREAMING_EVENT_UNDERRUN;
@@ -956,6 +1389,10 @@ static uint8_t gb_audio_activate_tx_handler(struct gb_operation *operation)
     struct gb_audio_info *info;
     struct gb_audio_dai_info *dai;
     unsigned int entries;
+    unsigned int data_size;
+#ifdef CONFIG_GREYBUS_AUDIO_JITTER_BUFFER
+    unsigned int jb_entries;
+#endif
     int ret;
 
     if (gb_operation_get_request_payload_size(operation) < sizeof(*request)) {
@@ -981,8 +1418,23 @@ static uint8_t gb_audio_activate_tx_handler(struct gb_operation *operation)
     /* (rate / samples_per_msg) * (buffer_amount_us / 1,000,000) */
     entries = ((dai->sample_freq * GB_AUDIO_SAMPLE_BUFFER_MIN_US) /
                (dai->tx_samples_per_msg * 1000000)) + GB_AUDIO_TX_RING_BUF_PAD;
+    data_size = dai->tx_data_size;
 
-    dai->tx_rb = ring_buf_alloc_ring(entries, 0, dai->tx_data_size, 0, NULL,
+#ifdef CONFIG_GREYBUS_AUDIO_JITTER_BUFFER
+    gb_audio_jb_init(dai);
+
+    /* Leave as much room above the high watermark as below it */
+    jb_entries = 2 * ((dai->tx_jb.high + dai->tx_samples_per_msg - 1) /
+                      dai->tx_samples_per_msg) + GB_AUDIO_TX_RING_BUF_PAD;
+    if (entries < jb_entries) {
+        entries = jb_entries;
+    }
+
+    /* Room for the samples repeated by the drift correction */
+    data_size += dai->tx_jb.step * dai->sample_size;
+#endif
+
+    dai->tx_rb = ring_buf_alloc_ring(entries, 0, data_size, 0, NULL,
                                      NULL, NULL);
     if (!dai->tx_rb) {
         return GB_OP_NO_MEMORY;
@@ -1054,6 +1506,11 @@ static uint8_t gb_audio_deactivate_tx_handler(struct gb_operation *operation)
     dai->tx_dummy_data = NULL;
 
     dai->tx_rb_count = 0;
+#ifdef CONFIG_GREYBUS_AUDIO_JITTER_BUFFER
+    /* Keep the statistics around until the next activation */
+    dai->tx_jb.depth = 0;
+    dai->tx_jb.last_rb = NULL;
+#endif
 
     dai->flags &= ~GB_AUDIO_FLAG_TX_ACTIVE;
 
@@ -1149,28 +1606,133 @@ static uint8_t gb_audio_get_rx_delay_handler(struct gb_operation *operation)
     return GB_OP_SUCCESS;
 }
 
+/* Capture time of an entry, from the hires timer, in nanoseconds */
+static uint64_t gb_audio_timestamp(void)
+{
+    struct timespec ts;
+
+    hrt_gettimespec(&ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
 static int gb_audio_send_data(struct gb_audio_dai_info *dai,
                               struct ring_buf *rb)
 {
+    struct gb_audio_send_data_request *request;
     struct gb_operation *operation;
+    uint64_t timestamp;
     int ret;
 
-    /*
-     * TODO: Use a thread to pass buffers to greybus_core so i2s irq
-     * isn't blocked too long (and we use the more than one entry in
-     * the rx ring buffer.
-     */
     operation = ring_buf_get_priv(rb);
+    request = gb_operation_get_request_payload(operation);
+    timestamp = le64_to_cpu(request->timestamp);
 
     ret = gb_operation_send_request(operation, NULL, false);
-    if (ret) {
-        return ret;
+    if (!ret) {
+        dai->rx_stats.sent++;
+        gb_audio_hist_record(&dai->rx_stats.latency,
+                             (gb_audio_timestamp() - timestamp) / 1000);
     }
 
+    /* Give the entry back even on error so that capture goes on */
     ring_buf_reset(rb);
     ring_buf_pass(rb);
 
-    return 0;
+    return ret;
+}
+
+/* Send all the entries filled by the I2S receiver, oldest first */
+static void gb_audio_rx_drain(struct gb_audio_dai_info *dai)
+{
+    unsigned int batch = 0;
+    int ret;
+
+    while (ring_buf_is_consumers(dai->rx_send_rb)) {
+        ret = gb_audio_send_data(dai, dai->rx_send_rb);
+        if (ret) {
+            dai->rx_stats.send_errors++;
+            gb_audio_report_event(dai, gb_errno_to_op_result(ret));
+        }
+
+        dai->rx_send_rb = ring_buf_get_next(dai->rx_send_rb);
+        batch++;
+    }
+
+    if (batch > dai->rx_stats.max_batch) {
+        dai->rx_stats.max_batch = batch;
+    }
+}
+
+/*
+ * Streaming thread of a capture stream.  The ring buffer is the hand-off
+ * queue: the I2S receiver passes each entry it fills to this thread, which
+ * sends it and passes it back.  The semaphore only wakes the thread up.
+ */
+static void *gb_audio_rx_thread(void *data)
+{
+    struct gb_audio_dai_info *dai = data;
+
+    while (1) {
+        sem_wait(&dai->rx_sem);
+
+        if (dai->rx_thread_stop) {
+            break;
+        }
+
+        gb_audio_rx_drain(dai);
+    }
+
+    return NULL;
+}
+
+static int gb_audio_rx_thread_start(struct gb_audio_dai_info *dai)
+{
+    pthread_attr_t thread_attr;
+    struct sched_param param;
+    int ret;
+
+    dai->rx_send_rb = dai->rx_rb;
+    dai->rx_thread_stop = false;
+    sem_init(&dai->rx_sem, 0, 0);
+
+    ret = pthread_attr_init(&thread_attr);
+    if (ret) {
+        goto err_destroy_sem;
+    }
+
+    ret = pthread_attr_setstacksize(&thread_attr,
+                                    CONFIG_GREYBUS_AUDIO_RX_STACKSIZE);
+    if (ret) {
+        goto err_destroy_attr;
+    }
+
+    param.sched_priority = CONFIG_GREYBUS_AUDIO_RX_PRIORITY;
+    ret = pthread_attr_setschedparam(&thread_attr, &param);
+    if (ret) {
+        goto err_destroy_attr;
+    }
+
+    ret = pthread_create(&dai->rx_thread, &thread_attr, gb_audio_rx_thread,
+                         dai);
+
+err_destroy_attr:
+    pthread_attr_destroy(&thread_attr);
+    if (!ret) {
+        return 0;
+    }
+err_destroy_sem:
+    sem_destroy(&dai->rx_sem);
+
+    return -ret;
+}
+
+static void gb_audio_rx_thread_stop(struct gb_audio_dai_info *dai)
+{
+    dai->rx_thread_stop = true;
+    sem_post(&dai->rx_sem);
+    pthread_join(dai->rx_thread, NULL);
+    sem_destroy(&dai->rx_sem);
 }
 
 /* Callback for low-level i2s receive operations */
@@ -1178,8 +1740,8 @@ static void gb_audio_i2s_rx_cb(struct ring_buf *rb,
                                enum device_i2s_event event, void *arg)
 {
     struct gb_audio_dai_info *dai = arg;
+    struct gb_audio_send_data_request *request;
     uint32_t gb_event = 0;
-    int ret;
 
     if (!(dai->flags & GB_AUDIO_FLAG_RX_STARTED)) {
         return;
@@ -1189,16 +1751,15 @@ static void gb_audio_i2s_rx_cb(struct ring_buf *rb,
     case DEVICE_I2S_EVENT_NONE:
         return;
     case DEVICE_I2S_EVENT_RX_COMPLETE:
-        ret = gb_audio_send_data(dai, rb);
-        if (ret) {
-            gb_audio_report_event(dai, gb_errno_to_op_result(ret));
-            return;
-        }
+        request = gb_operation_get_request_payload(ring_buf_get_priv(rb));
+        request->timestamp = cpu_to_le64(gb_audio_timestamp());
+        sem_post(&dai->rx_sem);
         break;
     case DEVICE_I2S_EVENT_UNDERRUN:
         gb_event = GB_AUDIO_STREAMING_EVENT_UNDERRUN;
         break;
     case DEVICE_I2S_EVENT_OVERRUN:
+        dai->rx_stats.overruns++;
         gb_event = GB_AUDIO_STREAMING_EVENT_OVERRUN;
         break;
     case DEVICE_I2S_EVENT_CLOCKING:
@@ -1236,7 +1797,7 @@ static int gb_audio_rb_alloc_gb_op(struct ring_buf *rb, void *arg)
     }
 
     request = gb_operation_get_request_payload(operation);
-    request->timestamp = 0; /* TODO: Implement timestamp support */
+    request->timestamp = 0; /* Set when the I2S receiver fills the entry */
 
     ring_buf_init(rb, request,
                   sizeof(struct gb_operation_hdr) + sizeof(*request),
@@ -1292,11 +1853,19 @@ static uint8_t gb_audio_activate_rx_handler(struct gb_operation *operation)
         return gb_errno_to_op_result(ENOMEM);
     }
 
+    memset(&dai->rx_stats, 0, sizeof(dai->rx_stats));
+    dai->rx_stats.latency.bucket_us = GB_AUDIO_RX_HIST_BUCKET_US;
+
+    ret = gb_audio_rx_thread_start(dai);
+    if (ret) {
+        goto err_free_rx_rb;
+    }
+
     /* Greybus i2s message transmitter is local i2s receiver */
     ret = device_i2s_prepare_receiver(dai->i2s_dev, dai->rx_rb,
                                       gb_audio_i2s_rx_cb, dai);
     if (ret) {
-        goto err_free_rx_rb;
+        goto err_stop_rx_thread;
     }
 
     dai->flags |= (GB_AUDIO_FLAG_RX_ACTIVE | GB_AUDIO_FLAG_RX_STARTED);
@@ -1309,7 +1878,10 @@ static uint8_t gb_audio_activate_rx_handler(struct gb_operation *operation)
     return GB_OP_SUCCESS;
 
 err_shutdown_receiver:
+    dai->flags &= ~(GB_AUDIO_FLAG_RX_ACTIVE | GB_AUDIO_FLAG_RX_STARTED);
     device_i2s_shutdown_receiver(dai->i2s_dev);
+err_stop_rx_thread:
+    gb_audio_rx_thread_stop(dai);
 err_free_rx_rb:
     ring_buf_free_ring(dai->rx_rb, gb_audio_rb_free_gb_op, dai);
     dai->rx_rb = NULL;
@@ -1344,6 +1916,7 @@ static uint8_t gb_audio_deactivate_rx_handler(struct gb_operation *operation)
     }
 
     device_i2s_stop_receiver(dai->i2s_dev);
+    gb_audio_rx_thread_stop(dai);
     device_i2s_shutdown_receiver(dai->i2s_dev);
 
     ring_buf_free_ring(dai->rx_rb, gb_audio_rb_free_gb_op, dai);
@@ -1393,16 +1966,9 @@ static void gb_audio_codec_jack_event_cb(uint8_t widget_id, uint8_t widget_type,
                                          void *arg)
 {
     struct gb_audio_info *info = arg;
-    struct gb_operation *operation;
-    struct gb_audio_jack_event_request *request;
+    struct gb_audio_jack_event_request request;
     uint32_t gb_event;
 
-    operation = gb_operation_create(info->mgmt_cport, GB_AUDIO_TYPE_JACK_EVENT,
-                                    sizeof(*request));
-    if (!operation) {
-        return;
-    }
-
     switch (event) {
     case DEVICE_CODEC_JACK_EVENT_INSERTION:
          gb_event = GB_AUDIO_JACK_EVENT_INSERTION;
@@ -1414,14 +1980,12 @@ static void gb_audio_codec_jack_event_cb(uint8_t widget_id, uint8_t widget_type,
         return;
     }
 
-    request = gb_operation_get_request_payload(operation);
-    request->widget_id = widget_id;
-    request->widget_type = widget_type;
-    request->event = gb_event;
+    request.widget_id = widget_id;
+    request.widget_type = widget_type;
+    request.event = gb_event;
 
     /* TODO: What to do when this fails? */
-    gb_operation_send_request(operation, NULL, false);
-    gb_operation_destroy(operation);
+    gb_event_channel_send(&info->jack_events, &request);
 }
 
 static void gb_audio_codec_button_event_cb(uint8_t widget_id,
@@ -1430,17 +1994,9 @@ static void gb_audio_codec_button_event_cb(uint8_t widget_id,
                                            void *arg)
 {
     struct gb_audio_info *info = arg;
-    struct gb_operation *operation;
-    struct gb_audio_button_event_request *request;
+    struct gb_audio_button_event_request request;
     uint32_t gb_event;
 
-    operation = gb_operation_create(info->mgmt_cport,
-                                    GB_AUDIO_TYPE_BUTTON_EVENT,
-                                    sizeof(*request));
-    if (!operation) {
-        return;
-    }
-
     switch (event) {
     case DEVICE_CODEC_BUTTON_EVENT_PRESS:
          gb_event = GB_AUDIO_BUTTON_EVENT_PRESS;
@@ -1452,14 +2008,12 @@ static void gb_audio_codec_button_event_cb(uint8_t widget_id,
         return;
     }
 
-    request = gb_operation_get_request_payload(operation);
-    request->widget_id = widget_id;
-    request->button_id = button_id;
-    request->event = gb_event;
+    request.widget_id = widget_id;
+    request.button_id = button_id;
+    request.event = gb_event;
 
     /* TODO: What to do when this fails? */
-    gb_operation_send_request(operation, NULL, false);
-    gb_operation_destroy(operation);
+    gb_event_channel_send(&info->button_events, &request);
 }
 
 static void gb_audio_alloc_info_list(void)
@@ -1580,35 +2134,69 @@ static int gb_audio_init(unsigned int mgmt_cport)
         return -EBUSY;
     }
 
+    /* Events are state changes that must keep their order: no coalescing */
+    ret = gb_event_channel_init(&info->streaming_events, mgmt_cport,
+                                GB_AUDIO_TYPE_STREAMING_EVENT,
+                                sizeof(struct gb_audio_streaming_event_request),
+                                GB_AUDIO_EVENTS, false);
+    if (ret) {
+        return ret;
+    }
+
+    ret = gb_event_channel_init(&info->jack_events, mgmt_cport,
+                                GB_AUDIO_TYPE_JACK_EVENT,
+                                sizeof(struct gb_audio_jack_event_request),
+                                GB_AUDIO_EVENTS, false);
+    if (ret) {
+        goto err_deinit_streaming_events;
+    }
+
+    ret = gb_event_channel_init(&info->button_events, mgmt_cport,
+                                GB_AUDIO_TYPE_BUTTON_EVENT,
+                                sizeof(struct gb_audio_button_event_request),
+                                GB_AUDIO_EVENTS, false);
+    if (ret) {
+        goto err_deinit_jack_events;
+    }
+
     ret = device_codec_register_tx_callback(info->codec_dev, gb_audio_codec_cb,
                                             info);
     if (ret) {
-        return ret;
+        goto err_deinit_button_events;
     }
 
     ret = device_codec_register_rx_callback(info->codec_dev, gb_audio_codec_cb,
                                             info);
     if (ret) {
-        return ret;
+        goto err_deinit_button_events;
     }
 
     ret = device_codec_register_jack_event_callback(info->codec_dev,
                                                   gb_audio_codec_jack_event_cb,
                                                   info);
     if (ret) {
-        return ret;
+        goto err_deinit_button_events;
     }
 
     ret = device_codec_register_button_event_callback(info->codec_dev,
                                                 gb_audio_codec_button_event_cb,
                                                 info);
     if (ret) {
-        return ret;
+        goto err_deinit_button_events;
     }
 
     info->initialized = true;
 
     return 0;
+
+err_deinit_button_events:
+    gb_event_channel_deinit(&info->button_events);
+err_deinit_jack_events:
+    gb_event_channel_deinit(&info->jack_events);
+err_deinit_streaming_events:
+    gb_event_channel_deinit(&info->streaming_events);
+
+    return ret;
 }
 
 static void gb_audio_exit(unsigned int mgmt_cport)
@@ -1626,6 +2214,9 @@ static void gb_audio_exit(unsigned int mgmt_cport)
 
     info->initialized = false;
 
+    gb_event_channel_deinit(&info->button_events);
+    gb_event_channel_deinit(&info->jack_events);
+    gb_event_channel_deinit(&info->streaming_events);
 }
 
 static struct gb_operation_handler gb_audio_mgmt_handlers[] = {
@@ -1694,11 +2285,29 @@ static uint8_t gb_audio_send_data_handler(struct gb_operation *operation)
     }
 
     if (!ring_buf_is_producers(dai->tx_rb)) {
+#ifdef CONFIG_GREYBUS_AUDIO_JITTER_BUFFER
+        dai->tx_jb.overruns++;
+#endif
         irqrestore(flags);
         gb_audio_report_event(dai, GB_AUDIO_STREAMING_EVENT_OVERRUN);
         return GB_OP_SUCCESS;
     }
 
+#ifdef CONFIG_GREYBUS_AUDIO_JITTER_BUFFER
+    gb_audio_jb_tx(dai, request->data);
+
+    /* Start playing once the high watermark is reached */
+    if ((dai->flags & GB_AUDIO_FLAG_TX_STARTED) ||
+        dai->tx_jb.depth < dai->tx_jb.high) {
+        irqrestore(flags);
+        return GB_OP_SUCCESS;
+    }
+
+    gb_audio_jb_start(dai);
+    dai->flags |= GB_AUDIO_FLAG_TX_STARTED;
+
+    irqrestore(flags);
+#else
     gb_audio_i2s_tx(dai, request->data);
 
     irqrestore(flags);
@@ -1710,6 +2319,7 @@ static uint8_t gb_audio_send_data_handler(struct gb_operation *operation)
      */
 
     dai->flags |= GB_AUDIO_FLAG_TX_STARTED;
+#endif
 
     ret = device_i2s_start_transmitter(dai->i2s_dev);
     if (ret) {
@@ -1739,3 +2349,60 @@ void gb_audio_data_register(int data_cport)
 {
     gb_register_driver(data_cport, &gb_audio_data_driver);
 }
+
+static size_t gb_audio_rx_dump(struct gb_audio_dai_info *dai, char *buf,
+                               size_t size)
+{
+    struct gb_audio_rx_stats stats;
+    bool started;
+    irqstate_t flags;
+    size_t len;
+
+    flags = irqsave();
+    stats = dai->rx_stats;
+    started = !!(dai->flags & GB_AUDIO_FLAG_RX_STARTED);
+    irqrestore(flags);
+
+    len = snprintf(buf, size,
+                   "cport %u rx: %s sent %u send_errors %u overruns %u "
+                   "max_batch %u\n",
+                   dai->data_cport, started ? "capturing" : "stopped",
+                   stats.sent, stats.send_errors, stats.overruns,
+                   stats.max_batch);
+    if (len >= size) {
+        return size;
+    }
+
+    return len + gb_audio_hist_dump(&stats.latency, buf + len, size - len);
+}
+
+size_t gb_audio_dump(char *buf, size_t size)
+{
+    struct gb_audio_info *info;
+    struct gb_audio_dai_info *dai;
+    struct list_head *iter, *dai_iter;
+    size_t len = 0;
+
+    list_foreach(&gb_audio_info_list, iter) {
+        info = list_entry(iter, struct gb_audio_info, list);
+
+        list_foreach(&info->dai_list, dai_iter) {
+            dai = list_entry(dai_iter, struct gb_audio_dai_info, list);
+
+#ifdef CONFIG_GREYBUS_AUDIO_JITTER_BUFFER
+            if (len >= size) {
+                return size;
+            }
+
+            len += gb_audio_jb_dump(dai, buf + len, size - len);
+#endif
+            if (len >= size) {
+                return size;
+            }
+
+            len += gb_audio_rx_dump(dai, buf + len, size - len);
+        }
+    }
+
+    return len < size ? len : size;
+}
@@ -38,7 +38,7 @@
 #define GB_GPIO_VERSION_MAJOR 0
 #define GB_GPIO_VERSION_MINOR 1
 
-static int g_gpio_cport;
+static struct gb_event_channel g_gpio_irq_events;
 
 static uint8_t gb_gpio_protocol_version(struct gb_operation *operation)
 {
@@ -255,24 +255,15 @@ static uint8_t gb_gpio_irq_unmask(struct gb_operation *operation)
 
 int gb_gpio_irq_event(int irq, FAR void *context)
 {
-    struct gb_gpio_irq_event_request *request;
-    struct gb_operation *operation;
-
-    operation = gb_operation_create(g_gpio_cport, GB_GPIO_TYPE_IRQ_EVENT,
-                                    sizeof(*request));
-    if (!operation)
-        return OK;
-
-    request = gb_operation_get_request_payload(operation);
-    request->which = irq;
+    struct gb_gpio_irq_event_request request = {
+        .which = irq,
+    };
 
     /* Host is responsible for unmasking. */
     gpio_irq_mask(irq);
 
-    /* Send unidirectional operation. */
-    gb_operation_send_request(operation, NULL, false);
-
-    gb_operation_destroy(operation);
+    /* Queue unidirectional operation, repeated IRQs on a line are merged. */
+    gb_event_channel_send(&g_gpio_irq_events, &request);
 
     return OK;
 }
@@ -337,13 +328,31 @@ static struct gb_operation_handler gb_gpio_handlers[] = {
     GB_HANDLER(GB_GPIO_TYPE_IRQ_UNMASK, gb_gpio_irq_unmask),
 };
 
+static int gb_gpio_init(unsigned int cport)
+{
+    /*
+     * One pending event per line at most, thanks to the coalescing, plus the
+     * one the worker is sending: it only goes back to the channel once sent.
+     */
+    return gb_event_channel_init(&g_gpio_irq_events, cport,
+                                 GB_GPIO_TYPE_IRQ_EVENT,
+                                 sizeof(struct gb_gpio_irq_event_request),
+                                 gpio_line_count() + 1, true);
+}
+
+static void gb_gpio_exit(unsigned int cport)
+{
+    gb_event_channel_deinit(&g_gpio_irq_events);
+}
+
 struct gb_driver gpio_driver = {
+    .init = gb_gpio_init,
+    .exit = gb_gpio_exit,
     .op_handlers = (struct gb_operation_handler*) gb_gpio_handlers,
     .op_handlers_count = ARRAY_SIZE(gb_gpio_handlers),
 };
 
 void gb_gpio_register(int cport)
 {
-    g_gpio_cport = cport;
     gb_register_driver(cport, &gpio_driver);
 }
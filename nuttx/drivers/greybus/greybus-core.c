@@ -34,7 +34,10 @@
 #include <nuttx/greybus/greybus.h>
 #include <nuttx/greybus/tape.h>
 #include <nuttx/greybus/debug.h>
+#include <nuttx/greybus/mempool.h>
+#include <nuttx/greybus/latency.h>
 #include <nuttx/wdog.h>
+#include <nuttx/clock.h>
 #include <loopback-gb.h>
 
 #include <arch/atomic.h>
@@ -53,6 +56,27 @@
 
 #define TIMEOUT_WD_DELAY    (TIMEOUT_IN_MS * CLOCKS_PER_SEC) / ONE_SEC_IN_MSEC
 
+/*
+ * In-flight requests are indexed by operation id. Ids are allocated
+ * sequentially, so masking them gives an even spread over the buckets.
+ */
+#define INFLIGHT_HASH_SIZE      64
+#define INFLIGHT_HASH_MASK      (INFLIGHT_HASH_SIZE - 1)
+
+/* Maximum number of messages a pool worker handles before yielding a cport */
+#define WORKER_POOL_BATCH       8
+
+#ifdef CONFIG_GREYBUS_WORKER_POOL
+struct gb_worker_pool {
+    struct list_head ready;
+    sem_t ready_sem;
+    pthread_t *threads;
+    unsigned int thread_count;
+    int priority;
+    volatile bool exit;
+};
+#endif
+
 struct gb_cport_driver {
     struct gb_driver *driver;
     struct list_head tx_fifo;
@@ -62,6 +86,20 @@ struct gb_cport_driver {
     volatile bool exit_worker;
     struct wdog_s timeout_wd;
     struct gb_operation timedout_operation;
+    struct list_head events;
+    struct gb_operation event_operation;
+#ifdef CONFIG_GREYBUS_WORKER_POOL
+    struct gb_worker_pool *pool;
+    struct list_head ready_node;
+    bool scheduled;
+    sem_t drain_sem;
+#endif
+};
+
+struct gb_event_op {
+    struct list_head list;
+    struct gb_event_channel *channel;
+    struct gb_operation *operation;
 };
 
 struct gb_tape_record_header {
@@ -72,6 +110,19 @@ struct gb_tape_record_header {
 static unsigned int cport_count;
 static atomic_t request_id;
 static struct gb_cport_driver *g_cport;
+static struct list_head g_inflight[INFLIGHT_HASH_SIZE];
+#ifdef CONFIG_GREYBUS_WORKER_POOL
+static struct gb_worker_pool g_worker_pool[] = {
+    [GB_WORKER_POOL_NORMAL - 1] = {
+        .thread_count = CONFIG_GREYBUS_WORKER_POOL_NORMAL_SIZE,
+        .priority = PTHREAD_DEFAULT_PRIORITY,
+    },
+    [GB_WORKER_POOL_HIGH - 1] = {
+        .thread_count = CONFIG_GREYBUS_WORKER_POOL_HIGH_SIZE,
+        .priority = CONFIG_GREYBUS_WORKER_POOL_HIGH_PRIORITY,
+    },
+};
+#endif
 static struct gb_transport_backend *transport_backend;
 static struct gb_tape_mechanism *gb_tape;
 static int gb_tape_fd = -EBADFD;
@@ -80,6 +131,8 @@ static struct gb_operation_hdr timedout_hdr = {
     .result = GB_OP_TIMEOUT,
     .type = GB_TYPE_RESPONSE_FLAG,
 };
+/* Queued in rx_fifo to have the worker send the pending events */
+static struct gb_operation_hdr event_hdr;
 static struct gb_operation_hdr oom_hdr = {
     .size = sizeof(timedout_hdr),
     .result = GB_OP_NO_MEMORY,
@@ -89,6 +142,48 @@ static struct gb_operation_hdr oom_hdr = {
 static void gb_operation_timeout(int argc, uint32_t cport, ...);
 static struct gb_operation *_gb_operation_create(unsigned int cport);
 
+#ifdef CONFIG_GREYBUS_MEMPOOL
+static void *gb_alloc_buf(size_t size)
+{
+    return gb_mempool_alloc_buf(size);
+}
+
+static void gb_free_buf(void *ptr)
+{
+    gb_mempool_free_buf(ptr);
+}
+
+static struct gb_operation *gb_alloc_operation(void)
+{
+    return gb_mempool_alloc_operation();
+}
+
+static void gb_free_operation(struct gb_operation *operation)
+{
+    gb_mempool_free_operation(operation);
+}
+#else
+static void *gb_alloc_buf(size_t size)
+{
+    return transport_backend->alloc_buf(size);
+}
+
+static void gb_free_buf(void *ptr)
+{
+    transport_backend->free_buf(ptr);
+}
+
+static struct gb_operation *gb_alloc_operation(void)
+{
+    return malloc(sizeof(struct gb_operation));
+}
+
+static void gb_free_operation(struct gb_operation *operation)
+{
+    free(operation);
+}
+#endif
+
 uint8_t gb_errno_to_op_result(int err)
 {
     switch (err) {
@@ -151,6 +246,33 @@ static void op_mark_send_time(struct gb_operation *operation) { }
 static void op_mark_recv_time(struct gb_operation *operation) { }
 #endif
 
+#ifdef CONFIG_GREYBUS_LATENCY
+static void op_mark_rx_usec(struct gb_operation *operation)
+{
+    operation->rx_usec = gb_latency_timestamp();
+}
+
+static void op_mark_tx_usec(struct gb_operation *operation)
+{
+    operation->tx_usec = gb_latency_timestamp();
+}
+
+static uint32_t op_rx_usec(struct gb_operation *operation)
+{
+    return operation->rx_usec;
+}
+
+static uint32_t op_tx_usec(struct gb_operation *operation)
+{
+    return operation->tx_usec;
+}
+#else
+static void op_mark_rx_usec(struct gb_operation *operation) { }
+static void op_mark_tx_usec(struct gb_operation *operation) { }
+static uint32_t op_rx_usec(struct gb_operation *operation) { return 0; }
+static uint32_t op_tx_usec(struct gb_operation *operation) { return 0; }
+#endif
+
 static int gb_compare_handlers(const void *data1, const void *data2)
 {
     const struct gb_operation_handler *handler1 = data1;
@@ -193,8 +315,12 @@ static void gb_process_request(struct gb_operation_hdr *hdr,
                                struct gb_operation *operation)
 {
     struct gb_operation_handler *op_handler;
+    uint32_t start;
     uint8_t result;
 
+    gb_latency_record(operation->cport, hdr->type, GB_LATENCY_RX,
+                      op_rx_usec(operation));
+
     op_handler = find_operation_handler(hdr->type, operation->cport);
     if (!op_handler) {
         gb_error("Cport %u: Invalid operation type %u\n",
@@ -203,54 +329,114 @@ static void gb_process_request(struct gb_operation_hdr *hdr,
         return;
     }
 
+    start = gb_latency_timestamp();
     result = op_handler->handler(operation);
+    gb_latency_record(operation->cport, hdr->type, GB_LATENCY_HANDLER, start);
     gb_debug("%s: %u\n", gb_handler_name(op_handler), result);
 
-    if (hdr->id)
+    if (hdr->id && !operation->response_deferred)
         gb_operation_send_response(operation, result);
     op_mark_send_time(operation);
 }
 
-static bool gb_operation_has_timedout(struct gb_operation *operation)
+static uint32_t gb_operation_elapsed_ms(struct gb_operation *operation)
 {
     struct timespec current_time;
-    struct timespec timeout_time;
 
-    timeout_time.tv_sec = operation->time.tv_sec +
-                          TIMEOUT_IN_MS / ONE_SEC_IN_MSEC;
-    timeout_time.tv_nsec = operation->time.tv_nsec +
-                          (TIMEOUT_IN_MS % ONE_SEC_IN_MSEC) * ONE_MSEC_IN_NSEC;
     clock_gettime(CLOCK_MONOTONIC, &current_time);
 
-    if (current_time.tv_sec > timeout_time.tv_sec)
-        return true;
+    return (current_time.tv_sec - operation->time.tv_sec) * ONE_SEC_IN_MSEC +
+           (current_time.tv_nsec - operation->time.tv_nsec) / ONE_MSEC_IN_NSEC;
+}
 
-    if (current_time.tv_sec < timeout_time.tv_sec)
-        return false;
+static bool gb_operation_has_timedout(struct gb_operation *operation)
+{
+    return gb_operation_elapsed_ms(operation) >= TIMEOUT_IN_MS;
+}
+
+static inline struct list_head *gb_inflight_bucket(uint16_t id)
+{
+    return &g_inflight[id & INFLIGHT_HASH_MASK];
+}
+
+/**
+ * Track an outgoing request until its response arrives or it times out.
+ *
+ * The operation is linked both in the in-flight hash table, for response
+ * matching, and at the tail of the cport tx_fifo. Every request has the same
+ * timeout, so the tx_fifo is always sorted by deadline.
+ *
+ * @note This function should be called from an atomic context
+ */
+static void gb_inflight_add(struct gb_operation *operation)
+{
+    struct gb_operation_hdr *hdr = operation->request_buffer;
 
-    return current_time.tv_nsec > timeout_time.tv_nsec;
+    list_add(gb_inflight_bucket(le16_to_cpu(hdr->id)),
+             &operation->inflight_list);
+    list_add(&g_cport[operation->cport].tx_fifo, &operation->list);
+}
+
+/**
+ * @note This function should be called from an atomic context
+ */
+static void gb_inflight_del(struct gb_operation *operation)
+{
+    list_del(&operation->inflight_list);
+    list_del(&operation->list);
+}
+
+/**
+ * Find and remove the in-flight request matching a response
+ *
+ * @note This function should be called from an atomic context
+ */
+static struct gb_operation *gb_inflight_take(unsigned int cport, uint16_t id)
+{
+    struct list_head *iter;
+    struct gb_operation *op;
+    struct gb_operation_hdr *op_hdr;
+
+    list_foreach(gb_inflight_bucket(id), iter) {
+        op = list_entry(iter, struct gb_operation, inflight_list);
+        op_hdr = op->request_buffer;
+
+        if (op->cport != cport || le16_to_cpu(op_hdr->id) != id)
+            continue;
+
+        gb_inflight_del(op);
+        return op;
+    }
+
+    return NULL;
 }
 
 /**
  * Update watchdog state
  *
  * Cancel cport watchdog if there is no outgoing message waiting for a response,
- * or update the watchdog if there is still outgoing messages.
- *
- * TODO use fine-grain timeout delay when doing the update
+ * or arm it to fire when the oldest outgoing message expires.
  *
  * @note This function should be called from an atomic context
  */
 static void gb_watchdog_update(unsigned int cport)
 {
     irqstate_t flags;
+    struct gb_operation *op;
+    uint32_t elapsed;
+    int delay = 1;
 
     flags = irqsave();
 
     if (list_is_empty(&g_cport[cport].tx_fifo)) {
         wd_cancel(&g_cport[cport].timeout_wd);
     } else {
-        wd_start(&g_cport[cport].timeout_wd, TIMEOUT_WD_DELAY,
+        op = list_entry(g_cport[cport].tx_fifo.next, struct gb_operation, list);
+        elapsed = gb_operation_elapsed_ms(op);
+        if (elapsed < TIMEOUT_IN_MS)
+            delay = MSEC2TICK(TIMEOUT_IN_MS - elapsed) + 1;
+
+        wd_start(&g_cport[cport].timeout_wd, delay,
                  gb_operation_timeout, 1, cport);
     }
 
@@ -260,18 +446,24 @@ static void gb_watchdog_update(unsigned int cport)
 static void gb_clean_timedout_operation(unsigned int cport)
 {
     irqstate_t flags;
-    struct list_head *iter, *iter_next;
     struct gb_operation *op;
 
-    list_foreach_safe(&g_cport[cport].tx_fifo, iter, iter_next) {
-        op = list_entry(iter, struct gb_operation, list);
+    /* tx_fifo is sorted by deadline: stop at the first live request */
+    while (1) {
+        flags = irqsave();
+
+        if (list_is_empty(&g_cport[cport].tx_fifo)) {
+            irqrestore(flags);
+            break;
+        }
 
+        op = list_entry(g_cport[cport].tx_fifo.next, struct gb_operation, list);
         if (!gb_operation_has_timedout(op)) {
-            continue;
+            irqrestore(flags);
+            break;
         }
 
-        flags = irqsave();
-        list_del(iter);
+        gb_inflight_del(op);
         irqrestore(flags);
 
         if (op->callback) {
@@ -287,43 +479,112 @@ static void gb_process_response(struct gb_operation_hdr *hdr,
                                 struct gb_operation *operation)
 {
     irqstate_t flags;
-    struct list_head *iter, *iter_next;
     struct gb_operation *op;
-    struct gb_operation_hdr *op_hdr;
 
-    list_foreach_safe(&g_cport[operation->cport].tx_fifo, iter, iter_next) {
-        op = list_entry(iter, struct gb_operation, list);
-        op_hdr = op->request_buffer;
+    flags = irqsave();
+    op = gb_inflight_take(operation->cport, le16_to_cpu(hdr->id));
+    if (op)
+        gb_watchdog_update(operation->cport);
+    irqrestore(flags);
 
-        if (hdr->id != op_hdr->id)
-            continue;
+    if (!op) {
+        gb_error("CPort %u: cannot find matching request for response %hu. Dropping message.\n",
+                 operation->cport, le16_to_cpu(hdr->id));
+        return;
+    }
+
+    /* attach this response with the original request */
+    gb_operation_ref(operation);
+    op->response = operation;
+    op_mark_recv_time(op);
+    gb_latency_record(op->cport, hdr->type & ~GB_TYPE_RESPONSE_FLAG,
+                      GB_LATENCY_RTT, op_tx_usec(op));
+    if (op->callback)
+        op->callback(op);
+    gb_operation_unref(op);
+}
 
+/**
+ * Send the events queued by gb_event_channel_send(), in order
+ */
+static void gb_send_events(unsigned int cport)
+{
+    struct gb_event_op *event;
+    irqstate_t flags;
+    int retval;
+
+    while (1) {
         flags = irqsave();
-        list_del(iter);
-        gb_watchdog_update(operation->cport);
+
+        if (list_is_empty(&g_cport[cport].events)) {
+            irqrestore(flags);
+            break;
+        }
+
+        event = list_entry(g_cport[cport].events.next, struct gb_event_op,
+                           list);
+        list_del(&event->list);
         irqrestore(flags);
 
-        /* attach this response with the original request */
-        gb_operation_ref(operation);
-        op->response = operation;
-        op_mark_recv_time(op);
-        if (op->callback)
-            op->callback(op);
-        gb_operation_unref(op);
-        return;
-    }
+        retval = gb_operation_send_request(event->operation, NULL, false);
 
-    gb_error("CPort %u: cannot find matching request for response %hu. Dropping message.\n",
-             operation->cport, le16_to_cpu(hdr->id));
+        flags = irqsave();
+        if (retval)
+            event->channel->dropped++;
+        else
+            event->channel->sent++;
+        list_add(&event->channel->free, &event->list);
+        irqrestore(flags);
+    }
 }
 
-static void *gb_pending_message_worker(void *data)
+/**
+ * Process the oldest message waiting in the cport rx_fifo
+ *
+ * @return false if there was no message to process
+ */
+static bool gb_process_next_operation(unsigned int cportid)
 {
-    const int cportid = (int) data;
     irqstate_t flags;
     struct gb_operation *operation;
     struct list_head *head;
     struct gb_operation_hdr *hdr;
+
+    flags = irqsave();
+    if (list_is_empty(&g_cport[cportid].rx_fifo)) {
+        irqrestore(flags);
+        return false;
+    }
+
+    head = g_cport[cportid].rx_fifo.next;
+    list_del(g_cport[cportid].rx_fifo.next);
+    irqrestore(flags);
+
+    operation = list_entry(head, struct gb_operation, list);
+    hdr = operation->request_buffer;
+
+    if (hdr == &timedout_hdr) {
+        gb_clean_timedout_operation(cportid);
+        return true;
+    }
+
+    if (hdr == &event_hdr) {
+        gb_send_events(cportid);
+        return true;
+    }
+
+    if (hdr->type & GB_TYPE_RESPONSE_FLAG)
+        gb_process_response(hdr, operation);
+    else
+        gb_process_request(hdr, operation);
+    gb_operation_destroy(operation);
+
+    return true;
+}
+
+static void *gb_pending_message_worker(void *data)
+{
+    const int cportid = (int) data;
     int retval;
 
     while (1) {
@@ -336,29 +597,214 @@ static void *gb_pending_message_worker(void *data)
             break;
         }
 
-        flags = irqsave();
-        head = g_cport[cportid].rx_fifo.next;
-        list_del(g_cport[cportid].rx_fifo.next);
-        irqrestore(flags);
+        gb_process_next_operation(cportid);
+    }
 
-        operation = list_entry(head, struct gb_operation, list);
-        hdr = operation->request_buffer;
+    return NULL;
+}
 
-        if (hdr == &timedout_hdr) {
-            gb_clean_timedout_operation(cportid);
+#ifdef CONFIG_GREYBUS_WORKER_POOL
+/**
+ * Pool worker
+ *
+ * A cport sits in the pool ready queue at most once and is removed from it
+ * while a worker processes its messages, so a cport is never serviced by two
+ * workers at the same time and its messages are handled in order.
+ */
+static void *gb_pool_worker(void *data)
+{
+    struct gb_worker_pool *pool = data;
+    struct gb_cport_driver *cport;
+    irqstate_t flags;
+    int retval;
+    int i;
+
+    while (1) {
+        retval = sem_wait(&pool->ready_sem);
+        if (retval < 0)
             continue;
+
+        if (pool->exit)
+            break;
+
+        flags = irqsave();
+        cport = list_entry(pool->ready.next, struct gb_cport_driver,
+                           ready_node);
+        list_del(&cport->ready_node);
+        irqrestore(flags);
+
+        for (i = 0; i < WORKER_POOL_BATCH; i++) {
+            if (!gb_process_next_operation(cport - g_cport))
+                break;
         }
 
-        if (hdr->type & GB_TYPE_RESPONSE_FLAG)
-            gb_process_response(hdr, operation);
-        else
-            gb_process_request(hdr, operation);
-        gb_operation_destroy(operation);
+        flags = irqsave();
+        if (list_is_empty(&cport->rx_fifo)) {
+            cport->scheduled = false;
+            if (cport->exit_worker)
+                sem_post(&cport->drain_sem);
+        } else {
+            /* Let the other cports of the pool run before going on */
+            list_add(&pool->ready, &cport->ready_node);
+            sem_post(&pool->ready_sem);
+        }
+        irqrestore(flags);
     }
 
     return NULL;
 }
 
+static int gb_worker_pool_start(struct gb_worker_pool *pool)
+{
+    pthread_attr_t thread_attr;
+    struct sched_param param;
+    unsigned int i = 0;
+    int retval;
+
+    if (pool->threads)
+        return 0;
+
+    list_init(&pool->ready);
+    sem_init(&pool->ready_sem, 0, 0);
+    pool->exit = false;
+
+    pool->threads = zalloc(sizeof(*pool->threads) * pool->thread_count);
+    if (!pool->threads)
+        return -ENOMEM;
+
+    retval = pthread_attr_init(&thread_attr);
+    if (retval)
+        goto pthread_attr_init_error;
+
+    retval = pthread_attr_setstacksize(&thread_attr,
+                                       CONFIG_GREYBUS_WORKER_POOL_STACKSIZE);
+    if (retval)
+        goto pthread_create_error;
+
+    param.sched_priority = pool->priority;
+    retval = pthread_attr_setschedparam(&thread_attr, &param);
+    if (retval)
+        goto pthread_create_error;
+
+    for (i = 0; i < pool->thread_count; i++) {
+        retval = pthread_create(&pool->threads[i], &thread_attr,
+                                gb_pool_worker, pool);
+        if (retval)
+            goto pthread_create_error;
+    }
+
+    pthread_attr_destroy(&thread_attr);
+
+    return 0;
+
+pthread_create_error:
+    pthread_attr_destroy(&thread_attr);
+    pool->exit = true;
+    while (i--) {
+        sem_post(&pool->ready_sem);
+        pthread_join(pool->threads[i], NULL);
+    }
+pthread_attr_init_error:
+    free(pool->threads);
+    pool->threads = NULL;
+    sem_destroy(&pool->ready_sem);
+    return -retval;
+}
+
+static void gb_worker_pool_stop(struct gb_worker_pool *pool)
+{
+    unsigned int i;
+
+    if (!pool->threads)
+        return;
+
+    pool->exit = true;
+    for (i = 0; i < pool->thread_count; i++)
+        sem_post(&pool->ready_sem);
+
+    for (i = 0; i < pool->thread_count; i++)
+        pthread_join(pool->threads[i], NULL);
+
+    free(pool->threads);
+    pool->threads = NULL;
+    sem_destroy(&pool->ready_sem);
+}
+
+static int gb_worker_pool_attach(unsigned int cport, struct gb_driver *driver)
+{
+    struct gb_worker_pool *pool;
+    int retval;
+
+    if (driver->worker_pool > ARRAY_SIZE(g_worker_pool))
+        return -EINVAL;
+
+    pool = &g_worker_pool[driver->worker_pool - 1];
+    if (!pool->thread_count)
+        return -ENOSYS;
+
+    if (driver->stack_size > CONFIG_GREYBUS_WORKER_POOL_STACKSIZE) {
+        gb_error("%s needs a %zu bytes stack, too large for the worker pool\n",
+                 gb_driver_name(driver), driver->stack_size);
+        return -E2BIG;
+    }
+
+    retval = gb_worker_pool_start(pool);
+    if (retval)
+        return retval;
+
+    sem_init(&g_cport[cport].drain_sem, 0, 0);
+    g_cport[cport].scheduled = false;
+    g_cport[cport].pool = pool;
+
+    return 0;
+}
+
+static void gb_worker_pool_detach(unsigned int cport)
+{
+    irqstate_t flags;
+    bool scheduled;
+    int retval;
+
+    flags = irqsave();
+    scheduled = g_cport[cport].scheduled;
+    irqrestore(flags);
+
+    /* Wait for the pool to process the messages still queued */
+    if (scheduled) {
+        do {
+            retval = sem_wait(&g_cport[cport].drain_sem);
+        } while (retval < 0 && errno == EINTR);
+    }
+
+    sem_destroy(&g_cport[cport].drain_sem);
+    g_cport[cport].pool = NULL;
+}
+#endif
+
+/**
+ * Wake up the worker in charge of a cport after a message has been queued
+ * in its rx_fifo
+ *
+ * @note This function should be called from an atomic context
+ */
+static void gb_cport_kick(unsigned int cport)
+{
+#ifdef CONFIG_GREYBUS_WORKER_POOL
+    struct gb_worker_pool *pool = g_cport[cport].pool;
+
+    if (pool) {
+        if (!g_cport[cport].scheduled) {
+            g_cport[cport].scheduled = true;
+            list_add(&pool->ready, &g_cport[cport].ready_node);
+            sem_post(&pool->ready_sem);
+        }
+        return;
+    }
+#endif
+
+    sem_post(&g_cport[cport].rx_fifo_lock);
+}
+
 #if defined(CONFIG_UNIPRO_ZERO_COPY)
 static struct gb_operation *gb_rx_create_operation(unsigned cport, void *data,
                                                    size_t size)
@@ -445,10 +891,11 @@ int greybus_rx_handler(unsigned int cport, void *data, size_t size)
         return -ENOMEM;
 
     op_mark_recv_time(op);
+    op_mark_rx_usec(op);
 
     flags = irqsave();
     list_add(&g_cport[cport].rx_fifo, &op->list);
-    sem_post(&g_cport[cport].rx_fifo_lock);
+    gb_cport_kick(cport);
     irqrestore(flags);
 
     return 0;
@@ -456,14 +903,20 @@ int greybus_rx_handler(unsigned int cport, void *data, size_t size)
 
 static void gb_flush_tx_fifo(unsigned int cport)
 {
-    struct list_head *iter, *iter_next;
+    irqstate_t flags;
+    struct gb_operation *op;
 
-    list_foreach_safe(&g_cport[cport].tx_fifo, iter, iter_next) {
-        struct gb_operation *op = list_entry(iter, struct gb_operation, list);
+    flags = irqsave();
+    while (!list_is_empty(&g_cport[cport].tx_fifo)) {
+        op = list_entry(g_cport[cport].tx_fifo.next, struct gb_operation, list);
+        gb_inflight_del(op);
+        irqrestore(flags);
 
-        list_del(iter);
         gb_operation_unref(op);
+
+        flags = irqsave();
     }
+    irqrestore(flags);
 }
 
 int gb_unregister_driver(unsigned int cport)
@@ -477,8 +930,16 @@ int gb_unregister_driver(unsigned int cport)
     wd_cancel(&g_cport[cport].timeout_wd);
 
     g_cport[cport].exit_worker = true;
-    sem_post(&g_cport[cport].rx_fifo_lock);
-    pthread_join(g_cport[cport].thread, NULL);
+
+#ifdef CONFIG_GREYBUS_WORKER_POOL
+    if (g_cport[cport].pool) {
+        gb_worker_pool_detach(cport);
+    } else
+#endif
+    {
+        sem_post(&g_cport[cport].rx_fifo_lock);
+        pthread_join(g_cport[cport].thread, NULL);
+    }
 
     gb_flush_tx_fifo(cport);
 
@@ -486,6 +947,8 @@ int gb_unregister_driver(unsigned int cport)
         g_cport[cport].driver->exit(cport);
     g_cport[cport].driver = NULL;
 
+    gb_latency_unregister(cport);
+
     return 0;
 }
 
@@ -533,6 +996,22 @@ int _gb_register_driver(unsigned int cport, struct gb_driver *driver)
 
     g_cport[cport].exit_worker = false;
 
+    if (gb_latency_register(cport))
+        gb_error("Can not allocate latency histograms for CP%u\n", cport);
+
+#ifdef CONFIG_GREYBUS_WORKER_POOL
+    if (driver->worker_pool != GB_WORKER_DEDICATED) {
+        retval = gb_worker_pool_attach(cport, driver);
+        if (!retval) {
+            g_cport[cport].driver = driver;
+            return 0;
+        }
+
+        gb_error("Can not use worker pool for %s (%d), falling back to a dedicated worker\n",
+                 gb_driver_name(driver), retval);
+    }
+#endif
+
     if (!driver->stack_size)
         driver->stack_size = DEFAULT_STACK_SIZE;
 
@@ -562,6 +1041,7 @@ pthread_attr_setstacksize_error:
         pthread_attr_destroy(&thread_attr);
 pthread_attr_init_error:
     gb_error("Can not create thread for %s\n: ", gb_driver_name(driver));
+    gb_latency_unregister(cport);
     if (driver->exit)
         driver->exit(cport);
     return retval;
@@ -617,7 +1097,7 @@ static void gb_operation_timeout(int argc, uint32_t cport, ...)
     }
 
     list_add(&g_cport[cport].rx_fifo, &g_cport[cport].timedout_operation.list);
-    sem_post(&g_cport[cport].rx_fifo_lock);
+    gb_cport_kick(cport);
     irqrestore(flags);
 }
 
@@ -647,7 +1127,7 @@ int gb_operation_send_request(struct gb_operation *operation,
         clock_gettime(CLOCK_MONOTONIC, &operation->time);
         operation->callback = callback;
         gb_operation_ref(operation);
-        list_add(&g_cport[operation->cport].tx_fifo, &operation->list);
+        gb_inflight_add(operation);
         if (!WDOG_ISACTIVE(&g_cport[operation->cport].timeout_wd)) {
             wd_start(&g_cport[operation->cport].timeout_wd, TIMEOUT_WD_DELAY,
                      gb_operation_timeout, 1, operation->cport);
@@ -655,12 +1135,15 @@ int gb_operation_send_request(struct gb_operation *operation,
     }
 
     gb_dump(operation->request_buffer, hdr->size);
+    op_mark_tx_usec(operation);
     retval = transport_backend->send(operation->cport,
                                      operation->request_buffer,
                                      le16_to_cpu(hdr->size));
     op_mark_send_time(operation);
+    gb_latency_record(operation->cport, hdr->type, GB_LATENCY_TX,
+                      op_tx_usec(operation));
     if (need_response && retval) {
-        list_del(&operation->list);
+        gb_inflight_del(operation);
         gb_watchdog_update(operation->cport);
         gb_operation_unref(operation);
     }
@@ -718,6 +1201,7 @@ static int gb_operation_send_oom_response(struct gb_operation *operation)
 int gb_operation_send_response(struct gb_operation *operation, uint8_t result)
 {
     struct gb_operation_hdr *resp_hdr;
+    uint32_t start;
     int retval;
     bool has_allocated_response = false;
 
@@ -742,16 +1226,50 @@ int gb_operation_send_response(struct gb_operation *operation, uint8_t result)
     resp_hdr = operation->response_buffer;
     resp_hdr->result = result;
 
+    /*
+     * An error response carries no payload. Don't send one anyway: a
+     * zero-copy response is not cleared, so its payload could still hold
+     * stale data from another CPort if the handler failed after allocating
+     * it.
+     */
+    if (result != GB_OP_SUCCESS)
+        resp_hdr->size = cpu_to_le16(sizeof(*resp_hdr));
+
     gb_dump(operation->response_buffer, resp_hdr->size);
     gb_loopback_log_exit(operation->cport, operation, resp_hdr->size);
+
+    start = gb_latency_timestamp();
+
+    if (operation->is_tx_buf_response) {
+        retval = transport_backend->send_tx_buf(operation->cport,
+                                                operation->response_buffer,
+                                                le16_to_cpu(resp_hdr->size));
+        gb_latency_record(operation->cport,
+                          resp_hdr->type & ~GB_TYPE_RESPONSE_FLAG,
+                          GB_LATENCY_TX, start);
+        if (!retval) {
+            /* the buffer now belongs to the transport */
+            operation->response_buffer = NULL;
+            operation->is_tx_buf_response = false;
+            operation->has_responded = true;
+            return 0;
+        }
+
+        gb_error("Greybus backend failed to send: error %d\n", retval);
+        return retval;
+    }
+
     retval = transport_backend->send(operation->cport,
                                      operation->response_buffer,
                                      le16_to_cpu(resp_hdr->size));
+    gb_latency_record(operation->cport,
+                      resp_hdr->type & ~GB_TYPE_RESPONSE_FLAG,
+                      GB_LATENCY_TX, start);
     if (retval) {
         gb_error("Greybus backend failed to send: error %d\n", retval);
         if (has_allocated_response) {
             gb_debug("Free the response buffer\n");
-            transport_backend->free_buf(operation->response_buffer);
+            gb_free_buf(operation->response_buffer);
             operation->response_buffer = NULL;
         }
         return retval;
@@ -768,8 +1286,7 @@ void *gb_operation_alloc_response(struct gb_operation *operation, size_t size)
 
     DEBUGASSERT(operation);
 
-    operation->response_buffer =
-        transport_backend->alloc_buf(size + sizeof(*resp_hdr));
+    operation->response_buffer = gb_alloc_buf(size + sizeof(*resp_hdr));
     if (!operation->response_buffer) {
         gb_error("Can not allocate a response_buffer\n");
         return NULL;
@@ -786,6 +1303,63 @@ void *gb_operation_alloc_response(struct gb_operation *operation, size_t size)
     return gb_operation_get_response_payload(operation);
 }
 
+/**
+ * Allocate a response without zeroing it
+ *
+ * When the transport supports it, the response is built in place in a buffer
+ * lent by the transport and handed back to it without any copy when sent.
+ * Only the header is initialized: the caller must fill the whole payload,
+ * unless the operation fails, in which case only the header is sent.
+ */
+void *gb_operation_alloc_zc_response(struct gb_operation *operation,
+                                     size_t size)
+{
+    struct gb_operation_hdr *req_hdr;
+    struct gb_operation_hdr *resp_hdr;
+
+    DEBUGASSERT(operation);
+
+    if (transport_backend->alloc_tx_buf && transport_backend->send_tx_buf) {
+        operation->response_buffer =
+            transport_backend->alloc_tx_buf(operation->cport,
+                                            size + sizeof(*resp_hdr));
+        operation->is_tx_buf_response = true;
+    } else {
+        operation->response_buffer = gb_alloc_buf(size + sizeof(*resp_hdr));
+        operation->is_tx_buf_response = false;
+    }
+
+    if (!operation->response_buffer) {
+        gb_error("Can not allocate a response_buffer\n");
+        operation->is_tx_buf_response = false;
+        return NULL;
+    }
+
+    req_hdr = operation->request_buffer;
+    resp_hdr = operation->response_buffer;
+
+    resp_hdr->size = cpu_to_le16(size + sizeof(*resp_hdr));
+    resp_hdr->id = req_hdr->id;
+    resp_hdr->type = GB_TYPE_RESPONSE_FLAG | req_hdr->type;
+    resp_hdr->result = 0;
+    resp_hdr->pad[0] = resp_hdr->pad[1] = 0;
+    return gb_operation_get_response_payload(operation);
+}
+
+/*
+ * Called from a request handler that completes the request asynchronously:
+ * the core does not send a response when the handler returns, and keeps a
+ * reference on the operation. The driver later calls
+ * gb_operation_send_response() then gb_operation_unref().
+ */
+void gb_operation_defer_response(struct gb_operation *operation)
+{
+    DEBUGASSERT(operation);
+
+    operation->response_deferred = true;
+    gb_operation_ref(operation);
+}
+
 void gb_operation_destroy(struct gb_operation *operation)
 {
     DEBUGASSERT(operation);
@@ -812,14 +1386,18 @@ void gb_operation_unref(struct gb_operation *operation)
     if (operation->is_unipro_rx_buf) {
         unipro_rxbuf_free(operation->cport, operation->request_buffer);
     } else {
-        transport_backend->free_buf(operation->request_buffer);
+        gb_free_buf(operation->request_buffer);
     }
 
-    transport_backend->free_buf(operation->response_buffer);
+    if (operation->is_tx_buf_response)
+        transport_backend->free_buf(operation->response_buffer);
+    else
+        gb_free_buf(operation->response_buffer);
+
     if (operation->response) {
         gb_operation_unref(operation->response);
     }
-    free(operation);
+    gb_free_operation(operation);
 }
 
 static struct gb_operation *_gb_operation_create(unsigned int cport)
@@ -829,7 +1407,7 @@ static struct gb_operation *_gb_operation_create(unsigned int cport)
     if (cport >= cport_count)
         return NULL;
 
-    operation = malloc(sizeof(*operation));
+    operation = gb_alloc_operation();
     if (!operation)
         return NULL;
 
@@ -837,6 +1415,7 @@ static struct gb_operation *_gb_operation_create(unsigned int cport)
     operation->cport = cport;
 
     list_init(&operation->list);
+    list_init(&operation->inflight_list);
     atomic_init(&operation->ref_count, 1);
 
     return operation;
@@ -856,8 +1435,7 @@ struct gb_operation *gb_operation_create(unsigned int cport, uint8_t type,
         return NULL;
     }
 
-    operation->request_buffer =
-        transport_backend->alloc_buf(req_size + sizeof(*hdr));
+    operation->request_buffer = gb_alloc_buf(req_size + sizeof(*hdr));
     if (!operation->request_buffer)
         goto malloc_error;
 
@@ -868,7 +1446,7 @@ struct gb_operation *gb_operation_create(unsigned int cport, uint8_t type,
 
     return operation;
 malloc_error:
-    free(operation);
+    gb_free_operation(operation);
     return NULL;
 }
 
@@ -908,6 +1486,155 @@ uint8_t gb_operation_get_request_result(struct gb_operation *operation)
     return hdr->result;
 }
 
+/**
+ * Preallocate the operations of an event channel
+ *
+ * @param channel channel to initialize, owned by the caller
+ * @param cport cport the events are sent on
+ * @param type type of the event requests
+ * @param payload_size size of the event request payload
+ * @param count maximum number of events waiting to be sent
+ * @param coalesce merge an event into an identical one waiting to be sent
+ * @return 0 on success, -errno on failure
+ */
+int gb_event_channel_init(struct gb_event_channel *channel, unsigned int cport,
+                          uint8_t type, size_t payload_size,
+                          unsigned int count, bool coalesce)
+{
+    unsigned int i;
+
+    if (!channel || cport >= cport_count || !count ||
+        payload_size > GB_MAX_PAYLOAD_SIZE)
+        return -EINVAL;
+
+    memset(channel, 0, sizeof(*channel));
+    channel->cport = cport;
+    channel->payload_size = payload_size;
+    channel->coalesce = coalesce;
+    list_init(&channel->free);
+
+    channel->events = zalloc(sizeof(*channel->events) * count);
+    if (!channel->events)
+        return -ENOMEM;
+
+    for (i = 0; i < count; i++) {
+        channel->events[i].operation = gb_operation_create(cport, type,
+                                                           payload_size);
+        if (!channel->events[i].operation) {
+            gb_event_channel_deinit(channel);
+            return -ENOMEM;
+        }
+
+        channel->events[i].channel = channel;
+        list_init(&channel->events[i].list);
+        list_add(&channel->free, &channel->events[i].list);
+        channel->count++;
+    }
+
+    return 0;
+}
+
+/**
+ * Release the operations of an event channel
+ *
+ * The events not sent yet are discarded. Must not be called while the
+ * worker of the cport runs, usually from the exit() callback of the driver.
+ */
+void gb_event_channel_deinit(struct gb_event_channel *channel)
+{
+    irqstate_t flags;
+    unsigned int i;
+
+    if (!channel || !channel->events)
+        return;
+
+    flags = irqsave();
+    for (i = 0; i < channel->count; i++)
+        list_del(&channel->events[i].list);
+    irqrestore(flags);
+
+    for (i = 0; i < channel->count; i++)
+        gb_operation_destroy(channel->events[i].operation);
+
+    free(channel->events);
+    channel->events = NULL;
+    channel->count = 0;
+}
+
+/**
+ * Queue an event
+ *
+ * Safe to call from interrupt context: the payload is copied into a free
+ * operation of the channel and the worker of the cport sends it. No memory is
+ * allocated.
+ *
+ * @param channel channel of the event
+ * @param payload request payload, of the size given to gb_event_channel_init()
+ * @return 0 if the event is queued or merged into a pending one, -ENOMEM if
+ *         every operation of the channel is waiting to be sent, -ENETDOWN if
+ *         the cport is going down, -ENODEV if the channel is not initialized
+ */
+int gb_event_channel_send(struct gb_event_channel *channel,
+                          const void *payload)
+{
+    struct gb_cport_driver *cport;
+    struct gb_event_op *event;
+    struct list_head *iter;
+    irqstate_t flags;
+
+    DEBUGASSERT(channel);
+
+    cport = &g_cport[channel->cport];
+
+    flags = irqsave();
+
+    if (!channel->events) {
+        irqrestore(flags);
+        return -ENODEV;
+    }
+
+    if (cport->exit_worker) {
+        channel->dropped++;
+        irqrestore(flags);
+        return -ENETDOWN;
+    }
+
+    if (channel->coalesce) {
+        list_foreach(&cport->events, iter) {
+            event = list_entry(iter, struct gb_event_op, list);
+            if (event->channel == channel &&
+                !memcmp(gb_operation_get_request_payload(event->operation),
+                        payload, channel->payload_size)) {
+                channel->coalesced++;
+                irqrestore(flags);
+                return 0;
+            }
+        }
+    }
+
+    if (list_is_empty(&channel->free)) {
+        channel->dropped++;
+        irqrestore(flags);
+        return -ENOMEM;
+    }
+
+    event = list_entry(channel->free.next, struct gb_event_op, list);
+    list_del(&event->list);
+    memcpy(gb_operation_get_request_payload(event->operation), payload,
+           channel->payload_size);
+    list_add(&cport->events, &event->list);
+
+    /* The worker sends every pending event, queue it only once */
+    if (list_is_empty(&cport->event_operation.list)) {
+        list_add(&cport->rx_fifo, &cport->event_operation.list);
+        gb_cport_kick(channel->cport);
+    }
+
+    irqrestore(flags);
+
+    return 0;
+}
+
 int gb_init(struct gb_transport_backend *transport)
 {
     int i;
@@ -924,13 +1651,27 @@ int gb_init(struct gb_transport_backend *transport)
         wd_static(&g_cport[i].timeout_wd);
         g_cport[i].timedout_operation.request_buffer = &timedout_hdr;
         list_init(&g_cport[i].timedout_operation.list);
+        list_init(&g_cport[i].events);
+        g_cport[i].event_operation.request_buffer = &event_hdr;
+        list_init(&g_cport[i].event_operation.list);
     }
 
+    for (i = 0; i < INFLIGHT_HASH_SIZE; i++)
+        list_init(&g_inflight[i]);
+
     atomic_init(&request_id, (uint32_t) 0);
 
     transport_backend = transport;
     transport_backend->init();
 
+#ifdef CONFIG_GREYBUS_MEMPOOL
+    /* Without the pools, every allocation simply falls back to the heap */
+    if (gb_mempool_init(transport))
+        gb_error("Greybus pools not preallocated, using the heap only\n");
+#endif
+
+    gb_latency_init(cport_count);
+
     return 0;
 }
 
@@ -948,8 +1689,19 @@ void gb_deinit(void)
         sem_destroy(&g_cport[i].rx_fifo_lock);
     }
 
+#ifdef CONFIG_GREYBUS_WORKER_POOL
+    for (i = 0; i < ARRAY_SIZE(g_worker_pool); i++)
+        gb_worker_pool_stop(&g_worker_pool[i]);
+#endif
+
     free(g_cport);
 
+#ifdef CONFIG_GREYBUS_MEMPOOL
+    gb_mempool_deinit();
+#endif
+
+    gb_latency_deinit();
+
     if (transport_backend->exit)
         transport_backend->exit();
     transport_backend = NULL;
@@ -0,0 +1,284 @@
+/*
+ * Copyright (c) 2016 Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ * Greybus latency histograms.
+ *
+ * Each CPort with a registered driver gets a table of histograms, one per
+ * operation type and latency metric. A CPort tracks up to
+ * CONFIG_GREYBUS_LATENCY_TYPES operation types, samples of any other type
+ * are accounted in a shared "other" slot. Recording a sample only takes a
+ * timer read, a bit scan and a few increments with interrupts disabled, so
+ * it can stay enabled on production builds.
+ */
+
+#include <nuttx/config.h>
+#include <nuttx/util.h>
+#include <nuttx/greybus/greybus.h>
+#include <nuttx/greybus/latency.h>
+
+#include <arch/irq.h>
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define GB_LATENCY_OTHER_SLOT   CONFIG_GREYBUS_LATENCY_TYPES
+
+struct gb_latency_histogram {
+    uint32_t count[GB_LATENCY_BUCKETS];
+    uint32_t max;
+};
+
+struct gb_latency_slot {
+    bool used;
+    uint8_t type;
+    struct gb_latency_histogram hist[GB_LATENCY_METRIC_COUNT];
+};
+
+struct gb_latency_cport {
+    struct gb_latency_slot slots[CONFIG_GREYBUS_LATENCY_TYPES + 1];
+};
+
+static struct gb_latency_cport **gb_latency_cports;
+static unsigned int gb_latency_cport_count;
+
+static const char *gb_latency_metric_name[GB_LATENCY_METRIC_COUNT] = {
+    [GB_LATENCY_RX] = "rx",
+    [GB_LATENCY_HANDLER] = "handler",
+    [GB_LATENCY_RTT] = "rtt",
+    [GB_LATENCY_TX] = "tx",
+};
+
+static inline unsigned int gb_latency_bucket(uint32_t usec)
+{
+    unsigned int bucket;
+
+    if (!usec)
+        return 0;
+
+    bucket = 32 - __builtin_clz(usec);
+    return bucket < GB_LATENCY_BUCKETS ? bucket : GB_LATENCY_BUCKETS - 1;
+}
+
+/* Must be called with interrupts disabled */
+static struct gb_latency_slot *gb_latency_find_slot(struct gb_latency_cport *lc,
+                                                    uint8_t type)
+{
+    int i;
+
+    for (i = 0; i < CONFIG_GREYBUS_LATENCY_TYPES; i++) {
+        if (!lc->slots[i].used) {
+            lc->slots[i].used = true;
+            lc->slots[i].type = type;
+            return &lc->slots[i];
+        }
+
+        if (lc->slots[i].type == type)
+            return &lc->slots[i];
+    }
+
+    return &lc->slots[GB_LATENCY_OTHER_SLOT];
+}
+
+/**
+ * Record a latency sample
+ *
+ * @param cport CPort the operation belongs to
+ * @param type operation type, without the response flag
+ * @param metric latency being measured
+ * @param start gb_latency_timestamp() at the beginning of the measured
+ *              interval, the interval ends now
+ */
+void gb_latency_record(unsigned int cport, uint8_t type,
+                       enum gb_latency_metric metric, uint32_t start)
+{
+    struct gb_latency_histogram *hist;
+    struct gb_latency_cport *lc;
+    irqstate_t flags;
+    uint32_t usec;
+
+    if (cport >= gb_latency_cport_count)
+        return;
+
+    usec = hrt_getusec() - start;
+
+    flags = irqsave();
+
+    lc = gb_latency_cports[cport];
+    if (lc) {
+        hist = &gb_latency_find_slot(lc, type)->hist[metric];
+        hist->count[gb_latency_bucket(usec)]++;
+        if (usec > hist->max)
+            hist->max = usec;
+    }
+
+    irqrestore(flags);
+}
+
+void gb_latency_reset(void)
+{
+    irqstate_t flags;
+    int i;
+
+    for (i = 0; i < gb_latency_cport_count; i++) {
+        flags = irqsave();
+        if (gb_latency_cports[i])
+            memset(gb_latency_cports[i], 0, sizeof(*gb_latency_cports[i]));
+        irqrestore(flags);
+    }
+}
+
+static size_t gb_latency_dump_histogram(unsigned int cport,
+                                        struct gb_latency_slot *slot,
+                                        enum gb_latency_metric metric,
+                                        char *buf, size_t size)
+{
+    struct gb_latency_histogram hist;
+    uint32_t total = 0;
+    size_t len = 0;
+    irqstate_t flags;
+    int i;
+
+    flags = irqsave();
+    memcpy(&hist, &slot->hist[metric], sizeof(hist));
+    irqrestore(flags);
+
+    for (i = 0; i < GB_LATENCY_BUCKETS; i++)
+        total += hist.count[i];
+
+    if (!total)
+        return 0;
+
+    if (slot->used)
+        len = snprintf(buf, size, "%4u 0x%02x %-7s %8u %8u",
+                       cport, slot->type, gb_latency_metric_name[metric],
+                       total, hist.max);
+    else
+        len = snprintf(buf, size, "%4u %4s %-7s %8u %8u",
+                       cport, "any", gb_latency_metric_name[metric],
+                       total, hist.max);
+
+    for (i = 0; i < GB_LATENCY_BUCKETS && len < size; i++)
+        len += snprintf(buf + len, size - len, " %u", hist.count[i]);
+
+    if (len < size)
+        len += snprintf(buf + len, size - len, "\n");
+
+    return len < size ? len : size;
+}
+
+size_t gb_latency_dump(char *buf, size_t size)
+{
+    struct gb_latency_cport *lc;
+    size_t len;
+    int i, j, k;
+
+    len = snprintf(buf, size,
+                   "cport type metric     samples  max(us) buckets(<1us, <2^n us)\n");
+    if (len >= size)
+        return size;
+
+    for (i = 0; i < gb_latency_cport_count; i++) {
+        lc = gb_latency_cports[i];
+        if (!lc)
+            continue;
+
+        for (j = 0; j < ARRAY_SIZE(lc->slots); j++) {
+            for (k = 0; k < GB_LATENCY_METRIC_COUNT && len < size; k++) {
+                len += gb_latency_dump_histogram(i, &lc->slots[j], k,
+                                                 buf + len, size - len);
+            }
+        }
+    }
+
+    return len < size ? len : size;
+}
+
+int gb_latency_register(unsigned int cport)
+{
+    struct gb_latency_cport *lc;
+    irqstate_t flags;
+
+    if (cport >= gb_latency_cport_count)
+        return -EINVAL;
+
+    if (gb_latency_cports[cport])
+        return 0;
+
+    lc = zalloc(sizeof(*lc));
+    if (!lc)
+        return -ENOMEM;
+
+    flags = irqsave();
+    gb_latency_cports[cport] = lc;
+    irqrestore(flags);
+
+    return 0;
+}
+
+void gb_latency_unregister(unsigned int cport)
+{
+    struct gb_latency_cport *lc;
+    irqstate_t flags;
+
+    if (cport >= gb_latency_cport_count)
+        return;
+
+    flags = irqsave();
+    lc = gb_latency_cports[cport];
+    gb_latency_cports[cport] = NULL;
+    irqrestore(flags);
+
+    free(lc);
+}
+
+int gb_latency_init(unsigned int cport_count)
+{
+    gb_latency_cports = zalloc(sizeof(*gb_latency_cports) * cport_count);
+    if (!gb_latency_cports)
+        return -ENOMEM;
+
+    gb_latency_cport_count = cport_count;
+    return 0;
+}
+
+void gb_latency_deinit(void)
+{
+    int i;
+
+    for (i = 0; i < gb_latency_cport_count; i++)
+        gb_latency_unregister(i);
+
+    gb_latency_cport_count = 0;
+    free(gb_latency_cports);
+    gb_latency_cports = NULL;
+}
@@ -0,0 +1,329 @@
+/*
+ * Copyright (c) 2015 Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ * Fixed-size pools for the Greybus operations and message buffers.
+ *
+ * Operations and buffers are handed out from preallocated free lists in
+ * constant time, with interrupts disabled only for the list push or pop, so
+ * they can be used from the UniPro RX interrupt. When a pool is exhausted,
+ * the allocation falls back to the heap (or to the transport allocator for
+ * message buffers).
+ */
+
+#include <nuttx/config.h>
+#include <nuttx/util.h>
+#include <nuttx/greybus/greybus.h>
+#include <nuttx/greybus/mempool.h>
+#include <nuttx/greybus/debug.h>
+
+#include <arch/irq.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+struct gb_mempool_node {
+    struct gb_mempool_node *next;
+};
+
+struct gb_mempool {
+    const char *name;
+    size_t size;
+    size_t count;
+
+    struct gb_mempool_node *free;
+    size_t in_use;
+    size_t high_water;
+    unsigned int alloc_count;
+    unsigned int fallback_count;
+};
+
+/*
+ * Header in front of each message buffer. It must keep the payload 8 bytes
+ * aligned.
+ */
+struct gb_mempool_buf {
+    struct gb_mempool *pool; /* NULL if allocated from the transport */
+    struct gb_mempool_node node;
+};
+
+static inline struct gb_mempool_buf *
+gb_mempool_node_to_buf(struct gb_mempool_node *node)
+{
+    return (struct gb_mempool_buf *)
+        ((char *) node - offsetof(struct gb_mempool_buf, node));
+}
+
+static struct gb_transport_backend *gb_mempool_transport;
+static struct gb_operation *gb_operation_storage;
+
+static struct gb_mempool gb_operation_pool = {
+    .name = "operation",
+    .size = sizeof(struct gb_operation),
+    .count = CONFIG_GREYBUS_MEMPOOL_OPERATIONS,
+};
+
+/* Sorted by increasing size */
+static struct gb_mempool gb_buf_pools[] = {
+    {
+        .name = "small",
+        .size = CONFIG_GREYBUS_MEMPOOL_SMALL_SIZE,
+        .count = CONFIG_GREYBUS_MEMPOOL_SMALL_COUNT,
+    },
+    {
+        .name = "medium",
+        .size = CONFIG_GREYBUS_MEMPOOL_MEDIUM_SIZE,
+        .count = CONFIG_GREYBUS_MEMPOOL_MEDIUM_COUNT,
+    },
+    {
+        .name = "large",
+        .size = CONFIG_GREYBUS_MEMPOOL_LARGE_SIZE,
+        .count = CONFIG_GREYBUS_MEMPOOL_LARGE_COUNT,
+    },
+};
+
+static void gb_mempool_push(struct gb_mempool *pool,
+                            struct gb_mempool_node *node)
+{
+    irqstate_t flags;
+
+    flags = irqsave();
+    node->next = pool->free;
+    pool->free = node;
+    pool->in_use--;
+    irqrestore(flags);
+}
+
+static struct gb_mempool_node *gb_mempool_pop(struct gb_mempool *pool)
+{
+    struct gb_mempool_node *node;
+    irqstate_t flags;
+
+    flags = irqsave();
+
+    node = pool->free;
+    if (!node) {
+        pool->fallback_count++;
+        irqrestore(flags);
+        return NULL;
+    }
+
+    pool->free = node->next;
+    pool->alloc_count++;
+    if (++pool->in_use > pool->high_water)
+        pool->high_water = pool->in_use;
+
+    irqrestore(flags);
+
+    return node;
+}
+
+struct gb_operation *gb_mempool_alloc_operation(void)
+{
+    struct gb_operation *operation;
+
+    operation = (struct gb_operation *) gb_mempool_pop(&gb_operation_pool);
+    if (!operation)
+        operation = malloc(sizeof(*operation));
+
+    return operation;
+}
+
+void gb_mempool_free_operation(struct gb_operation *operation)
+{
+    if (!operation)
+        return;
+
+    if (gb_operation_storage && operation >= gb_operation_storage &&
+        operation < gb_operation_storage + gb_operation_pool.count) {
+        gb_mempool_push(&gb_operation_pool,
+                        (struct gb_mempool_node *) operation);
+        return;
+    }
+
+    free(operation);
+}
+
+void *gb_mempool_alloc_buf(size_t size)
+{
+    struct gb_mempool_node *node;
+    struct gb_mempool_buf *buf = NULL;
+    int i;
+
+    for (i = 0; i < ARRAY_SIZE(gb_buf_pools); i++) {
+        if (size > gb_buf_pools[i].size)
+            continue;
+
+        node = gb_mempool_pop(&gb_buf_pools[i]);
+        if (node)
+            buf = gb_mempool_node_to_buf(node);
+        break;
+    }
+
+    if (!buf) {
+        buf = gb_mempool_transport->alloc_buf(sizeof(*buf) + size);
+        if (!buf)
+            return NULL;
+
+        buf->pool = NULL;
+    }
+
+    return buf + 1;
+}
+
+void gb_mempool_free_buf(void *ptr)
+{
+    struct gb_mempool_buf *buf;
+
+    if (!ptr)
+        return;
+
+    buf = (struct gb_mempool_buf *) ptr - 1;
+    if (!buf->pool) {
+        gb_mempool_transport->free_buf(buf);
+        return;
+    }
+
+    gb_mempool_push(buf->pool, &buf->node);
+}
+
+static int gb_buf_pool_fill(struct gb_mempool *pool)
+{
+    struct gb_mempool_buf *buf;
+    size_t i;
+
+    for (i = 0; i < pool->count; i++) {
+        buf = gb_mempool_transport->alloc_buf(sizeof(*buf) + pool->size);
+        if (!buf)
+            return -ENOMEM;
+
+        buf->pool = pool;
+        buf->node.next = pool->free;
+        pool->free = &buf->node;
+    }
+
+    return 0;
+}
+
+static void gb_buf_pool_drain(struct gb_mempool *pool)
+{
+    struct gb_mempool_node *node;
+
+    while (pool->free) {
+        node = pool->free;
+        pool->free = node->next;
+        gb_mempool_transport->free_buf(gb_mempool_node_to_buf(node));
+    }
+}
+
+/*
+ * On failure, all the pools are left empty, so that every allocation falls
+ * back to the heap or the transport allocator.
+ */
+int gb_mempool_init(struct gb_transport_backend *transport)
+{
+    struct gb_mempool_node *node;
+    int retval;
+    int i;
+
+    gb_mempool_transport = transport;
+
+    gb_operation_storage = zalloc(sizeof(*gb_operation_storage) *
+                                  gb_operation_pool.count);
+    if (!gb_operation_storage && gb_operation_pool.count) {
+        gb_error("Can not preallocate the %s pool\n",
+                 gb_operation_pool.name);
+        return -ENOMEM;
+    }
+
+    for (i = 0; i < gb_operation_pool.count; i++) {
+        node = (struct gb_mempool_node *) &gb_operation_storage[i];
+        node->next = gb_operation_pool.free;
+        gb_operation_pool.free = node;
+    }
+
+    for (i = 0; i < ARRAY_SIZE(gb_buf_pools); i++) {
+        retval = gb_buf_pool_fill(&gb_buf_pools[i]);
+        if (retval) {
+            gb_error("Can not preallocate the %s buffer pool\n",
+                     gb_buf_pools[i].name);
+            gb_mempool_deinit();
+            return retval;
+        }
+    }
+
+    return 0;
+}
+
+void gb_mempool_deinit(void)
+{
+    int i;
+
+    for (i = 0; i < ARRAY_SIZE(gb_buf_pools); i++)
+        gb_buf_pool_drain(&gb_buf_pools[i]);
+
+    free(gb_operation_storage);
+    gb_operation_storage = NULL;
+    gb_operation_pool.free = NULL;
+}
+
+static size_t gb_mempool_dump_pool(struct gb_mempool *pool, char *buf,
+                                   size_t size)
+{
+    int len;
+
+    len = snprintf(buf, size, "%-10s %6zu %6zu %6zu %6zu %10u %10u\n",
+                   pool->name, pool->size, pool->count, pool->in_use,
+                   pool->high_water, pool->alloc_count, pool->fallback_count);
+    if (len < 0)
+        return 0;
+
+    return (size_t) len < size ? len : size;
+}
+
+size_t gb_mempool_dump(char *buf, size_t size)
+{
+    size_t len;
+    int i;
+
+    len = snprintf(buf, size, "%-10s %6s %6s %6s %6s %10s %10s\n",
+                   "pool", "size", "count", "used", "max", "allocs",
+                   "fallbacks");
+    if (len >= size)
+        return size;
+
+    len += gb_mempool_dump_pool(&gb_operation_pool, buf + len, size - len);
+
+    for (i = 0; i < ARRAY_SIZE(gb_buf_pools); i++)
+        len += gb_mempool_dump_pool(&gb_buf_pools[i], buf + len, size - len);
+
+    return len;
+}
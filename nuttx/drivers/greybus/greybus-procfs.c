@@ -0,0 +1,181 @@
+/*
+ * Copyright (c) 2015 Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ * Greybus statistics exported under /proc/greybus/.
+ *
+ * The content of a file is rendered once when it is opened, so that
+ * consecutive reads return a consistent snapshot.
+ */
+
+#include <nuttx/config.h>
+#include <nuttx/util.h>
+#include <nuttx/kmalloc.h>
+#include <nuttx/fs/fs.h>
+#include <nuttx/fs/procfs.h>
+#include <nuttx/greybus/debug.h>
+#include <nuttx/greybus/mempool.h>
+#include <nuttx/greybus/latency.h>
+#include <nuttx/greybus/audio.h>
+#include <nuttx/greybus/sdio.h>
+#include <nuttx/greybus/uart.h>
+
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <string.h>
+#include <errno.h>
+
+#if !defined(CONFIG_DISABLE_MOUNTPOINT) && defined(CONFIG_FS_PROCFS)
+
+#define GB_PROCFS_BUFSIZE       1024
+
+struct gb_procfs_entry {
+    const char *name;
+    size_t (*dump)(char *buf, size_t size);
+    size_t bufsize;
+};
+
+struct gb_procfs_file {
+    struct procfs_file_s base;
+    size_t size;
+    size_t bufsize;
+    char buf[];
+};
+
+static const struct gb_procfs_entry gb_procfs_entries[] = {
+#ifdef CONFIG_GREYBUS_MEMPOOL
+    { "greybus/mempool", gb_mempool_dump, GB_PROCFS_BUFSIZE },
+#endif
+#ifdef CONFIG_GREYBUS_LATENCY
+    { "greybus/latency", gb_latency_dump, 4 * GB_PROCFS_BUFSIZE },
+#endif
+#ifdef CONFIG_GREYBUS_AUDIO
+    { "greybus/audio", gb_audio_dump, GB_PROCFS_BUFSIZE },
+#endif
+#ifdef CONFIG_GREYBUS_SDIO_PHY
+    { "greybus/sdio", gb_sdio_dump, GB_PROCFS_BUFSIZE },
+#endif
+#ifdef CONFIG_GREYBUS_UART_PHY
+    { "greybus/uart", gb_uart_dump, GB_PROCFS_BUFSIZE },
+#endif
+};
+
+static const struct gb_procfs_entry *gb_procfs_find(const char *relpath)
+{
+    int i;
+
+    for (i = 0; i < ARRAY_SIZE(gb_procfs_entries); i++) {
+        if (!strcmp(gb_procfs_entries[i].name, relpath))
+            return &gb_procfs_entries[i];
+    }
+
+    return NULL;
+}
+
+static int gb_procfs_open(struct file *filep, const char *relpath,
+                          int oflags, mode_t mode)
+{
+    const struct gb_procfs_entry *entry;
+    struct gb_procfs_file *priv;
+
+    if ((oflags & O_WRONLY) != 0 || (oflags & O_RDONLY) == 0)
+        return -EACCES;
+
+    entry = gb_procfs_find(relpath);
+    if (!entry)
+        return -ENOENT;
+
+    priv = kmm_zalloc(sizeof(*priv) + entry->bufsize);
+    if (!priv)
+        return -ENOMEM;
+
+    priv->bufsize = entry->bufsize;
+    priv->size = entry->dump(priv->buf, priv->bufsize);
+    filep->f_priv = priv;
+
+    return 0;
+}
+
+static int gb_procfs_close(struct file *filep)
+{
+    kmm_free(filep->f_priv);
+    filep->f_priv = NULL;
+
+    return 0;
+}
+
+static ssize_t gb_procfs_read(struct file *filep, char *buffer, size_t buflen)
+{
+    struct gb_procfs_file *priv = filep->f_priv;
+    off_t offset = filep->f_pos;
+    size_t len;
+
+    DEBUGASSERT(priv);
+
+    len = procfs_memcpy(priv->buf, priv->size, buffer, buflen, &offset);
+    filep->f_pos += len;
+
+    return len;
+}
+
+static int gb_procfs_dup(const struct file *oldp, struct file *newp)
+{
+    struct gb_procfs_file *oldpriv = oldp->f_priv;
+    struct gb_procfs_file *priv;
+
+    priv = kmm_malloc(sizeof(*priv) + oldpriv->bufsize);
+    if (!priv)
+        return -ENOMEM;
+
+    memcpy(priv, oldpriv, sizeof(*priv) + oldpriv->bufsize);
+    newp->f_priv = priv;
+
+    return 0;
+}
+
+static int gb_procfs_stat(const char *relpath, struct stat *buf)
+{
+    if (!gb_procfs_find(relpath))
+        return -ENOENT;
+
+    memset(buf, 0, sizeof(*buf));
+    buf->st_mode = S_IFREG | S_IROTH | S_IRGRP | S_IRUSR;
+
+    return 0;
+}
+
+const struct procfs_operations gb_procfsoperations = {
+    .open = gb_procfs_open,
+    .close = gb_procfs_close,
+    .read = gb_procfs_read,
+    .dup = gb_procfs_dup,
+    .stat = gb_procfs_stat,
+};
+
+#endif /* !CONFIG_DISABLE_MOUNTPOINT && CONFIG_FS_PROCFS */
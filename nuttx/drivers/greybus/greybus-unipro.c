@@ -43,6 +43,29 @@ static int gb_unipro_rx_handler(unsigned int cport, void *data, size_t size)
     return retval;
 }
 
+#ifdef CONFIG_ARCH_UNIPROTX_USE_DMA
+/*
+ * With the DMA TX path, unipro_send() and unipro_send_async() share the same
+ * queue, so responses can be sent asynchronously straight from their bufram
+ * buffer without breaking the message order.
+ */
+static int gb_unipro_tx_buf_sent(int status, const void *buf, void *priv)
+{
+    bufram_free((void *) buf);
+    return 0;
+}
+
+static void *gb_unipro_alloc_tx_buf(unsigned int cport, size_t size)
+{
+    return bufram_alloc(size);
+}
+
+static int gb_unipro_send_tx_buf(unsigned int cport, void *buf, size_t len)
+{
+    return unipro_send_async(cport, buf, len, gb_unipro_tx_buf_sent, NULL);
+}
+#endif
+
 static struct unipro_driver greybus_driver = {
     .name = "greybus",
     .rx_handler = gb_unipro_rx_handler,
@@ -65,6 +88,10 @@ struct gb_transport_backend gb_unipro_backend = {
     .stop_listening = gb_unipro_stop_listening,
     .alloc_buf = bufram_alloc,
     .free_buf = bufram_free,
+#ifdef CONFIG_ARCH_UNIPROTX_USE_DMA
+    .alloc_tx_buf = gb_unipro_alloc_tx_buf,
+    .send_tx_buf = gb_unipro_send_tx_buf,
+#endif
 };
 
 int gb_unipro_init(void)
@@ -43,12 +43,16 @@
 #define GB_LIGHTS_VERSION_MAJOR 0
 #define GB_LIGHTS_VERSION_MINOR 1
 
+/* Number of events that can wait to be sent */
+#define GB_LIGHTS_EVENTS        4
+
 /**
  * The structure for Lights Protocol information
  */
 struct gb_lights_info {
     unsigned int    cport;
     struct device   *dev;
+    struct gb_event_channel events;
 };
 
 /**
@@ -69,23 +73,12 @@ static struct gb_lights_info *lights_info = NULL;
  */
 static int event_callback(uint8_t light_id, uint8_t event)
 {
-    struct gb_operation *operation;
-    struct gb_lights_event_request *request;
-
-    operation = gb_operation_create(lights_info->cport, GB_LIGHTS_TYPE_EVENT,
-                                    sizeof(*request));
-    if (!operation) {
-        return -EIO;
-    }
+    struct gb_lights_event_request request = {
+        .light_id = light_id,
+        .event = event,
+    };
 
-    request = gb_operation_get_request_payload(operation);
-    request->light_id = light_id;
-    request->event = event;
-
-    gb_operation_send_request(operation, NULL, false);
-    gb_operation_destroy(operation);
-
-    return 0;
+    return gb_event_channel_send(&lights_info->events, &request);
 }
 
 /**
@@ -562,10 +555,18 @@ static int gb_lights_init(unsigned int cport)
 
     lights_info->cport = cport;
 
+    ret = gb_event_channel_init(&lights_info->events, cport,
+                                GB_LIGHTS_TYPE_EVENT,
+                                sizeof(struct gb_lights_event_request),
+                                GB_LIGHTS_EVENTS, true);
+    if (ret) {
+        goto err_free_info;
+    }
+
     lights_info->dev = device_open(DEVICE_TYPE_LIGHTS_HW, 0);
     if (!lights_info->dev) {
         ret = -EIO;
-        goto err_free_info;
+        goto err_deinit_events;
     }
 
     ret = device_lights_register_callback(lights_info->dev, event_callback);
@@ -578,6 +579,9 @@ static int gb_lights_init(unsigned int cport)
 err_close_device:
     device_close(lights_info->dev);
 
+err_deinit_events:
+    gb_event_channel_deinit(&lights_info->events);
+
 err_free_info:
     free(lights_info);
 
@@ -595,6 +599,8 @@ static void gb_lights_exit(unsigned int cport)
 
     device_close(lights_info->dev);
 
+    gb_event_channel_deinit(&lights_info->events);
+
     free(lights_info);
     lights_info = NULL;
 }
@@ -625,6 +631,7 @@ static struct gb_driver gb_lights_driver = {
     .exit = gb_lights_exit,
     .op_handlers = gb_lights_handlers,
     .op_handlers_count = ARRAY_SIZE(gb_lights_handlers),
+    .worker_pool = GB_WORKER_POOL_NORMAL,
 };
 
 /**
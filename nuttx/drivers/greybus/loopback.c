@@ -385,11 +385,14 @@ static uint8_t gb_loopback_transfer_req_cb(struct gb_operation *operation)
 
     request_length = le32_to_cpu(request->len);
 
-    response = gb_operation_alloc_response(operation,
-                                           sizeof(*response) + request_length);
+    response = gb_operation_alloc_zc_response(operation,
+                                              sizeof(*response) +
+                                              request_length);
     if(!response)
         return GB_OP_NO_MEMORY;
     response->len = request->len;
+    response->reserved0 = 0;
+    response->reserved1 = 0;
     memcpy(response->data, request->data, request_length);
     return GB_OP_SUCCESS;
 }
@@ -44,6 +44,9 @@
 
 #define DESC_LEN 32
 
+/* Number of events that can wait to be sent */
+#define GB_POWER_SUPPLY_EVENTS 4
+
 /**
  * Power supply protocol private information.
  */
@@ -52,6 +55,8 @@ struct gb_power_supply_info {
     unsigned int cport;
     /** Power supply driver handle */
     struct device *dev;
+    /** Preallocated event requests */
+    struct gb_event_channel events;
 };
 
 static struct gb_power_supply_info *info = NULL;
@@ -65,23 +70,12 @@ static struct gb_power_supply_info *info = NULL;
  */
 static int event_callback(uint8_t psy_id, uint8_t event)
 {
-    struct gb_operation *operation;
-    struct gb_power_supply_event_request *request;
-
-    operation = gb_operation_create(info->cport, GB_POWER_SUPPLY_TYPE_EVENT,
-                                    sizeof(*request));
-    if (!operation) {
-        return -ENOMEM;
-    }
-
-    request = gb_operation_get_request_payload(operation);
-    request->psy_id = psy_id;
-    request->event = event;
-
-    gb_operation_send_request(operation, NULL, false);
-    gb_operation_destroy(operation);
+    struct gb_power_supply_event_request request = {
+        .psy_id = psy_id,
+        .event = event,
+    };
 
-    return 0;
+    return gb_event_channel_send(&info->events, &request);
 }
 
 /**
@@ -336,10 +330,18 @@ static int gb_power_supply_init(unsigned int cport)
 
     info->cport = cport;
 
+    ret = gb_event_channel_init(&info->events, cport,
+                                GB_POWER_SUPPLY_TYPE_EVENT,
+                                sizeof(struct gb_power_supply_event_request),
+                                GB_POWER_SUPPLY_EVENTS, true);
+    if (ret) {
+        goto err_free_info;
+    }
+
     info->dev = device_open(DEVICE_TYPE_POWER_SUPPLY_DEVICE, 0);
     if (!info->dev) {
         ret = -ENODEV;
-        goto err_free_info;
+        goto err_deinit_events;
     }
 
     ret = device_power_supply_attach_callback(info->dev, event_callback);
@@ -351,6 +353,8 @@ static int gb_power_supply_init(unsigned int cport)
 
 err_close_device:
     device_close(info->dev);
+err_deinit_events:
+    gb_event_channel_deinit(&info->events);
 err_free_info:
     free(info);
 
@@ -373,6 +377,8 @@ static void gb_power_supply_exit(unsigned int cport)
 
     device_close(info->dev);
 
+    gb_event_channel_deinit(&info->events);
+
     free(info);
     info = NULL;
 }
@@ -399,6 +405,7 @@ static struct gb_driver gb_power_supply_driver = {
     .exit              = gb_power_supply_exit,
     .op_handlers       = gb_power_supply_handlers,
     .op_handlers_count = ARRAY_SIZE(gb_power_supply_handlers),
+    .worker_pool = GB_WORKER_POOL_NORMAL,
 };
 
 /**
@@ -465,6 +465,7 @@ static struct gb_driver gb_pwm_driver = {
     .exit = gb_pwm_exit,
     .op_handlers = gb_pwm_handlers,
     .op_handlers_count = ARRAY_SIZE(gb_pwm_handlers),
+    .worker_pool = GB_WORKER_POOL_NORMAL,
 };
 
 
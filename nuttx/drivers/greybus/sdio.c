@@ -26,17 +26,22 @@
  * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
 #include <debug.h>
+#include <semaphore.h>
 
 #include <nuttx/config.h>
 #include <nuttx/device.h>
 #include <nuttx/device_sdio.h>
+#include <nuttx/hires_tmr.h>
 #include <nuttx/greybus/greybus.h>
+#include <nuttx/greybus/sdio.h>
 #include <apps/greybus-utils/utils.h>
 
+#include <arch/irq.h>
 #include <arch/byteorder.h>
 
 #include "sdio-gb.h"
@@ -48,6 +53,32 @@
 #define MAX_BLOCK_SIZE_1        1024
 #define MAX_BLOCK_SIZE_2        2048
 
+/* Number of events that can wait to be sent */
+#define GB_SDIO_EVENTS          4
+
+enum gb_sdio_dir {
+    GB_SDIO_DIR_READ,
+    GB_SDIO_DIR_WRITE,
+    GB_SDIO_DIR_COUNT,
+};
+
+/**
+ * Data transfer statistics of one direction.
+ */
+struct gb_sdio_stats {
+    /** Number of successful transfers */
+    uint32_t        transfers;
+    /** Number of failed transfers */
+    uint32_t        errors;
+    /** Bytes moved by the successful transfers */
+    uint64_t        bytes;
+    /** Time spent on the bus by the successful transfers, in usec */
+    uint64_t        busy;
+    /** Start time of the first and end time of the last transfer */
+    uint32_t        first;
+    uint32_t        last;
+};
+
 /**
  * SDIO protocol private information.
  */
@@ -56,9 +87,136 @@ struct gb_sdio_info {
     unsigned int    cport;
     /** SDIO driver handle */
     struct device   *dev;
+    /** Held while a command or a data transfer uses the SDIO bus */
+    sem_t           bus_sem;
+    /** Preallocated event requests */
+    struct gb_event_channel events;
+#ifdef CONFIG_GREYBUS_SDIO_ASYNC
+    /** Transfer operation waiting for its completion callback */
+    struct gb_operation *pending;
+    /** Direction of the pending transfer */
+    enum gb_sdio_dir pending_dir;
+    /** Start time of the pending transfer */
+    uint32_t        pending_start;
+#endif
 };
 
 static struct gb_sdio_info *info = NULL;
+static struct gb_sdio_stats sdio_stats[GB_SDIO_DIR_COUNT];
+static const char * const sdio_dir_names[GB_SDIO_DIR_COUNT] = {
+    [GB_SDIO_DIR_READ] = "read",
+    [GB_SDIO_DIR_WRITE] = "write",
+};
+
+static void gb_sdio_bus_lock(void)
+{
+    while (sem_wait(&info->bus_sem) < 0) {
+        DEBUGASSERT(errno == EINTR);
+    }
+}
+
+static void gb_sdio_bus_unlock(void)
+{
+    sem_post(&info->bus_sem);
+}
+
+/**
+ * @brief Account a finished data transfer
+ *
+ * @param dir Direction of the transfer.
+ * @param size Number of bytes transferred.
+ * @param start Time the transfer was started at, in usec.
+ * @param err Result of the transfer.
+ */
+static void gb_sdio_stats_record(enum gb_sdio_dir dir, size_t size,
+                                 uint32_t start, int err)
+{
+    struct gb_sdio_stats *stats = &sdio_stats[dir];
+    uint32_t now = hrt_getusec();
+    irqstate_t flags;
+
+    flags = irqsave();
+    if (err) {
+        stats->errors++;
+    } else {
+        if (!stats->transfers) {
+            stats->first = start;
+        }
+        stats->transfers++;
+        stats->bytes += size;
+        stats->busy += now - start;
+        stats->last = now;
+    }
+    irqrestore(flags);
+}
+
+/**
+ * @brief Return a throughput in tenths of MB/s
+ *
+ * @param bytes Number of bytes transferred.
+ * @param usec Time taken to transfer them.
+ * @return The throughput, 0 if no time was accounted.
+ */
+static unsigned long gb_sdio_mbps10(uint64_t bytes, uint64_t usec)
+{
+    /* One byte per microsecond is one MB/s */
+    return usec ? (unsigned long)(bytes * 10 / usec) : 0;
+}
+
+/**
+ * @brief Print the data transfer statistics
+ *
+ * For each direction, "bus" is the throughput while a transfer is on the
+ * SDIO bus and "sustained" the throughput between the start of the first
+ * and the end of the last transfer, which includes the Greybus overhead.
+ *
+ * @param buf Buffer to print to.
+ * @param size Size of the buffer.
+ * @return Number of characters written to the buffer.
+ */
+size_t gb_sdio_dump(char *buf, size_t size)
+{
+    struct gb_sdio_stats stats;
+    unsigned long bus, sustained;
+    irqstate_t flags;
+    size_t len = 0;
+    int i;
+
+    for (i = 0; i < GB_SDIO_DIR_COUNT; i++) {
+        flags = irqsave();
+        stats = sdio_stats[i];
+        irqrestore(flags);
+
+        bus = gb_sdio_mbps10(stats.bytes, stats.busy);
+        sustained = gb_sdio_mbps10(stats.bytes,
+                                   (uint32_t)(stats.last - stats.first));
+
+        if (len >= size) {
+            return size;
+        }
+
+        len += snprintf(buf + len, size - len,
+                        "%s: %u transfers %u errors %lu KiB\n"
+                        "  bus %lu.%lu MB/s sustained %lu.%lu MB/s\n",
+                        sdio_dir_names[i], stats.transfers, stats.errors,
+                        (unsigned long)(stats.bytes / 1024),
+                        bus / 10, bus % 10, sustained / 10, sustained % 10);
+    }
+
+    return len < size ? len : size;
+}
+
+/**
+ * @brief Clear the data transfer statistics
+ */
+void gb_sdio_reset(void)
+{
+    irqstate_t flags;
+
+    flags = irqsave();
+    memset(sdio_stats, 0, sizeof(sdio_stats));
+    irqrestore(flags);
+}
 
 /**
  * @brief Return the max block length value in scale
@@ -89,22 +247,11 @@ static uint16_t scale_max_sd_block_length(uint16_t value)
  */
 static int event_callback(uint8_t event)
 {
-    struct gb_operation *operation;
-    struct gb_sdio_event_request *request;
-
-    operation = gb_operation_create(info->cport, GB_SDIO_TYPE_EVENT,
-                                    sizeof(*request));
-    if (!operation) {
-        return -ENOMEM;
-    }
-
-    request = gb_operation_get_request_payload(operation);
-    request->event = event;
+    struct gb_sdio_event_request request = {
+        .event = event,
+    };
 
-    gb_operation_send_request(operation, NULL, false);
-    gb_operation_destroy(operation);
-
-    return 0;
+    return gb_event_channel_send(&info->events, &request);
 }
 
 /**
@@ -214,7 +361,9 @@ static uint8_t gb_sdio_protocol_set_ios(struct gb_operation *operation)
     ios.timing = request->timing;
     ios.signal_voltage = request->signal_voltage;
     ios.drv_type = request->drv_type;
+    gb_sdio_bus_lock();
     ret = device_sdio_set_ios(info->dev, &ios);
+    gb_sdio_bus_unlock();
     if (ret) {
         return gb_errno_to_op_result(ret);
     }
@@ -252,7 +401,9 @@ static uint8_t gb_sdio_protocol_command(struct gb_operation *operation)
     cmd.data_blocks = le16_to_cpu(request->data_blocks);
     cmd.data_blksz = le16_to_cpu(request->data_blksz);
     cmd.resp = resp;
+    gb_sdio_bus_lock();
     ret = device_sdio_send_cmd(info->dev, &cmd);
+    gb_sdio_bus_unlock();
     if (ret && ret != -ETIMEDOUT) {
         /*
          * The Linux MMC core send pariticular command to indentify the card is
@@ -294,12 +445,65 @@ static uint8_t gb_sdio_protocol_command(struct gb_operation *operation)
     return GB_OP_SUCCESS;
 }
 
+#ifdef CONFIG_GREYBUS_SDIO_ASYNC
+/**
+ * @brief Completion callback of a non-blocking data transfer
+ *
+ * Called by the SDIO host controller driver once the pending transfer is
+ * over. It completes the transfer operation whose response was deferred.
+ *
+ * @param blocks Number of blocks transferred.
+ * @param blksz Block size.
+ * @param data Pointer to the transferred data.
+ * @param err Result of the transfer.
+ * @return 0 on success, negative errno on error.
+ */
+static int gb_sdio_transfer_done(uint16_t blocks, uint16_t blksz,
+                                 uint8_t *data, int err)
+{
+    struct gb_operation *operation = info->pending;
+    struct gb_sdio_transfer_response *response;
+
+    DEBUGASSERT(operation);
+    info->pending = NULL;
+
+    gb_sdio_stats_record(info->pending_dir, blocks * blksz,
+                         info->pending_start, err);
+
+    /*
+     * On error, the core only sends the response header: the read buffer
+     * was not cleared and must not go out.
+     */
+    if (err) {
+        blocks = 0;
+        blksz = 0;
+    }
+
+    response = gb_operation_get_response_payload(operation);
+    response->data_blocks = cpu_to_le16(blocks);
+    response->data_blksz = cpu_to_le16(blksz);
+
+    gb_operation_send_response(operation, err ? gb_errno_to_op_result(err) :
+                                                GB_OP_SUCCESS);
+    gb_operation_unref(operation);
+
+    gb_sdio_bus_unlock();
+
+    return 0;
+}
+#endif
+
 /**
  * @brief Protocol request to send and receive data.
  *
  * SDIO transfer operation allows the requester to send or receive data blocks
  * and shall be preceded by a Greybus Command Request for data transfer command
  *
+ * The response is allocated before the data moves, so that read data lands
+ * straight in it. With CONFIG_GREYBUS_SDIO_ASYNC, the transfer is only
+ * started here and the response is sent from gb_sdio_transfer_done(): the
+ * next request can be received and prepared while the data is on the bus.
+ *
  * @param operation The pointer to structure of Greybus operation.
  * @return GB_OP_SUCCESS on success, error code on failure.
  */
@@ -308,6 +512,9 @@ static uint8_t gb_sdio_protocol_transfer(struct gb_operation *operation)
     struct gb_sdio_transfer_request *request;
     struct gb_sdio_transfer_response *response;
     struct sdio_transfer transfer;
+    enum gb_sdio_dir dir;
+    uint32_t start;
+    size_t size;
     int ret;
 
     request = gb_operation_get_request_payload(operation);
@@ -319,43 +526,75 @@ static uint8_t gb_sdio_protocol_transfer(struct gb_operation *operation)
 
     transfer.blocks = le16_to_cpu(request->data_blocks);
     transfer.blksz = le16_to_cpu(request->data_blksz);
-    transfer.dma = NULL; /* NO DMA so far */
-    transfer.callback = NULL; /* NO non-blocking transfer */
+    transfer.dma = NULL; /* tsb_sdio moves the data by PIO */
+    transfer.callback = NULL;
+    size = transfer.blocks * transfer.blksz;
 
     if (request->data_flags & GB_SDIO_DATA_WRITE) {
         if (!request->data) {
             return GB_OP_INVALID;
         }
-        transfer.data = request->data;
-        ret = device_sdio_write(info->dev, &transfer);
-        if (ret) {
-            return gb_errno_to_op_result(ret);
-        }
         response = gb_operation_alloc_response(operation, sizeof(*response));
         if (!response) {
             return GB_OP_NO_MEMORY;
         }
-        response->data_blocks = cpu_to_le16(transfer.blocks);
-        response->data_blksz = cpu_to_le16(transfer.blksz);
+        transfer.data = request->data;
+        dir = GB_SDIO_DIR_WRITE;
     } else if (request->data_flags & GB_SDIO_DATA_READ) {
-        response = gb_operation_alloc_response(operation, sizeof(*response) +
-                                                          transfer.blocks *
-                                                          transfer.blksz);
+        response = gb_operation_alloc_zc_response(operation,
+                                                  sizeof(*response) + size);
         if (!response) {
             return GB_OP_NO_MEMORY;
         }
         transfer.data = response->data;
-        ret = device_sdio_read(info->dev, &transfer);
-        if (ret) {
-            return gb_errno_to_op_result(ret);
-        }
-        response->data_blocks = cpu_to_le16(transfer.blocks);
-        response->data_blksz = cpu_to_le16(transfer.blksz);
+        dir = GB_SDIO_DIR_READ;
     } else {
         return GB_OP_INVALID;
     }
 
+    gb_sdio_bus_lock();
+    start = hrt_getusec();
+
+#ifdef CONFIG_GREYBUS_SDIO_ASYNC
+    /* The callback may run before device_sdio_{read,write}() returns */
+    transfer.callback = gb_sdio_transfer_done;
+    info->pending = operation;
+    info->pending_dir = dir;
+    info->pending_start = start;
+    gb_operation_defer_response(operation);
+#endif
+
+    if (dir == GB_SDIO_DIR_WRITE) {
+        ret = device_sdio_write(info->dev, &transfer);
+    } else {
+        ret = device_sdio_read(info->dev, &transfer);
+    }
+
+#ifdef CONFIG_GREYBUS_SDIO_ASYNC
+    if (!ret) {
+        return GB_OP_SUCCESS;
+    }
+
+    /* The transfer did not start: complete the operation here */
+    info->pending = NULL;
+    gb_sdio_bus_unlock();
+    gb_sdio_stats_record(dir, 0, start, ret);
+    gb_operation_send_response(operation, gb_errno_to_op_result(ret));
+    gb_operation_unref(operation);
+
+    return GB_OP_SUCCESS;
+#else
+    gb_sdio_bus_unlock();
+    gb_sdio_stats_record(dir, size, start, ret);
+    if (ret) {
+        return gb_errno_to_op_result(ret);
+    }
+
+    response->data_blocks = cpu_to_le16(transfer.blocks);
+    response->data_blksz = cpu_to_le16(transfer.blksz);
+
     return GB_OP_SUCCESS;
+#endif
 }
 
 /**
@@ -377,11 +616,20 @@ static int gb_sdio_init(unsigned int cport)
     }
 
     info->cport = cport;
+    sem_init(&info->bus_sem, 0, 1);
+
+    /* Insertion and removal must keep their order: no coalescing */
+    ret = gb_event_channel_init(&info->events, cport, GB_SDIO_TYPE_EVENT,
+                                sizeof(struct gb_sdio_event_request),
+                                GB_SDIO_EVENTS, false);
+    if (ret) {
+        goto err_free_info;
+    }
 
     info->dev = device_open(DEVICE_TYPE_SDIO_HW, 0);
     if (!info->dev) {
         ret = -ENODEV;
-        goto err_free_info;
+        goto err_deinit_events;
     }
 
     ret = device_sdio_attach_callback(info->dev, event_callback);
@@ -393,7 +641,10 @@ static int gb_sdio_init(unsigned int cport)
 
 err_close_device:
     device_close(info->dev);
+err_deinit_events:
+    gb_event_channel_deinit(&info->events);
 err_free_info:
+    sem_destroy(&info->bus_sem);
     free(info);
 
     return ret;
@@ -411,10 +662,16 @@ static void gb_sdio_exit(unsigned int cport)
 {
     DEBUGASSERT(cport == info->cport);
 
+    /* Wait for a pending transfer to complete */
+    gb_sdio_bus_lock();
+
     device_sdio_attach_callback(info->dev, NULL);
 
     device_close(info->dev);
 
+    gb_event_channel_deinit(&info->events);
+
+    sem_destroy(&info->bus_sem);
     free(info);
     info = NULL;
 }
@@ -44,7 +44,72 @@
 #define GB_SPI_VERSION_MAJOR 0
 #define GB_SPI_VERSION_MINOR 1
 
+/**
+ * SPI settings last applied to the device, so that the transfers of a request
+ * skip the settings that did not change. Other users of the device may
+ * reconfigure it whenever the bus is unlocked, so this is only valid while
+ * the bus is locked.
+ */
+struct gb_spi_settings {
+    /** The fields below match the device */
+    bool valid;
+    uint16_t mode;
+    uint8_t bits_per_word;
+    uint32_t speed_hz;
+};
+
 static struct device *spi_dev = NULL;
+static struct gb_spi_settings spi_settings;
+
+/**
+ * @brief Apply the settings of a transfer to the SPI device
+ *
+ * Only the settings that differ from the ones last applied are written.
+ * This function should be called with the SPI bus locked.
+ *
+ * @param mode SPI mode
+ * @param bits_per_word number of bits per word
+ * @param speed_hz SPI clock requested
+ * @return 0 on success, negative errno on error
+ */
+static int gb_spi_configure(uint16_t mode, uint8_t bits_per_word,
+                            uint32_t speed_hz)
+{
+    bool valid = spi_settings.valid;
+    uint32_t freq;
+    int ret;
+
+    /* on error, the device is left in an unknown state */
+    spi_settings.valid = false;
+
+    if (!valid || spi_settings.mode != mode) {
+        ret = device_spi_setmode(spi_dev, mode);
+        if (ret) {
+            return ret;
+        }
+        spi_settings.mode = mode;
+    }
+
+    if (!valid || spi_settings.bits_per_word != bits_per_word) {
+        ret = device_spi_setbits(spi_dev, bits_per_word);
+        if (ret) {
+            return ret;
+        }
+        spi_settings.bits_per_word = bits_per_word;
+    }
+
+    if (!valid || spi_settings.speed_hz != speed_hz) {
+        freq = speed_hz;
+        ret = device_spi_setfrequency(spi_dev, &freq);
+        if (ret) {
+            return ret;
+        }
+        spi_settings.speed_hz = speed_hz;
+    }
+
+    spi_settings.valid = true;
+    return 0;
+}
 
 /**
  * @brief Returns the major and minor Greybus SPI protocol version number
@@ -181,23 +246,26 @@ static uint8_t gb_spi_protocol_num_chipselect(struct gb_operation *operation)
  * @brief Performs a SPI transaction as one or more SPI transfers, defined
  *        in the supplied array.
  *
+ * The data of consecutive transfers is contiguous in the request and in the
+ * response, so consecutive transfers with the same settings, no delay and no
+ * chip-select change between them are done as a single exchange.
+ *
  * @param operation pointer to structure of Greybus operation message
  * @return GB_OP_SUCCESS on success, error code on failure
  */
 static uint8_t gb_spi_protocol_transfer(struct gb_operation *operation)
 {
-    int i, op_count;
-    uint32_t size = 0;
+    int i, count, op_count;
+    uint32_t size = 0, len;
     int ret = 0, errcode = GB_OP_SUCCESS;
     uint8_t *write_data;
     uint8_t *read_buf;
-    uint32_t freq = 0;
     bool selected = false;
     struct device_spi_transfer transfer;
     size_t request_size = gb_operation_get_request_payload_size(operation);
     size_t expected_size;
 
-    struct gb_spi_transfer_desc *desc;
+    struct gb_spi_transfer_desc *desc, *last;
     struct gb_spi_transfer_request *request;
     struct gb_spi_transfer_response *response;
 
@@ -221,7 +289,8 @@ static uint8_t gb_spi_protocol_transfer(struct gb_operation *operation)
         size += le32_to_cpu(desc->len);
     }
 
-    response = gb_operation_alloc_response(operation, size);
+    /* every byte of the response is written by the transfers below */
+    response = gb_operation_alloc_zc_response(operation, size);
     if (!response) {
         return GB_OP_NO_MEMORY;
     }
@@ -233,25 +302,30 @@ static uint8_t gb_spi_protocol_transfer(struct gb_operation *operation)
         return (ret == -EINVAL)? GB_OP_INVALID : GB_OP_UNKNOWN_ERROR;
     }
 
-    /* set SPI mode */
-    ret = device_spi_setmode(spi_dev, request->mode);
-    if (ret) {
-        goto spi_err;
-    }
+    /* someone else may have configured the device since we last held it */
+    spi_settings.valid = false;
 
     /* parse all transfer request from AP host side */
-    for (i = 0; i < op_count; i++) {
+    for (i = 0; i < op_count; i += count) {
         desc = &request->transfers[i];
-        freq = le32_to_cpu(desc->speed_hz);
-
-        /* set SPI bits-per-word */
-        ret = device_spi_setbits(spi_dev, desc->bits_per_word);
-        if (ret) {
-            goto spi_err;
+        len = le32_to_cpu(desc->len);
+
+        /* merge the following transfers that can share the exchange */
+        last = desc;
+        for (count = 1; i + count < op_count; count++) {
+            if (last->cs_change || le16_to_cpu(last->delay_usecs) ||
+                request->transfers[i + count].bits_per_word !=
+                desc->bits_per_word ||
+                request->transfers[i + count].speed_hz != desc->speed_hz) {
+                break;
+            }
+            last = &request->transfers[i + count];
+            len += le32_to_cpu(last->len);
         }
 
-        /* set SPI clock */
-        ret = device_spi_setfrequency(spi_dev, &freq);
+        /* set SPI mode, bits-per-word and clock */
+        ret = gb_spi_configure(request->mode, desc->bits_per_word,
+                               le32_to_cpu(desc->speed_hz));
         if (ret) {
             goto spi_err;
         }
@@ -269,7 +343,7 @@ static uint8_t gb_spi_protocol_transfer(struct gb_operation *operation)
         memset(&transfer, 0, sizeof(struct device_spi_transfer));
         transfer.txbuffer = write_data;
         transfer.rxbuffer = read_buf;
-        transfer.nwords = le32_to_cpu(desc->len);
+        transfer.nwords = len;
         transfer.flags = SPI_FLAG_DMA_TRNSFER; // synchronous & DMA transfer
 
         /* start SPI transfer */
@@ -278,15 +352,15 @@ static uint8_t gb_spi_protocol_transfer(struct gb_operation *operation)
             goto spi_err;
         }
         /* move to next gb_spi_transfer data buffer */
-        write_data += le32_to_cpu(desc->len);
-        read_buf += le32_to_cpu(desc->len);
+        write_data += len;
+        read_buf += len;
 
-        if (le16_to_cpu(desc->delay_usecs) > 0) {
-            usleep(le16_to_cpu(desc->delay_usecs));
+        if (le16_to_cpu(last->delay_usecs) > 0) {
+            usleep(le16_to_cpu(last->delay_usecs));
         }
 
         /* if cs_change enable, change the chip-select pin signal */
-        if (desc->cs_change) {
+        if (last->cs_change) {
             /* force deassert chip-select pin */
             ret = device_spi_deselect(spi_dev, request->chip_select);
             if (ret) {
@@ -328,6 +402,8 @@ spi_err:
  */
 static int gb_spi_init(unsigned int cport)
 {
+    spi_settings.valid = false;
+
     if (!spi_dev) {
         spi_dev = device_open(DEVICE_TYPE_SPI_HW, 0);
         if (!spi_dev) {
@@ -391,6 +467,7 @@ int gb_spi_set_dev(struct device *dev)
         spi_dev = dev;
     else
         return -EBUSY;
+    spi_settings.valid = false;
     return 0;
 }
 
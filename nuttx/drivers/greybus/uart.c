@@ -36,10 +36,13 @@
 #include <nuttx/device.h>
 #include <nuttx/device_uart.h>
 #include <nuttx/util.h>
+#include <nuttx/wdog.h>
+#include <nuttx/clock.h>
 #include <nuttx/config.h>
 #include <nuttx/greybus/types.h>
 #include <nuttx/greybus/greybus.h>
 #include <nuttx/greybus/debug.h>
+#include <nuttx/greybus/uart.h>
 #include <nuttx/unipro/unipro.h>
 #include <apps/greybus-utils/utils.h>
 #include <arch/byteorder.h>
@@ -50,8 +53,11 @@
 #define GB_UART_VERSION_MINOR   1
 
 /* Reserved operations for rx data buffer. */
-#define MAX_RX_OPERATION        5
-#define MAX_RX_BUF_SIZE         256
+#define MAX_RX_OPERATION        CONFIG_GREYBUS_UART_RX_OPERATIONS
+#define MAX_RX_BUF_SIZE         CONFIG_GREYBUS_UART_RX_BUFSIZE
+
+/* Receiving buffer used while no operation is free, its content is dropped */
+#define RX_DISCARD_BUF_SIZE     16
 
 /* The id of error in protocol operating. */
 #define GB_UART_EVENT_PROTOCOL_ERROR    1
@@ -71,6 +77,22 @@ struct op_node {
     uint8_t             *data_flags;
     /** pointer to buffer of request in operation */
     uint8_t             *buffer;
+    /** number of characters received in buffer */
+    int                 fill;
+};
+
+/**
+ * Receiving statistics.
+ */
+struct gb_uart_rx_stats {
+    /** receive operations sent */
+    uint32_t            operations;
+    /** characters sent in receive operations */
+    uint32_t            bytes;
+    /** characters dropped for lack of operation or on send errors */
+    uint32_t            dropped;
+    /** receive operations that failed to be sent */
+    uint32_t            send_errors;
 };
 
 /**
@@ -103,8 +125,18 @@ struct gb_uart_info {
     int                 rx_buf_size;
     /** amount of operations */
     int                 entries;
-    /** flag for requesting a free operation in callback */
-    int                 require_node;
+    /** idle time before sending a partially filled operation, in ticks */
+    int                 rx_idle_ticks;
+    /** timer of the idle time */
+    struct wdog_s       rx_idle_wd;
+    /** the receiving is flushed by the idle timer */
+    bool                rx_flush;
+    /** receiving in rx_discard_buf as no operation was free */
+    bool                rx_discard;
+    /** flags to report in the next operation for the dropped characters */
+    uint8_t             rx_lost_flags;
+    /** buffer to keep the receiver running while no operation is free */
+    uint8_t             rx_discard_buf[RX_DISCARD_BUF_SIZE];
     /** semaphore for notifying data received */
     sem_t               rx_sem;
     /** receiving data process threed */
@@ -118,6 +150,9 @@ struct gb_uart_info {
 /* The structure for keeping protocol global data. */
 static struct gb_uart_info *info = NULL;
 
+/* Receiving statistics, kept across connections */
+static struct gb_uart_rx_stats rx_stats;
+
 /**
  * @brief Put the node to the back of the queue.
  *
@@ -282,29 +317,15 @@ static void uart_ls_callback(uint8_t ls)
 }
 
 /**
- * @brief Callback for data receiving
- *
- * The callback function provided to device driver for being notified when
- * driver received a data stream.
- *
- * This function Must be called from interrupt context.
+ * @brief Convert the line errors of the driver to receive flags
  *
- * It put the current operation to received queue and gets another operation to
- * continue receiving. Then notifies rx thread to process.
- *
- * @param buffer Data buffer.
- * @param length Received data length.
- * @param error Error code when driver receiving.
- * @return None.
+ * @param error Line status errors reported by the driver.
+ * @return The receive data flags of the protocol.
  */
-static void uart_rx_callback(uint8_t *buffer, int length, int error)
+static uint8_t uart_rx_flags(int error)
 {
-    struct op_node *node;
-    int ret;
     uint8_t flags = 0;
 
-    *info->rx_node->data_size = cpu_to_le16(length);
-
     if (error & LSR_OE) {
         flags |= GB_UART_RECV_FLAG_OVERRUN;
     }
@@ -317,28 +338,151 @@ static void uart_rx_callback(uint8_t *buffer, int length, int error)
     if (error & LSR_BI) {
         flags |= GB_UART_RECV_FLAG_BREAK;
     }
-    *info->rx_node->data_flags = flags;
 
-    put_node_back(&info->data_queue, info->rx_node);
+    return flags;
+}
+
+/**
+ * @brief Pass a filled operation to the rx thread
+ *
+ * The operation message is cut down to the characters received, so that only
+ * them are sent.
+ *
+ * This function must be called with interrupts disabled.
+ *
+ * @param node The node of the operation.
+ * @return None.
+ */
+static void uart_rx_queue(struct op_node *node)
+{
+    struct gb_operation_hdr *hdr = node->operation->request_buffer;
+
+    *node->data_size = cpu_to_le16(node->fill);
+    hdr->size = cpu_to_le16(sizeof(*hdr) +
+                            sizeof(struct gb_uart_receive_data_request) +
+                            node->fill);
+
+    sq_addlast(&node->entry, &info->data_queue);
     /* notify rx thread to process this data*/
     sem_post(&info->rx_sem);
+}
 
-    node = get_node_from(&info->free_queue);
+static void uart_rx_callback(uint8_t *buffer, int length, int error);
+
+/**
+ * @brief Start the receiver
+ *
+ * The receiver fills the remaining space of the current operation, or of a
+ * free one. When no operation is free, the receiver keeps on running in a
+ * discard buffer rather than stalling, and the characters it gets are
+ * dropped. The next operation then reports an overrun.
+ *
+ * This function must be called with interrupts disabled.
+ *
+ * @param None.
+ * @return None.
+ */
+static void uart_rx_start(void)
+{
+    struct op_node *node = info->rx_node;
+    uint8_t *buffer;
+    int length;
+    int ret;
 
     if (!node) {
-        /*
-         * there is no free buffer, inform the rx thread to engage another uart
-         * receiver.
-         */
-        info->require_node = 1;
-        return;
+        node = get_node_from(&info->free_queue);
+        if (node) {
+            node->fill = 0;
+            *node->data_flags = info->rx_lost_flags;
+            info->rx_lost_flags = 0;
+            info->rx_node = node;
+        }
     }
 
-    info->rx_node = node;
-    ret = device_uart_start_receiver(info->dev, node->buffer, info->rx_buf_size,
-                                     NULL, NULL, uart_rx_callback);
+    if (node) {
+        buffer = node->buffer + node->fill;
+        length = info->rx_buf_size - node->fill;
+        info->rx_discard = false;
+    } else {
+        buffer = info->rx_discard_buf;
+        length = sizeof(info->rx_discard_buf);
+        info->rx_discard = true;
+    }
+
+    ret = device_uart_start_receiver(info->dev, buffer, length, NULL, NULL,
+                                     uart_rx_callback);
     if (ret) {
-        uart_report_error(GB_UART_EVENT_PROTOCOL_ERROR, __func__);
+        uart_report_error(GB_UART_EVENT_DEVICE_ERROR, __func__);
+    }
+}
+
+/**
+ * @brief Idle timer handler
+ *
+ * No character was received for the idle time: flush the receiver so that
+ * the partially filled operation is sent.
+ *
+ * @param argc The number of arguments.
+ * @param arg Unused.
+ * @return None.
+ */
+static void uart_rx_idle(int argc, uint32_t arg, ...)
+{
+    info->rx_flush = true;
+    if (device_uart_flush_receiver(info->dev)) {
+        info->rx_flush = false;
+    }
+}
+
+/**
+ * @brief Callback for data receiving
+ *
+ * The callback function provided to device driver for being notified when
+ * driver received a data stream.
+ *
+ * This function Must be called from interrupt context.
+ *
+ * The characters are accumulated in the current operation, which is passed
+ * to the rx thread once it is full, on line errors or when no character was
+ * received for the idle time. The receiver is then restarted right away.
+ *
+ * @param buffer Data buffer.
+ * @param length Received data length.
+ * @param error Error code when driver receiving.
+ * @return None.
+ */
+static void uart_rx_callback(uint8_t *buffer, int length, int error)
+{
+    struct op_node *node = info->rx_node;
+    uint8_t flags = uart_rx_flags(error);
+    bool flush = info->rx_flush;
+
+    info->rx_flush = false;
+    wd_cancel(&info->rx_idle_wd);
+
+    if (info->rx_discard) {
+        rx_stats.dropped += length;
+        if (length) {
+            flags |= GB_UART_RECV_FLAG_OVERRUN;
+        }
+        info->rx_lost_flags |= flags;
+        uart_rx_start();
+        return;
+    }
+
+    node->fill += length;
+    *node->data_flags |= flags;
+
+    if (node->fill && (flush || flags || node->fill == info->rx_buf_size ||
+                       !info->rx_idle_ticks)) {
+        info->rx_node = NULL;
+        uart_rx_queue(node);
+    }
+
+    uart_rx_start();
+
+    if (info->rx_node && info->rx_node->fill) {
+        wd_start(&info->rx_idle_wd, info->rx_idle_ticks, uart_rx_idle, 0);
     }
 }
 
@@ -414,9 +558,9 @@ static void *uart_status_thread(void *data)
  * @brief Data receiving process thread
  *
  * This function is the thread for processing data receiving tasks. When
- * it wake up, it checks the receiving queue for processing the come in data.
- * If protocol is running out of operation, once it gets a free operation,
- * it passes to driver for continuing the receiving.
+ * it wake up, it sends the filled operations and gives them back to the
+ * receiver. If the receiver was dropping characters for lack of operation,
+ * it is flushed to restart in the operation just freed.
  *
  * @param data The regular thread data.
  * @return None.
@@ -424,6 +568,7 @@ static void *uart_status_thread(void *data)
 static void *uart_rx_thread(void *data)
 {
     struct op_node *node = NULL;
+    irqstate_t flags;
     int ret;
 
     while (1) {
@@ -434,27 +579,30 @@ static void *uart_rx_thread(void *data)
         }
 
         node = get_node_from(&info->data_queue);
-        if (node) {
-            ret = gb_operation_send_request(node->operation, NULL, false);
-            if (ret) {
-                uart_report_error(GB_UART_EVENT_PROTOCOL_ERROR, __func__);
-            }
-            put_node_back(&info->free_queue, node);
+        if (!node) {
+            continue;
         }
 
-        /*
-         * In case there is no free node in callback.
-         */
-        if (info->require_node) {
-            node = get_node_from(&info->free_queue);
-            info->rx_node = node;
-            ret = device_uart_start_receiver(info->dev, node->buffer,
-                                             info->rx_buf_size, NULL, NULL,
-                                             uart_rx_callback);
-            if (ret) {
-                uart_report_error(GB_UART_EVENT_DEVICE_ERROR, __func__);
-            }
-            info->require_node = 0;
+        ret = gb_operation_send_request(node->operation, NULL, false);
+
+        flags = irqsave();
+        if (ret) {
+            rx_stats.send_errors++;
+            rx_stats.dropped += node->fill;
+        } else {
+            rx_stats.operations++;
+            rx_stats.bytes += node->fill;
+        }
+        irqrestore(flags);
+
+        if (ret) {
+            uart_report_error(GB_UART_EVENT_PROTOCOL_ERROR, __func__);
+        }
+
+        put_node_back(&info->free_queue, node);
+
+        if (info->rx_discard) {
+            device_uart_flush_receiver(info->dev);
         }
     }
 
@@ -545,6 +693,12 @@ static void uart_receiver_cb_deinit(void)
 
     sem_destroy(&info->rx_sem);
 
+    wd_delete(&info->rx_idle_wd);
+
+    if (info->rx_node) {
+        put_node_back(&info->free_queue, info->rx_node);
+        info->rx_node = NULL;
+    }
     uart_free_op(&info->data_queue);
     uart_free_op(&info->free_queue);
 }
@@ -569,6 +723,9 @@ static int uart_receiver_cb_init(void)
 
     info->entries = MAX_RX_OPERATION;
     info->rx_buf_size = MAX_RX_BUF_SIZE;
+    info->rx_idle_ticks = (CONFIG_GREYBUS_UART_RX_IDLE_TIMEOUT +
+                           USEC_PER_TICK - 1) / USEC_PER_TICK;
+    wd_static(&info->rx_idle_wd);
 
     ret = uart_alloc_op(info->entries, info->rx_buf_size, &info->free_queue);
     if (ret) {
@@ -595,6 +752,38 @@ err_free_data_op:
     return -ret;
 }
 
+/**
+ * @brief Print the receiving statistics
+ *
+ * The number of characters per operation shows how well the received
+ * characters are coalesced.
+ *
+ * @param buf Buffer to print to.
+ * @param size Size of the buffer.
+ * @return Number of characters written to the buffer.
+ */
+size_t gb_uart_dump(char *buf, size_t size)
+{
+    struct gb_uart_rx_stats stats;
+    unsigned long per_op;
+    irqstate_t flags;
+    size_t len;
+
+    flags = irqsave();
+    stats = rx_stats;
+    irqrestore(flags);
+
+    per_op = stats.operations ? stats.bytes * 10 / stats.operations : 0;
+
+    len = snprintf(buf, size,
+                   "rx: %u operations %u bytes %lu.%lu bytes/operation\n"
+                   "  %u dropped %u send errors\n",
+                   stats.operations, stats.bytes, per_op / 10, per_op % 10,
+                   stats.dropped, stats.send_errors);
+
+    return len < size ? len : size;
+}
+
 /**
  * @brief Protocol get version function.
  *
@@ -817,6 +1006,7 @@ static int gb_uart_init(unsigned int cport)
 {
     int ret;
     uint8_t ms = 0, ls = 0;
+    irqstate_t flags;
 
     info = zalloc(sizeof(*info));
     if (info == NULL) {
@@ -866,9 +1056,15 @@ static int gb_uart_init(unsigned int cport)
         goto err_clr_ms_callback;
     }
 
+    /* the idle timeout needs to flush the receiver */
+    if (device_uart_flush_receiver(info->dev) == -ENOSYS) {
+        info->rx_idle_ticks = 0;
+    }
+
     /* trigger the first receiving */
-    info->require_node = 1;
-    sem_post(&info->rx_sem);
+    flags = irqsave();
+    uart_rx_start();
+    irqrestore(flags);
 
     return 0;
 
@@ -900,6 +1096,8 @@ static void gb_uart_exit(unsigned int cport)
 
     device_uart_attach_ms_callback(info->dev, NULL);
 
+    wd_cancel(&info->rx_idle_wd);
+
     device_close(info->dev);
 
     uart_receiver_cb_deinit();
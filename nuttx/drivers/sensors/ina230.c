@@ -452,6 +452,10 @@ int ina230_get_data(ina230_device *dev, ina230_sample *m)
     int ret;
     int16_t raw_vbus, raw_current;
     int64_t power_tmp;
+    uint8_t reg_vbus = INA230_BUS_VOLTAGE;
+    uint8_t reg_current = INA230_CURRENT;
+    uint8_t buf_vbus[2], buf_current[2];
+    struct i2c_msg_s msg[4];
 
     if ((!dev) || (!m)) {
         return -EINVAL;
@@ -460,14 +464,37 @@ int ina230_get_data(ina230_device *dev, ina230_sample *m)
     m->uA = 0;
     m->uW = 0;
 
-    ret = ina230_i2c_get(dev->i2c_dev, dev->addr,
-                         INA230_BUS_VOLTAGE, (uint16_t *) &raw_vbus);
-    ret = ret || ina230_i2c_get(dev->i2c_dev, dev->addr,
-                                INA230_CURRENT, (uint16_t *) &raw_current);
+    /*
+     * The register pointer does not auto-increment on reads, so both
+     * registers need their own pointer write. Chain them with repeated
+     * starts in a single transfer rather than arbitrating for the bus
+     * twice.
+     */
+    msg[0].addr = dev->addr;
+    msg[0].flags = 0;
+    msg[0].buffer = &reg_vbus;
+    msg[0].length = 1;
+    msg[1].addr = dev->addr;
+    msg[1].flags = I2C_M_READ;
+    msg[1].buffer = buf_vbus;
+    msg[1].length = 2;
+    msg[2].addr = dev->addr;
+    msg[2].flags = 0;
+    msg[2].buffer = &reg_current;
+    msg[2].length = 1;
+    msg[3].addr = dev->addr;
+    msg[3].flags = I2C_M_READ;
+    msg[3].buffer = buf_current;
+    msg[3].length = 2;
+
+    ret = I2C_TRANSFER(dev->i2c_dev, msg, ARRAY_SIZE(msg));
     if (ret) {
         dbg_error("%s(): failed to read data registers! (%d)\n", __func__, ret);
         return -EIO;
     }
+    raw_vbus = (int16_t) (((uint16_t) buf_vbus[0] << 8) | buf_vbus[1]);
+    raw_current = (int16_t) (((uint16_t) buf_current[0] << 8) |
+                             buf_current[1]);
     dbg_verbose("%s(): addr=0x%02X raw_vbus=0x%04X raw_current=0x%04X\n",
                 __func__, dev->addr, raw_vbus, raw_current);
 
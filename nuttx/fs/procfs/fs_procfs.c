@@ -96,6 +96,14 @@ extern const struct procfs_operations smartfs_procfsoperations;
 extern const struct procfs_operations ccm_procfsoperations;
 #endif
 
+#if defined(CONFIG_GREYBUS) && !defined(CONFIG_FS_PROCFS_EXCLUDE_GREYBUS)
+extern const struct procfs_operations gb_procfsoperations;
+#endif
+
+#if defined(CONFIG_MM_BUFRAM_ALLOCATOR) && !defined(CONFIG_FS_PROCFS_EXCLUDE_BUFRAM)
+extern const struct procfs_operations bufram_procfsoperations;
+#endif
+
 /****************************************************************************
  * Private Types
  ****************************************************************************/
@@ -132,6 +140,28 @@ static const struct procfs_entry_s g_procfsentries[] =
 #if defined(CONFIG_STM32_CCM_PROCFS) && !defined(CONFIG_FS_PROCFS_EXCLUDE_CCM)
   { "ccm",             &ccm_procfsoperations },
 #endif
+
+#if defined(CONFIG_MM_BUFRAM_ALLOCATOR) && !defined(CONFIG_FS_PROCFS_EXCLUDE_BUFRAM)
+  { "bufram",           &bufram_procfsoperations },
+#endif
+
+#if defined(CONFIG_GREYBUS) && !defined(CONFIG_FS_PROCFS_EXCLUDE_GREYBUS)
+#if defined(CONFIG_GREYBUS_MEMPOOL)
+  { "greybus/mempool", &gb_procfsoperations },
+#endif
+#if defined(CONFIG_GREYBUS_LATENCY)
+  { "greybus/latency", &gb_procfsoperations },
+#endif
+#if defined(CONFIG_GREYBUS_AUDIO)
+  { "greybus/audio", &gb_procfsoperations },
+#endif
+#if defined(CONFIG_GREYBUS_SDIO_PHY)
+  { "greybus/sdio", &gb_procfsoperations },
+#endif
+#if defined(CONFIG_GREYBUS_UART_PHY)
+  { "greybus/uart", &gb_procfsoperations },
+#endif
+#endif
 };
 
 static const uint8_t g_procfsentrycount = sizeof(g_procfsentries) /
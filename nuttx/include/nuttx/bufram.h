@@ -46,5 +46,8 @@ void bufram_page_free(void *ptr, size_t page_count);
 
 size_t bufram_size_to_page_count(size_t size);
 
+/* render the free lists and the allocator counters, see /proc/bufram */
+size_t bufram_dump(char *buf, size_t size);
+
 #endif /* __NUTTX_MM_BUFRAM_H__ */
 
@@ -81,6 +81,9 @@
 #define DEVICE_DMA_CALLBACK_EVENT_DEQUEUED  BIT(2)
 #define DEVICE_DMA_CALLBACK_EVENT_ERROR     BIT(3)
 
+/* Channel options */
+#define DEVICE_DMA_CHAN_FLAG_IRQ_CALLBACK   BIT(0) /* callbacks in interrupt */
+
 /* Alignments for the source and destination address */
 #define DEVICE_DMA_ALIGNMENT_8              BIT(0)
 #define DEVICE_DMA_ALIGNMENT_16             BIT(1)
@@ -146,6 +149,7 @@ struct device_dma_params {
     unsigned int transfer_size;
     unsigned int burst_len;
     unsigned int swap;
+    unsigned int flags; /* DEVICE_DMA_CHAN_FLAG_*, honored if supported */
 };
 
 struct device_dma_type_ops {
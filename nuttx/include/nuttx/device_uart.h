@@ -119,6 +119,8 @@ struct device_uart_type_ops {
                                            int error));
     /** UART stop_receiver() function pointer */
     int (*stop_receiver)(struct device *dev);
+    /** UART flush_receiver() function pointer */
+    int (*flush_receiver)(struct device *dev);
 };
 
 /**
@@ -432,4 +434,28 @@ static inline int device_uart_stop_receiver(struct device *dev)
     return -ENOSYS;
 }
 
+/**
+ * @brief UART flush_receiver function
+ *
+ * The function completes a non-blocking receiving with the data received so
+ * far: the callback is called as if the buffer was full. Unlike
+ * stop_receiver(), the characters still in the receiver FIFO are kept for the
+ * next receiving.
+ *
+ * @param dev pointer to the UART device structure
+ * @return 0 for success, -errno for failures.
+ */
+static inline int device_uart_flush_receiver(struct device *dev)
+{
+    DEVICE_DRIVER_ASSERT_OPS(dev);
+
+    if (!device_is_open(dev))
+        return -ENODEV;
+
+    if (DEVICE_DRIVER_GET_OPS(dev, uart)->flush_receiver)
+        return DEVICE_DRIVER_GET_OPS(dev, uart)->flush_receiver(dev);
+
+    return -ENOSYS;
+}
+
 #endif /* __INCLUDE_NUTTX_DEVICE_UART_H */
@@ -98,23 +98,34 @@ struct gb_transport_backend {
     int (*send)(unsigned int cport, const void *buf, size_t len);
     void *(*alloc_buf)(size_t size);
     void (*free_buf)(void *ptr);
+
+    /*
+     * Optional zero-copy TX: alloc_tx_buf() lends a buffer ready to be handed
+     * to the hardware, and send_tx_buf() queues it and takes its ownership
+     * on success. A lent buffer that is not sent is released with free_buf().
+     */
+    void *(*alloc_tx_buf)(unsigned int cport, size_t size);
+    int (*send_tx_buf)(unsigned int cport, void *buf, size_t len);
 };
 
 struct gb_operation {
     unsigned int cport;
     bool has_responded;
+    bool response_deferred;
     atomic_t ref_count;
     struct timespec time;
 
     void *request_buffer;
     void *response_buffer;
     bool is_unipro_rx_buf;
+    bool is_tx_buf_response;
 
     gb_operation_callback callback;
     sem_t sync_sem;
 
     void *priv_data;
     struct list_head list;
+    struct list_head inflight_list;
 
     struct gb_operation *response;
 
@@ -122,6 +133,22 @@ struct gb_operation {
     struct timespec send_ts;
     struct timespec recv_ts;
 #endif
+
+#ifdef CONFIG_GREYBUS_LATENCY
+    uint32_t rx_usec;
+    uint32_t tx_usec;
+#endif
+};
+
+/*
+ * Worker servicing the messages of a cport. The worker pools are only
+ * available with CONFIG_GREYBUS_WORKER_POOL, drivers fall back to a
+ * dedicated worker otherwise.
+ */
+enum gb_worker_type {
+    GB_WORKER_DEDICATED,
+    GB_WORKER_POOL_NORMAL,
+    GB_WORKER_POOL_HIGH,
 };
 
 struct gb_driver {
@@ -133,10 +160,33 @@ struct gb_driver {
     struct gb_operation_handler *op_handlers;
 
     size_t stack_size;
+    enum gb_worker_type worker_pool;
     size_t op_handlers_count;
     const char *name;
 };
 
+struct gb_event_op;
+
+/*
+ * Unidirectional requests reporting events, sent from operations allocated
+ * once by gb_event_channel_init(). gb_event_channel_send() can be called from
+ * interrupt context: it only queues the event, the request is sent by the
+ * worker of the cport. With coalesce set, an event identical to one still
+ * waiting to be sent is merged into it.
+ */
+struct gb_event_channel {
+    unsigned int cport;
+    size_t payload_size;
+    bool coalesce;
+    unsigned int count;
+    struct gb_event_op *events;
+    struct list_head free;
+
+    uint32_t sent;
+    uint32_t coalesced;
+    uint32_t dropped;
+};
+
 struct gb_operation_hdr {
     __le16 size;
     __le16 id;
@@ -215,7 +265,10 @@ int gb_notify(unsigned cport, enum gb_event event);
 
 void gb_operation_destroy(struct gb_operation *operation);
 void *gb_operation_alloc_response(struct gb_operation *operation, size_t size);
+void *gb_operation_alloc_zc_response(struct gb_operation *operation,
+                                     size_t size);
 int gb_operation_send_response(struct gb_operation *operation, uint8_t result);
+void gb_operation_defer_response(struct gb_operation *operation);
 int gb_operation_send_request_sync(struct gb_operation *operation);
 int gb_operation_send_request(struct gb_operation *operation,
                               gb_operation_callback callback,
@@ -226,6 +279,12 @@ void gb_operation_ref(struct gb_operation *operation);
 void gb_operation_unref(struct gb_operation *operation);
 size_t gb_operation_get_request_payload_size(struct gb_operation *operation);
 uint8_t gb_operation_get_request_result(struct gb_operation *operation);
+int gb_event_channel_init(struct gb_event_channel *channel, unsigned int cport,
+                          uint8_t type, size_t payload_size,
+                          unsigned int count, bool coalesce);
+void gb_event_channel_deinit(struct gb_event_channel *channel);
+int gb_event_channel_send(struct gb_event_channel *channel,
+                          const void *payload);
 int greybus_rx_handler(unsigned int, void*, size_t);
 
 void gb_control_register(int cport);
@@ -0,0 +1,79 @@
+/*
+ * Copyright (c) 2016 Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef _GREYBUS_LATENCY_H_
+#define _GREYBUS_LATENCY_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <nuttx/hires_tmr.h>
+
+/*
+ * Latency samples are counted in log2 buckets: bucket 0 holds the samples
+ * under 1us, bucket n the samples in [2^(n-1), 2^n) us and the last bucket
+ * everything above.
+ */
+#define GB_LATENCY_BUCKETS      16
+
+enum gb_latency_metric {
+    GB_LATENCY_RX,          /* message received to handler called */
+    GB_LATENCY_HANDLER,     /* handler duration */
+    GB_LATENCY_RTT,         /* request sent to response received */
+    GB_LATENCY_TX,          /* time spent handing a message to the transport */
+    GB_LATENCY_METRIC_COUNT,
+};
+
+#ifdef CONFIG_GREYBUS_LATENCY
+int gb_latency_init(unsigned int cport_count);
+void gb_latency_deinit(void);
+int gb_latency_register(unsigned int cport);
+void gb_latency_unregister(unsigned int cport);
+
+void gb_latency_record(unsigned int cport, uint8_t type,
+                       enum gb_latency_metric metric, uint32_t start);
+void gb_latency_reset(void);
+size_t gb_latency_dump(char *buf, size_t size);
+
+static inline uint32_t gb_latency_timestamp(void)
+{
+    return hrt_getusec();
+}
+#else
+static inline int gb_latency_init(unsigned int cport_count) { return 0; }
+static inline void gb_latency_deinit(void) { }
+static inline int gb_latency_register(unsigned int cport) { return 0; }
+static inline void gb_latency_unregister(unsigned int cport) { }
+static inline void gb_latency_record(unsigned int cport, uint8_t type,
+                                     enum gb_latency_metric metric,
+                                     uint32_t start) { }
+static inline void gb_latency_reset(void) { }
+static inline uint32_t gb_latency_timestamp(void) { return 0; }
+#endif
+
+#endif /* _GREYBUS_LATENCY_H_ */
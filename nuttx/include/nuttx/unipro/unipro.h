@@ -43,6 +43,17 @@ enum unipro_event {
     UNIPRO_EVT_LUP_DONE,
 };
 
+/*
+ * TX priority classes, served in strict priority order. CPorts of the same
+ * class share the link according to their weight.
+ */
+enum unipro_tx_class {
+    UNIPRO_TX_CLASS_ISOC,       /* latency sensitive: audio, camera control */
+    UNIPRO_TX_CLASS_NORMAL,
+    UNIPRO_TX_CLASS_BULK,       /* throughput oriented: storage */
+    UNIPRO_TX_CLASS_COUNT,
+};
+
 typedef int (*unipro_send_completion_t)(int status, const void *buf,
                                         void *priv);
 typedef void (*cport_reset_completion_cb_t)(unsigned int cportid, void *data);
@@ -66,11 +77,16 @@ int unipro_send_async(unsigned int cportid, const void *buf, size_t len,
                       unipro_send_completion_t callback, void *priv);
 int unipro_reset_cport(unsigned int cportid, cport_reset_completion_cb_t cb,
                        void *priv);
+int unipro_set_cport_priority(unsigned int cportid,
+                              enum unipro_tx_class class, unsigned int weight);
 
 int unipro_set_max_inflight_rxbuf_count(unsigned int cportid,
                                         size_t max_inflight_buf);
+int unipro_set_rxbuf_ring_depth(unsigned int cportid, size_t depth);
 void *unipro_rxbuf_alloc(unsigned int cportid);
 void unipro_rxbuf_free(unsigned int cportid, void *ptr);
+int unipro_hold_rx(unsigned int cportid);
+int unipro_release_rx(unsigned int cportid);
 
 /*
  * UniPro attributes
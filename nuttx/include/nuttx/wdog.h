@@ -135,10 +135,15 @@ struct wdog_s
 #ifdef CONFIG_PIC
   FAR void          *picbase;    /* PIC base address */
 #endif
-  int                lag;        /* Timer associated with the delay */
+  int                lag;        /* Timer associated with the delay (the
+                                  * expiration tick with the timer wheel) */
   uint8_t            flags;      /* See WDOGF_* definitions above */
   uint8_t            argc;       /* The number of parameters to pass */
   uint32_t           parm[CONFIG_MAX_WDOGPARMS];
+#ifdef CONFIG_WDOG_TIMER_WHEEL
+  FAR struct wdog_s *prev;       /* Support for doubly linked wheel slots */
+  uint16_t           slot;       /* Wheel slot holding the watchdog */
+#endif
 };
 
 /* Watchdog 'handle' */
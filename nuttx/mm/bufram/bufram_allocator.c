@@ -30,6 +30,8 @@
 
 #include <stdint.h>
 #include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
 #include <errno.h>
 #include <stddef.h>
 
@@ -43,6 +45,14 @@
 
 #define MM_BUCKET_MAX           31
 #define MM_CANARY               0xfab0fab0
+#define MM_REGION_MAX           4
+
+/*
+ * Smallest block handled by the allocator. Blocks are aligned on their size,
+ * so the state of every possible block head fits in one bit per granule.
+ */
+#define MM_MIN_ORDER            5
+#define MM_GRANULE_COUNT        (BUFRAM_SIZE >> MM_MIN_ORDER)
 
 #ifdef CONFIG_MM_BUFRAM_DEBUG
 #define mm_warn(message...) lowsyslog(message)
@@ -58,6 +68,31 @@ struct mm_buffer {
     struct list_head list;
 } __attribute__((packed)); // MUST be a multiple of 8 bytes
 
+struct mm_region {
+    uintptr_t base;
+    unsigned order;
+};
+
+static struct mm_region mm_regions[MM_REGION_MAX];
+static unsigned mm_region_count;
+
+/*
+ * A bit is set when the granule is the head of a free block. The header of
+ * a free block belongs to the allocator, so the bit and the order stored in
+ * the header are enough to know if a buddy can be merged, without looking
+ * at the memory of allocated blocks, which page allocations overwrite.
+ */
+static uint32_t mm_free_map[(MM_GRANULE_COUNT + 31) / 32];
+
+static struct {
+    size_t free_blocks[MM_BUCKET_MAX + 1];
+    unsigned long alloc_count;
+    unsigned long free_count;
+    unsigned long fail_count;
+    unsigned long split_count;
+    unsigned long merge_count;
+} mm_stats;
+
 size_t bufram_size_to_page_count(size_t size)
 {
     int page_count = size / BUFRAM_PAGE_SIZE;
@@ -84,143 +119,162 @@ static size_t order_to_size(int order)
     return 1 << order;
 }
 
-void bufram_register_region(uintptr_t base, unsigned order)
+static inline unsigned buffer_granule(struct mm_buffer *buffer)
 {
-    struct mm_buffer *buffer;
+    return ((uintptr_t) buffer - BUFRAM_BASE) >> MM_MIN_ORDER;
+}
+
+static inline bool buffer_is_free(struct mm_buffer *buffer)
+{
+    unsigned granule = buffer_granule(buffer);
+
+    return mm_free_map[granule / 32] & (1 << (granule % 32));
+}
+
+static void bucket_add(struct mm_buffer *buffer, int order)
+{
+    unsigned granule = buffer_granule(buffer);
 
-    buffer = (struct mm_buffer*) base;
     buffer->bucket = order;
 #if defined(CONFIG_MM_BUFRAM_CANARY)
     buffer->canary = MM_CANARY;
 #endif
-    list_init(&buffer->list);
+    list_add(&mm_bucket[order], &buffer->list);
 
-    list_add(&mm_bucket[buffer->bucket], &buffer->list);
+    mm_free_map[granule / 32] |= 1 << (granule % 32);
+    mm_stats.free_blocks[order]++;
 }
 
-void bufram_init(void)
+static void bucket_del(struct mm_buffer *buffer)
 {
-    int i;
-
-    for (i = 0; i < ARRAY_SIZE(mm_bucket); i++)
-        list_init(&mm_bucket[i]);
-}
+    unsigned granule = buffer_granule(buffer);
 
-static inline void *get_buffer_payload(struct mm_buffer *buffer)
-{
-    return buffer + 1; // payload immediately follows the control header
-}
+    list_del(&buffer->list);
 
-static inline struct mm_buffer *get_buffer_control_data(void *payload)
-{
-    return (struct mm_buffer*) payload - 1;
+    mm_free_map[granule / 32] &= ~(1 << (granule % 32));
+    mm_stats.free_blocks[buffer->bucket]--;
 }
 
-static struct mm_buffer *find_buffer_in_bucket(int order)
+static struct mm_region *find_region(struct mm_buffer *buffer)
 {
-    if (order > MM_BUCKET_MAX)
-        return NULL;
+    uintptr_t addr = (uintptr_t) buffer;
+    int i;
 
-    if (list_is_empty(&mm_bucket[order]))
-        return NULL;
+    for (i = 0; i < mm_region_count; i++) {
+        if (addr >= mm_regions[i].base &&
+            addr - mm_regions[i].base < order_to_size(mm_regions[i].order))
+            return &mm_regions[i];
+    }
 
-    return list_entry(mm_bucket[order].next, struct mm_buffer, list);
+    return NULL;
 }
 
-static int fill_bucket(int order)
+void bufram_register_region(uintptr_t base, unsigned order)
 {
-    struct mm_buffer *buffer1;
-    struct mm_buffer *buffer2;
-    int retval;
-
-    if (order > MM_BUCKET_MAX)
-        return -ENOMEM;
+    struct mm_region *region;
 
-    buffer1 = find_buffer_in_bucket(order + 1);
-    if (!buffer1) {
-        retval = fill_bucket(order + 1);
-        if (retval)
-            return retval;
+    DEBUGASSERT(sizeof(struct mm_buffer) <= order_to_size(MM_MIN_ORDER));
+    DEBUGASSERT(order >= MM_MIN_ORDER && order <= MM_BUCKET_MAX);
+    DEBUGASSERT(base >= BUFRAM_BASE &&
+                base + order_to_size(order) <= BUFRAM_BASE + BUFRAM_SIZE);
+    DEBUGASSERT(!(base & (order_to_size(MM_MIN_ORDER) - 1)));
 
-        buffer1 = find_buffer_in_bucket(order + 1);
-        DEBUGASSERT(buffer1);
+    if (mm_region_count >= MM_REGION_MAX) {
+        mm_warn("mm: too many regions, ignoring %p\n", (void *) base);
+        return;
     }
 
-    list_del(&buffer1->list);
+    region = &mm_regions[mm_region_count++];
+    region->base = base;
+    region->order = order;
 
-    buffer2 = (struct mm_buffer*) ((char*) buffer1 + order_to_size(order));
-    list_init(&buffer2->list);
-
-    buffer1->bucket = order;
-    buffer2->bucket = order;
+    bucket_add((struct mm_buffer*) base, order);
+}
 
-#if defined(CONFIG_MM_BUFRAM_CANARY)
-    buffer2->canary = buffer1->canary = MM_CANARY;
-#endif
+void bufram_init(void)
+{
+    int i;
 
-    list_add(&mm_bucket[order], &buffer1->list);
-    list_add(&mm_bucket[order], &buffer2->list);
+    for (i = 0; i < ARRAY_SIZE(mm_bucket); i++)
+        list_init(&mm_bucket[i]);
 
-    return 0;
+    memset(mm_free_map, 0, sizeof(mm_free_map));
+    memset(&mm_stats, 0, sizeof(mm_stats));
+    mm_region_count = 0;
 }
 
-static void defragment(struct mm_buffer *buffer)
+static inline void *get_buffer_payload(struct mm_buffer *buffer)
 {
-    struct list_head *iter;
-    struct mm_buffer *buffer_low;
-    struct mm_buffer *buffer_high;
-    struct mm_buffer *buffer2;
-    struct mm_buffer *buffer3;
-
-    if (list_is_empty(&mm_bucket[buffer->bucket])) {
-        mm_warn("mm: trying to defragment empty bucket");
-        return;
-    }
+    return buffer + 1; // payload immediately follows the control header
+}
 
-    if (((unsigned long) buffer) & (1 << buffer->bucket)) {
-        buffer_low = buffer2 = (struct mm_buffer*)
-            ((char*) buffer - order_to_size(buffer->bucket));
-        buffer_high = buffer;
-    } else {
-        buffer_low = buffer;
-        buffer_high = buffer2 = (struct mm_buffer*)
-            ((char*) buffer + order_to_size(buffer->bucket));
-    }
+static inline struct mm_buffer *get_buffer_control_data(void *payload)
+{
+    return (struct mm_buffer*) payload - 1;
+}
 
-    list_foreach(&mm_bucket[buffer->bucket], iter) {
-        buffer3 = list_entry(iter, struct mm_buffer, list);
-        if (buffer3 != buffer2)
-            continue;
+/*
+ * Take a block of the requested order, splitting the smallest larger free
+ * block if needed: the low half is kept and the high half is made free at
+ * each step.
+ */
+static struct mm_buffer *get_buffer(int order)
+{
+    struct mm_buffer *buffer;
+    int i;
 
-        list_del(&buffer_low->list);
-        list_del(&buffer_high->list);
+    for (i = order; i <= MM_BUCKET_MAX; i++) {
+        if (!list_is_empty(&mm_bucket[i]))
+            break;
+    }
 
-        buffer_low->bucket++;
-        list_add(&mm_bucket[buffer_low->bucket], &buffer_low->list);
+    if (i > MM_BUCKET_MAX)
+        return NULL;
 
-        defragment(buffer_low);
+    buffer = list_entry(mm_bucket[i].next, struct mm_buffer, list);
+    bucket_del(buffer);
 
-        return;
+    while (i > order) {
+        i--;
+        bucket_add((struct mm_buffer*) ((char*) buffer + order_to_size(i)), i);
+        mm_stats.split_count++;
     }
+
+    buffer->bucket = order;
+    return buffer;
 }
 
-static struct mm_buffer *get_buffer(int order)
+/*
+ * Give a block back, merging it with its buddy as long as the buddy is
+ * free and whole. The buddy is found from the offset of the block in its
+ * region, so regions only need to be aligned on MM_MIN_ORDER.
+ */
+static void put_buffer(struct mm_buffer *buffer)
 {
-    struct mm_buffer *buffer;
-    int retval;
+    struct mm_region *region = find_region(buffer);
+    struct mm_buffer *buddy;
+    uintptr_t offset;
+    int order = buffer->bucket;
 
-    buffer = find_buffer_in_bucket(order);
-    if (buffer)
-        return buffer;
+    DEBUGASSERT(region);
 
-    retval = fill_bucket(order);
-    if (!retval) {
-        buffer = find_buffer_in_bucket(order);
-        DEBUGASSERT(buffer);
-        return buffer;
+    while (order < region->order) {
+        offset = (uintptr_t) buffer - region->base;
+        buddy = (struct mm_buffer*)
+            (region->base + (offset ^ order_to_size(order)));
+
+        if (!buffer_is_free(buddy) || buddy->bucket != order)
+            break;
+
+        bucket_del(buddy);
+        if (buddy < buffer)
+            buffer = buddy;
+
+        order++;
+        mm_stats.merge_count++;
     }
 
-    return NULL;
+    bucket_add(buffer, order);
 }
 
 void *bufram_alloc(size_t size)
@@ -240,18 +294,22 @@ void *bufram_alloc(size_t size)
     if (order > MM_BUCKET_MAX)
         return NULL;
 
+    if (order < MM_MIN_ORDER)
+        order = MM_MIN_ORDER;
+
     flags = irqsave();
 
     buffer = get_buffer(order);
     if (!buffer)
         goto error;
 
-    list_del(&buffer->list);
+    mm_stats.alloc_count++;
     irqrestore(flags);
 
     return get_buffer_payload(buffer);
 
 error:
+    mm_stats.fail_count++;
     irqrestore(flags);
     return NULL;
 }
@@ -265,7 +323,9 @@ void bufram_free(void *ptr)
         return;
 
     buffer = get_buffer_control_data(ptr);
-    if (buffer->list.prev != buffer->list.next) {
+    if ((uintptr_t) buffer < BUFRAM_BASE ||
+        (uintptr_t) buffer >= BUFRAM_BASE + BUFRAM_SIZE ||
+        buffer->list.prev != buffer->list.next || buffer_is_free(buffer)) {
         mm_warn("mm: trying to free invalid pointer: %p\n", ptr);
         return;
     }
@@ -279,8 +339,8 @@ void bufram_free(void *ptr)
 
     flags = irqsave();
 
-    list_add(&mm_bucket[buffer->bucket], &buffer->list);
-    defragment(buffer);
+    put_buffer(buffer);
+    mm_stats.free_count++;
 
     irqrestore(flags);
 }
@@ -303,7 +363,7 @@ void bufram_page_free(void *ptr, size_t page_count)
     uintptr_t ptraddr = (uintptr_t) ptr;
     size_t size = page_count * BUFRAM_PAGE_SIZE;
 
-    if (ptraddr < BUFRAM_BASE || ptraddr + size >= BUFRAM_BASE + BUFRAM_SIZE) {
+    if (ptraddr < BUFRAM_BASE || ptraddr + size > BUFRAM_BASE + BUFRAM_SIZE) {
         mm_warn("mm: trying to free invalid pointer: %p\n", ptr);
         return;
     }
@@ -316,3 +376,55 @@ void bufram_page_free(void *ptr, size_t page_count)
 
     bufram_free(get_buffer_payload(buffer));
 }
+
+size_t bufram_dump(char *buf, size_t size)
+{
+    size_t free_blocks[MM_BUCKET_MAX + 1];
+    size_t free_bytes = 0;
+    size_t largest = 0;
+    size_t len = 0;
+    unsigned long alloc_count, free_count, fail_count;
+    unsigned long split_count, merge_count;
+    irqstate_t flags;
+    int i;
+
+    flags = irqsave();
+    memcpy(free_blocks, mm_stats.free_blocks, sizeof(free_blocks));
+    alloc_count = mm_stats.alloc_count;
+    free_count = mm_stats.free_count;
+    fail_count = mm_stats.fail_count;
+    split_count = mm_stats.split_count;
+    merge_count = mm_stats.merge_count;
+    irqrestore(flags);
+
+    len += snprintf(buf + len, size - len, "%5s %8s %8s %10s\n",
+                    "order", "size", "blocks", "free");
+
+    for (i = MM_MIN_ORDER; i <= MM_BUCKET_MAX && len < size; i++) {
+        if (!free_blocks[i])
+            continue;
+
+        free_bytes += free_blocks[i] * order_to_size(i);
+        largest = order_to_size(i);
+
+        len += snprintf(buf + len, size - len, "%5d %8zu %8zu %10zu\n", i,
+                        order_to_size(i), free_blocks[i],
+                        free_blocks[i] * order_to_size(i));
+    }
+
+    if (len < size) {
+        len += snprintf(buf + len, size - len,
+                        "free: %zu bytes, largest free block: %zu bytes\n",
+                        free_bytes, largest);
+    }
+
+    if (len < size) {
+        len += snprintf(buf + len, size - len,
+                        "allocs: %lu frees: %lu failures: %lu "
+                        "splits: %lu merges: %lu\n",
+                        alloc_count, free_count, fail_count, split_count,
+                        merge_count);
+    }
+
+    return MIN(len, size);
+}
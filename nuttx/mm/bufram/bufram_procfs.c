@@ -0,0 +1,135 @@
+/*
+ * Copyright (c) 2016 Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Bufram allocator statistics exported as /proc/bufram.
+ *
+ * The content of the file is rendered once when it is opened, so that
+ * consecutive reads return a consistent snapshot.
+ */
+
+#include <nuttx/config.h>
+#include <nuttx/kmalloc.h>
+#include <nuttx/bufram.h>
+#include <nuttx/fs/fs.h>
+#include <nuttx/fs/procfs.h>
+
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <string.h>
+#include <errno.h>
+#include <debug.h>
+
+#if !defined(CONFIG_DISABLE_MOUNTPOINT) && defined(CONFIG_FS_PROCFS)
+
+#define BUFRAM_PROCFS_BUFSIZE   1024
+
+struct bufram_procfs_file {
+    struct procfs_file_s base;
+    size_t size;
+    char buf[BUFRAM_PROCFS_BUFSIZE];
+};
+
+static int bufram_procfs_open(struct file *filep, const char *relpath,
+                              int oflags, mode_t mode)
+{
+    struct bufram_procfs_file *priv;
+
+    if ((oflags & O_WRONLY) != 0 || (oflags & O_RDONLY) == 0)
+        return -EACCES;
+
+    if (strcmp(relpath, "bufram"))
+        return -ENOENT;
+
+    priv = kmm_zalloc(sizeof(*priv));
+    if (!priv)
+        return -ENOMEM;
+
+    priv->size = bufram_dump(priv->buf, sizeof(priv->buf));
+    filep->f_priv = priv;
+
+    return 0;
+}
+
+static int bufram_procfs_close(struct file *filep)
+{
+    kmm_free(filep->f_priv);
+    filep->f_priv = NULL;
+
+    return 0;
+}
+
+static ssize_t bufram_procfs_read(struct file *filep, char *buffer,
+                                  size_t buflen)
+{
+    struct bufram_procfs_file *priv = filep->f_priv;
+    off_t offset = filep->f_pos;
+    size_t len;
+
+    DEBUGASSERT(priv);
+
+    len = procfs_memcpy(priv->buf, priv->size, buffer, buflen, &offset);
+    filep->f_pos += len;
+
+    return len;
+}
+
+static int bufram_procfs_dup(const struct file *oldp, struct file *newp)
+{
+    struct bufram_procfs_file *priv;
+
+    priv = kmm_malloc(sizeof(*priv));
+    if (!priv)
+        return -ENOMEM;
+
+    memcpy(priv, oldp->f_priv, sizeof(*priv));
+    newp->f_priv = priv;
+
+    return 0;
+}
+
+static int bufram_procfs_stat(const char *relpath, struct stat *buf)
+{
+    if (strcmp(relpath, "bufram"))
+        return -ENOENT;
+
+    memset(buf, 0, sizeof(*buf));
+    buf->st_mode = S_IFREG | S_IROTH | S_IRGRP | S_IRUSR;
+
+    return 0;
+}
+
+const struct procfs_operations bufram_procfsoperations = {
+    .open = bufram_procfs_open,
+    .close = bufram_procfs_close,
+    .read = bufram_procfs_read,
+    .dup = bufram_procfs_dup,
+    .stat = bufram_procfs_stat,
+};
+
+#endif /* !CONFIG_DISABLE_MOUNTPOINT && CONFIG_FS_PROCFS */
@@ -91,8 +91,10 @@
 
 int wd_cancel(WDOG_ID wdog)
 {
+#ifndef CONFIG_WDOG_TIMER_WHEEL
   FAR struct wdog_s *curr;
   FAR struct wdog_s *prev;
+#endif
   irqstate_t state;
   int ret = ERROR;
 
@@ -108,6 +110,16 @@ int wd_cancel(WDOG_ID wdog)
 
   if (wdog && WDOG_ISACTIVE(wdog))
     {
+#ifdef CONFIG_WDOG_TIMER_WHEEL
+      /* Unlink the watchdog from its wheel slot.  Reassess the interval
+       * timer only if the next event of the wheel may have moved.
+       */
+
+      if (wd_wheel_remove(wdog))
+        {
+          sched_timer_reassess();
+        }
+#else
       /* Search the g_wdactivelist for the target FCB.  We can't use sq_rem
        * to do this because there are additional operations that need to be
        * done.
@@ -157,6 +169,7 @@ int wd_cancel(WDOG_ID wdog)
 
           sched_timer_reassess();
         }
+#endif
 
       /* Mark the watchdog inactive */
 
@@ -96,6 +96,69 @@ typedef void (*wdentry4_t)(int argc, uint32_t arg1, uint32_t arg2,
 /****************************************************************************
  * Private Functions
  ****************************************************************************/
+/****************************************************************************
+ * Name: wd_call
+ *
+ * Description:
+ *   Execute the function of a watchdog that has expired.
+ *
+ * Parameters:
+ *   wdog - The expired watchdog, already removed from the timer queue
+ *
+ * Return Value:
+ *   None
+ *
+ * Assumptions:
+ *
+ ****************************************************************************/
+
+static inline void wd_call(FAR struct wdog_s *wdog)
+{
+  /* Indicate that the watchdog is no longer active. */
+
+  WDOG_CLRACTIVE(wdog);
+
+  /* Execute the watchdog function */
+
+  up_setpicbase(wdog->picbase);
+  switch (wdog->argc)
+    {
+      default:
+        DEBUGPANIC();
+        break;
+
+      case 0:
+        (*((wdentry0_t)(wdog->func)))(0);
+        break;
+
+#if CONFIG_MAX_WDOGPARMS > 0
+      case 1:
+        (*((wdentry1_t)(wdog->func)))(1, wdog->parm[0]);
+        break;
+#endif
+#if CONFIG_MAX_WDOGPARMS > 1
+      case 2:
+        (*((wdentry2_t)(wdog->func)))(2,
+                        wdog->parm[0], wdog->parm[1]);
+        break;
+#endif
+#if CONFIG_MAX_WDOGPARMS > 2
+      case 3:
+        (*((wdentry3_t)(wdog->func)))(3,
+                        wdog->parm[0], wdog->parm[1],
+                        wdog->parm[2]);
+        break;
+#endif
+#if CONFIG_MAX_WDOGPARMS > 3
+      case 4:
+        (*((wdentry4_t)(wdog->func)))(4,
+                        wdog->parm[0], wdog->parm[1],
+                        wdog->parm[2] ,wdog->parm[3]);
+        break;
+#endif
+    }
+}
+
 /****************************************************************************
  * Name: wd_expiration
  *
@@ -103,6 +166,9 @@ typedef void (*wdentry4_t)(int argc, uint32_t arg1, uint32_t arg2,
  *   Check if the timer for the watchdog at the head of list is ready to
  *   run.  If so, remove the watchdog from the list and execute it.
  *
+ *   With the timer wheel, run all the watchdogs that the wheel found
+ *   expired.
+ *
  * Parameters:
  *   None
  *
@@ -113,6 +179,17 @@ typedef void (*wdentry4_t)(int argc, uint32_t arg1, uint32_t arg2,
  *
  ****************************************************************************/
 
+#ifdef CONFIG_WDOG_TIMER_WHEEL
+static inline void wd_expiration(void)
+{
+  FAR struct wdog_s *wdog;
+
+  while ((wdog = wd_wheel_expired()) != NULL)
+    {
+      wd_call(wdog);
+    }
+}
+#else
 static inline void wd_expiration(void)
 {
   FAR struct wdog_s *wdog;
@@ -141,52 +218,13 @@ static inline void wd_expiration(void)
               ((FAR struct wdog_s *)g_wdactivelist.head)->lag += wdog->lag;
             }
 
-          /* Indicate that the watchdog is no longer active. */
-
-          WDOG_CLRACTIVE(wdog);
-
           /* Execute the watchdog function */
 
-          up_setpicbase(wdog->picbase);
-          switch (wdog->argc)
-            {
-              default:
-                DEBUGPANIC();
-                break;
-
-              case 0:
-                (*((wdentry0_t)(wdog->func)))(0);
-                break;
-
-#if CONFIG_MAX_WDOGPARMS > 0
-              case 1:
-                (*((wdentry1_t)(wdog->func)))(1, wdog->parm[0]);
-                break;
-#endif
-#if CONFIG_MAX_WDOGPARMS > 1
-              case 2:
-                (*((wdentry2_t)(wdog->func)))(2,
-                                wdog->parm[0], wdog->parm[1]);
-                break;
-#endif
-#if CONFIG_MAX_WDOGPARMS > 2
-              case 3:
-                (*((wdentry3_t)(wdog->func)))(3,
-                                wdog->parm[0], wdog->parm[1],
-                                wdog->parm[2]);
-                break;
-#endif
-#if CONFIG_MAX_WDOGPARMS > 3
-              case 4:
-                (*((wdentry4_t)(wdog->func)))(4,
-                                wdog->parm[0], wdog->parm[1],
-                                wdog->parm[2] ,wdog->parm[3]);
-                break;
-#endif
-            }
+          wd_call(wdog);
         }
     }
 }
+#endif
 
 /****************************************************************************
  * Public Functions
@@ -228,10 +266,12 @@ static inline void wd_expiration(void)
 int wd_start(WDOG_ID wdog, int delay, wdentry_t wdentry,  int argc, ...)
 {
   va_list ap;
+#ifndef CONFIG_WDOG_TIMER_WHEEL
   FAR struct wdog_s *curr;
   FAR struct wdog_s *prev;
   FAR struct wdog_s *next;
   int32_t now;
+#endif
   irqstate_t state;
   int i;
 
@@ -295,6 +335,11 @@ int wd_start(WDOG_ID wdog, int delay, wdentry_t wdentry,  int argc, ...)
   (void)sched_timer_cancel();
 #endif
 
+#ifdef CONFIG_WDOG_TIMER_WHEEL
+  /* Hash the watchdog into the timer wheel */
+
+  wd_wheel_insert(wdog, delay);
+#else
   /* Do the easy case first -- when the watchdog timer queue is empty. */
 
   if (g_wdactivelist.head == NULL)
@@ -380,9 +425,13 @@ int wd_start(WDOG_ID wdog, int delay, wdentry_t wdentry,  int argc, ...)
         }
     }
 
-  /* Put the lag into the watchdog structure and mark it as active. */
+  /* Put the lag into the watchdog structure */
 
   wdog->lag = delay;
+#endif
+
+  /* Mark the watchdog as active */
+
   WDOG_SETACTIVE(wdog);
 
 #ifdef CONFIG_SCHED_TICKLESS
@@ -423,7 +472,33 @@ int wd_start(WDOG_ID wdog, int delay, wdentry_t wdentry,  int argc, ...)
  *
  ****************************************************************************/
 
-#ifdef CONFIG_SCHED_TICKLESS
+#if defined(CONFIG_WDOG_TIMER_WHEEL) && defined(CONFIG_SCHED_TICKLESS)
+unsigned int wd_timer(int ticks)
+{
+  /* Account for the elapsed ticks and run the watchdogs that expired */
+
+  if (ticks > 0)
+    {
+      wd_wheel_advance(ticks);
+    }
+
+  wd_expiration();
+
+  /* Return the delay until the wheel needs attention again.  This may be
+   * earlier than the next expiration, when watchdogs need to be cascaded.
+   */
+
+  return wd_wheel_next();
+}
+
+#elif defined(CONFIG_WDOG_TIMER_WHEEL)
+void wd_timer(void)
+{
+  wd_wheel_advance(1);
+  wd_expiration();
+}
+
+#elif defined(CONFIG_SCHED_TICKLESS)
 unsigned int wd_timer(int ticks)
 {
   FAR struct wdog_s *wdog;
@@ -0,0 +1,409 @@
+/*
+ * Copyright (c) 2015 Google, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/****************************************************************************
+ * Hierarchical timing wheel for watchdogs.
+ *
+ * The wheel has WDOG_WHEEL_LEVELS levels of WDOG_WHEEL_SIZE slots.  A slot
+ * of level l spans WDOG_WHEEL_SIZE^l ticks.  A watchdog is put in the
+ * lowest level able to hold its remaining delay, in the slot of its
+ * expiration time.  When the wheel reaches the start of the range of a
+ * slot above level 0, the watchdogs of that slot are cascaded, i.e.
+ * re-inserted at a lower level.  When it reaches a level 0 slot, its
+ * watchdogs have expired.
+ *
+ * Starting and cancelling a watchdog is O(1), and a per-level occupancy
+ * bitmap lets tickless configurations find the next event and skip empty
+ * slots without visiting them.
+ *
+ * Watchdogs further away than the top level can hold are parked in the
+ * last slot it can reach and cascaded again from there.
+ ****************************************************************************/
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <nuttx/config.h>
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <nuttx/wdog.h>
+
+#include "wdog/wdog.h"
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+#define WDOG_WHEEL_BITS     6
+#define WDOG_WHEEL_SIZE     (1 << WDOG_WHEEL_BITS)
+#define WDOG_WHEEL_MASK     (WDOG_WHEEL_SIZE - 1)
+#define WDOG_WHEEL_LEVELS   4
+#define WDOG_WHEEL_SLOTS    (WDOG_WHEEL_LEVELS * WDOG_WHEEL_SIZE)
+
+/* Pseudo slot holding the expired watchdogs until they are run */
+
+#define WDOG_WHEEL_EXPIRED  WDOG_WHEEL_SLOTS
+
+/* Longest delay the wheel can hold without re-cascading from the top */
+
+#define WDOG_WHEEL_MAXDELAY \
+  ((uint32_t)(1 << (WDOG_WHEEL_BITS * WDOG_WHEEL_LEVELS)) - 1)
+
+#define WDOG_WHEEL_SHIFT(l) ((l) * WDOG_WHEEL_BITS)
+
+/****************************************************************************
+ * Private Type Declarations
+ ****************************************************************************/
+
+struct wd_wheel_s
+{
+  uint32_t           now;                           /* Last processed tick */
+  uint64_t           bitmap[WDOG_WHEEL_LEVELS];     /* Non-empty slots */
+  FAR struct wdog_s *slots[WDOG_WHEEL_SLOTS + 1];   /* Slot lists */
+};
+
+/****************************************************************************
+ * Private Variables
+ ****************************************************************************/
+
+static struct wd_wheel_s g_wdwheel;
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+static inline unsigned int wd_wheel_ctz(uint64_t x)
+{
+#ifdef __GNUC__
+  return __builtin_ctzll(x);
+#else
+  unsigned int n = 0;
+
+  while (!(x & 1))
+    {
+      x >>= 1;
+      n++;
+    }
+
+  return n;
+#endif
+}
+
+/****************************************************************************
+ * Name: wd_slot_append
+ *
+ * Description:
+ *   Append a watchdog to a slot list.  Slot lists are NULL terminated
+ *   through next, and the prev link of the head points to the tail so
+ *   that appending is O(1).
+ *
+ ****************************************************************************/
+
+static void wd_slot_append(unsigned int slot, FAR struct wdog_s *wdog)
+{
+  FAR struct wdog_s *head = g_wdwheel.slots[slot];
+
+  wdog->next = NULL;
+  wdog->slot = slot;
+
+  if (!head)
+    {
+      wdog->prev = wdog;
+      g_wdwheel.slots[slot] = wdog;
+      if (slot < WDOG_WHEEL_SLOTS)
+        {
+          g_wdwheel.bitmap[slot / WDOG_WHEEL_SIZE] |=
+            (uint64_t)1 << (slot & WDOG_WHEEL_MASK);
+        }
+    }
+  else
+    {
+      wdog->prev       = head->prev;
+      head->prev->next = wdog;
+      head->prev       = wdog;
+    }
+}
+
+/****************************************************************************
+ * Name: wd_slot_remove
+ *
+ * Description:
+ *   Remove a watchdog from its slot list.  Returns true if the slot became
+ *   empty.
+ *
+ ****************************************************************************/
+
+static bool wd_slot_remove(FAR struct wdog_s *wdog)
+{
+  unsigned int slot = wdog->slot;
+  FAR struct wdog_s *head = g_wdwheel.slots[slot];
+  bool empty = false;
+
+  if (wdog == head)
+    {
+      g_wdwheel.slots[slot] = wdog->next;
+      if (wdog->next)
+        {
+          wdog->next->prev = wdog->prev;
+        }
+      else
+        {
+          empty = true;
+          if (slot < WDOG_WHEEL_SLOTS)
+            {
+              g_wdwheel.bitmap[slot / WDOG_WHEEL_SIZE] &=
+                ~((uint64_t)1 << (slot & WDOG_WHEEL_MASK));
+            }
+        }
+    }
+  else
+    {
+      wdog->prev->next = wdog->next;
+      if (wdog->next)
+        {
+          wdog->next->prev = wdog->prev;
+        }
+      else
+        {
+          head->prev = wdog->prev;
+        }
+    }
+
+  wdog->next = NULL;
+  wdog->prev = NULL;
+  return empty;
+}
+
+/****************************************************************************
+ * Name: wd_wheel_place
+ *
+ * Description:
+ *   Put a watchdog in the slot matching its expiration time (held in lag)
+ *   relative to the current time of the wheel.
+ *
+ ****************************************************************************/
+
+static void wd_wheel_place(FAR struct wdog_s *wdog)
+{
+  uint32_t expiry = (uint32_t)wdog->lag;
+  int32_t delta = (int32_t)(expiry - g_wdwheel.now);
+  unsigned int level;
+
+  if (delta <= 0)
+    {
+      wd_slot_append(WDOG_WHEEL_EXPIRED, wdog);
+      return;
+    }
+
+  if ((uint32_t)delta > WDOG_WHEEL_MAXDELAY)
+    {
+      expiry = g_wdwheel.now + WDOG_WHEEL_MAXDELAY;
+      delta  = WDOG_WHEEL_MAXDELAY;
+    }
+
+  for (level = 0; level < WDOG_WHEEL_LEVELS - 1; level++)
+    {
+      if ((uint32_t)delta < ((uint32_t)1 << WDOG_WHEEL_SHIFT(level + 1)))
+        {
+          break;
+        }
+    }
+
+  wd_slot_append(level * WDOG_WHEEL_SIZE +
+                 ((expiry >> WDOG_WHEEL_SHIFT(level)) & WDOG_WHEEL_MASK),
+                 wdog);
+}
+
+/****************************************************************************
+ * Name: wd_wheel_tick
+ *
+ * Description:
+ *   Process the current tick of the wheel: cascade the higher level slots
+ *   whose range starts now, then move the watchdogs of the current level 0
+ *   slot to the expired list.
+ *
+ ****************************************************************************/
+
+static void wd_wheel_tick(void)
+{
+  FAR struct wdog_s *wdog;
+  FAR struct wdog_s *next;
+  uint32_t now = g_wdwheel.now;
+  unsigned int level;
+  unsigned int slot;
+
+  for (level = 1; level < WDOG_WHEEL_LEVELS; level++)
+    {
+      if (now & (((uint32_t)1 << WDOG_WHEEL_SHIFT(level)) - 1))
+        {
+          break;
+        }
+
+      slot = level * WDOG_WHEEL_SIZE +
+             ((now >> WDOG_WHEEL_SHIFT(level)) & WDOG_WHEEL_MASK);
+      wdog = g_wdwheel.slots[slot];
+      g_wdwheel.slots[slot] = NULL;
+      g_wdwheel.bitmap[level] &= ~((uint64_t)1 << (slot & WDOG_WHEEL_MASK));
+
+      for (; wdog; wdog = next)
+        {
+          next = wdog->next;
+          wd_wheel_place(wdog);
+        }
+    }
+
+  slot = now & WDOG_WHEEL_MASK;
+  wdog = g_wdwheel.slots[slot];
+  g_wdwheel.slots[slot] = NULL;
+  g_wdwheel.bitmap[0] &= ~((uint64_t)1 << slot);
+
+  for (; wdog; wdog = next)
+    {
+      next = wdog->next;
+      wd_slot_append(WDOG_WHEEL_EXPIRED, wdog);
+    }
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+void wd_wheel_initialize(void)
+{
+  memset(&g_wdwheel, 0, sizeof(g_wdwheel));
+}
+
+void wd_wheel_insert(FAR struct wdog_s *wdog, int delay)
+{
+  wdog->lag = (int)(g_wdwheel.now + (uint32_t)delay);
+  wd_wheel_place(wdog);
+}
+
+bool wd_wheel_remove(FAR struct wdog_s *wdog)
+{
+  bool empty = wd_slot_remove(wdog);
+
+  /* The next event only depends on which wheel slots are occupied */
+
+  return empty && wdog->slot != WDOG_WHEEL_EXPIRED;
+}
+
+int wd_wheel_remaining(FAR struct wdog_s *wdog)
+{
+  int32_t delta = (int32_t)((uint32_t)wdog->lag - g_wdwheel.now);
+
+  return delta > 0 ? delta : 0;
+}
+
+void wd_wheel_advance(unsigned int ticks)
+{
+  unsigned int step;
+
+  /* The common non-tickless case: just process the next tick */
+
+  if (ticks == 1)
+    {
+      g_wdwheel.now++;
+      wd_wheel_tick();
+      return;
+    }
+
+  /* Otherwise only visit the ticks where something has to be done */
+
+  while (ticks > 0)
+    {
+      step = wd_wheel_next();
+      if (step == 0 || step > ticks)
+        {
+          g_wdwheel.now += ticks;
+          break;
+        }
+
+      g_wdwheel.now += step;
+      ticks         -= step;
+      wd_wheel_tick();
+    }
+}
+
+FAR struct wdog_s *wd_wheel_expired(void)
+{
+  FAR struct wdog_s *wdog = g_wdwheel.slots[WDOG_WHEEL_EXPIRED];
+
+  if (wdog)
+    {
+      (void)wd_slot_remove(wdog);
+    }
+
+  return wdog;
+}
+
+unsigned int wd_wheel_next(void)
+{
+  unsigned int level;
+  unsigned int shift;
+  unsigned int start;
+  uint32_t base;
+  uint32_t delay;
+  uint32_t next = 0;
+  uint64_t map;
+
+  for (level = 0; level < WDOG_WHEEL_LEVELS; level++)
+    {
+      if (!g_wdwheel.bitmap[level])
+        {
+          continue;
+        }
+
+      /* Find the first occupied slot after the current one, wrapping
+       * around to the current one itself.
+       */
+
+      shift = WDOG_WHEEL_SHIFT(level);
+      base  = g_wdwheel.now >> shift;
+      start = (base + 1) & WDOG_WHEEL_MASK;
+      map   = g_wdwheel.bitmap[level] >> start;
+      if (start)
+        {
+          map |= g_wdwheel.bitmap[level] << (WDOG_WHEEL_SIZE - start);
+        }
+
+      /* Ticks until that slot is processed (level 0) or cascaded */
+
+      delay = ((base + wd_wheel_ctz(map) + 1) << shift) - g_wdwheel.now;
+      if (!next || delay < next)
+        {
+          next = delay;
+        }
+    }
+
+  return next;
+}
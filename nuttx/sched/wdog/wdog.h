@@ -74,12 +74,14 @@ extern "C"
 
 extern sq_queue_t g_wdfreelist;
 
+#ifndef CONFIG_WDOG_TIMER_WHEEL
 /* The g_wdactivelist data structure is a singly linked list ordered by
  * watchdog expiration time. When watchdog timers expire,the functions on
  * this linked list are removed and the function is called.
  */
 
 extern sq_queue_t g_wdactivelist;
+#endif
 
 /* This is the number of free, pre-allocated watchdog structures in the
  * g_wdfreelist.  This value is used to enforce a reserve for interrupt
@@ -144,6 +146,40 @@ unsigned int wd_timer(int ticks);
 void wd_timer(void);
 #endif
 
+#ifdef CONFIG_WDOG_TIMER_WHEEL
+/****************************************************************************
+ * Timer wheel (see wd_wheel.c)
+ *
+ * Description:
+ *   With CONFIG_WDOG_TIMER_WHEEL, active watchdogs are kept in a
+ *   hierarchical timing wheel instead of g_wdactivelist:
+ *
+ *   wd_wheel_initialize - Empty the wheel.
+ *   wd_wheel_insert     - Add a watchdog expiring delay (> 0) ticks from
+ *                         now.
+ *   wd_wheel_remove     - Remove an active watchdog.  Returns true if this
+ *                         may have changed the next expiration time.
+ *   wd_wheel_remaining  - Ticks until the watchdog expires.
+ *   wd_wheel_advance    - Account for elapsed ticks, moving the watchdogs
+ *                         that expired to a pending list.
+ *   wd_wheel_expired    - Pop the next expired watchdog, NULL if none.
+ *   wd_wheel_next       - Ticks until the wheel needs to be advanced again,
+ *                         zero if it is empty.
+ *
+ * Assumptions:
+ *   Called with interrupts disabled.
+ *
+ ****************************************************************************/
+
+void wd_wheel_initialize(void);
+void wd_wheel_insert(FAR struct wdog_s *wdog, int delay);
+bool wd_wheel_remove(FAR struct wdog_s *wdog);
+int wd_wheel_remaining(FAR struct wdog_s *wdog);
+void wd_wheel_advance(unsigned int ticks);
+FAR struct wdog_s *wd_wheel_expired(void);
+unsigned int wd_wheel_next(void);
+#endif
+
 #undef EXTERN
 #ifdef __cplusplus
 }
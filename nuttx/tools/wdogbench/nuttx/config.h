@@ -0,0 +1,52 @@
+/****************************************************************************
+ * tools/wdogbench/nuttx/config.h
+ *
+ * Host stand-in for the generated nuttx/config.h, force-included by the
+ * wdogbench build.  It provides the configuration and the few kernel
+ * services that the sched/wdog sources need, and keeps out the headers
+ * that only build for a configured target.
+ *
+ ****************************************************************************/
+
+#ifndef __TOOLS_WDOGBENCH_NUTTX_CONFIG_H
+#define __TOOLS_WDOGBENCH_NUTTX_CONFIG_H
+
+#include <assert.h>
+#include <errno.h>
+#include <stdlib.h>
+
+#define CONFIG_MAX_WDOGPARMS    4
+#define CONFIG_PREALLOC_WDOGS   8
+
+/* nuttx/arch.h and sched/sched.h need a configured target */
+
+#define __INCLUDE_NUTTX_ARCH_H
+#define __SCHED_SCHED_SCHED_H
+
+#define FAR
+#define CODE
+
+#define OK                      0
+#define ERROR                   (-1)
+
+typedef int irqstate_t;
+
+#define irqsave()               0
+#define irqrestore(s)           ((void)(s))
+#define up_setpicbase(p)
+#define up_getpicbase(p)
+#define set_errno(e)            (errno = (e))
+
+#define ASSERT(f)               assert(f)
+#define DEBUGASSERT(f)          assert(f)
+#define DEBUGPANIC()            abort()
+
+#define sched_timer_cancel()    0
+#define sched_timer_resume()
+#define sched_timer_reassess()
+
+/* Normally pulled in through sched/sched.h */
+
+#include <queue.h>
+
+#endif /* __TOOLS_WDOGBENCH_NUTTX_CONFIG_H */
@@ -0,0 +1,273 @@
+/****************************************************************************
+ * tools/wdogbench/wdogbench.c
+ *
+ * Copyright (c) 2015 Google, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/****************************************************************************
+ * Host benchmark of the watchdog timer queue.
+ *
+ * Builds the real sched/wdog sources (see Makefile.host) and times
+ * wd_start(), wd_cancel() and the expiration of thousands of watchdogs,
+ * once with the sorted delta list and once with CONFIG_WDOG_TIMER_WHEEL.
+ * Every watchdog checks that it expires on the exact tick it was due, and
+ * wd_gettime() is checked against the expected remaining delay.
+ *
+ ****************************************************************************/
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include <nuttx/wdog.h>
+
+#include "wdog/wdog.h"
+
+/****************************************************************************
+ * Definitions
+ ****************************************************************************/
+
+#define DEFAULT_NWDOGS   4096
+#define DEFAULT_MAXDELAY 5000
+#define DEFAULT_NCHURN   100000
+
+#ifdef CONFIG_WDOG_TIMER_WHEEL
+#  define QUEUE_NAME     "wheel"
+#else
+#  define QUEUE_NAME     "list"
+#endif
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+static struct wdog_s *g_wdogs;
+static uint32_t *g_deadline;
+static uint32_t g_tick;
+static unsigned int g_nfired;
+static unsigned int g_nerrors;
+static unsigned int g_maxdelay = DEFAULT_MAXDELAY;
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+static uint64_t bench_now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void bench_report(const char *phase, uint64_t ns, unsigned int nops)
+{
+  printf("%-6s %-8s %10u ops %12.1f ns/op\n", QUEUE_NAME, phase, nops,
+         nops ? (double)ns / nops : 0.0);
+}
+
+static void bench_expired(int argc, uint32_t index)
+{
+  if (g_tick != g_deadline[index])
+    {
+      fprintf(stderr, "wdog %u expired at tick %u, due at %u\n",
+              index, g_tick, g_deadline[index]);
+      g_nerrors++;
+    }
+
+  g_nfired++;
+}
+
+static void bench_start(unsigned int index)
+{
+  int delay = 1 + rand() % g_maxdelay;
+
+  /* wd_start() waits for one extra tick: the current one is partial */
+
+  g_deadline[index] = g_tick + delay + 1;
+  if (wd_start(&g_wdogs[index], delay, (wdentry_t)bench_expired, 1,
+               index) != OK)
+    {
+      fprintf(stderr, "wd_start failed\n");
+      exit(EXIT_FAILURE);
+    }
+}
+
+static void bench_check_remaining(unsigned int nwdogs)
+{
+  unsigned int i;
+  int remaining;
+
+  for (i = 0; i < nwdogs; i++)
+    {
+      remaining = wd_gettime(&g_wdogs[i]);
+      if (remaining != (int)(g_deadline[i] - g_tick))
+        {
+          fprintf(stderr, "wdog %u: %d ticks remaining, expected %d\n",
+                  i, remaining, (int)(g_deadline[i] - g_tick));
+          g_nerrors++;
+        }
+    }
+}
+
+static void show_usage(const char *progname)
+{
+  fprintf(stderr, "USAGE: %s [-n <wdogs>] [-d <maxdelay>] [-c <churn>] "
+          "[-s <seed>]\n", progname);
+  fprintf(stderr, "  -n: number of active watchdogs (default %d)\n",
+          DEFAULT_NWDOGS);
+  fprintf(stderr, "  -d: longest delay in ticks (default %d)\n",
+          DEFAULT_MAXDELAY);
+  fprintf(stderr, "  -c: number of cancel/restart pairs (default %d)\n",
+          DEFAULT_NCHURN);
+  fprintf(stderr, "  -s: random seed (default 1)\n");
+  exit(EXIT_FAILURE);
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+int main(int argc, char **argv)
+{
+  unsigned int nwdogs = DEFAULT_NWDOGS;
+  unsigned int nchurn = DEFAULT_NCHURN;
+  unsigned int seed = 1;
+  unsigned int nticks;
+  unsigned int index;
+  unsigned int i;
+  uint64_t start;
+  int opt;
+#ifdef CONFIG_SCHED_TICKLESS
+  unsigned int next;
+#endif
+
+  while ((opt = getopt(argc, argv, "n:d:c:s:h")) != -1)
+    {
+      switch (opt)
+        {
+          case 'n':
+            nwdogs = strtoul(optarg, NULL, 0);
+            break;
+          case 'd':
+            g_maxdelay = strtoul(optarg, NULL, 0);
+            break;
+          case 'c':
+            nchurn = strtoul(optarg, NULL, 0);
+            break;
+          case 's':
+            seed = strtoul(optarg, NULL, 0);
+            break;
+          default:
+            show_usage(argv[0]);
+        }
+    }
+
+  if (!nwdogs || !g_maxdelay)
+    {
+      show_usage(argv[0]);
+    }
+
+  g_wdogs    = calloc(nwdogs, sizeof(*g_wdogs));
+  g_deadline = calloc(nwdogs, sizeof(*g_deadline));
+  if (!g_wdogs || !g_deadline)
+    {
+      fprintf(stderr, "out of memory\n");
+      return EXIT_FAILURE;
+    }
+
+  srand(seed);
+  wd_initialize();
+
+  /* Arm all the watchdogs */
+
+  start = bench_now();
+  for (i = 0; i < nwdogs; i++)
+    {
+      bench_start(i);
+    }
+
+  bench_report("start", bench_now() - start, nwdogs);
+
+  /* Cancel and restart random watchdogs, as timeouts that are re-armed
+   * on every transfer do.
+   */
+
+  start = bench_now();
+  for (i = 0; i < nchurn; i++)
+    {
+      index = rand() % nwdogs;
+      wd_cancel(&g_wdogs[index]);
+      bench_start(index);
+    }
+
+  bench_report("churn", bench_now() - start, nchurn);
+
+  bench_check_remaining(nwdogs);
+
+  /* Let all of them expire */
+
+  nticks = 0;
+  start = bench_now();
+#ifdef CONFIG_SCHED_TICKLESS
+  next = wd_timer(0);
+  while (g_nfired < nwdogs && next > 0)
+    {
+      g_tick += next;
+      nticks++;
+      next = wd_timer(next);
+    }
+#else
+  while (g_nfired < nwdogs && nticks <= g_maxdelay + 1)
+    {
+      g_tick++;
+      nticks++;
+      wd_timer();
+    }
+#endif
+
+  bench_report("expire", bench_now() - start, g_nfired);
+  printf("%-6s %-8s %10u timer interrupts\n", QUEUE_NAME, "", nticks);
+
+  if (g_nfired != nwdogs)
+    {
+      fprintf(stderr, "%u of %u watchdogs expired\n", g_nfired, nwdogs);
+      g_nerrors++;
+    }
+
+  free(g_deadline);
+  free(g_wdogs);
+  return g_nerrors ? EXIT_FAILURE : EXIT_SUCCESS;
+}